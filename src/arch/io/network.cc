@@ -6,11 +6,13 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netdb.h>
+#include <linux/errqueue.h>
 #include <netinet/tcp.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "utils.hpp"
 #include <boost/bind.hpp>
@@ -102,6 +104,8 @@ linux_tcp_conn_t::linux_tcp_conn_t(const ip_address_t &peer,
         write_queue_limiter(WRITE_QUEUE_MAX_SIZE),
         write_coro_pool(1, &write_queue, &write_handler),
         current_write_buffer(get_write_buffer()),
+        zerocopy_enabled(false),
+        zerocopy_sends(0),
         drainer(new auto_drainer_t) {
     guarantee_err(fcntl(sock.get(), F_SETFL, O_NONBLOCK) == 0, "Could not make socket non-blocking");
 
@@ -155,6 +159,8 @@ linux_tcp_conn_t::linux_tcp_conn_t(fd_t s) :
         write_queue_limiter(WRITE_QUEUE_MAX_SIZE),
         write_coro_pool(1, &write_queue, &write_handler),
         current_write_buffer(get_write_buffer()),
+        zerocopy_enabled(false),
+        zerocopy_sends(0),
         drainer(new auto_drainer_t) {
     rassert(sock.get() != INVALID_FD);
 
@@ -168,6 +174,15 @@ void linux_tcp_conn_t::enable_keepalive() {
     guarantee(res != -1, "Could not set SO_KEEPALIVE option.");
 }
 
+bool linux_tcp_conn_t::enable_zerocopy() {
+#ifdef SO_ZEROCOPY
+    int optval = 1;
+    int res = setsockopt(sock.get(), SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval));
+    zerocopy_enabled = (res == 0);
+#endif
+    return zerocopy_enabled;
+}
+
 linux_tcp_conn_t::write_buffer_t * linux_tcp_conn_t::get_write_buffer() {
     write_buffer_t *buffer;
 
@@ -199,6 +214,7 @@ void linux_tcp_conn_t::release_write_buffer(write_buffer_t *buffer) {
 
 void linux_tcp_conn_t::release_write_queue_op(write_queue_op_t *op) {
     op->keepalive = auto_drainer_t::lock_t();
+    op->shared.reset();
     unused_write_queue_ops.push_front(op);
 }
 
@@ -339,11 +355,36 @@ linux_tcp_conn_t::write_handler_t::write_handler_t(linux_tcp_conn_t *_parent) :
 { }
 
 void linux_tcp_conn_t::write_handler_t::coro_pool_callback(write_queue_op_t *operation, UNUSED signal_t *interruptor) {
-    if (operation->buffer != NULL) {
+    if (operation->shared.has()) {
+        const bool zerocopy = parent->zerocopy_enabled
+            && operation->shared_size >= ZEROCOPY_WRITE_MIN_SIZE;
+        struct iovec iov[2];
+        int count = 0;
+        if (operation->size > 0) {
+            iov[count].iov_base = const_cast<void *>(operation->buffer);
+            iov[count].iov_len = operation->size;
+            ++count;
+        }
+        if (zerocopy && count > 0) {
+            /* The kernel may read from every buffer of a `MSG_ZEROCOPY` send until
+            it tells us it's done, but we release the write buffer as soon as we
+            return. So it goes out in a normal send of its own first. */
+            parent->perform_writev(iov, count, counted_t<const shared_buf_t>());
+            count = 0;
+        }
+        iov[count].iov_base = const_cast<char *>(operation->shared_data);
+        iov[count].iov_len = operation->shared_size;
+        ++count;
+        parent->perform_writev(iov, count,
+            zerocopy ? operation->shared : counted_t<const shared_buf_t>());
+        guarantee(operation->dealloc != NULL);
+        parent->release_write_buffer(operation->dealloc);
+        parent->write_queue_limiter.unlock(operation->limiter_count);
+    } else if (operation->buffer != NULL) {
         parent->perform_write(operation->buffer, operation->size);
         if (operation->dealloc != NULL) {
             parent->release_write_buffer(operation->dealloc);
-            parent->write_queue_limiter.unlock(operation->size);
+            parent->write_queue_limiter.unlock(operation->limiter_count);
         }
     }
 
@@ -365,6 +406,8 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     op->buffer = current_write_buffer->buffer;
     op->size = current_write_buffer->size;
     op->dealloc = current_write_buffer.release();
+    op->shared.reset();
+    op->limiter_count = op->size;
     op->cond = NULL;
     op->keepalive = auto_drainer_t::lock_t(drainer.get());
     current_write_buffer.init(get_write_buffer());
@@ -373,12 +416,49 @@ void linux_tcp_conn_t::internal_flush_write_buffer() {
     to be released once the write is completed by the coroutine pool */
     rassert(op->size <= WRITE_CHUNK_SIZE);
     rassert(WRITE_CHUNK_SIZE < WRITE_QUEUE_MAX_SIZE);
-    write_queue_limiter.co_lock(op->size);
+    write_queue_limiter.co_lock(op->limiter_count);
+
+    write_queue.push(op);
+}
+
+void linux_tcp_conn_t::internal_flush_write_buffer_with_shared(
+        const counted_t<const shared_buf_t> &shared, const char *data, size_t size) {
+    write_queue_op_t *op = get_write_queue_op();
+    assert_thread();
+    rassert(write_in_progress);
+
+    /* This is the same as `internal_flush_write_buffer()`, except that the op also
+    holds a reference to `shared`. We always pass on the write buffer, even if it's
+    empty, because the write handler recycles ops that have one. */
+    op->buffer = current_write_buffer->buffer;
+    op->size = current_write_buffer->size;
+    op->dealloc = current_write_buffer.release();
+    op->shared = shared;
+    op->shared_data = data;
+    op->shared_size = size;
+    /* The semaphore can't be locked for more than its capacity, so a big buffer
+    takes all of it. It's still held only until the write is done. */
+    op->limiter_count = op->size + size < WRITE_QUEUE_MAX_SIZE
+        ? op->size + size
+        : WRITE_QUEUE_MAX_SIZE;
+    op->cond = NULL;
+    op->keepalive = auto_drainer_t::lock_t(drainer.get());
+    current_write_buffer.init(get_write_buffer());
+
+    write_queue_limiter.co_lock(op->limiter_count);
 
     write_queue.push(op);
 }
 
 void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
+    struct iovec iov;
+    iov.iov_base = const_cast<void *>(buf);
+    iov.iov_len = size;
+    perform_writev(&iov, 1, counted_t<const shared_buf_t>());
+}
+
+void linux_tcp_conn_t::perform_writev(struct iovec *iov, int count,
+                                      const counted_t<const shared_buf_t> &zerocopy_buf) {
     assert_thread();
 
     if (write_closed.is_pulsed()) {
@@ -388,8 +468,26 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
         return;
     }
 
-    while (size > 0) {
-        ssize_t res = ::write(sock.get(), buf, size);
+    int flags = 0;
+#ifdef MSG_ZEROCOPY
+    if (zerocopy_buf.has()) {
+        rassert(zerocopy_enabled);
+        flags |= MSG_ZEROCOPY;
+    }
+#endif
+
+    /* Skip over empty buffers, so that `count == 0` means we're done */
+    while (count > 0 && iov->iov_len == 0) {
+        ++iov;
+        --count;
+    }
+
+    while (count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t res = ::sendmsg(sock.get(), &msg, flags);
 
         if (res == -1 && (get_errno() == EAGAIN || get_errno() == EWOULDBLOCK)) {
             /* Wait for a notification from the event queue, or for an order to
@@ -412,6 +510,11 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
             on_shutdown_write();
             break;
 
+        } else if (res == -1 && get_errno() == ENOBUFS && flags != 0) {
+            /* The kernel couldn't pin the pages for a zero-copy send; it's always
+            safe to fall back to a normal send. */
+            flags = 0;
+
         } else if (res == -1) {
             /* In theory this should never happen, but it probably will. So we write a log message
                and then shut down normally. */
@@ -427,12 +530,70 @@ void linux_tcp_conn_t::perform_write(const void *buf, size_t size) {
             break;
 
         } else {
-            rassert(res <= static_cast<ssize_t>(size));
-            buf = reinterpret_cast<const void *>(reinterpret_cast<const char *>(buf) + res);
-            size -= res;
+            if (flags != 0) {
+                /* The kernel may read from `zerocopy_buf` until it sends us a
+                completion notification for this send. */
+                zerocopy_pending.push_back(std::make_pair(zerocopy_sends, zerocopy_buf));
+                ++zerocopy_sends;
+            }
             if (write_perfmon) write_perfmon->record(res);
+            size_t written = res;
+            while (count > 0 && written >= iov->iov_len) {
+                written -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = reinterpret_cast<char *>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            } else {
+                rassert(written == 0);
+            }
+        }
+    }
+
+    if (!zerocopy_pending.empty()) {
+        reap_zerocopy_completions();
+    }
+}
+
+void linux_tcp_conn_t::reap_zerocopy_completions() {
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+    while (!zerocopy_pending.empty()) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t res = ::recvmsg(sock.get(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (res == -1) {
+            // Usually `EAGAIN`, meaning that there are no more notifications.
+            break;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            const struct sock_extended_err *err =
+                reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cm));
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            /* The sends numbered `ee_info` through `ee_data` are done. The counter
+            wraps around, hence the unsigned arithmetic. */
+            const uint32_t first = err->ee_info, last = err->ee_data;
+            for (auto it = zerocopy_pending.begin(); it != zerocopy_pending.end();) {
+                if (it->first - first <= last - first) {
+                    it = zerocopy_pending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
         }
     }
+#endif
 }
 
 void linux_tcp_conn_t::write(const void *buf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
@@ -485,6 +646,23 @@ void linux_tcp_conn_t::write_buffered(const void *vbuf, size_t size, signal_t *c
     if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
 }
 
+void linux_tcp_conn_t::write_shared_buffered(const counted_t<const shared_buf_t> &buf,
+                                             size_t offset,
+                                             size_t size,
+                                             signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
+    guarantee(offset + size <= buf->size());
+    if (size < SHARED_WRITE_MIN_SIZE) {
+        write_buffered(buf->data(offset), size, closer);
+        return;
+    }
+
+    write_op_wrapper_t sentry(this, closer);
+
+    internal_flush_write_buffer_with_shared(buf, buf->data(offset), size);
+
+    if (write_closed.is_pulsed()) throw tcp_conn_write_closed_exc_t();
+}
+
 void linux_tcp_conn_t::writef(signal_t *closer, const char *format, ...) THROWS_ONLY(tcp_conn_write_closed_exc_t) {
     va_list ap;
     va_start(ap, format);
@@ -604,12 +782,26 @@ bool linux_tcp_conn_t::getpeername(ip_and_port_t *ip_and_port) {
     return false;
 }
 
-void linux_tcp_conn_t::on_event(int /* events */) {
+void linux_tcp_conn_t::on_event(int events) {
     assert_thread();
 
     /* This is called by linux_event_watcher_t when error events occur. Ordinary
     poll_event_in/poll_event_out events are not sent through this function. */
 
+    /* Zero-copy completion notifications arrive on the socket's error queue, so they
+    look like errors. `perform_writev()` may already have reaped the ones that woke
+    us up, so we don't go by whether there are any left; if the socket has no real
+    error, the connection is fine. */
+    if (zerocopy_enabled && !(events & (poll_event_hup | poll_event_rdhup))) {
+        reap_zerocopy_completions();
+        int error = 0;
+        socklen_t error_size = sizeof(error);
+        int res = getsockopt(sock.get(), SOL_SOCKET, SO_ERROR, &error, &error_size);
+        if (res == 0 && error == 0) {
+            return;
+        }
+    }
+
     if (is_write_open()) {
         shutdown_write();
     }
@@ -8,7 +8,9 @@
 #include <ifaddrs.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
 
+#include <deque>
 #include <functional>
 #include <set>
 #include <stdexcept>
@@ -19,6 +21,7 @@
 #include "concurrency/interruptor.hpp"
 #include "containers/lazy_erase_vector.hpp"
 #include "containers/scoped.hpp"
+#include "containers/shared_buffer.hpp"
 #include "arch/address.hpp"
 #include "arch/io/event_watcher.hpp"
 #include "arch/io/io_utils.hpp"
@@ -41,6 +44,10 @@ public:
 
     void enable_keepalive();
 
+    /* Lets `write_shared_buffered()` send large buffers with `MSG_ZEROCOPY`, if the
+    kernel supports it. Returns false if it doesn't. */
+    bool enable_zerocopy();
+
     class connect_failed_exc_t : public std::exception {
     public:
         explicit connect_failed_exc_t(int en) :
@@ -111,6 +118,15 @@ public:
     buffered writes; this may improve performance. */
     void write_buffered(const void *buf, size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
 
+    /* write_shared_buffered() is like write_buffered(), but instead of copying
+    `size` bytes at `offset` in `buf` into the write buffer, it keeps a reference to
+    `buf` until they have been sent, and sends them in the same `writev()` as the
+    buffered data before them. If `enable_zerocopy()` was called, big buffers are
+    instead sent on their own without the kernel copying them. Small buffers are
+    simply copied, because that's cheaper. */
+    void write_shared_buffered(const counted_t<const shared_buf_t> &buf, size_t offset,
+                               size_t size, signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);
+
     void writef(signal_t *closer, const char *format, ...) THROWS_ONLY(tcp_conn_write_closed_exc_t) __attribute__ ((format (printf, 3, 4)));
 
     void flush_buffer(signal_t *closer) THROWS_ONLY(tcp_conn_write_closed_exc_t);   // Blocks until flush is done
@@ -233,6 +249,11 @@ private:
 
     static const size_t WRITE_QUEUE_MAX_SIZE = 128 * KILOBYTE;
     static const size_t WRITE_CHUNK_SIZE = 8 * KILOBYTE;
+    /* `write_shared_buffered()` copies buffers smaller than this into the write buffer */
+    static const size_t SHARED_WRITE_MIN_SIZE = 2 * KILOBYTE;
+    /* ...and sends buffers at least this big with `MSG_ZEROCOPY`, if it's enabled.
+    Below this, setting up the zero-copy send costs more than the copy. */
+    static const size_t ZEROCOPY_WRITE_MIN_SIZE = 32 * KILOBYTE;
 
     /* Structs to avoid over-using dynamic allocation */
     struct write_buffer_t : public intrusive_list_node_t<write_buffer_t> {
@@ -244,6 +265,12 @@ private:
         write_buffer_t *dealloc;
         const void *buffer;
         size_t size;
+        /* Written after `buffer`, straight from the `shared_buf_t`. */
+        counted_t<const shared_buf_t> shared;
+        const char *shared_data;
+        size_t shared_size;
+        /* How much of `write_queue_limiter` to release when the write is done */
+        size_t limiter_count;
         cond_t *cond;
         auto_drainer_t::lock_t keepalive;
     };
@@ -283,6 +310,11 @@ private:
     data to be completely written. */
     void internal_flush_write_buffer();
 
+    /* Like `internal_flush_write_buffer()`, but the old write buffer's contents are
+    followed by `size` bytes at `data` in `shared`. */
+    void internal_flush_write_buffer_with_shared(const counted_t<const shared_buf_t> &shared,
+                                                 const char *data, size_t size);
+
     /* Used to queue up buffers to write. The functions in `write_queue` will all be
     `std::bind()`s of the `perform_write()` function below. */
     unlimited_fifo_queue_t<write_queue_op_t*, intrusive_list_t<write_queue_op_t> > write_queue;
@@ -302,6 +334,28 @@ private:
     `size` bytes from `buffer` to the socket. */
     void perform_write(const void *buffer, size_t size);
 
+    /* Like `perform_write()`, but writes the `count` buffers in `iov` with one
+    `writev()`. If `zerocopy_buf` is set, the data is in it and is sent with
+    `MSG_ZEROCOPY`, and we keep `zerocopy_buf` alive until the kernel tells us it's
+    done with it. `iov` is modified. */
+    void perform_writev(struct iovec *iov, int count,
+                        const counted_t<const shared_buf_t> &zerocopy_buf);
+
+    /* Whether `enable_zerocopy()` succeeded. */
+    bool zerocopy_enabled;
+
+    /* The number of `MSG_ZEROCOPY` sends we've made; the kernel identifies them by
+    this counter when it tells us that it's done with them. */
+    uint32_t zerocopy_sends;
+
+    /* Buffers of `MSG_ZEROCOPY` sends that the kernel may still read from, with the
+    number of the send. */
+    std::deque<std::pair<uint32_t, counted_t<const shared_buf_t> > > zerocopy_pending;
+
+    /* Reads the kernel's zero-copy completion notifications off the socket's error
+    queue and releases the buffers of the completed sends. */
+    void reap_zerocopy_completions();
+
     scoped_ptr_t<auto_drainer_t> drainer;
 };
 
@@ -14,9 +14,63 @@ values from the leaf nodes. */
 static const int MAX_CONCURRENT_VALUE_LOADS = 16;
 
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(backfill_pre_item_t, range);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(backfill_digest_t, num_pairs, sum1, sum2);
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(backfill_item_t::pair_t, key, recency, value);
-RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(backfill_item_t,
-    range, pairs, min_deletion_timestamp);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(backfill_item_t,
+    range, pairs, min_deletion_timestamp, values_omitted);
+
+/* `hash_backfill_pair()` is FNV-1a over the key's length, the key, and the value,
+followed by the MurmurHash3 finalizer so that the bits of the result are well mixed
+before `backfill_digest_t` adds it up. The key's length comes first so that the boundary
+between the key and the value is unambiguous. `basis` and `prime` pick one of the two
+hashes in the digest. */
+static uint64_t hash_backfill_pair(
+        uint64_t basis,
+        uint64_t prime,
+        const store_key_t &key,
+        const std::vector<char> &value) {
+    uint64_t h = basis;
+    h = (h ^ static_cast<uint8_t>(key.size())) * prime;
+    for (int i = 0; i < key.size(); ++i) {
+        h = (h ^ key.contents()[i]) * prime;
+    }
+    for (char c : value) {
+        h = (h ^ static_cast<uint8_t>(c)) * prime;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void backfill_digest_t::add_pair(
+        const store_key_t &key, const std::vector<char> &value) {
+    ++num_pairs;
+    sum1 += hash_backfill_pair(0xcbf29ce484222325ULL, 0x100000001b3ULL, key, value);
+    sum2 += hash_backfill_pair(0x84222325cbf29ce4ULL, 0x9e3779b97f4a7c15ULL, key, value);
+}
+
+backfill_digest_t backfill_item_t::get_digest() const {
+    guarantee(!values_omitted);
+    backfill_digest_t digest;
+    for (const auto &pair : pairs) {
+        if (static_cast<bool>(pair.value)) {
+            digest.add_pair(pair.key, *pair.value);
+        }
+    }
+    return digest;
+}
+
+void backfill_item_t::omit_values() {
+    for (auto &&pair : pairs) {
+        if (static_cast<bool>(pair.value)) {
+            *pair.value = std::vector<char>();
+        }
+    }
+    values_omitted = true;
+}
 
 void backfill_item_t::mask_in_place(const key_range_t &m) {
     range = range.intersection(m);
@@ -647,3 +701,89 @@ void btree_receive_backfill_item_update_deletion_timestamps(
     guarantee(res == continue_bool_t::CONTINUE);
 }
 
+
+class backfill_digest_computer_t : public depth_first_traversal_callback_t {
+public:
+    backfill_digest_computer_t(
+            const backfill_value_copier_t *_copy_value, backfill_digest_t *_digest) :
+        copy_value(_copy_value), digest(_digest) { }
+    continue_bool_t handle_pair(scoped_key_value_t &&keyvalue, signal_t *interruptor) {
+        std::vector<char> value;
+        (*copy_value)(keyvalue.expose_buf(), keyvalue.value(), interruptor, &value);
+        digest->add_pair(store_key_t(keyvalue.key()), value);
+        return continue_bool_t::CONTINUE;
+    }
+private:
+    const backfill_value_copier_t *copy_value;
+    backfill_digest_t *digest;
+};
+
+void btree_compute_backfill_digests(
+        superblock_t *superblock,
+        release_superblock_t release_superblock,
+        const std::vector<key_range_t> &ranges,
+        const backfill_value_copier_t &copy_value,
+        std::vector<backfill_digest_t> *digests_out,
+        signal_t *interruptor) {
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        rassert(i == 0
+            || key_range_t::right_bound_t(ranges[i].left) >= ranges[i - 1].right);
+        backfill_digest_t digest;
+        backfill_digest_computer_t computer(&copy_value, &digest);
+        continue_bool_t res = btree_depth_first_traversal(
+            superblock, ranges[i], &computer, access_t::read, FORWARD,
+            i + 1 == ranges.size() ? release_superblock : release_superblock_t::KEEP,
+            interruptor);
+        guarantee(res == continue_bool_t::CONTINUE);
+        digests_out->push_back(digest);
+    }
+}
+
+class backfill_omitted_value_loader_t : public depth_first_traversal_callback_t {
+public:
+    backfill_omitted_value_loader_t(
+            const backfill_value_copier_t *_copy_value, backfill_item_t *_item) :
+        copy_value(_copy_value), item(_item), next_pair(0) { }
+    continue_bool_t handle_pair(scoped_key_value_t &&keyvalue, signal_t *interruptor) {
+        store_key_t key(keyvalue.key());
+        skip_deletions();
+        guarantee(next_pair < item->pairs.size() && item->pairs[next_pair].key == key,
+            "The B-tree has different keys than the backfill item whose values were "
+            "omitted");
+        (*copy_value)(keyvalue.expose_buf(), keyvalue.value(), interruptor,
+            &*item->pairs[next_pair].value);
+        ++next_pair;
+        return continue_bool_t::CONTINUE;
+    }
+    void skip_deletions() {
+        while (next_pair < item->pairs.size()
+                && !static_cast<bool>(item->pairs[next_pair].value)) {
+            ++next_pair;
+        }
+    }
+    bool loaded_all() {
+        skip_deletions();
+        return next_pair == item->pairs.size();
+    }
+private:
+    const backfill_value_copier_t *copy_value;
+    backfill_item_t *item;
+    size_t next_pair;
+};
+
+void btree_load_omitted_backfill_values(
+        superblock_t *superblock,
+        release_superblock_t release_superblock,
+        const backfill_value_copier_t &copy_value,
+        backfill_item_t *item,
+        signal_t *interruptor) {
+    guarantee(item->values_omitted);
+    backfill_omitted_value_loader_t loader(&copy_value, item);
+    continue_bool_t res = btree_depth_first_traversal(
+        superblock, item->range, &loader, access_t::read, FORWARD, release_superblock,
+        interruptor);
+    guarantee(res == continue_bool_t::CONTINUE);
+    guarantee(loader.loaded_all(),
+        "The B-tree is missing keys of the backfill item whose values were omitted");
+    item->values_omitted = false;
+}
@@ -2,6 +2,7 @@
 #ifndef BTREE_BACKFILL_HPP_
 #define BTREE_BACKFILL_HPP_
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -39,6 +40,29 @@ public:
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(backfill_pre_item_t);
 
+/* A `backfill_digest_t` summarizes the key-value pairs in some range of keys, so that
+the backfill source can tell whether the destination already has the same pairs in that
+range without sending the values over. It's the sum of a hash of every pair, so it
+doesn't depend on the order in which the pairs are added. Timestamps and deletion entries
+aren't part of the digest, because the backfill items carry them either way. */
+class backfill_digest_t {
+public:
+    backfill_digest_t() : num_pairs(0), sum1(0), sum2(0) { }
+
+    void add_pair(const store_key_t &key, const std::vector<char> &value);
+
+    bool operator==(const backfill_digest_t &other) const {
+        return num_pairs == other.num_pairs && sum1 == other.sum1 && sum2 == other.sum2;
+    }
+
+    uint64_t num_pairs;
+
+    /* `sum1` and `sum2` add up two unrelated 64-bit hashes of each pair, which makes it
+    very unlikely that two different ranges end up with the same digest. */
+    uint64_t sum1, sum2;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(backfill_digest_t);
+
 /* A `backfill_item_t` is a complete description of some sub-range of the B-tree,
 containing all the information necessary to bring the corresponding sub-range of any
 other B-tree into a state equivalent to that of the B-tree that the `backfill_item_t`
@@ -52,6 +76,8 @@ public:
         boost::optional<std::vector<char> > value;   /* empty indicates deletion */
     };
 
+    backfill_item_t() : values_omitted(false) { }
+
     key_range_t get_range() const {
         return range;
     }
@@ -81,6 +107,13 @@ public:
         return pairs.size() == 1 && x == range.right;
     }
 
+    /* `get_digest()` returns the `backfill_digest_t` of the pairs that have values. */
+    backfill_digest_t get_digest() const;
+
+    /* The backfill source calls `omit_values()` if the destination's digest for `range`
+    matches the item's own. It empties the values and sets `values_omitted`. */
+    void omit_values();
+
     /* The `range` member describes what range of keys this item applies to. `pairs`
     contains an entry for every key present in the range on the backfill source. In
     addition, for every key that has been deleted from the range with timestamp greater
@@ -91,6 +124,13 @@ public:
     std::vector<pair_t> pairs;
     repli_timestamp_t min_deletion_timestamp;
 
+    /* If `values_omitted` is `true`, then the pairs that aren't deletions carry empty
+    values, and the backfill destination must fill them in from its own B-tree with
+    `btree_load_omitted_backfill_values()` before it applies the item. Everything
+    else about the item, including the timestamps and deletion entries, is applied as
+    usual. */
+    bool values_omitted;
+
     /* TODO: For single-key items, this is not very memory-efficient, because we store
     the key in three places: in `pairs[0].key`, in `range.left`, and in `range.right.key`
     minus one. Consider wrapping `range` in a `scoped_ptr_t`, which is left empty for a
@@ -234,5 +274,39 @@ void btree_receive_backfill_item_update_deletion_timestamps(
     const backfill_item_t &item,
     signal_t *interruptor);
 
+/* `backfill_value_copier_t` reads a value out of the leaf node into a vector, in the
+same format as `btree_backfill_item_consumer_t::copy_value()`. */
+typedef std::function<void(
+    buf_parent_t buf_parent,
+    const void *value_in_leaf_node,
+    signal_t *interruptor,
+    std::vector<char> *value_out)> backfill_value_copier_t;
+
+/* `btree_compute_backfill_digests()` appends the `backfill_digest_t` of the key-value
+pairs in each of `ranges` to `*digests_out`. The ranges must be in lexicographical order
+and must not overlap. The B-tree doesn't store digests in its internal nodes, because
+keeping them up to date would change the disk format and would make every write lock the
+whole path from the root to the leaf; so this reads every value in the ranges. The
+backfill only asks for the digests of the ranges that the timestamps say have changed. */
+void btree_compute_backfill_digests(
+    superblock_t *superblock,
+    release_superblock_t release_superblock,
+    const std::vector<key_range_t> &ranges,
+    const backfill_value_copier_t &copy_value,
+    std::vector<backfill_digest_t> *digests_out,
+    signal_t *interruptor);
+
+/* `btree_load_omitted_backfill_values()` fills in the values of an item whose
+`values_omitted` is `true` from the B-tree, and then sets `values_omitted` to `false`.
+The keys in `item->range` in the B-tree must be exactly the keys of the pairs in the item
+that aren't deletions. This is the case when the digests matched and nothing has written
+to the range since. */
+void btree_load_omitted_backfill_values(
+    superblock_t *superblock,
+    release_superblock_t release_superblock,
+    const backfill_value_copier_t &copy_value,
+    backfill_item_t *item,
+    signal_t *interruptor);
+
 #endif  // BTREE_BACKFILL_HPP_
 
@@ -0,0 +1,493 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "btree/bulk_load.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "btree/internal_node.hpp"
+#include "btree/leaf_node.hpp"
+#include "btree/node.hpp"
+#include "btree/operations.hpp"
+#include "buffer_cache/alt.hpp"
+#include "containers/scoped.hpp"
+
+/* `acquire_path()` acquires every node on the path from `root` down to the leaf node
+whose key range contains `key`, and puts them into `path_out`, starting with `root`. If
+that leaf node isn't the rightmost one in the tree, it sets `*bound_out` to the greatest
+key in its key range and returns `true`; otherwise it returns `false`. */
+static bool acquire_path(
+        const btree_key_t *key,
+        buf_lock_t &&root,
+        access_t access,
+        std::vector<buf_lock_t> *path_out,
+        store_key_t *bound_out) {
+    rassert(path_out->empty());
+    path_out->push_back(std::move(root));
+    bool has_bound = false;
+    for (;;) {
+        block_id_t child_id;
+        {
+            buf_read_t read(&path_out->back());
+            const node_t *node = static_cast<const node_t *>(read.get_data_read());
+            if (node::is_leaf(node)) {
+                return has_bound;
+            }
+            const internal_node_t *inode =
+                reinterpret_cast<const internal_node_t *>(node);
+            int index = internal_node::get_offset_index(inode, key);
+            /* The key ranges get narrower as we go down, so the last bound we see is
+            the tightest one. */
+            if (index != inode->npairs - 1) {
+                bound_out->assign(&internal_node::get_pair_by_index(inode, index)->key);
+                has_bound = true;
+            }
+            child_id = internal_node::get_pair_by_index(inode, index)->lnode;
+        }
+        buf_lock_t child(&path_out->back(), child_id, access);
+        path_out->push_back(std::move(child));
+    }
+}
+
+bool btree_range_is_empty(
+        superblock_t *superblock,
+        value_sizer_t *sizer,
+        const key_range_t &range) {
+    if (range.is_empty() || superblock->get_root_block_id() == NULL_BLOCK_ID) {
+        return true;
+    }
+    /* Check one leaf node at a time, from left to right, until we've covered all of
+    `range`. */
+    store_key_t key = range.left;
+    for (;;) {
+        std::vector<buf_lock_t> path;
+        store_key_t bound;
+        bool has_bound = acquire_path(key.btree_key(),
+            buf_lock_t(superblock->expose_buf(), superblock->get_root_block_id(),
+                access_t::read),
+            access_t::read, &path, &bound);
+        bool found = false;
+        {
+            buf_read_t read(&path.back());
+            leaf::visit_entries(sizer,
+                static_cast<const leaf_node_t *>(read.get_data_read()),
+                path.back().get_recency(),
+                [&](const btree_key_t *k, repli_timestamp_t, const void *)
+                        -> continue_bool_t {
+                    if (range.contains_key(k)) {
+                        found = true;
+                        return continue_bool_t::ABORT;
+                    }
+                    return continue_bool_t::CONTINUE;
+                });
+        }
+        if (found) {
+            return false;
+        }
+        if (!has_bound) {
+            return true;
+        }
+        key = bound;
+        if (!key.increment() || !range.contains_key(key)) {
+            return true;
+        }
+    }
+}
+
+/* `replace_root()` creates an empty internal node and makes it the root of the tree in
+place of `old_root`. The caller must then insert `old_root` into the new root. */
+static buf_lock_t replace_root(
+        value_sizer_t *sizer,
+        superblock_t *superblock,
+        buf_lock_t *old_root) {
+    superblock->expose_buf().detach_child(old_root->block_id());
+    buf_lock_t new_root(superblock->expose_buf(), alt_create_t::create);
+    {
+        buf_write_t write(&new_root);
+        internal_node::init(sizer->block_size(),
+            static_cast<internal_node_t *>(write.get_data_write()));
+    }
+    new_root.set_recency(old_root->get_recency());
+    insert_root(new_root.block_id(), superblock);
+    return new_root;
+}
+
+/* `split_internal_node()` moves the children of the internal node `*node` from
+`median_index` onwards into a new sibling immediately to its right, and links the sibling
+into `*parent`, which must have room for it. If `follow_sibling` is true, it then replaces
+`*node` with the sibling. */
+static void split_internal_node(
+        value_sizer_t *sizer,
+        buf_lock_t *parent,
+        buf_lock_t *node,
+        int median_index,
+        bool follow_sibling) {
+    buf_lock_t sibling(parent, alt_create_t::create);
+    store_key_t median_buffer;
+    btree_key_t *median = median_buffer.btree_key();
+    {
+        buf_write_t node_write(node);
+        buf_write_t sibling_write(&sibling);
+        internal_node_t *snode =
+            static_cast<internal_node_t *>(sibling_write.get_data_write());
+        internal_node::split_at(sizer->block_size(),
+            static_cast<internal_node_t *>(node_write.get_data_write()),
+            snode, median_index, median);
+        /* The children that moved used to be children of `*node`. */
+        for (int i = 0; i < snode->npairs; ++i) {
+            node->detach_child(internal_node::get_pair_by_index(snode, i)->lnode);
+        }
+    }
+    /* `*node`'s recency is greater than or equal to that of the sub-trees we moved, so
+    it's a valid recency for `sibling`. */
+    sibling.set_recency(node->get_recency());
+
+    {
+        buf_write_t write(parent);
+        bool success = internal_node::insert(
+            static_cast<internal_node_t *>(write.get_data_write()),
+            median, node->block_id(), sibling.block_id());
+        guarantee(success, "could not insert internal btree node");
+    }
+
+    if (follow_sibling) {
+        *node = std::move(sibling);
+    }
+}
+
+/* `bulk_loader_t` does the work for `btree_bulk_load()`. It holds the path from the root
+to the leaf node that it's currently filling. A new leaf node always goes immediately to
+the right of the current one and takes over the right-hand part of its key range, so the
+path stays valid until a key comes along that's outside the current leaf node's key
+range. Then the loader finishes with that key range and descends again from the root. */
+class bulk_loader_t {
+public:
+    bulk_loader_t(
+            superblock_t *_superblock,
+            value_sizer_t *_sizer,
+            const value_deleter_t *_detacher,
+            double _fill_factor,
+            repli_timestamp_t _min_deletion_timestamp) :
+        superblock(_superblock), sizer(_sizer), detacher(_detacher),
+        fill_factor(_fill_factor), min_deletion_timestamp(_min_deletion_timestamp),
+        value(sizer->max_possible_size()), has_bound(false), has_last_key(false),
+        current_min_deletion_timestamp(repli_timestamp_t::distant_past),
+        tail_min_deletion_timestamp(repli_timestamp_t::distant_past),
+        flushing_tail(false) { }
+
+    /* Inserts the pair that `source->next_pair()` just returned. */
+    void append(
+            const store_key_t &key,
+            repli_timestamp_t recency,
+            btree_bulk_load_source_t *source) {
+        if (path.empty() || (has_bound && key > bound)) {
+            if (!path.empty()) {
+                close_leaf_range();
+            }
+            open_leaf_range(key);
+        }
+        guarantee(tail.empty() || key < tail.front().key,
+            "the B-tree has entries between the bulk-loaded keys");
+
+        source->write_value(buf_parent_t(&path.back()), value.get());
+        if (current_leaf_is_full(key.btree_key(), value.get())) {
+            /* The value's blocks were created as children of the leaf that turned out
+            to be full. Detach them from it, the same way `check_and_handle_split()`
+            does for values that move to a new leaf. */
+            detacher->delete_value(buf_parent_t(&path.back()), value.get());
+            start_new_leaf();
+        }
+        insert_into_leaf(key.btree_key(), recency, value.get());
+    }
+
+    void finish() {
+        if (!path.empty()) {
+            close_leaf_range();
+        }
+    }
+
+private:
+    /* An entry that we took out of a leaf node to make room for the new pairs in front
+    of it. It goes back in after them. */
+    struct tail_entry_t {
+        store_key_t key;
+        repli_timestamp_t recency;
+        bool is_deletion;
+        std::vector<char> value;
+    };
+
+    /* Acquires the path to the leaf node whose key range contains `key`, and takes the
+    entries at or after `key` out of that leaf node. */
+    void open_leaf_range(const store_key_t &key) {
+        has_bound = acquire_path(key.btree_key(), get_root(sizer, superblock),
+            access_t::write, &path, &bound);
+        buf_lock_t *leaf = &path.back();
+        {
+            buf_write_t write(leaf);
+            leaf_node_t *node = static_cast<leaf_node_t *>(write.get_data_write());
+            /* Entries that were already in the leaf node may end up in a new leaf node,
+            which must not claim to remember deletions that this one has forgotten. */
+            tail_min_deletion_timestamp =
+                leaf::min_deletion_timestamp(sizer, node, leaf->get_recency());
+            current_min_deletion_timestamp = superceding_recency(
+                min_deletion_timestamp, tail_min_deletion_timestamp);
+
+            has_last_key = false;
+            leaf::visit_entries(sizer, node, leaf->get_recency(),
+                [&](const btree_key_t *k, repli_timestamp_t tstamp, const void *v)
+                        -> continue_bool_t {
+                    if (btree_key_cmp(k, key.btree_key()) >= 0) {
+                        tail_entry_t entry;
+                        entry.key.assign(k);
+                        entry.recency = tstamp;
+                        entry.is_deletion = (v == nullptr);
+                        if (v != nullptr) {
+                            const char *data = static_cast<const char *>(v);
+                            entry.value.assign(data, data + sizer->size(v));
+                        }
+                        tail.push_back(std::move(entry));
+                    } else if (!has_last_key
+                            || btree_key_cmp(k, last_key.btree_key()) > 0) {
+                        last_key.assign(k);
+                        has_last_key = true;
+                    }
+                    return continue_bool_t::CONTINUE;
+                });
+            for (const tail_entry_t &entry : tail) {
+                if (!entry.is_deletion) {
+                    detacher->delete_value(buf_parent_t(leaf), entry.value.data());
+                }
+                leaf::erase_presence(sizer, node, entry.key.btree_key(),
+                    key_modification_proof_t::real_proof());
+            }
+        }
+        std::sort(tail.begin(), tail.end(),
+            [](const tail_entry_t &a, const tail_entry_t &b) {
+                return a.key < b.key;
+            });
+    }
+
+    /* Puts the entries that `open_leaf_range()` took out back in after the new pairs,
+    and releases the path. */
+    void close_leaf_range() {
+        if (!tail.empty()) {
+            flushing_tail = true;
+            current_min_deletion_timestamp = superceding_recency(
+                current_min_deletion_timestamp, tail_min_deletion_timestamp);
+            for (const tail_entry_t &entry : tail) {
+                if (entry.is_deletion) {
+                    /* Deletion entries never need a new leaf node; `leaf::remove()`
+                    drops the oldest ones if there's no room. */
+                    insert_deletion_into_leaf(entry.key.btree_key(), entry.recency);
+                } else {
+                    if (current_leaf_is_full(entry.key.btree_key(), entry.value.data())) {
+                        start_new_leaf();
+                    }
+                    insert_into_leaf(
+                        entry.key.btree_key(), entry.recency, entry.value.data());
+                }
+            }
+            tail.clear();
+            flushing_tail = false;
+        }
+        finish_leaf();
+        path.clear();
+    }
+
+    bool current_leaf_is_full(const btree_key_t *key, const void *v) {
+        if (!has_last_key) {
+            /* Any pair fits into an empty leaf node. */
+            return false;
+        }
+        buf_read_t read(&path.back());
+        return leaf::is_full(sizer,
+            static_cast<const leaf_node_t *>(read.get_data_read()), key, v,
+            fill_factor);
+    }
+
+    void insert_into_leaf(
+            const btree_key_t *key, repli_timestamp_t recency, const void *v) {
+        buf_lock_t *leaf = &path.back();
+        leaf->set_recency(superceding_recency(recency, leaf->get_recency()));
+        {
+            buf_write_t write(leaf);
+            leaf::insert(sizer, static_cast<leaf_node_t *>(write.get_data_write()),
+                key, v, recency, leaf->get_recency(),
+                key_modification_proof_t::real_proof());
+        }
+        last_key.assign(key);
+        has_last_key = true;
+    }
+
+    void insert_deletion_into_leaf(const btree_key_t *key, repli_timestamp_t recency) {
+        buf_lock_t *leaf = &path.back();
+        leaf->set_recency(superceding_recency(recency, leaf->get_recency()));
+        {
+            buf_write_t write(leaf);
+            leaf::remove(sizer, static_cast<leaf_node_t *>(write.get_data_write()),
+                key, recency, leaf->get_recency(),
+                key_modification_proof_t::real_proof());
+        }
+        last_key.assign(key);
+        has_last_key = true;
+    }
+
+    /* Finishes the current leaf node, then creates an empty one immediately to its
+    right and makes that the current one. */
+    void start_new_leaf() {
+        rassert(has_last_key);
+        finish_leaf();
+
+        if (path.size() == 1) {
+            /* The root is a leaf, so the new leaf needs a new root to share with it. */
+            path.insert(path.begin(), replace_root(sizer, superblock, &path[0]));
+        }
+        make_room(path.size() - 2);
+
+        buf_lock_t *parent = &path[path.size() - 2];
+        buf_lock_t leaf(parent, alt_create_t::create);
+        {
+            buf_write_t write(&leaf);
+            leaf::init(sizer, static_cast<leaf_node_t *>(write.get_data_write()));
+        }
+        {
+            /* `last_key` is less than the greatest key in the current leaf node's key
+            range, so this gives the new leaf node the rest of that key range. */
+            buf_write_t write(parent);
+            bool success = internal_node::insert(
+                static_cast<internal_node_t *>(write.get_data_write()),
+                last_key.btree_key(), path.back().block_id(), leaf.block_id());
+            guarantee(success, "could not insert internal btree node");
+        }
+        path.back() = std::move(leaf);
+        has_last_key = false;
+        current_min_deletion_timestamp = flushing_tail
+            ? superceding_recency(min_deletion_timestamp, tail_min_deletion_timestamp)
+            : min_deletion_timestamp;
+    }
+
+    /* Makes sure that the internal node `path[level]` can take another child, splitting
+    it, and recursively its ancestors, if necessary. `path` keeps leading to the current
+    leaf node. Returns the new index of `path[level]`, which changes if a new root is
+    added above it. */
+    size_t make_room(size_t level) {
+        for (;;) {
+            int npairs, index;
+            {
+                buf_read_t read(&path[level]);
+                const internal_node_t *node =
+                    static_cast<const internal_node_t *>(read.get_data_read());
+                if (!internal_node::is_full(sizer->block_size(), node, fill_factor)) {
+                    return level;
+                }
+                npairs = node->npairs;
+                index = internal_node::get_offset_index(node, last_key.btree_key());
+            }
+            rassert(npairs >= 4);
+
+            if (level == 0) {
+                path.insert(path.begin(), replace_root(sizer, superblock, &path[0]));
+                level = 1;
+            } else {
+                level = make_room(level - 1) + 1;
+            }
+
+            /* When we're appending at the right-hand end of the node, we move just the
+            last two children into the new sibling and continue in the sibling, which
+            leaves the node as full as it is. Otherwise we move the children to the
+            right of the path into the sibling, so that there's room for new ones. */
+            int median_index;
+            if (index < npairs - 2) {
+                median_index = std::max(index + 1, 2);
+            } else {
+                median_index = npairs - 2;
+            }
+            split_internal_node(sizer, &path[level - 1], &path[level], median_index,
+                index >= median_index);
+        }
+    }
+
+    /* Called on every leaf node that receives new pairs, once we're done filling it. */
+    void finish_leaf() {
+        buf_lock_t *leaf = &path.back();
+        {
+            buf_write_t write(leaf);
+            leaf::erase_deletions(sizer,
+                static_cast<leaf_node_t *>(write.get_data_write()),
+                current_min_deletion_timestamp);
+        }
+        leaf->set_recency(
+            superceding_recency(current_min_deletion_timestamp, leaf->get_recency()));
+
+        /* Maintain the invariant that each node's recency is greater than or equal to
+        that of anything below it. */
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+            path[i].set_recency(
+                superceding_recency(leaf->get_recency(), path[i].get_recency()));
+        }
+    }
+
+    superblock_t *const superblock;
+    value_sizer_t *const sizer;
+    const value_deleter_t *const detacher;
+    const double fill_factor;
+    const repli_timestamp_t min_deletion_timestamp;
+
+    /* Space for the value that we're inserting */
+    scoped_malloc_t<void> value;
+
+    /* The path from the root to the current leaf node */
+    std::vector<buf_lock_t> path;
+
+    /* The greatest key in the current leaf node's key range, if it has one */
+    bool has_bound;
+    store_key_t bound;
+
+    /* The greatest key in the current leaf node, if it isn't empty */
+    bool has_last_key;
+    store_key_t last_key;
+
+    /* What `finish_leaf()` will apply to the current leaf node */
+    repli_timestamp_t current_min_deletion_timestamp;
+
+    /* The entries that `open_leaf_range()` took out, in key order, and the min deletion
+    timestamp of the leaf node that they came from */
+    std::vector<tail_entry_t> tail;
+    repli_timestamp_t tail_min_deletion_timestamp;
+    bool flushing_tail;
+
+    DISABLE_COPYING(bulk_loader_t);
+};
+
+size_t btree_bulk_load(
+        superblock_t *superblock,
+        value_sizer_t *sizer,
+        const value_deleter_t *detacher,
+        double fill_factor,
+        repli_timestamp_t min_deletion_timestamp,
+        btree_bulk_load_source_t *source) {
+    guarantee(fill_factor >= 0.5 && fill_factor <= 1.0);
+    bulk_loader_t loader(
+        superblock, sizer, detacher, fill_factor, min_deletion_timestamp);
+
+    size_t num_pairs = 0;
+    store_key_t key, last_key;
+    repli_timestamp_t recency;
+    while (source->next_pair(&key, &recency)) {
+        guarantee(num_pairs == 0 || key > last_key, "bulk-loaded keys must be increasing");
+        loader.append(key, recency, source);
+        last_key = key;
+        ++num_pairs;
+    }
+    loader.finish();
+
+    if (num_pairs != 0 && superblock->get_stat_block_id() != NULL_BLOCK_ID) {
+        buf_lock_t stat_block(buf_parent_t(superblock->expose_buf().txn()),
+            superblock->get_stat_block_id(), access_t::write);
+        buf_write_t write(&stat_block);
+        auto stat_block_buf = static_cast<btree_statblock_t *>(
+            write.get_data_write(BTREE_STATBLOCK_SIZE));
+        stat_block_buf->population += num_pairs;
+    }
+
+    return num_pairs;
+}
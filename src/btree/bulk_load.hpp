@@ -0,0 +1,66 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef BTREE_BULK_LOAD_HPP_
+#define BTREE_BULK_LOAD_HPP_
+
+#include "btree/keys.hpp"
+#include "btree/types.hpp"
+#include "repli_timestamp.hpp"
+
+class buf_parent_t;
+class superblock_t;
+class value_sizer_t;
+
+/* `btree_bulk_load_source_t` supplies key-value pairs to `btree_bulk_load()`. The pairs
+must come in strictly increasing key order. */
+class btree_bulk_load_source_t {
+public:
+    /* Returns `false` if there are no more pairs. Otherwise, sets `*key_out` and
+    `*recency_out` to describe the next pair. */
+    virtual bool next_pair(store_key_t *key_out, repli_timestamp_t *recency_out) = 0;
+
+    /* Writes the value of the pair that `next_pair()` most recently returned into
+    `value_out`, which has room for `sizer->max_possible_size()` bytes. Any blocks that
+    the value refers to must be created as children of `leaf`. */
+    virtual void write_value(buf_parent_t leaf, void *value_out) = 0;
+
+protected:
+    virtual ~btree_bulk_load_source_t() { }
+};
+
+/* Returns `true` if the B-tree has no entries, not even deletion entries, in `range`.
+The superblock must be acquired for read or write; it isn't released. */
+bool btree_range_is_empty(
+    superblock_t *superblock,
+    value_sizer_t *sizer,
+    const key_range_t &range);
+
+/* `btree_bulk_load()` inserts the pairs from `source` into the B-tree. Instead of
+walking down the tree for every key, it fills leaf nodes one after another, each up to
+`fill_factor` of its capacity, and links each new leaf into the tree next to the one
+before it, splitting the internal nodes on the path to it as they fill up. Because each
+leaf is finished before the next one is started, each block is written only once per
+flush of the cache.
+
+The B-tree must not have any entries, not even deletion entries, between the first and
+the last key that `source` produces; `btree_range_is_empty()` checks for that. Entries
+on either side are fine, so this works for an empty tree, for the right-hand end of a
+tree and for an empty range in the middle of a tree. `fill_factor` must be between one
+half and one; leaving some room in each node makes later insertions cheaper.
+
+The leaf nodes that receive new pairs never hold deletion entries or timestamps older
+than `min_deletion_timestamp`, in the same way as if
+`btree_receive_backfill_item_update_deletion_timestamps()` had been applied to them.
+Blocks that the values refer to are detached from their old leaf with `detacher` if a
+value turns out not to fit.
+
+The superblock must be acquired for write; it isn't released. Returns the number of pairs
+that were inserted. */
+size_t btree_bulk_load(
+    superblock_t *superblock,
+    value_sizer_t *sizer,
+    const value_deleter_t *detacher,
+    double fill_factor,
+    repli_timestamp_t min_deletion_timestamp,
+    btree_bulk_load_source_t *source);
+
+#endif  // BTREE_BULK_LOAD_HPP_
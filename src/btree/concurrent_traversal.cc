@@ -3,12 +3,17 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <functional>
 
 #include "arch/runtime/coroutines.hpp"
+#include "btree/get_distribution.hpp"
+#include "btree/operations.hpp"
 #include "concurrency/auto_drainer.hpp"
+#include "concurrency/pmap.hpp"
 #include "concurrency/semaphore.hpp"
 #include "concurrency/fifo_enforcer.hpp"
+#include "rdb_protocol/profile.hpp"
 
 class incr_decr_t {
 public:
@@ -189,3 +194,116 @@ continue_bool_t btree_concurrent_traversal(
     return failure_cond.is_pulsed() ? continue_bool_t::ABORT : continue_bool_t::CONTINUE;
 }
 
+
+std::vector<key_range_t> split_range_for_parallel_traversal(
+        superblock_t *superblock,
+        const key_range_t &range,
+        size_t max_parts,
+        profile::trace_t *trace) {
+    std::vector<key_range_t> parts;
+    if (max_parts <= 1 || range.is_empty()
+        || superblock->get_root_block_id() == NULL_BLOCK_ID) {
+        parts.push_back(range);
+        return parts;
+    }
+
+    // The keys in the top two levels of the tree that lie in `range`.
+    std::vector<store_key_t> keys;
+    {
+        profile::starter_t starter("Compute key distribution.", trace);
+        int64_t key_count;
+        get_btree_key_distribution(superblock, 2, &key_count, &keys, range,
+                                   release_superblock_t::KEEP);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    // A part can't start where `range` starts, other than the first one.
+    if (!keys.empty() && keys.front() == range.left) {
+        keys.erase(keys.begin());
+    }
+
+    // Pick evenly spaced keys so that each part holds about the same number of
+    // them.
+    const size_t num_parts = std::min(max_parts, keys.size() + 1);
+    store_key_t left = range.left;
+    for (size_t i = 1; i < num_parts; ++i) {
+        const store_key_t &boundary = keys[i * (keys.size() + 1) / num_parts - 1];
+        key_range_t part;
+        part.left = left;
+        part.right = key_range_t::right_bound_t(boundary);
+        parts.push_back(part);
+        left = boundary;
+    }
+    key_range_t last;
+    last.left = left;
+    last.right = range.right;
+    parts.push_back(last);
+    return parts;
+}
+
+/* Hands out the same superblock to several traversals. The real superblock is
+released once all of them have released their copy. */
+class shared_superblock_t : public superblock_t {
+public:
+    shared_superblock_t(superblock_t *_inner, size_t *_refcount,
+                        release_superblock_t _release_inner)
+        : inner(_inner), refcount(_refcount), release_inner(_release_inner),
+          released(false) {
+        ++*refcount;
+    }
+    ~shared_superblock_t() {
+        release();
+    }
+    void release() {
+        if (!released) {
+            released = true;
+            guarantee(*refcount > 0);
+            --*refcount;
+            if (*refcount == 0 && release_inner == release_superblock_t::RELEASE) {
+                inner->release();
+            }
+        }
+    }
+    block_id_t get_root_block_id() { return inner->get_root_block_id(); }
+    void set_root_block_id(block_id_t) { unreachable(); }
+    block_id_t get_stat_block_id() { return inner->get_stat_block_id(); }
+    buf_parent_t expose_buf() { return inner->expose_buf(); }
+
+private:
+    superblock_t *const inner;
+    size_t *const refcount;
+    const release_superblock_t release_inner;
+    bool released;
+};
+
+continue_bool_t btree_parallel_concurrent_traversal(
+        superblock_t *superblock,
+        const std::vector<key_range_t> &ranges,
+        const std::vector<concurrent_traversal_callback_t *> &cbs,
+        direction_t direction,
+        release_superblock_t release_superblock) {
+    guarantee(ranges.size() == cbs.size());
+    size_t refcount = 0;
+    std::vector<scoped_ptr_t<shared_superblock_t> > superblocks;
+    superblocks.reserve(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        superblocks.push_back(make_scoped<shared_superblock_t>(
+            superblock, &refcount, release_superblock));
+    }
+    if (ranges.empty() && release_superblock == release_superblock_t::RELEASE) {
+        superblock->release();
+    }
+
+    bool aborted = false;
+    pmap(ranges.size(), [&](int64_t i) {
+        if (continue_bool_t::ABORT == btree_concurrent_traversal(
+                superblocks[i].get(), ranges[i], cbs[i], direction,
+                release_superblock_t::RELEASE)) {
+            aborted = true;
+        }
+        // `btree_concurrent_traversal()` doesn't release the superblock for an
+        // empty range.
+        superblocks[i]->release();
+    });
+    return aborted ? continue_bool_t::ABORT : continue_bool_t::CONTINUE;
+}
@@ -2,6 +2,8 @@
 #ifndef BTREE_CONCURRENT_TRAVERSAL_HPP_
 #define BTREE_CONCURRENT_TRAVERSAL_HPP_
 
+#include <vector>
+
 #include "btree/depth_first_traversal.hpp"
 #include "concurrency/interruptor.hpp"
 
@@ -65,4 +67,26 @@ continue_bool_t btree_concurrent_traversal(
         direction_t direction,
         release_superblock_t release_superblock);
 
+/* Splits `range` into at most `max_parts` contiguous sub-ranges, in key order. The
+split points are picked evenly from the key distribution of the top two levels of the
+tree (see `get_btree_key_distribution()`), so the parts hold roughly the same number of
+keys. If the tree is too small to be split, the result is just `range`. Doesn't release
+`superblock`. */
+std::vector<key_range_t> split_range_for_parallel_traversal(
+        superblock_t *superblock,
+        const key_range_t &range,
+        size_t max_parts,
+        profile::trace_t *trace);
+
+/* Runs a `btree_concurrent_traversal()` over each of `ranges` at the same time, using
+`cbs[i]` for `ranges[i]`. The callbacks don't exclude each other, so each one needs its
+own state. `superblock` is released (if `release_superblock` says so) once every
+traversal has acquired the root. Returns `ABORT` if any of the traversals aborted. */
+continue_bool_t btree_parallel_concurrent_traversal(
+        superblock_t *superblock,
+        const std::vector<key_range_t> &ranges,
+        const std::vector<concurrent_traversal_callback_t *> &cbs,
+        direction_t direction,
+        release_superblock_t release_superblock);
+
 #endif  // BTREE_CONCURRENT_TRAVERSAL_HPP_
@@ -0,0 +1,101 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "btree/count_keys.hpp"
+
+#include "btree/depth_first_traversal.hpp"
+#include "btree/leaf_node.hpp"
+#include "btree/node.hpp"
+
+class count_keys_callback_t : public depth_first_traversal_callback_t {
+public:
+    count_keys_callback_t(const key_range_t *_range, count_keys_filter_t *_filter,
+                          profile::trace_t *_trace)
+        : range(_range), filter(_filter), trace(_trace), count(0) { }
+
+    continue_bool_t handle_pre_leaf(
+            const counted_t<counted_buf_lock_and_read_t> &buf,
+            UNUSED const btree_key_t *left_excl_or_null,
+            UNUSED const btree_key_t *right_incl,
+            UNUSED signal_t *interruptor,
+            bool *skip_out) {
+        // The traversal has already acquired the leaf for reading.
+        const leaf_node_t *lnode =
+            static_cast<const leaf_node_t *>(buf->read->get_data_read());
+        uint64_t leaf_count = 0;
+        for (auto it = leaf::inclusive_lower_bound(range->left.btree_key(), *lnode);
+             it != leaf::end(*lnode); ++it) {
+            // `range->right` is exclusive
+            if (!range->right.unbounded &&
+                btree_key_cmp((*it).first, range->right.key().btree_key()) >= 0) {
+                break;
+            }
+            switch (filter != nullptr
+                    ? filter->check_key((*it).first)
+                    : count_keys_filter_t::decision_t::COUNT) {
+            case count_keys_filter_t::decision_t::COUNT:
+                ++leaf_count;
+                break;
+            case count_keys_filter_t::decision_t::SKIP:
+                break;
+            case count_keys_filter_t::decision_t::CHECK_VALUE:
+                // Let `handle_pair()` go through this leaf one pair at a time.
+                *skip_out = false;
+                return continue_bool_t::CONTINUE;
+            default:
+                unreachable();
+            }
+        }
+        count += leaf_count;
+        // We've already counted everything we need from this leaf.
+        *skip_out = true;
+        return continue_bool_t::CONTINUE;
+    }
+
+    continue_bool_t handle_pair(scoped_key_value_t &&keyvalue,
+                                signal_t *interruptor) {
+        // We only get here for leaves with at least one key that needs its value
+        // checked, which requires a filter.
+        guarantee(filter != nullptr);
+        switch (filter->check_key(keyvalue.key())) {
+        case count_keys_filter_t::decision_t::COUNT:
+            ++count;
+            return continue_bool_t::CONTINUE;
+        case count_keys_filter_t::decision_t::SKIP:
+            return continue_bool_t::CONTINUE;
+        case count_keys_filter_t::decision_t::CHECK_VALUE: {
+            bool count_it;
+            continue_bool_t res =
+                filter->check_value(std::move(keyvalue), interruptor, &count_it);
+            if (res == continue_bool_t::CONTINUE && count_it) {
+                ++count;
+            }
+            return res;
+        }
+        default:
+            unreachable();
+        }
+    }
+
+    profile::trace_t *get_trace() THROWS_NOTHING { return trace; }
+
+    uint64_t get_count() const { return count; }
+
+private:
+    const key_range_t *const range;
+    count_keys_filter_t *const filter;
+    profile::trace_t *const trace;
+    uint64_t count;
+};
+
+uint64_t btree_count_keys(
+        superblock_t *superblock,
+        const key_range_t &range,
+        count_keys_filter_t *filter,
+        release_superblock_t release_superblock,
+        profile::trace_t *trace,
+        signal_t *interruptor)
+    THROWS_ONLY(interrupted_exc_t) {
+    count_keys_callback_t callback(&range, filter, trace);
+    btree_depth_first_traversal(superblock, range, &callback, access_t::read,
+                                FORWARD, release_superblock, interruptor);
+    return callback.get_count();
+}
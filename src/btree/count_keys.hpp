@@ -0,0 +1,46 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef BTREE_COUNT_KEYS_HPP_
+#define BTREE_COUNT_KEYS_HPP_
+
+#include <stdint.h>
+
+#include "btree/keys.hpp"
+#include "btree/types.hpp"
+#include "concurrency/interruptor.hpp"
+
+class scoped_key_value_t;
+class superblock_t;
+namespace profile { class trace_t; }
+
+/* Lets the caller of `btree_count_keys()` decide which keys in the range count.
+Most keys should be decided by `check_key()` alone; `check_value()` is only called
+for the keys for which `check_key()` returned `CHECK_VALUE`. */
+class count_keys_filter_t {
+public:
+    enum class decision_t { COUNT, SKIP, CHECK_VALUE };
+    virtual decision_t check_key(const btree_key_t *key) = 0;
+    /* Sets `*count_out` to whether the key-value pair should be counted. Can return
+    `ABORT` to stop the count early, in which case the result is meaningless. */
+    virtual continue_bool_t check_value(
+            scoped_key_value_t &&keyvalue,
+            signal_t *interruptor,
+            bool *count_out) = 0;
+protected:
+    virtual ~count_keys_filter_t() { }
+};
+
+/* Counts the keys in `range` without loading any values. Each leaf node's keys are
+counted in one go, rather than being handed to a callback one key-value pair at a
+time the way a regular traversal does. If `filter` is non-NULL, only the keys it
+accepts are counted; a leaf falls back to a pair-by-pair traversal only if one of
+its keys needs its value checked. */
+uint64_t btree_count_keys(
+        superblock_t *superblock,
+        const key_range_t &range,
+        count_keys_filter_t *filter,
+        release_superblock_t release_superblock,
+        profile::trace_t *trace,
+        signal_t *interruptor)
+    THROWS_ONLY(interrupted_exc_t);
+
+#endif  // BTREE_COUNT_KEYS_HPP_
@@ -10,8 +10,9 @@
 
 class get_distribution_traversal_helper_t : public btree_traversal_helper_t, public home_thread_mixin_debug_only_t {
 public:
-    get_distribution_traversal_helper_t(int _depth_limit, std::vector<store_key_t> *_keys)
-        : depth_limit(_depth_limit), key_count(0), keys(_keys)
+    get_distribution_traversal_helper_t(int _depth_limit, const key_range_t &_range,
+                                        std::vector<store_key_t> *_keys)
+        : depth_limit(_depth_limit), range(_range), key_count(0), keys(_keys)
     { }
 
     void read_stat_block(buf_lock_t *stat_block) {
@@ -36,7 +37,9 @@ public:
 
         for (auto it = leaf::begin(*node); it != leaf::end(*node); ++it) {
             const btree_key_t *key = (*it).first;
-            keys->push_back(store_key_t(key->size, key->contents));
+            if (range.contains_key(key)) {
+                keys->push_back(store_key_t(key->size, key->contents));
+            }
         }
     }
 
@@ -50,7 +53,9 @@ public:
          * */
         for (int i = 0; i < (node->npairs - 1); i++) {
             const btree_internal_pair *pair = internal_node::get_pair_by_index(node, i);
-            keys->push_back(store_key_t(pair->key.size, pair->key.contents));
+            if (range.contains_key(&pair->key)) {
+                keys->push_back(store_key_t(pair->key.size, pair->key.contents));
+            }
         }
     }
 
@@ -64,6 +69,15 @@ public:
                 const btree_key_t *left, *right;
                 ids_source->get_block_id_and_bounding_interval(i, &block_id, &left, &right);
 
+                // Skip the children that lie entirely outside of `range`.
+                if (right != NULL
+                    && btree_key_cmp(right, range.left.btree_key()) < 0) {
+                    continue;
+                }
+                if (left != NULL && !range.right.unbounded
+                    && btree_key_cmp(left, range.right.key().btree_key()) >= 0) {
+                    continue;
+                }
                 cb->receive_interesting_child(i);
             }
         } else {
@@ -82,19 +96,24 @@ public:
     }
 
     int depth_limit;
+    key_range_t range;
     int64_t key_count;
 
     //TODO this is inefficient since each one is maximum size
     std::vector<store_key_t> *keys;
 };
 
-void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
-                                int64_t *key_count_out,
-                                std::vector<store_key_t> *keys_out) {
-    get_distribution_traversal_helper_t helper(depth_limit, keys_out);
+void get_btree_key_distribution(
+        superblock_t *superblock, int depth_limit,
+        int64_t *key_count_out,
+        std::vector<store_key_t> *keys_out,
+        const key_range_t &range,
+        release_superblock_t release_superblock) {
+    get_distribution_traversal_helper_t helper(depth_limit, range, keys_out);
     rassert(keys_out->empty(), "Why is this output parameter not an empty vector\n");
 
     cond_t non_interruptor;
-    btree_parallel_traversal(superblock, &helper, &non_interruptor);
+    btree_parallel_traversal(superblock, &helper, &non_interruptor,
+                             release_superblock);
     *key_count_out = helper.key_count;
 }
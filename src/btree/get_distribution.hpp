@@ -5,12 +5,19 @@
 #include <vector>
 
 #include "btree/keys.hpp"
+#include "btree/types.hpp"
 #include "buffer_cache/types.hpp"
 
 class superblock_t;
 
-void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
-                                int64_t *key_count_out,
-                                std::vector<store_key_t> *keys_out);
+/* Collects the keys of the nodes in the top `depth_limit` levels of the tree, the
+root being at level 1. Only the keys in `range` are collected, and only the nodes that
+overlap `range` are visited. `*key_count_out` is the population of the whole tree. */
+void get_btree_key_distribution(
+        superblock_t *superblock, int depth_limit,
+        int64_t *key_count_out,
+        std::vector<store_key_t> *keys_out,
+        const key_range_t &range = key_range_t::universe(),
+        release_superblock_t release_superblock = release_superblock_t::RELEASE);
 
 #endif /* BTREE_GET_DISTRIBUTION_HPP_ */
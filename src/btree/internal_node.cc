@@ -89,7 +89,11 @@ void split(block_size_t block_size, internal_node_t *node, internal_node_t *rnod
         first_pairs += pair_size(get_pair_by_index(node, index));
         index++;
     }
-    int median_index = index;
+    split_at(block_size, node, rnode, index, median);
+}
+
+void split_at(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, int median_index, btree_key_t *median) {
+    rassert(median_index > 0 && median_index < node->npairs);
 
     // Equality takes the left branch, so the median should be from this node.
     const btree_key_t *median_key = &get_pair_by_index(node, median_index-1)->key;
@@ -99,7 +103,7 @@ void split(block_size_t block_size, internal_node_t *node, internal_node_t *rnod
 
     // TODO: This is really slow because most pairs will likely be copied
     // repeatedly.  There should be a better way.
-    for (index = median_index; index < node->npairs; index++) {
+    for (int index = median_index; index < node->npairs; index++) {
         impl::delete_pair(node, node->pair_offsets[index]);
     }
 
@@ -291,6 +295,16 @@ bool is_full(const internal_node_t *node) {
     return sizeof(internal_node_t) + (node->npairs + 1) * sizeof(*node->pair_offsets) + impl::pair_size_with_key_size(MAX_KEY_SIZE) >=  node->frontmost_offset;
 }
 
+bool is_full(block_size_t block_size, const internal_node_t *node, double fill_factor) {
+    rassert(fill_factor > 0 && fill_factor <= 1);
+    if (is_full(node)) {
+        return true;
+    }
+    size_t used = sizeof(internal_node_t) + node->npairs * sizeof(*node->pair_offsets) +
+        (block_size.value() - node->frontmost_offset);
+    return used > block_size.value() * fill_factor;
+}
+
 bool change_unsafe(const internal_node_t *node) {
     return sizeof(internal_node_t) + node->npairs * sizeof(*node->pair_offsets) + MAX_KEY_SIZE >= node->frontmost_offset;
 }
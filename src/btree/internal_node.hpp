@@ -34,6 +34,8 @@ block_id_t lookup(const internal_node_t *node, const btree_key_t *key);
 bool insert(internal_node_t *node, const btree_key_t *key, block_id_t lnode, block_id_t rnode);
 bool remove(block_size_t block_size, internal_node_t *node, const btree_key_t *key);
 void split(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, btree_key_t *median);
+// Like `split()`, but moves the pairs from `median_index` onwards into `rnode`.
+void split_at(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, int median_index, btree_key_t *median);
 void merge(block_size_t block_size, const internal_node_t *node, internal_node_t *rnode, const internal_node_t *parent);
 bool level(block_size_t block_size, internal_node_t *node, internal_node_t *sibling,
            btree_key_t *replacement_key, const internal_node_t *parent,
@@ -42,6 +44,8 @@ int sibling(const internal_node_t *node, const btree_key_t *key, block_id_t *sib
 void update_key(internal_node_t *node, const btree_key_t *key_to_replace, const btree_key_t *replacement_key);
 int nodecmp(const internal_node_t *node1, const internal_node_t *node2);
 bool is_full(const internal_node_t *node);
+// Also true if more than `fill_factor` of the block is in use.
+bool is_full(block_size_t block_size, const internal_node_t *node, double fill_factor);
 bool is_underfull(block_size_t block_size, const internal_node_t *node);
 bool change_unsafe(const internal_node_t *node);
 bool is_mergable(block_size_t block_size, const internal_node_t *node, const internal_node_t *sibling, const internal_node_t *parent);
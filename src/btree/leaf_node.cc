@@ -546,6 +546,14 @@ bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *k
     return size > free_space(sizer);
 }
 
+bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value, double fill_factor) {
+    // Below one half, the node would count as underfull as soon as we stopped filling it.
+    rassert(fill_factor >= 0.5 && fill_factor <= 1);
+    int size = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS);
+    size += sizeof(uint16_t) + sizeof(repli_timestamp_t) + key->full_size() + sizer->size(value);
+    return size > free_space(sizer) * fill_factor;
+}
+
 bool is_underfull(value_sizer_t *sizer, const leaf_node_t *node) {
 
     // An underfull node is one whose mandatory fields' cost
@@ -125,6 +125,10 @@ bool is_empty(const leaf_node_t *node);
 
 bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value);
 
+/* Like `is_full()`, but the node counts as full once the pair would take it past
+`fill_factor` of its capacity. `fill_factor` must be at least one half. */
+bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value, double fill_factor);
+
 bool is_underfull(value_sizer_t *sizer, const leaf_node_t *node);
 
 void split(value_sizer_t *sizer, leaf_node_t *node, leaf_node_t *sibling,
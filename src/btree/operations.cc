@@ -545,6 +545,104 @@ void find_keyvalue_location_for_read(
     }
 }
 
+void find_keyvalue_locations_in_subtree(
+        value_sizer_t *sizer,
+        buf_lock_t *buf,
+        std::vector<store_key_t>::const_iterator begin,
+        std::vector<store_key_t>::const_iterator end,
+        multi_keyvalue_location_callback_t *cb,
+        profile::trace_t *trace) {
+#ifndef NDEBUG
+    {
+        buf_read_t read(buf);
+        node::validate(sizer, static_cast<const node_t *>(read.get_data_read()));
+    }
+#endif  // NDEBUG
+
+    // The children of an internal node that contain any of the keys, each with the
+    // (contiguous, since the keys are sorted) range of keys that belongs to it.
+    std::vector<std::pair<block_id_t, std::vector<store_key_t>::const_iterator> >
+        children;
+    // For a leaf node, the keys that were found and a copy of their values.
+    std::vector<std::pair<std::vector<store_key_t>::const_iterator,
+                          scoped_malloc_t<void> > > found;
+    {
+        buf_read_t read(buf);
+        const void *data = read.get_data_read();
+        if (node::is_internal(static_cast<const node_t *>(data))) {
+            const internal_node_t *node = static_cast<const internal_node_t *>(data);
+            for (auto it = begin; it != end; ++it) {
+                block_id_t node_id = internal_node::lookup(node, it->btree_key());
+                rassert(node_id != NULL_BLOCK_ID && node_id != SUPERBLOCK_ID);
+                if (children.empty() || children.back().first != node_id) {
+                    children.push_back(std::make_pair(node_id, it));
+                }
+            }
+        } else {
+            const leaf_node_t *leaf = static_cast<const leaf_node_t *>(data);
+            // Most of the keys may be missing, so we only allocate a new buffer
+            // once the previous one was handed to `found`.
+            scoped_malloc_t<void> value;
+            for (auto it = begin; it != end; ++it) {
+                if (!value.has()) {
+                    value = scoped_malloc_t<void>(sizer->max_possible_size());
+                }
+                if (leaf::lookup(sizer, leaf, it->btree_key(), value.get())) {
+                    found.push_back(std::make_pair(it, std::move(value)));
+                }
+            }
+        }
+    }
+
+    for (auto &&pair : found) {
+        cb->on_value(pair.first->btree_key(), pair.second.get(), buf_parent_t(buf));
+    }
+
+    for (size_t i = 0; i < children.size(); ++i) {
+        buf_lock_t child;
+        {
+            profile::starter_t starter("Acquire a block for read.", trace);
+            child = buf_lock_t(buf, children[i].first, access_t::read);
+        }
+        find_keyvalue_locations_in_subtree(
+            sizer, &child, children[i].second,
+            i + 1 < children.size() ? children[i + 1].second : end,
+            cb, trace);
+    }
+}
+
+void find_keyvalue_locations_for_read(
+        value_sizer_t *sizer,
+        superblock_t *superblock,
+        const std::vector<store_key_t> &keys,
+        multi_keyvalue_location_callback_t *cb,
+        btree_stats_t *stats,
+        profile::trace_t *trace) {
+    rassert(std::is_sorted(keys.begin(), keys.end()));
+    stats->pm_keys_read.record(keys.size());
+    stats->pm_total_keys_read += keys.size();
+
+    const block_id_t root_id = superblock->get_root_block_id();
+    rassert(root_id != SUPERBLOCK_ID);
+
+    if (root_id == NULL_BLOCK_ID || keys.empty()) {
+        // There is no root, so the tree is empty.
+        superblock->release();
+        return;
+    }
+
+    buf_lock_t buf;
+    {
+        profile::starter_t starter("Acquire a block for read.", trace);
+        buf_lock_t tmp(superblock->expose_buf(), root_id, access_t::read);
+        superblock->release();
+        buf = std::move(tmp);
+    }
+
+    find_keyvalue_locations_in_subtree(sizer, &buf, keys.begin(), keys.end(), cb,
+                                       trace);
+}
+
 void apply_keyvalue_change(
         value_sizer_t *sizer,
         keyvalue_location_t *kv_loc,
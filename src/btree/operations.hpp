@@ -213,6 +213,30 @@ void find_keyvalue_location_for_read(
         btree_stats_t *stats,
         profile::trace_t *trace);
 
+/* Callback for `find_keyvalue_locations_for_read()`. */
+class multi_keyvalue_location_callback_t {
+public:
+    /* Called once for every key that has a value, in key order. `value` is only
+    valid for the duration of the call; `parent` can be used to read any blocks the
+    value refers to. */
+    virtual void on_value(const btree_key_t *key, const void *value,
+                          buf_parent_t parent) = 0;
+protected:
+    virtual ~multi_keyvalue_location_callback_t() { }
+};
+
+/* Like `find_keyvalue_location_for_read()`, but for many keys at once. `keys` must be
+sorted and must not contain duplicates. The tree is descended only once: a node that
+lies on the path to several of the keys is acquired a single time, rather than once
+per key. */
+void find_keyvalue_locations_for_read(
+        value_sizer_t *sizer,
+        superblock_t *superblock,
+        const std::vector<store_key_t> &keys,
+        multi_keyvalue_location_callback_t *cb,
+        btree_stats_t *stats,
+        profile::trace_t *trace);
+
 /* `delete_mode_t` controls how `apply_keyvalue_change()` acts when `kv_loc->value` is
 empty. */
 enum class delete_mode_t {
@@ -404,6 +404,8 @@ admin_artificial_tables_t::admin_artificial_tables_t(
             cluster_semilattice_metadata_t> > _semilattice_view,
         boost::shared_ptr< semilattice_readwrite_view_t<
             auth_semilattice_metadata_t> > _auth_view,
+        boost::shared_ptr< semilattice_readwrite_view_t<
+            backfill_semilattice_metadata_t> > _backfill_view,
         clone_ptr_t< watchable_t< change_tracking_map_t<peer_id_t,
             cluster_directory_metadata_t> > > _directory_view,
         watchable_map_t<peer_id_t, cluster_directory_metadata_t> *_directory_map_view,
@@ -415,7 +417,7 @@ admin_artificial_tables_t::admin_artificial_tables_t(
         std::pair<artificial_table_backend_t *, artificial_table_backend_t *> > backends;
 
     cluster_config_backend.init(new cluster_config_artificial_table_backend_t(
-        _auth_view));
+        _auth_view, _backfill_view));
     backends[name_string_t::guarantee_valid("cluster_config")] =
         std::make_pair(cluster_config_backend.get(), cluster_config_backend.get());
 
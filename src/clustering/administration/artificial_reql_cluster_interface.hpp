@@ -200,6 +200,8 @@ public:
                 cluster_semilattice_metadata_t> > _semilattice_view,
             boost::shared_ptr< semilattice_readwrite_view_t<
                 auth_semilattice_metadata_t> > _auth_view,
+            boost::shared_ptr< semilattice_readwrite_view_t<
+                backfill_semilattice_metadata_t> > _backfill_view,
             clone_ptr_t< watchable_t< change_tracking_map_t<peer_id_t,
                 cluster_directory_metadata_t> > > _directory_view,
             watchable_map_t<peer_id_t, cluster_directory_metadata_t>
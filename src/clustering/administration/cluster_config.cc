@@ -6,9 +6,13 @@
 
 cluster_config_artificial_table_backend_t::cluster_config_artificial_table_backend_t(
         boost::shared_ptr< semilattice_readwrite_view_t<
-            auth_semilattice_metadata_t> > _sl_view) :
-    auth_doc(_sl_view) {
+            auth_semilattice_metadata_t> > _auth_sl_view,
+        boost::shared_ptr< semilattice_readwrite_view_t<
+            backfill_semilattice_metadata_t> > _backfill_sl_view) :
+    auth_doc(_auth_sl_view),
+    backfill_doc(_backfill_sl_view) {
     docs["auth"] = &auth_doc;
+    docs["backfill"] = &backfill_doc;
 }
 
 cluster_config_artificial_table_backend_t::~cluster_config_artificial_table_backend_t() {
@@ -219,3 +223,122 @@ void cluster_config_artificial_table_backend_t::auth_doc_t::set_notification_cal
     }
 }
 
+
+/* The `backfill` doc shows the byte rates in megabytes per second, because that's a
+more convenient unit for the user. */
+static const double backfill_doc_bytes_per_mb = 1024 * 1024;
+
+ql::datum_t convert_backfill_limit_to_datum(
+        const boost::optional<uint64_t> &value,
+        double unit) {
+    if (static_cast<bool>(value)) {
+        return ql::datum_t(static_cast<double>(*value) / unit);
+    } else {
+        return ql::datum_t::null();
+    }
+}
+
+bool convert_backfill_limit_from_datum(
+        ql::datum_t datum,
+        double unit,
+        boost::optional<uint64_t> *value_out,
+        admin_err_t *error_out) {
+    if (datum.get_type() == ql::datum_t::R_NULL) {
+        *value_out = boost::none;
+        return true;
+    }
+    /* Anything that rounds down to zero would stop backfills entirely. */
+    if (datum.get_type() == ql::datum_t::R_NUM
+            && datum.as_num() * unit >= 1
+            && datum.as_num() * unit <= static_cast<double>(UINT64_MAX / 2)) {
+        *value_out = static_cast<uint64_t>(datum.as_num() * unit);
+        return true;
+    }
+    *error_out = admin_err_t{
+        "Expected a positive number or null; got " + datum.print(),
+        query_state_t::FAILED};
+    return false;
+}
+
+bool cluster_config_artificial_table_backend_t::backfill_doc_t::read(
+        UNUSED signal_t *interruptor,
+        ql::datum_t *row_out,
+        UNUSED admin_err_t *error_out) {
+    on_thread_t thread_switcher(sl_view->home_thread());
+    backfill_rate_config_t config = sl_view->get().rate_config.get_ref();
+    ql::datum_object_builder_t obj_builder;
+    obj_builder.overwrite("id", ql::datum_t("backfill"));
+    obj_builder.overwrite("send_mb_per_sec", convert_backfill_limit_to_datum(
+        config.send_bytes_per_sec, backfill_doc_bytes_per_mb));
+    obj_builder.overwrite("receive_mb_per_sec", convert_backfill_limit_to_datum(
+        config.receive_bytes_per_sec, backfill_doc_bytes_per_mb));
+    obj_builder.overwrite("latency_target_ms", convert_backfill_limit_to_datum(
+        config.latency_target_ms, 1));
+    *row_out = std::move(obj_builder).to_datum();
+    return true;
+}
+
+bool cluster_config_artificial_table_backend_t::backfill_doc_t::write(
+        UNUSED signal_t *interruptor,
+        ql::datum_t *row_inout,
+        admin_err_t *error_out) {
+    converter_from_datum_object_t converter;
+    admin_err_t dummy_error;
+    if (!converter.init(*row_inout, &dummy_error)) {
+        crash("artificial_table_t should guarantee input is an object");
+    }
+    ql::datum_t dummy_pkey;
+    if (!converter.get("id", &dummy_pkey, &dummy_error)) {
+        crash("artificial_table_t should guarantee primary key is present and correct");
+    }
+
+    backfill_rate_config_t config;
+    ql::datum_t datum;
+    if (!converter.get("send_mb_per_sec", &datum, error_out)) {
+        return false;
+    }
+    if (!convert_backfill_limit_from_datum(datum, backfill_doc_bytes_per_mb,
+            &config.send_bytes_per_sec, error_out)) {
+        error_out->msg = "In `send_mb_per_sec`: " + error_out->msg;
+        return false;
+    }
+    if (!converter.get("receive_mb_per_sec", &datum, error_out)) {
+        return false;
+    }
+    if (!convert_backfill_limit_from_datum(datum, backfill_doc_bytes_per_mb,
+            &config.receive_bytes_per_sec, error_out)) {
+        error_out->msg = "In `receive_mb_per_sec`: " + error_out->msg;
+        return false;
+    }
+    if (!converter.get("latency_target_ms", &datum, error_out)) {
+        return false;
+    }
+    if (!convert_backfill_limit_from_datum(datum, 1,
+            &config.latency_target_ms, error_out)) {
+        error_out->msg = "In `latency_target_ms`: " + error_out->msg;
+        return false;
+    }
+
+    if (!converter.check_no_extra_keys(error_out)) {
+        return false;
+    }
+
+    {
+        on_thread_t thread_switcher(sl_view->home_thread());
+        backfill_semilattice_metadata_t md = sl_view->get();
+        md.rate_config.set(config);
+        sl_view->join(md);
+    }
+
+    return true;
+}
+
+void cluster_config_artificial_table_backend_t::backfill_doc_t::
+        set_notification_callback(const std::function<void()> &fun) {
+    if (static_cast<bool>(fun)) {
+        subs = make_scoped<semilattice_read_view_t<
+            backfill_semilattice_metadata_t>::subscription_t>(fun, sl_view);
+    } else {
+        subs.reset();
+    }
+}
@@ -16,7 +16,11 @@
 elsewhere but aren't complicated enough to deserve their own table. It has a fixed set of
 rows, each of which has a unique format and corresponds to a different setting.
 
-Right now the only row is `auth`, with the format `{"id": "auth", "auth_key": ...}`. */
+Right now there are two rows:
+  - `auth`, with the format `{"id": "auth", "auth_key": ...}`
+  - `backfill`, with the format `{"id": "backfill", "send_mb_per_sec": ...,
+    "receive_mb_per_sec": ..., "latency_target_ms": ...}`, where each field is a
+    positive number or `null` for no limit. */
 
 class cluster_config_artificial_table_backend_t :
     public caching_cfeed_artificial_table_backend_t
@@ -24,7 +28,9 @@ class cluster_config_artificial_table_backend_t :
 public:
     cluster_config_artificial_table_backend_t(
             boost::shared_ptr<semilattice_readwrite_view_t<
-                auth_semilattice_metadata_t> > _sl_view);
+                auth_semilattice_metadata_t> > _auth_sl_view,
+            boost::shared_ptr<semilattice_readwrite_view_t<
+                backfill_semilattice_metadata_t> > _backfill_sl_view);
     ~cluster_config_artificial_table_backend_t();
 
     std::string get_primary_key_name();
@@ -92,7 +98,28 @@ private:
             semilattice_read_view_t<auth_semilattice_metadata_t>::subscription_t> subs;
     };
 
+    class backfill_doc_t : public doc_t {
+    public:
+        backfill_doc_t(boost::shared_ptr< semilattice_readwrite_view_t<
+            backfill_semilattice_metadata_t> > _sl_view) : sl_view(_sl_view) { }
+        bool read(
+                signal_t *interruptor,
+                ql::datum_t *row_out,
+                admin_err_t *error_out);
+        bool write(
+                signal_t *interruptor,
+                ql::datum_t *value_inout,
+                admin_err_t *error_out);
+        void set_notification_callback(const std::function<void()> &fun);
+    private:
+        boost::shared_ptr< semilattice_readwrite_view_t<
+            backfill_semilattice_metadata_t> > sl_view;
+        scoped_ptr_t<semilattice_read_view_t<
+            backfill_semilattice_metadata_t>::subscription_t> subs;
+    };
+
     auth_doc_t auth_doc;
+    backfill_doc_t backfill_doc;
 
     std::map<std::string, doc_t *> docs;
 };
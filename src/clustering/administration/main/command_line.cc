@@ -409,6 +409,23 @@ std::string get_web_path(boost::optional<std::string> web_static_directory) {
     return abs_path.path();
 }
 
+boost::optional<base_path_t> parse_write_ahead_log_directory_option(
+        const std::map<std::string, options::values_t> &opts) {
+    boost::optional<std::string> directory =
+        get_optional_option(opts, "--write-ahead-log-directory");
+    if (!static_cast<bool>(directory)) {
+        return boost::none;
+    }
+    base_path_t abs_path(*directory);
+    if (!check_existence(abs_path)) {
+        throw std::runtime_error(strprintf(
+            "ERROR: write-ahead log directory not found '%s'",
+            abs_path.path().c_str()));
+    }
+    abs_path.make_absolute();
+    return abs_path;
+}
+
 std::string get_web_path(const std::map<std::string, options::values_t> &opts) {
     if (!exists_option(opts, "--no-http-admin")) {
         boost::optional<std::string> web_static_directory = get_optional_option(opts, "--web-static-directory");
@@ -635,6 +652,25 @@ peer_address_t get_canonical_addresses(const std::map<std::string, options::valu
 service_address_ports_t get_service_address_ports(const std::map<std::string, options::values_t> &opts) {
     const int port_offset = get_single_int(opts, "--port-offset");
     const int cluster_port = offseted_port(get_single_int(opts, "--cluster-port"), port_offset);
+    const int cluster_connections = get_single_int(opts, "--cluster-connections");
+    if (cluster_connections < 1
+        || cluster_connections > connectivity_cluster_t::max_connections_per_peer) {
+        throw std::runtime_error(strprintf(
+            "--cluster-connections must be between 1 and %d (got %d)",
+            connectivity_cluster_t::max_connections_per_peer, cluster_connections));
+    }
+    const std::string cluster_compression_str =
+        get_single_option(opts, "--cluster-compression");
+    cluster_compression_t cluster_compression;
+    if (cluster_compression_str == "zlib") {
+        cluster_compression = cluster_compression_t::ZLIB;
+    } else if (cluster_compression_str == "none") {
+        cluster_compression = cluster_compression_t::NONE;
+    } else {
+        throw std::runtime_error(strprintf(
+            "--cluster-compression must be 'zlib' or 'none' (got '%s')",
+            cluster_compression_str.c_str()));
+    }
     return service_address_ports_t(
         get_local_addresses(all_options(opts, "--bind"),
                             exists_option(opts, "--no-default-bind") ?
@@ -643,6 +679,8 @@ service_address_ports_t get_service_address_ports(const std::map<std::string, op
         get_canonical_addresses(opts, cluster_port),
         cluster_port,
         get_single_int(opts, "--client-port"),
+        cluster_connections,
+        cluster_compression,
         exists_option(opts, "--no-http-admin"),
         offseted_port(get_single_int(opts, "--http-port"), port_offset),
         offseted_port(get_single_int(opts, "--driver-port"), port_offset),
@@ -928,6 +966,12 @@ options::help_section_t get_file_options(std::vector<options::option_t> *options
     options_out->push_back(options::option_t(options::names_t("--direct-io"),
                                              options::OPTIONAL_NO_PARAMETER));
     help.add("--direct-io", "use direct I/O for file access");
+    options_out->push_back(
+        options::option_t(options::names_t("--write-ahead-log-directory"),
+                          options::OPTIONAL));
+    help.add("--write-ahead-log-directory path", "log writes with hard durability to "
+             "this directory, which can be on a separate device, instead of flushing "
+             "the tables for each write");
     options_out->push_back(options::option_t(options::names_t("--cache-size"),
                                              options::OPTIONAL));
     help.add("--cache-size mb", "total cache size (in megabytes) for the process. Can "
@@ -1068,6 +1112,16 @@ options::help_section_t get_network_options(const bool join_required, std::vecto
                                              strprintf("%d", port_defaults::peer_port)));
     help.add("--cluster-port port", "port for receiving connections from other nodes");
 
+    options_out->push_back(options::option_t(options::names_t("--cluster-connections"),
+                                             options::OPTIONAL,
+                                             "1"));
+    help.add("--cluster-connections n", "the number of TCP connections to use for each other node");
+
+    options_out->push_back(options::option_t(options::names_t("--cluster-compression"),
+                                             options::OPTIONAL,
+                                             "zlib"));
+    help.add("--cluster-compression {zlib|none}", "how to compress large messages to other nodes");
+
     options_out->push_back(options::option_t(options::names_t("--client-port"),
                                              options::OPTIONAL,
                                              strprintf("%d", port_defaults::client_port)));
@@ -1419,6 +1473,9 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
 
         std::string web_path = get_web_path(opts);
 
+        boost::optional<base_path_t> write_ahead_log_directory =
+            parse_write_ahead_log_directory_option(opts);
+
         int num_workers;
         if (!parse_cores_option(opts, &num_workers)) {
             return EXIT_FAILURE;
@@ -1465,6 +1522,7 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                 do_update_checking,
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
+                                write_ahead_log_directory,
                                 std::vector<std::string>(argv, argv + argc));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
@@ -1549,6 +1607,7 @@ int main_rethinkdb_proxy(int argc, char *argv[]) {
                                 update_check_t::do_not_perform,
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
+                                boost::none,
                                 std::vector<std::string>(argv, argv + argc));
 
         bool result;
@@ -1650,6 +1709,9 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
 
         std::string web_path = get_web_path(opts);
 
+        boost::optional<base_path_t> write_ahead_log_directory =
+            parse_write_ahead_log_directory_option(opts);
+
         int num_workers;
         if (!parse_cores_option(opts, &num_workers)) {
             return EXIT_FAILURE;
@@ -1716,6 +1778,7 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                 do_update_checking,
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
+                                write_ahead_log_directory,
                                 std::vector<std::string>(argv, argv + argc));
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
@@ -106,12 +106,17 @@ bool do_serve(io_backender_t *io_backender,
 
         cluster_semilattice_metadata_t cluster_metadata;
         auth_semilattice_metadata_t auth_metadata;
+        backfill_semilattice_metadata_t backfill_metadata;
         server_id_t server_id = generate_uuid();
         if (metadata_file != NULL) {
             cond_t non_interruptor;
             metadata_file_t::read_txn_t txn(metadata_file, &non_interruptor);
             cluster_metadata = txn.read(mdkey_cluster_semilattices(), &non_interruptor);
             auth_metadata = txn.read(mdkey_auth_semilattices(), &non_interruptor);
+            /* Metadata files from before the backfill settings existed don't have
+            them, so we keep the defaults in that case. */
+            txn.read_maybe(mdkey_backfill_semilattices(), &backfill_metadata,
+                &non_interruptor);
             server_id = txn.read(mdkey_server_id(), &non_interruptor);
         }
 
@@ -127,12 +132,15 @@ bool do_serve(io_backender_t *io_backender,
         this server, and routes mailbox messages received from other servers. */
         mailbox_manager_t mailbox_manager(&connectivity_cluster, 'M');
 
-        /* `semilattice_manager_cluster` and `semilattice_manager_auth` are responsible
-        for syncing the semilattice metadata between servers over the network. */
+        /* `semilattice_manager_cluster`, `semilattice_manager_auth`, and
+        `semilattice_manager_backfill` are responsible for syncing the semilattice
+        metadata between servers over the network. */
         semilattice_manager_t<cluster_semilattice_metadata_t>
             semilattice_manager_cluster(&connectivity_cluster, 'S', cluster_metadata);
         semilattice_manager_t<auth_semilattice_metadata_t>
             semilattice_manager_auth(&connectivity_cluster, 'A', auth_metadata);
+        semilattice_manager_t<backfill_semilattice_metadata_t>
+            semilattice_manager_backfill(&connectivity_cluster, 'B', backfill_metadata);
 
         /* The `directory_*_read_manager_t`s are responsible for receiving directory
         updates over the network from other servers. */
@@ -201,7 +209,9 @@ bool do_serve(io_backender_t *io_backender,
                 serve_info.ports.local_addresses,
                 serve_info.ports.canonical_addresses,
                 serve_info.ports.port,
-                serve_info.ports.client_port));
+                serve_info.ports.client_port,
+                serve_info.ports.cluster_connections,
+                serve_info.ports.cluster_compression));
         } catch (const address_in_use_exc_t &ex) {
             throw address_in_use_exc_t(strprintf("Could not bind to cluster port: %s", ex.what()));
         }
@@ -275,6 +285,7 @@ bool do_serve(io_backender_t *io_backender,
                         io_backender,
                         cache_balancer.get(),
                         base_path,
+                        serve_info.write_ahead_log_directory,
                         outdated_index_issue_tracker.get(),
                         &rdb_ctx,
                         metadata_file));
@@ -299,6 +310,22 @@ bool do_serve(io_backender_t *io_backender,
                     table_directory_read_manager.get_root_view()));
             }
 
+            /* `backfill_rate_subs` applies the backfill rate limits from the `backfill`
+            row of `rethinkdb.cluster_config` to the backfills on this server. */
+            scoped_ptr_t<semilattice_read_view_t<
+                backfill_semilattice_metadata_t>::subscription_t> backfill_rate_subs;
+            if (i_am_a_server) {
+                auto apply_backfill_rate = [&]() {
+                    multi_table_manager->get_backfill_throttler()->set_rate_config(
+                        semilattice_manager_backfill.get_root_view()->get()
+                            .rate_config.get_ref());
+                };
+                apply_backfill_rate();
+                backfill_rate_subs.init(new semilattice_read_view_t<
+                        backfill_semilattice_metadata_t>::subscription_t(
+                    apply_backfill_rate, semilattice_manager_backfill.get_root_view()));
+            }
+
             /* The `table_meta_client_t` sends messages to the `multi_table_manager_t`s
             on the other servers in the cluster to create, drop, and reconfigure tables,
             as well as request information about them. */
@@ -326,6 +353,7 @@ bool do_serve(io_backender_t *io_backender,
                 &real_reql_cluster_interface,
                 semilattice_manager_cluster.get_root_view(),
                 semilattice_manager_auth.get_root_view(),
+                semilattice_manager_backfill.get_root_view(),
                 directory_read_manager.get_root_view(),
                 directory_read_manager.get_root_map_view(),
                 &table_meta_client,
@@ -485,13 +513,15 @@ bool do_serve(io_backender_t *io_backender,
                         return (md->proc.reql_port != serve_info.ports.reql_port);
                     });
 
-                /* `cluster_metadata_persister` and `auth_metadata_persister` are
-                responsible for syncing the two pieces of semilattice metadata to disk.
-                */
+                /* `cluster_metadata_persister`, `auth_metadata_persister`, and
+                `backfill_metadata_persister` are responsible for syncing the three
+                pieces of semilattice metadata to disk. */
                 scoped_ptr_t<semilattice_persister_t<cluster_semilattice_metadata_t> >
                     cluster_metadata_persister;
                 scoped_ptr_t<semilattice_persister_t<auth_semilattice_metadata_t> >
                     auth_metadata_persister;
+                scoped_ptr_t<semilattice_persister_t<backfill_semilattice_metadata_t> >
+                    backfill_metadata_persister;
                 if (i_am_a_server) {
                     cluster_metadata_persister.init(
                         new semilattice_persister_t<cluster_semilattice_metadata_t>(
@@ -503,6 +533,11 @@ bool do_serve(io_backender_t *io_backender,
                             metadata_file,
                             mdkey_auth_semilattices(),
                             semilattice_manager_auth.get_root_view()));
+                    backfill_metadata_persister.init(
+                        new semilattice_persister_t<backfill_semilattice_metadata_t>(
+                            metadata_file,
+                            mdkey_backfill_semilattices(),
+                            semilattice_manager_backfill.get_root_view()));
                 }
 
                 {
@@ -11,6 +11,7 @@
 #include "clustering/administration/persist/file.hpp"
 #include "clustering/administration/main/version_check.hpp"
 #include "arch/address.hpp"
+#include "rpc/connectivity/compression.hpp"
 
 class os_signal_cond_t;
 
@@ -44,6 +45,8 @@ struct service_address_ports_t {
     service_address_ports_t() :
         port(0),
         client_port(0),
+        cluster_connections(1),
+        cluster_compression(cluster_compression_t::ZLIB),
         http_port(0),
         reql_port(0),
         port_offset(0) { }
@@ -52,6 +55,8 @@ struct service_address_ports_t {
                             const peer_address_t &_canonical_addresses,
                             int _port,
                             int _client_port,
+                            int _cluster_connections,
+                            cluster_compression_t _cluster_compression,
                             bool _http_admin_is_disabled,
                             int _http_port,
                             int _reql_port,
@@ -60,6 +65,8 @@ struct service_address_ports_t {
         canonical_addresses(_canonical_addresses),
         port(_port),
         client_port(_client_port),
+        cluster_connections(_cluster_connections),
+        cluster_compression(_cluster_compression),
         http_admin_is_disabled(_http_admin_is_disabled),
         http_port(_http_port),
         reql_port(_reql_port),
@@ -79,6 +86,8 @@ struct service_address_ports_t {
     peer_address_t canonical_addresses;
     int port;
     int client_port;
+    int cluster_connections;
+    cluster_compression_t cluster_compression;
     bool http_admin_is_disabled;
     int http_port;
     int reql_port;
@@ -95,6 +104,7 @@ public:
                  update_check_t _do_version_checking,
                  service_address_ports_t _ports,
                  boost::optional<std::string> _config_file,
+                 boost::optional<base_path_t> _write_ahead_log_directory,
                  std::vector<std::string> &&_argv) :
         joins(std::move(_joins)),
         reql_http_proxy(std::move(_reql_http_proxy)),
@@ -102,6 +112,7 @@ public:
         do_version_checking(_do_version_checking),
         ports(_ports),
         config_file(_config_file),
+        write_ahead_log_directory(_write_ahead_log_directory),
         argv(std::move(_argv))
     { }
 
@@ -116,6 +127,8 @@ public:
     update_check_t do_version_checking;
     service_address_ports_t ports;
     boost::optional<std::string> config_file;
+    /* Where tables put their write-ahead logs, if they should have them at all. */
+    boost::optional<base_path_t> write_ahead_log_directory;
     /* The original arguments, so we can display them in `server_status`. All the
     argument parsing has already been completed at this point. */
     std::vector<std::string> argv;
@@ -18,6 +18,10 @@ RDB_IMPL_SERIALIZABLE_1_SINCE_v1_13(auth_semilattice_metadata_t, auth_key);
 RDB_IMPL_SEMILATTICE_JOINABLE_1(auth_semilattice_metadata_t, auth_key);
 RDB_IMPL_EQUALITY_COMPARABLE_1(auth_semilattice_metadata_t, auth_key);
 
+RDB_IMPL_SERIALIZABLE_1_SINCE_v2_1(backfill_semilattice_metadata_t, rate_config);
+RDB_IMPL_SEMILATTICE_JOINABLE_1(backfill_semilattice_metadata_t, rate_config);
+RDB_IMPL_EQUALITY_COMPARABLE_1(backfill_semilattice_metadata_t, rate_config);
+
 RDB_IMPL_SERIALIZABLE_9_FOR_CLUSTER(proc_directory_metadata_t,
     version,
     time_started,
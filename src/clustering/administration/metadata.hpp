@@ -16,6 +16,7 @@
 #include "clustering/administration/servers/server_metadata.hpp"
 #include "clustering/administration/stats/stat_manager.hpp"
 #include "clustering/administration/tables/database_metadata.hpp"
+#include "clustering/immediate_consistency/backfill_throttler.hpp"
 #include "clustering/table_manager/table_metadata.hpp"
 #include "arch/address.hpp"
 #include "containers/cow_ptr.hpp"
@@ -48,6 +49,20 @@ RDB_DECLARE_SERIALIZABLE(auth_semilattice_metadata_t);
 RDB_DECLARE_SEMILATTICE_JOINABLE(auth_semilattice_metadata_t);
 RDB_DECLARE_EQUALITY_COMPARABLE(auth_semilattice_metadata_t);
 
+/* `backfill_semilattice_metadata_t` holds the settings from the `backfill` row of the
+`rethinkdb.cluster_config` table. It's persisted in the metadata file along with the
+other semilattices. */
+class backfill_semilattice_metadata_t {
+public:
+    backfill_semilattice_metadata_t() { }
+
+    versioned_t<backfill_rate_config_t> rate_config;
+};
+
+RDB_DECLARE_SERIALIZABLE(backfill_semilattice_metadata_t);
+RDB_DECLARE_SEMILATTICE_JOINABLE(backfill_semilattice_metadata_t);
+RDB_DECLARE_EQUALITY_COMPARABLE(backfill_semilattice_metadata_t);
+
 enum cluster_directory_peer_type_t {
     SERVER_PEER,
     PROXY_PEER
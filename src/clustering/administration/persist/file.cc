@@ -372,7 +372,8 @@ void metadata_file_t::init_serializer(
     }
     serializer.init(new merger_serializer_t(
         std::move(standard_ser),
-        MERGER_SERIALIZER_MAX_ACTIVE_WRITES));
+        MERGER_SERIALIZER_MAX_ACTIVE_WRITES,
+        perfmon_parent));
 }
 
 metadata_file_t::~metadata_file_t() {
@@ -6,6 +6,7 @@
 #include "containers/uuid.hpp"
 
 class auth_semilattice_metadata_t;
+class backfill_semilattice_metadata_t;
 class branch_birth_certificate_t;
 class cluster_semilattice_metadata_t;
 template<class state_t> class raft_log_entry_t;
@@ -23,6 +24,8 @@ metadata_file_t::key_t<cluster_semilattice_metadata_t>
     mdkey_cluster_semilattices();
 metadata_file_t::key_t<auth_semilattice_metadata_t>
     mdkey_auth_semilattices();
+metadata_file_t::key_t<backfill_semilattice_metadata_t>
+    mdkey_backfill_semilattices();
 metadata_file_t::key_t<server_id_t>
     mdkey_server_id();
 metadata_file_t::key_t<server_config_versioned_t>
@@ -24,4 +24,5 @@ void semilattice_persister_t<metadata_t>::persist(signal_t *interruptor) {
 
 template class semilattice_persister_t<cluster_semilattice_metadata_t>;
 template class semilattice_persister_t<auth_semilattice_metadata_t>;
+template class semilattice_persister_t<backfill_semilattice_metadata_t>;
 
@@ -13,6 +13,21 @@
 #include "serializer/log/log_serializer.hpp"
 #include "serializer/merger.hpp"
 #include "serializer/translator.hpp"
+#include "serializer/write_ahead_log.hpp"
+
+static std::string write_ahead_log_path(
+        const base_path_t &directory, const namespace_id_t &table_id, int ix) {
+    return strprintf("%s/%s_%d.wal",
+        directory.path().c_str(), uuid_to_str(table_id).c_str(), ix);
+}
+
+/* Each store keeps its changefeed change log next to the table's file, so that feeds
+can be resumed after a restart. */
+static std::string change_log_path(
+        const base_path_t &directory, const namespace_id_t &table_id, int ix) {
+    return strprintf("%s/%s_%d.changes",
+        directory.path().c_str(), uuid_to_str(table_id).c_str(), ix);
+}
 
 class real_multistore_ptr_t :
     public multistore_ptr_t {
@@ -22,6 +37,7 @@ public:
             const serializer_filepath_t &path,
             scoped_ptr_t<real_branch_history_manager_t> &&bhm,
             const base_path_t &base_path,
+            const boost::optional<base_path_t> &write_ahead_log_directory,
             io_backender_t *io_backender,
             cache_balancer_t *cache_balancer,
             rdb_context_t *rdb_context,
@@ -67,7 +83,8 @@ public:
             perfmon_collection_serializers));
         serializer.init(new merger_serializer_t(
             std::move(inner_serializer),
-            MERGER_SERIALIZER_MAX_ACTIVE_WRITES));
+            MERGER_SERIALIZER_MAX_ACTIVE_WRITES,
+            perfmon_collection_serializers));
 
         std::vector<serializer_t *> ptrs;
         ptrs.push_back(serializer.get());
@@ -99,7 +116,8 @@ public:
                 io_backender,
                 base_path,
                 std::move(index_report),
-                table_id));
+                table_id,
+                change_log_path(base_path, table_id, ix)));
 
             /* Initialize the metainfo if necessary */
             if (create) {
@@ -116,6 +134,13 @@ public:
                     write_durability_t::HARD,
                     &non_interruptor);
             }
+
+            if (static_cast<bool>(write_ahead_log_directory)) {
+                cond_t non_interruptor;
+                stores[ix]->open_write_ahead_log(
+                    write_ahead_log_path(*write_ahead_log_directory, table_id, ix),
+                    &non_interruptor);
+            }
         });
 
         if (create) {
@@ -285,6 +310,7 @@ void real_table_persistence_interface_t::load_multistore(
         file_name_for(table_id),
         std::move(bhm),
         base_path,
+        write_ahead_log_directory,
         io_backender,
         cache_balancer,
         rdb_context,
@@ -319,6 +345,14 @@ void real_table_persistence_interface_t::destroy_multistore(
     guarantee_err(res == 0 || get_errno() == ENOENT,
                   "unlink failed for file %s", filepath.c_str());
 
+    for (int ix = 0; ix < CPU_SHARDING_FACTOR; ++ix) {
+        write_ahead_log_t::remove(change_log_path(base_path, table_id, ix));
+        if (static_cast<bool>(write_ahead_log_directory)) {
+            write_ahead_log_t::remove(write_ahead_log_path(
+                *write_ahead_log_directory, table_id, ix));
+        }
+    }
+
     real_branch_history_manager_t::erase(table_id, metadata_file, interruptor);
 }
 
@@ -19,12 +19,14 @@ public:
             io_backender_t *_io_backender,
             cache_balancer_t *_cache_balancer,
             const base_path_t &_base_path,
+            const boost::optional<base_path_t> &_write_ahead_log_directory,
             outdated_index_issue_tracker_t *_outdated_index_issue_tracker,
             rdb_context_t *_rdb_context,
             metadata_file_t *_metadata_file) :
         io_backender(_io_backender),
         cache_balancer(_cache_balancer),
         base_path(_base_path),
+        write_ahead_log_directory(_write_ahead_log_directory),
         outdated_index_issue_tracker(_outdated_index_issue_tracker),
         rdb_context(_rdb_context),
         metadata_file(_metadata_file),
@@ -81,6 +83,8 @@ private:
     io_backender_t * const io_backender;
     cache_balancer_t * const cache_balancer;
     base_path_t const base_path;
+    /* If this is set, every store gets a write-ahead log in this directory. */
+    boost::optional<base_path_t> const write_ahead_log_directory;
     outdated_index_issue_tracker_t * const outdated_index_issue_tracker;
     rdb_context_t * const rdb_context;
     metadata_file_t * const metadata_file;
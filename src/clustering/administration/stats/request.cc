@@ -42,7 +42,10 @@ parsed_stats_t::table_stats_t::table_stats_t() :
     in_use_bytes(0), metadata_bytes(0), data_bytes(0),
     garbage_bytes(0), preallocated_bytes(0),
     read_bytes_per_sec(0), read_bytes_total(0),
-    written_bytes_per_sec(0), written_bytes_total(0) { }
+    written_bytes_per_sec(0), written_bytes_total(0),
+    changefeed_messages_per_sec(0), changefeed_messages_total(0),
+    changefeed_serialized_bytes_per_sec(0), changefeed_serialized_bytes_total(0),
+    changefeed_queue_depth(0) { }
 
 parsed_stats_t::parsed_stats_t(const std::vector<ql::datum_t> &stats) {
     for (auto const &s : stats) {
@@ -125,6 +128,18 @@ void parsed_stats_t::store_shard_values(const ql::datum_t &shard_perf,
                 } else if (key == "cache") {
                     add_perfmon_value(sub_pair.second, "in_use_bytes",
                                       &stats_out->in_use_bytes);
+                } else if (key == "changefeeds") {
+                    r_sanity_check(sub_pair.second.get_type() == ql::datum_t::R_OBJECT);
+                    add_perfmon_value(sub_pair.second, "messages_sent",
+                                      &stats_out->changefeed_messages_per_sec);
+                    add_perfmon_value(sub_pair.second, "total_messages_sent",
+                                      &stats_out->changefeed_messages_total);
+                    add_perfmon_value(sub_pair.second, "bytes_serialized",
+                                      &stats_out->changefeed_serialized_bytes_per_sec);
+                    add_perfmon_value(sub_pair.second, "total_bytes_serialized",
+                                      &stats_out->changefeed_serialized_bytes_total);
+                    add_perfmon_value(sub_pair.second, "queue_depth",
+                                      &stats_out->changefeed_queue_depth);
                 }
             }
         }
@@ -343,7 +358,8 @@ table_stats_request_t::table_stats_request_t(const namespace_id_t &_table_id) :
 
 std::set<std::vector<std::string> > table_stats_request_t::get_filter() const {
     return std::set<std::vector<std::string> >({
-        { uuid_to_str(table_id), "serializers", "shard_[0-9]+", "btree-.*", "keys_.*" }
+        { uuid_to_str(table_id), "serializers", "shard_[0-9]+", "btree-.*", "keys_.*" },
+        { uuid_to_str(table_id), "serializers", "shard_[0-9]+", "changefeeds" }
         });
 }
 
@@ -373,6 +389,8 @@ bool table_stats_request_t::to_datum(const parsed_stats_t &stats,
     ql::datum_object_builder_t qe_builder;
     ADD_TABLE_STAT(qe_builder, stats, table_id, read_docs_per_sec);
     ADD_TABLE_STAT(qe_builder, stats, table_id, written_docs_per_sec);
+    ADD_TABLE_STAT(qe_builder, stats, table_id, changefeed_messages_per_sec);
+    ADD_TABLE_STAT(qe_builder, stats, table_id, changefeed_queue_depth);
     row_builder.overwrite("query_engine", std::move(qe_builder).to_datum());
 
     *result_out = std::move(row_builder).to_datum();
@@ -548,6 +566,11 @@ bool table_server_stats_request_t::to_datum(const parsed_stats_t &stats,
         ADD_STAT(qe_builder, table_stats, read_docs_total);
         ADD_STAT(qe_builder, table_stats, written_docs_per_sec);
         ADD_STAT(qe_builder, table_stats, written_docs_total);
+        ADD_STAT(qe_builder, table_stats, changefeed_messages_per_sec);
+        ADD_STAT(qe_builder, table_stats, changefeed_messages_total);
+        ADD_STAT(qe_builder, table_stats, changefeed_serialized_bytes_per_sec);
+        ADD_STAT(qe_builder, table_stats, changefeed_serialized_bytes_total);
+        ADD_STAT(qe_builder, table_stats, changefeed_queue_depth);
 
         ql::datum_object_builder_t se_cache_builder;
         ADD_STAT(se_cache_builder, table_stats, in_use_bytes);
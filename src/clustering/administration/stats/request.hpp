@@ -36,6 +36,11 @@ public:
         double read_bytes_total;
         double written_bytes_per_sec;
         double written_bytes_total;
+        double changefeed_messages_per_sec;
+        double changefeed_messages_total;
+        double changefeed_serialized_bytes_per_sec;
+        double changefeed_serialized_bytes_total;
+        double changefeed_queue_depth;
     };
 
     struct server_stats_t {
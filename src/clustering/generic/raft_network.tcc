@@ -46,6 +46,9 @@ bool raft_networked_member_t<state_t>::send_rpc(
             got_reply.pulse();
         });
     send(mailbox_manager, bcard->rpc, request, reply_mailbox.get_address());
+    /* Raft RPCs are small, so `send()` leaves them in the send buffer. Nothing else
+    is going to push them out while we wait for the reply. */
+    flush_sent_messages(mailbox_manager, bcard->rpc.get_peer());
     wait_any_t waiter(&watcher, &got_reply);
     wait_interruptible(&waiter, interruptor);
     return got_reply.is_pulsed();
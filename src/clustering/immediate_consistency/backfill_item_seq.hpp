@@ -1,6 +1,8 @@
 #ifndef CLUSTERING_IMMEDIATE_CONSISTENCY_BACKFILL_ITEM_SEQ_HPP_
 #define CLUSTERING_IMMEDIATE_CONSISTENCY_BACKFILL_ITEM_SEQ_HPP_
 
+#include <functional>
+
 #include "rdb_protocol/protocol.hpp"
 
 /* A `backfill_item_seq_t` contains all of the `backfill_{pre_}item_t`s in some range of
@@ -119,6 +121,18 @@ public:
         left_key = cut;
     }
 
+    /* Calls `callback` on every item in the seq. `callback` may change the items, but
+    not their ranges. The running total of the mem size is updated accordingly. */
+    void modify_items(const std::function<void(item_t *)> &callback) {
+        mem_size = 0;
+        for (item_t &item : items) {
+            DEBUG_VAR key_range_t range = item.get_range();
+            callback(&item);
+            rassert(item.get_range() == range);
+            mem_size += item.get_mem_size();
+        }
+    }
+
     /* Appends an item to the end of the seq, expanding the seq's domain on the right.
     Atoms must be appended in lexicographical order, so calling `push_back()` implicitly
     states that there are no items between the previous end of the seq and `item`. */
@@ -4,12 +4,16 @@
 backfill_config_t::backfill_config_t() :
     item_queue_mem_size(4 * MEGABYTE),
     item_chunk_mem_size(100 * KILOBYTE),
+    item_prefetch_mem_size(4 * MEGABYTE),
+    item_parallel_ranges(4),
+    compare_digests(true),
     pre_item_queue_mem_size(4 * MEGABYTE),
     pre_item_chunk_mem_size(100 * KILOBYTE)
     { }
 
-RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(backfill_config_t,
-    item_queue_mem_size, item_chunk_mem_size, pre_item_queue_mem_size,
+RDB_IMPL_SERIALIZABLE_7_FOR_CLUSTER(backfill_config_t,
+    item_queue_mem_size, item_chunk_mem_size, item_prefetch_mem_size,
+    item_parallel_ranges, compare_digests, pre_item_queue_mem_size,
     pre_item_chunk_mem_size);
 
 RDB_IMPL_SERIALIZABLE_9_FOR_CLUSTER(backfiller_bcard_t::intro_2_t,
@@ -17,9 +21,9 @@ RDB_IMPL_SERIALIZABLE_9_FOR_CLUSTER(backfiller_bcard_t::intro_2_t,
     end_session_mailbox, ack_items_mailbox, num_changes_estimate, distribution_counts,
     distribution_counts_sum);
 
-RDB_IMPL_SERIALIZABLE_7_FOR_CLUSTER(backfiller_bcard_t::intro_1_t,
+RDB_IMPL_SERIALIZABLE_8_FOR_CLUSTER(backfiller_bcard_t::intro_1_t,
     config, initial_version, initial_version_history, intro_mailbox, items_mailbox,
-    ack_end_session_mailbox, ack_pre_items_mailbox);
+    ack_end_session_mailbox, ack_pre_items_mailbox, digests_mailbox);
 
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(backfiller_bcard_t, region, registrar);
 RDB_IMPL_EQUALITY_COMPARABLE_2(backfiller_bcard_t, region, registrar);
@@ -26,6 +26,22 @@ public:
     backfiller to the backfillee. */
     size_t item_chunk_mem_size;
 
+    /* The maximum amount of RAM that can be used on the backfiller for items that have
+    been read from the store ahead of time but not sent yet. */
+    size_t item_prefetch_mem_size;
+
+    /* The number of disjoint sub-ranges of the key-space that the backfiller reads
+    items from concurrently. */
+    size_t item_parallel_ranges;
+
+    /* If `compare_digests` is `true`, the backfiller asks the backfillee for the
+    `backfill_digest_t` of each item's range before it sends the item, and leaves out the
+    values if the backfillee already has the same ones. That costs the backfillee a read
+    of the range, but it saves sending the values when the timestamps say that a range
+    changed but the data is the same, which is common after a replica has been offline
+    for a while or after an emergency repair. */
+    bool compare_digests;
+
     /* The maximum amount of RAM that can be used for the pre-items queued in memory on
     the backfiller. */
     size_t pre_item_queue_mem_size;
@@ -81,10 +97,22 @@ has ended.
 `backfill_item_seq_t`s in lexicographical order. Each message includes the corresponding
 metainfo. The backfillee applies the items to its B-tree.
 
+If `backfill_config_t::compare_digests` is set, then before sending a chunk of items the
+backfiller sends the ranges of the items to the `digests_mailbox_t` on the backfillee,
+which replies with the `backfill_digest_t` of its data in each range. The backfiller
+leaves out the values of the items whose digests match its own, and the backfillee fills
+them in from its own B-tree when it applies the items.
+
+The backfiller doesn't wait for the backfillee between chunks; it reads chunks for
+several sub-ranges of the key-space ahead of time, and keeps sending them for as long as
+the flow control in step 3 allows. But it always sends them in order.
+
 3. As the backfillee applies each item, it sends messages to the `ack_items_mailbox_t` on
 the backfiller. The backfiller uses this as flow control; it limits the total mem size of
-all of the items that it has sent but not received an acknowledgement for. (Note: The
-backfillee must acknowledge every item, even if the session is interrupted.)
+all of the items that it has sent but not received an acknowledgement for. The backfillee
+acknowledges as soon as it has applied about a chunk's worth of items, so the items in
+flight are limited by memory rather than by round trips. (Note: The backfillee must
+acknowledge every item, even if the session is interrupted.)
 
 4a. The backfillee may decide to interrupt the session. It does this by sending a message
 to the `end_session_mailbox_t` on the backfiller, which responds by sending a message to
@@ -183,6 +211,19 @@ public:
         size_t
         )> ack_pre_items_mailbox_t;
 
+    /* The digest messages don't have `fifo_enforcer_write_token_t`s attached. Every
+    request comes with its own reply mailbox, and the backfillee's data in the requested
+    ranges can't change until it receives the items for them, so the order doesn't
+    matter. */
+    typedef mailbox_t<void(
+        std::vector<backfill_digest_t>
+        )> digests_reply_mailbox_t;
+
+    typedef mailbox_t<void(
+        std::vector<key_range_t>,
+        digests_reply_mailbox_t::address_t
+        )> digests_mailbox_t;
+
     class intro_1_t {
     public:
         backfill_config_t config;
@@ -192,6 +233,7 @@ public:
         items_mailbox_t::address_t items_mailbox;
         ack_end_session_mailbox_t::address_t ack_end_session_mailbox;
         ack_pre_items_mailbox_t::address_t ack_pre_items_mailbox;
+        digests_mailbox_t::address_t digests_mailbox;
     };
 
     /* This `region_t` describes the region that the backfiller applies to. Backfill
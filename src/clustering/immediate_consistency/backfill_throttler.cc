@@ -0,0 +1,9 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "clustering/immediate_consistency/backfill_throttler.hpp"
+
+#include "containers/archive/boost_types.hpp"
+
+RDB_IMPL_SERIALIZABLE_3_SINCE_v2_1(backfill_rate_config_t,
+    send_bytes_per_sec, receive_bytes_per_sec, latency_target_ms);
+RDB_IMPL_EQUALITY_COMPARABLE_3(backfill_rate_config_t,
+    send_bytes_per_sec, receive_bytes_per_sec, latency_target_ms);
@@ -11,12 +11,40 @@
 #include "concurrency/new_semaphore.hpp"
 #include "containers/scoped.hpp"
 #include "rpc/connectivity/peer_id.hpp"
+#include "rpc/semilattice/joins/macros.hpp"
+#include "rpc/serialize_macros.hpp"
 #include "threading.hpp"
 
+class store_view_t;
+
+/* `backfill_rate_config_t` describes how fast backfills are allowed to transfer data.
+The user sets it through the `backfill` row of the `rethinkdb.cluster_config` table, and
+it applies to each server separately. */
+class backfill_rate_config_t {
+public:
+    /* The default constructor doesn't limit anything. */
+    backfill_rate_config_t() { }
+
+    /* The maximum number of bytes per second that all the backfills on a server
+    together may send to other servers, or receive from other servers. If empty, there
+    is no limit. */
+    boost::optional<uint64_t> send_bytes_per_sec;
+    boost::optional<uint64_t> receive_bytes_per_sec;
+
+    /* If the average latency of the foreground reads and writes on a store that is
+    involved in a backfill rises above `latency_target_ms`, the server reduces its
+    backfill rate until the latency falls below the target again. If empty, backfills
+    don't react to the latency. */
+    boost::optional<uint64_t> latency_target_ms;
+};
+
+RDB_DECLARE_SERIALIZABLE(backfill_rate_config_t);
+RDB_DECLARE_EQUALITY_COMPARABLE(backfill_rate_config_t);
+
 /* `backfill_throttler_t` controls which backfills are allowed to run when. It can block
-backfills from starting and also preempt already-running backfills. It's abstract to make
-unit testing easier; the concrete implementation used in production is always
-`standard_backfill_throttler_t`. */
+backfills from starting and also preempt already-running backfills. It also controls how
+fast the running backfills may go. It's abstract to make unit testing easier; the
+concrete implementation used in production is always `standard_backfill_throttler_t`. */
 
 class backfill_throttler_t : public home_thread_mixin_t {
 public:
@@ -67,6 +95,20 @@ public:
         cond_t preempt_signal;
     };
 
+    enum class direction_t { SEND, RECEIVE };
+
+    /* The backfiller calls `limit_rate()` before it sends a chunk of `bytes` bytes read
+    from `store`, and the backfillee calls it before it lets the backfiller send it
+    another `bytes` bytes to write to `store`. It blocks for as long as necessary to
+    keep the backfills within their rate limits. It must be called on `store`'s home
+    thread. By default it doesn't limit anything. */
+    virtual void limit_rate(
+            UNUSED direction_t direction,
+            UNUSED size_t bytes,
+            UNUSED store_view_t *store,
+            UNUSED signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) { }
+
 protected:
     friend class lock_t;
 
@@ -7,8 +7,9 @@
 #include "concurrency/wait_any.hpp"
 
 /* `ITEM_ACK_INTERVAL_MS` controls how often we send acknowledgements back to the
-backfiller. If it's too short, we'll waste resources sending lots of tiny
-acknowledgements; if it's too long, the pipeline might stall. */
+backfiller if we consume less than a chunk's worth of items in between. If it's too
+short, we'll waste resources sending lots of tiny acknowledgements; if it's too long, the
+pipeline might stall. */
 static const int ITEM_ACK_INTERVAL_MS = 100;
 
 /* `backfillee_t::session_t` contains all the bits and pieces for managing a single
@@ -96,7 +97,7 @@ private:
                     items, or else we'd wait forever. This also ensures that if we're
                     ending the session, we'll ack every item instead of leaking semaphore
                     credits. */
-                    send_ack_items();
+                    send_ack_items(keepalive.get_drain_signal());
 
                     if (got_ack_end_session.is_pulsed()) {
                         /* The callback returned false, so we sent an end-session message
@@ -129,7 +130,8 @@ private:
                 range or we run out of items */
                 class producer_t : public store_view_t::backfill_item_producer_t {
                 public:
-                    explicit producer_t(session_t *_parent) : parent(_parent) {
+                    explicit producer_t(session_t *_parent) :
+                            parent(_parent), pulse_to_ack(nullptr) {
                         coro_t::spawn_sometime(std::bind(
                             &producer_t::ack_periodically, this, drainer.lock()));
                     }
@@ -144,6 +146,9 @@ private:
                             *is_item_out = true;
                             *item_out = parent->items.front();
                             parent->items.pop_front();
+                            if (pulse_to_ack != nullptr && should_ack()) {
+                                pulse_to_ack->pulse_if_not_already_pulsed();
+                            }
                             return continue_bool_t::CONTINUE;
                         } else if (!parent->items.empty_domain()) {
                             /* There aren't any more items left in the queue, but there's
@@ -204,21 +209,42 @@ private:
                         parent->threshold = new_threshold;
                     }
                 private:
+                    /* `should_ack()` returns `true` if we've consumed at least a chunk's
+                    worth of items that we haven't acknowledged yet. */
+                    bool should_ack() const {
+                        return parent->items_mem_size_unacked
+                                - parent->items.get_mem_size()
+                            >= parent->parent->backfill_config.item_chunk_mem_size;
+                    }
                     /* `ack_periodically()` calls `session_t::send_ack_items()` every so
                     often during the backfill, so that the backfiller will keep sending
                     us items as they consume them and so ideally the `items` queue won't
-                    ever bottom out before we're done. */
+                    ever bottom out before we're done. It doesn't wait for the interval
+                    to run out if we've consumed a whole chunk in the meantime; otherwise
+                    the interval would be added to every round trip. */
                     void ack_periodically(auto_drainer_t::lock_t keepalive2) {
                         try {
                             while (true) {
-                                nap(ITEM_ACK_INTERVAL_MS, keepalive2.get_drain_signal());
-                                parent->send_ack_items();
+                                if (!should_ack()) {
+                                    signal_timer_t timer(ITEM_ACK_INTERVAL_MS);
+                                    cond_t cond;
+                                    assignment_sentry_t<cond_t *> sentry(
+                                        &pulse_to_ack, &cond);
+                                    wait_any_t waiter(&timer, &cond);
+                                    wait_interruptible(
+                                        &waiter, keepalive2.get_drain_signal());
+                                }
+                                parent->send_ack_items(
+                                    keepalive2.get_drain_signal());
                             }
                         } catch (const interrupted_exc_t &) {
                             /* ignore */
                         }
                     }
                     session_t *parent;
+                    /* `ack_periodically()` puts a `cond_t` here while it waits.
+                    `next_item()` pulses it once `should_ack()` returns `true`. */
+                    cond_t *pulse_to_ack;
                     auto_drainer_t drainer;
                 } producer(this);
 
@@ -231,7 +257,7 @@ private:
 
             /* Make sure that we acknowledged every single item that the backfiller sent
             us */
-            send_ack_items();
+            send_ack_items(keepalive.get_drain_signal());
 
             if (!callback_returned_false) {
                 /* Do the handshake to end the session. It's a little bit redundant in
@@ -257,12 +283,17 @@ private:
 
     /* `send_ack_items()` lets the backfiller know the total mem size of the items we've
     consumed since the last call to `send_ack_items()`, so it knows when it's safe to
-    send more items. */
-    void send_ack_items() {
+    send more items. Since the backfiller can't have more than a fixed amount of items
+    in flight, delaying the acknowledgement is how we limit the rate at which we receive
+    backfills. */
+    void send_ack_items(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         guarantee(items_mem_size_unacked >= items.get_mem_size());
         size_t diff = items_mem_size_unacked - items.get_mem_size();
         if (diff != 0) {
             items_mem_size_unacked -= diff;
+            parent->backfill_throttler->limit_rate(
+                backfill_throttler_t::direction_t::RECEIVE, diff, parent->store,
+                interruptor);
             send(parent->mailbox_manager, parent->intro.ack_items_mailbox,
                 parent->fifo_source.enter_write(), diff);
         }
@@ -324,12 +355,14 @@ backfillee_t::backfillee_t(
         store_view_t *_store,
         const backfiller_bcard_t &backfiller,
         const backfill_config_t &_backfill_config,
+        backfill_throttler_t *_backfill_throttler,
         backfill_progress_tracker_t::progress_tracker_t *_progress_tracker,
         signal_t *interruptor) :
     mailbox_manager(_mailbox_manager),
     branch_history_manager(_branch_history_manager),
     store(_store),
     backfill_config(_backfill_config),
+    backfill_throttler(_backfill_throttler),
     progress_tracker(_progress_tracker),
     pre_item_throttler(backfill_config.pre_item_queue_mem_size),
     pre_item_throttler_acq(&pre_item_throttler, 0),
@@ -340,7 +373,9 @@ backfillee_t::backfillee_t(
     ack_end_session_mailbox(mailbox_manager,
         std::bind(&backfillee_t::on_ack_end_session, this, ph::_1, ph::_2)),
     ack_pre_items_mailbox(mailbox_manager,
-        std::bind(&backfillee_t::on_ack_pre_items, this, ph::_1, ph::_2, ph::_3))
+        std::bind(&backfillee_t::on_ack_pre_items, this, ph::_1, ph::_2, ph::_3)),
+    digests_mailbox(mailbox_manager,
+        std::bind(&backfillee_t::on_digests, this, ph::_1, ph::_2, ph::_3))
 {
     guarantee(region_is_superset(backfiller.region, store->get_region()));
     guarantee(store->get_region().beg == backfiller.region.beg);
@@ -351,6 +386,7 @@ backfillee_t::backfillee_t(
     our_intro.ack_pre_items_mailbox = ack_pre_items_mailbox.get_address();
     our_intro.items_mailbox = items_mailbox.get_address();
     our_intro.ack_end_session_mailbox = ack_end_session_mailbox.get_address();
+    our_intro.digests_mailbox = digests_mailbox.get_address();
 
     /* Fetch the `initial_version` and `initial_version_history` fields for the
     `intro_1_t` that we'll send to the backfiller */
@@ -535,3 +571,12 @@ void backfillee_t::on_ack_pre_items(
     pre_item_throttler_acq.change_count(pre_item_throttler_acq.count() - mem_size);
 }
 
+
+void backfillee_t::on_digests(
+        signal_t *interruptor,
+        const std::vector<key_range_t> &ranges,
+        const backfiller_bcard_t::digests_reply_mailbox_t::address_t &reply_mailbox) {
+    std::vector<backfill_digest_t> digests;
+    store->compute_backfill_digests(ranges, &digests, interruptor);
+    send(mailbox_manager, reply_mailbox, digests);
+}
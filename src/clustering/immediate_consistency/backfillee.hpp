@@ -5,6 +5,7 @@
 #include "clustering/generic/registrant.hpp"
 #include "clustering/immediate_consistency/history.hpp"
 #include "clustering/immediate_consistency/backfill_metadata.hpp"
+#include "clustering/immediate_consistency/backfill_throttler.hpp"
 #include "clustering/table_manager/backfill_progress_tracker.hpp"
 #include "concurrency/new_mutex.hpp"
 #include "rpc/connectivity/peer_id.hpp"
@@ -65,6 +66,7 @@ public:
         store_view_t *_store,
         const backfiller_bcard_t &backfiller,
         const backfill_config_t &backfill_config,
+        backfill_throttler_t *backfill_throttler,
         backfill_progress_tracker_t::progress_tracker_t *progress_tracker,
         signal_t *interruptor);
     ~backfillee_t();
@@ -90,8 +92,8 @@ public:
         signal_t *interruptor) THROWS_ONLY(interrupted_exc_t);
 
 private:
-    /* `on_items()`, `on_ack_end_session()`, and `on_ack_pre_items()` are mailbox
-    callbacks. */
+    /* `on_items()`, `on_ack_end_session()`, `on_ack_pre_items()`, and `on_digests()` are
+    mailbox callbacks. */
 
     void on_items(
         signal_t *interruptor,
@@ -114,10 +116,18 @@ private:
         const fifo_enforcer_write_token_t &fifo_token,
         size_t chunk_size);
 
+    /* `on_digests()` computes the digests that the backfiller asks for and sends them
+    back to `reply_mailbox`. */
+    void on_digests(
+        signal_t *interruptor,
+        const std::vector<key_range_t> &ranges,
+        const backfiller_bcard_t::digests_reply_mailbox_t::address_t &reply_mailbox);
+
     mailbox_manager_t *const mailbox_manager;
     branch_history_manager_t *const branch_history_manager;
     store_view_t *const store;
     backfill_config_t const backfill_config;
+    backfill_throttler_t *const backfill_throttler;
     backfill_progress_tracker_t::progress_tracker_t *const progress_tracker;
 
     backfiller_bcard_t::intro_2_t intro;
@@ -151,6 +161,7 @@ private:
     backfiller_bcard_t::items_mailbox_t items_mailbox;
     backfiller_bcard_t::ack_end_session_mailbox_t ack_end_session_mailbox;
     backfiller_bcard_t::ack_pre_items_mailbox_t ack_pre_items_mailbox;
+    backfiller_bcard_t::digests_mailbox_t digests_mailbox;
     scoped_ptr_t<registrant_t<backfiller_bcard_t::intro_1_t> > registrant;
 };
 
@@ -1,16 +1,26 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "clustering/immediate_consistency/backfiller.hpp"
 
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "clustering/immediate_consistency/backfill_throttler.hpp"
 #include "clustering/immediate_consistency/history.hpp"
+#include "concurrency/promise.hpp"
+#include "containers/map_sentries.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "store_view.hpp"
 
 backfiller_t::backfiller_t(
         mailbox_manager_t *_mailbox_manager,
         branch_history_manager_t *_branch_history_manager,
+        backfill_throttler_t *_backfill_throttler,
         store_view_t *_store) :
     mailbox_manager(_mailbox_manager),
     branch_history_manager(_branch_history_manager),
+    backfill_throttler(_backfill_throttler),
     store(_store),
     registrar(mailbox_manager, this)
     { }
@@ -22,6 +32,7 @@ backfiller_t::client_t::client_t(
     parent(_parent),
     intro(_intro),
     full_region(intro.initial_version.get_domain()),
+    compare_digests(false),
     pre_items(full_region.beg, full_region.end,
         key_range_t::right_bound_t(full_region.inner.left)),
     item_throttler(intro.config.item_queue_mem_size),
@@ -86,8 +97,8 @@ backfiller_t::client_t::client_t(
     }
 
     /* Fetch the key distribution from the store, this is used by the backfillee to
-    calculate the progress of backfill jobs. */
-    std::map<store_key_t, int64_t> distribution_counts;
+    calculate the progress of backfill jobs and by the sessions to split their key range
+    into sub-ranges. */
     int64_t distribution_counts_sum = 0;
     {
         static const int max_depth = 2;
@@ -118,6 +129,15 @@ backfiller_t::client_t::client_t(
         }
     }
 
+    if (intro.config.compare_digests) {
+        intro.initial_version.visit(full_region,
+        [&](const region_t &, const version_t &version) {
+            if (version.timestamp != state_timestamp_t::zero()) {
+                compare_digests = true;
+            }
+        });
+    }
+
     /* Estimate the total number of changes that will need to be backfilled, by comparing
     `our_version`, `intro.initial_version`, and `common_version`. We estimate the number
     of changes as the largest version difference. In theory we could be smarter by
@@ -147,7 +167,7 @@ backfiller_t::client_t::client_t(
     our_intro.end_session_mailbox = end_session_mailbox.get_address();
     our_intro.ack_items_mailbox = ack_items_mailbox.get_address();
     our_intro.num_changes_estimate = num_changes_estimate;
-    our_intro.distribution_counts = std::move(distribution_counts);
+    our_intro.distribution_counts = distribution_counts;
     our_intro.distribution_counts_sum = distribution_counts_sum;
     send(parent->mailbox_manager, intro.intro_mailbox, our_intro);
 }
@@ -240,15 +260,94 @@ private:
     key_range_t::right_bound_t last_cursor;
 };
 
+/* Returns a copy of the part of `pre_items` between `left` and `right`. */
+static backfill_item_seq_t<backfill_pre_item_t> copy_pre_items(
+        const backfill_item_seq_t<backfill_pre_item_t> &pre_items,
+        const key_range_t::right_bound_t &left,
+        const key_range_t::right_bound_t &right) {
+    guarantee(pre_items.get_left_key() <= left);
+    guarantee(right <= pre_items.get_right_key());
+    guarantee(left < right);
+    key_range_t mask;
+    mask.left = left.key();
+    mask.right = right;
+    backfill_item_seq_t<backfill_pre_item_t> copy(
+        pre_items.get_beg_hash(), pre_items.get_end_hash(), left);
+    for (const backfill_pre_item_t &pre_item : pre_items) {
+        if (pre_item.range.right <= left) {
+            continue;
+        }
+        if (key_range_t::right_bound_t(pre_item.range.left) >= right) {
+            break;
+        }
+        backfill_pre_item_t masked = pre_item;
+        masked.mask_in_place(mask);
+        copy.push_back(std::move(masked));
+    }
+    copy.push_back_nothing(right);
+    return copy;
+}
+
+/* `split_backfill_range()` divides the key-space between `left` and `right` into at
+most `max_ranges` sub-ranges with roughly the same number of keys in each, according to
+`distribution_counts` (which holds partial sums, as computed in the `client_t`
+constructor). It returns the right-hand bound of each sub-range, from left to right; the
+last one is always `right`. */
+static std::vector<key_range_t::right_bound_t> split_backfill_range(
+        const key_range_t::right_bound_t &left,
+        const key_range_t::right_bound_t &right,
+        const std::map<store_key_t, int64_t> &distribution_counts,
+        size_t max_ranges) {
+    std::vector<key_range_t::right_bound_t> bounds;
+    if (max_ranges > 1 && !left.unbounded) {
+        int64_t base = 0;
+        auto it = distribution_counts.upper_bound(left.key());
+        if (it != distribution_counts.begin()) {
+            base = std::prev(it)->second;
+        }
+        std::vector<std::pair<store_key_t, int64_t> > inside;
+        for (; it != distribution_counts.end()
+                && key_range_t::right_bound_t(it->first) < right; ++it) {
+            inside.push_back(*it);
+        }
+        if (!inside.empty()) {
+            int64_t total = inside.back().second - base;
+            size_t next = 1;
+            for (const auto &pair : inside) {
+                if (next == max_ranges) {
+                    break;
+                }
+                if ((pair.second - base) * static_cast<int64_t>(max_ranges)
+                        >= total * static_cast<int64_t>(next)) {
+                    bounds.push_back(key_range_t::right_bound_t(pair.first));
+                    ++next;
+                }
+            }
+        }
+    }
+    bounds.push_back(right);
+    return bounds;
+}
+
 /* When the `client_t` receives a begin-session message from the backfillee, it creates a
 `session_t`. The `session_t` is responsible for sending items to the backfillee. When the
 session is over, the backfillee will send an end-session message to the `client_t`, which
 will destroy the `session_t` and then send an ack-end-session message back to the
-backfillee. */
+backfillee.
+
+Reading the items from the store and sending them over the network are pipelined. The
+session's key range is split into up to `item_parallel_ranges` disjoint sub-ranges, and
+a separate coroutine reads chunks from each sub-range into memory, up to a total of
+`item_prefetch_mem_size` bytes. `run()` sends the chunks to the backfillee strictly from
+left to right, and reads a chunk again if it's older than the chunks to its left, so the
+backfillee doesn't notice the difference. This way the disk reads for several parts of
+the key range overlap with each other and with the network round trips, which matters a
+lot when the backfiller and backfillee are far apart. */
 class backfiller_t::client_t::session_t {
 public:
     session_t(client_t *_parent, const key_range_t::right_bound_t &_threshold) :
-        parent(_parent), threshold(_threshold), pulse_when_pre_items_arrive(nullptr)
+        parent(_parent), threshold(_threshold),
+        sent_timestamp(state_timestamp_t::zero()), pulse_when_chunk_ready(nullptr)
     {
         guarantee(parent->pre_items.empty_of_items() ||
             key_range_t::right_bound_t(parent->pre_items.front().range.left)
@@ -261,124 +360,129 @@ public:
     /* Every time the `client_t` receives more pre-items from the backfillee, it calls
     `on_pre_items()` to notify us. */
     void on_pre_items() {
-        if (pulse_when_pre_items_arrive != nullptr) {
-            pulse_when_pre_items_arrive->pulse_if_not_already_pulsed();
+        for (cond_t *cond : pulse_when_pre_items_arrive) {
+            cond->pulse_if_not_already_pulsed();
         }
     }
 
 private:
+    /* A `chunk_t` is a chunk of items that has been read from the store but not yet
+    sent to the backfillee. */
+    class chunk_t {
+    public:
+        chunk_t(
+                backfill_item_seq_t<backfill_item_t> &&_items,
+                region_map_t<version_t> &&_metainfo,
+                new_semaphore_acq_t &&_prefetch_acq) :
+            items(std::move(_items)),
+            metainfo(std::move(_metainfo)),
+            prefetch_acq(std::move(_prefetch_acq)) { }
+        backfill_item_seq_t<backfill_item_t> items;
+        region_map_t<version_t> metainfo;
+        /* `prefetch_acq` holds the sub-range's `prefetch_throttler` for the mem size of
+        `items` until the chunk has been sent. */
+        new_semaphore_acq_t prefetch_acq;
+    };
+
+    /* A `range_t` is one of the sub-ranges that `read_ahead()` reads concurrently. */
+    class range_t {
+    public:
+        range_t(
+                const key_range_t::right_bound_t &_left,
+                const key_range_t::right_bound_t &_right,
+                size_t prefetch_mem_size) :
+            cursor(_left),
+            right(_right),
+            prefetch_throttler(std::max<int64_t>(prefetch_mem_size, 1)),
+            done(false) { }
+
+        /* `cursor` is how far `read_ahead()` has read; it moves from the left-hand
+        bound of the sub-range to `right`. */
+        key_range_t::right_bound_t cursor;
+        key_range_t::right_bound_t const right;
+
+        /* `prefetch_throttler` limits the total mem size of `chunks`. Every sub-range
+        has its own, so that the sub-ranges further right can't use up the memory that
+        the sub-range `run()` is waiting for. */
+        new_semaphore_t prefetch_throttler;
+
+        /* `chunks` are the chunks that have been read but not sent yet, from left to
+        right. `done` is set once `cursor` has reached `right`. */
+        std::deque<chunk_t> chunks;
+        bool done;
+    };
+
+    /* `run()` runs in a separate coroutine for the duration of the session's existence.
+    It starts `read_ahead()` for every sub-range and then sends the chunks that they
+    produce to the backfillee in order. */
     void run(auto_drainer_t::lock_t keepalive) {
         with_priority_t p(CORO_PRIORITY_BACKFILL_SENDER);
         try {
-            while (threshold != parent->full_region.inner.right) {
+            if (threshold == parent->full_region.inner.right) {
+                return;
+            }
+            std::vector<key_range_t::right_bound_t> bounds = split_backfill_range(
+                threshold, parent->full_region.inner.right,
+                parent->distribution_counts, parent->intro.config.item_parallel_ranges);
+            key_range_t::right_bound_t left = threshold;
+            for (const key_range_t::right_bound_t &bound : bounds) {
+                ranges.push_back(make_scoped<range_t>(left, bound,
+                    parent->intro.config.item_prefetch_mem_size / bounds.size()));
+                left = bound;
+            }
+            for (const auto &range : ranges) {
+                coro_t::spawn_sometime(std::bind(
+                    &session_t::read_ahead, this, range.get(), keepalive));
+            }
+
+            for (const auto &range : ranges) {
+                while (true) {
+                    while (range->chunks.empty() && !range->done) {
+                        cond_t cond;
+                        assignment_sentry_t<cond_t *> sentry(
+                            &pulse_when_chunk_ready, &cond);
+                        wait_interruptible(&cond, keepalive.get_drain_signal());
+                    }
+                    if (range->chunks.empty()) {
+                        break;
+                    }
+                    chunk_t chunk(std::move(range->chunks.front()));
+                    range->chunks.pop_front();
+                    if (min_timestamp(chunk.metainfo) < sent_timestamp) {
+                        reread_and_send_chunk(
+                            std::move(chunk), keepalive.get_drain_signal());
+                    } else {
+                        send_chunk(std::move(chunk), keepalive.get_drain_signal());
+                    }
+                }
+            }
+            guarantee(threshold == parent->full_region.inner.right);
+        } catch (const interrupted_exc_t &) {
+            /* The backfillee sent us a stop message; or the backfillee was destroyed; or
+            the backfiller was destroyed. */
+        }
+    }
+
+    /* `read_ahead()` reads chunks of items for the given sub-range from the store and
+    appends them to `range->chunks`, until it reaches the end of the sub-range. */
+    void read_ahead(range_t *range, auto_drainer_t::lock_t keepalive) {
+        with_priority_t p(CORO_PRIORITY_BACKFILL_SENDER);
+        try {
+            while (range->cursor != range->right) {
                 /* Wait until there's room in the semaphore for the chunk we're about to
                 process */
                 new_semaphore_acq_t sem_acq(
-                    &parent->item_throttler, parent->intro.config.item_chunk_mem_size);
+                    &range->prefetch_throttler,
+                    parent->intro.config.item_chunk_mem_size);
                 wait_interruptible(
                     sem_acq.acquisition_signal(), keepalive.get_drain_signal());
 
-                /* Wait until we have some pre items, or else we won't be able to make
-                any progress on the backfill */
-                while (parent->pre_items.get_right_key() == threshold) {
-                    cond_t cond;
-                    assignment_sentry_t<cond_t *> sentry(
-                        &pulse_when_pre_items_arrive, &cond);
-                    wait_interruptible(&cond, keepalive.get_drain_signal());
-                }
-
-                /* Set up a `region_t` describing the range that still needs to be
-                backfilled */
-                region_t subregion = parent->full_region;
-                subregion.inner.left = threshold.key();
-
-                /* Copy items from the store into `chunk` until the total size hits
-                `ITEM_CHUNK_SIZE`; we finish the backfill range; or we run out of
-                pre-items. */
-
                 backfill_item_seq_t<backfill_item_t> chunk(
                     parent->full_region.beg, parent->full_region.end,
-                    threshold);
+                    range->cursor);
                 region_map_t<version_t> metainfo = region_map_t<version_t>::empty();
-
-                {
-                    /* `producer` will pop items off of `parent->pre_items` as
-                    `send_backfill()` requests them, but it will restore them all when it
-                    goes out of scope. Restoring them is important because when we
-                    interrupt `send_backfill()`, it might not yet have produced items
-                    corresponding to all of the pre-items it consumed, so those pre-items
-                    might be needed again in a later call to `send_backfill()`. It's a
-                    little sketchy that `producer` modifies `pre_items` like this, but
-                    it's safe because only one `session_t` can exist at once and because
-                    `client_t::on_pre_items` only touches the right-hand end of
-                    `parent->pre_items`. */
-                    item_seq_pre_item_producer_t producer(
-                        &parent->pre_items, threshold);
-
-                    /* `consumer_t` is responsible for receiving backfill items and
-                    the corresponding metainfo from `send_backfill()` and storing them in
-                    `chunk` and in `metainfo`. */
-                    class consumer_t : public store_view_t::backfill_item_consumer_t {
-                    public:
-                        consumer_t(
-                                backfill_item_seq_t<backfill_item_t> *_chunk,
-                                region_map_t<version_t> *_metainfo,
-                                const backfill_config_t *_config) :
-                            chunk(_chunk), metainfo(_metainfo), config(_config) { }
-                        continue_bool_t on_item(
-                                const region_map_t<binary_blob_t> &item_metainfo,
-                                backfill_item_t &&item) THROWS_NOTHING {
-                            rassert(key_range_t::right_bound_t(item.range.left) >=
-                                chunk->get_right_key());
-                            rassert(!item.range.is_empty());
-                            on_metainfo(item_metainfo, item.range.right);
-                            chunk->push_back(std::move(item));
-                            if (chunk->get_mem_size() < config->item_chunk_mem_size) {
-                                return continue_bool_t::CONTINUE;
-                            } else {
-                                return continue_bool_t::ABORT;
-                            }
-                        }
-                        continue_bool_t on_empty_range(
-                                const region_map_t<binary_blob_t> &range_metainfo,
-                                const key_range_t::right_bound_t &new_threshold)
-                                THROWS_NOTHING {
-                            rassert(new_threshold >= chunk->get_right_key());
-                            on_metainfo(range_metainfo, new_threshold);
-                            chunk->push_back_nothing(new_threshold);
-                            return continue_bool_t::CONTINUE;
-                        }
-                    private:
-                        void on_metainfo(
-                                const region_map_t<binary_blob_t> &new_metainfo,
-                                const key_range_t::right_bound_t &new_threshold) {
-                            if (new_threshold == chunk->get_right_key()) {
-                                /* This is a no-op. But if `chunk->get_right_key()` is
-                                already unbounded, calling `key()` on it will crash. So
-                                the normal code path might break on certain no-ops and we
-                                should just return instead. */
-                                return;
-                            }
-                            region_t mask;
-                            mask.beg = chunk->get_beg_hash();
-                            mask.end = chunk->get_end_hash();
-                            mask.inner.left = chunk->get_right_key().key();
-                            mask.inner.right = new_threshold;
-                            metainfo->extend_keys_right(
-                                to_version_map(new_metainfo.mask(mask)));
-                        }
-                        backfill_item_seq_t<backfill_item_t> *const chunk;
-                        region_map_t<version_t> *const metainfo;
-                        backfill_config_t const *const config;
-                    } consumer(&chunk, &metainfo, &parent->intro.config);
-
-                    parent->parent->store->send_backfill(
-                        parent->common_version.mask(subregion), &producer, &consumer,
-                        keepalive.get_drain_signal());
-
-                    /* `producer` goes out of scope here, so it restores `pre_items` to
-                    what it was before */
-                }
+                read_chunk(range->cursor, range->right, &chunk, &metainfo,
+                    keepalive.get_drain_signal());
 
                 /* Check if we actually got a non-empty chunk; if we got an empty chunk
                 there's no point in sending it over the network. Note that we use
@@ -387,90 +491,304 @@ private:
                 information for the backfillee to have. */
                 if (!chunk.empty_domain()) {
                     /* Adjust for the fact that `chunk.get_mem_size()` isn't precisely
-                    equal to `ITEM_CHUNK_SIZE`, and then transfer the semaphore
-                    ownership. */
+                    equal to `item_chunk_mem_size` */
                     sem_acq.change_count(chunk.get_mem_size());
-                    parent->item_throttler_acq.transfer_in(std::move(sem_acq));
-
-                    /* Update `threshold` */
-                    guarantee(chunk.get_left_key() == threshold);
-                    threshold = chunk.get_right_key();
-
-                    /* Note: It's essential that we update `common_version` and
-                    `pre_items` if and only if we send the chunk over the network. So
-                    we shouldn't e.g. check the interruptor in between. This is because
-                    we want to make sure that `common_version` and `pre_items` accurately
-                    represent the state of the backfillee after it applies all the chunks
-                    we've sent. */
-                    try {
-                        /* Send the chunk over the network */
-                        send(parent->parent->mailbox_manager,
-                            parent->intro.items_mailbox,
-                            parent->fifo_source.enter_write(), metainfo, chunk);
-
-                        /* Update `common_version` to reflect the changes that will
-                        happen on the backfillee in response to the chunk */
-                        parent->common_version.update(
-                            metainfo.map(metainfo.get_domain(),
-                                [](const version_t &v) { return v.timestamp; }));
-
-                        /* Discard pre-items we don't need anymore. This has two
-                        purposes: it saves memory, and it keeps `pre_items` consistent
-                        with `common_version`. However, we note that the domain of the
-                        `pre_items` seq still starts at the left-hand end of the range to
-                        be backfilled, representing that there are no pre items there.
-                        This is correct because after the backfillee applies the item we
-                        just sent, it won't have any divergent data relative to us in
-                        that region. */
-                        size_t old_size = parent->pre_items.get_mem_size();
-                        parent->pre_items.delete_to_key(threshold);
-                        parent->pre_items.push_front_nothing(
-                            key_range_t::right_bound_t(parent->full_region.inner.left));
-                        size_t new_size = parent->pre_items.get_mem_size();
-
-                        /* Notify the backfiller that it's OK to send us more pre items.
-
-                        Note that the way we acknowledge pre-items is different from how
-                        the backfillee acknowledges items; the backfillee acknowledges
-                        items periodically during the call to `receive_backfill()`, but
-                        we wait until after `send_backfill()` returns to acknowledge the
-                        pre-items. This way of doing things is simpler; the reason we
-                        can't do things the same way in the backfillee is because the
-                        call to `receive_backfill()` might run for a long time, but our
-                        call to `send_backfill()` will only go until it fills up the
-                        chunk. */
-                        if (old_size != new_size) {
-                            send(parent->parent->mailbox_manager,
-                                parent->intro.ack_pre_items_mailbox,
-                                parent->fifo_source.enter_write(), old_size - new_size);
-                        }
-                    } catch (const interrupted_exc_t &) {
-                        /* This is just a sanity check in case someone unthinkingly makes
-                        something interruptible in the above code block */
-                        crash("We shouldn't be interrupted during this block");
+
+                    guarantee(chunk.get_left_key() == range->cursor);
+                    range->cursor = chunk.get_right_key();
+                    range->chunks.push_back(chunk_t(
+                        std::move(chunk), std::move(metainfo), std::move(sem_acq)));
+                    if (pulse_when_chunk_ready != nullptr) {
+                        pulse_when_chunk_ready->pulse_if_not_already_pulsed();
                     }
                 }
             }
+            range->done = true;
+            if (pulse_when_chunk_ready != nullptr) {
+                pulse_when_chunk_ready->pulse_if_not_already_pulsed();
+            }
         } catch (const interrupted_exc_t &) {
-            /* The backfillee sent us a stop message; or the backfillee was destroyed; or
-            the backfiller was destroyed. */
+            /* The session is being destroyed */
+        }
+    }
+
+    /* `read_chunk()` reads the items between `left` and `right` from the store into
+    `*chunk_out`, which must start at `left`, and their metainfo into `*metainfo_out`. */
+    void read_chunk(
+            const key_range_t::right_bound_t &left,
+            const key_range_t::right_bound_t &right,
+            backfill_item_seq_t<backfill_item_t> *chunk_out,
+            region_map_t<version_t> *metainfo_out,
+            signal_t *interruptor) {
+        /* Wait until we have some pre items for this part of the key-space, or
+        else we won't be able to make any progress on the backfill */
+        while (parent->pre_items.get_right_key() <= left) {
+            cond_t cond;
+            set_insertion_sentry_t<cond_t *> sentry(
+                &pulse_when_pre_items_arrive, &cond);
+            wait_interruptible(&cond, interruptor);
+        }
+
+        /* Set up a `region_t` describing the part of the sub-range that still
+        needs to be read */
+        region_t subregion = parent->full_region;
+        subregion.inner.left = left.key();
+        subregion.inner.right = right;
+
+        /* Copy items from the store into `*chunk_out` until the total size hits
+        `item_chunk_mem_size`; we reach `right`; or we run out of pre-items. */
+        {
+            /* Several sub-ranges are read at once, so each of them works on its
+            own copy of the pre-items. `parent->pre_items` only changes when a
+            chunk is sent. */
+            backfill_item_seq_t<backfill_pre_item_t> pre_items = copy_pre_items(
+                parent->pre_items, left,
+                std::min(right, parent->pre_items.get_right_key()));
+            item_seq_pre_item_producer_t producer(&pre_items, left);
+
+            /* `consumer_t` is responsible for receiving backfill items and
+            the corresponding metainfo from `send_backfill()` and storing them in
+            `*chunk_out` and in `*metainfo_out`. */
+            class consumer_t : public store_view_t::backfill_item_consumer_t {
+            public:
+                consumer_t(
+                        backfill_item_seq_t<backfill_item_t> *_chunk,
+                        region_map_t<version_t> *_metainfo,
+                        const backfill_config_t *_config) :
+                    chunk(_chunk), metainfo(_metainfo), config(_config) { }
+                continue_bool_t on_item(
+                        const region_map_t<binary_blob_t> &item_metainfo,
+                        backfill_item_t &&item) THROWS_NOTHING {
+                    rassert(key_range_t::right_bound_t(item.range.left) >=
+                        chunk->get_right_key());
+                    rassert(!item.range.is_empty());
+                    on_metainfo(item_metainfo, item.range.right);
+                    chunk->push_back(std::move(item));
+                    if (chunk->get_mem_size() < config->item_chunk_mem_size) {
+                        return continue_bool_t::CONTINUE;
+                    } else {
+                        return continue_bool_t::ABORT;
+                    }
+                }
+                continue_bool_t on_empty_range(
+                        const region_map_t<binary_blob_t> &range_metainfo,
+                        const key_range_t::right_bound_t &new_threshold)
+                        THROWS_NOTHING {
+                    rassert(new_threshold >= chunk->get_right_key());
+                    on_metainfo(range_metainfo, new_threshold);
+                    chunk->push_back_nothing(new_threshold);
+                    return continue_bool_t::CONTINUE;
+                }
+            private:
+                void on_metainfo(
+                        const region_map_t<binary_blob_t> &new_metainfo,
+                        const key_range_t::right_bound_t &new_threshold) {
+                    if (new_threshold == chunk->get_right_key()) {
+                        /* This is a no-op. But if `chunk->get_right_key()` is
+                        already unbounded, calling `key()` on it will crash. So
+                        the normal code path might break on certain no-ops and we
+                        should just return instead. */
+                        return;
+                    }
+                    region_t mask;
+                    mask.beg = chunk->get_beg_hash();
+                    mask.end = chunk->get_end_hash();
+                    mask.inner.left = chunk->get_right_key().key();
+                    mask.inner.right = new_threshold;
+                    metainfo->extend_keys_right(
+                        to_version_map(new_metainfo.mask(mask)));
+                }
+                backfill_item_seq_t<backfill_item_t> *const chunk;
+                region_map_t<version_t> *const metainfo;
+                backfill_config_t const *const config;
+            } consumer(chunk_out, metainfo_out, &parent->intro.config);
+
+            parent->parent->store->send_backfill(
+                parent->common_version.mask(subregion), &producer, &consumer,
+                interruptor);
+        }
+
+        omit_matching_values(chunk_out, interruptor);
+    }
+
+    /* `omit_matching_values()` asks the backfillee for the digest of the range of every
+    item in `*items` that has any values, and omits the values of the items whose
+    digests match ours. The backfillee then uses its own copies of the values. Its data
+    in these ranges can't change before it applies the items, because nothing writes to
+    the part of its key range that it hasn't received items for yet. */
+    void omit_matching_values(
+            backfill_item_seq_t<backfill_item_t> *items,
+            signal_t *interruptor) {
+        if (!parent->compare_digests) {
+            return;
+        }
+        std::vector<key_range_t> ranges;
+        std::vector<backfill_digest_t> our_digests;
+        for (const backfill_item_t &item : *items) {
+            backfill_digest_t digest = item.get_digest();
+            if (digest.num_pairs != 0) {
+                ranges.push_back(item.range);
+                our_digests.push_back(digest);
+            }
+        }
+        if (ranges.empty()) {
+            return;
+        }
+
+        promise_t<std::vector<backfill_digest_t> > their_digests;
+        backfiller_bcard_t::digests_reply_mailbox_t reply_mailbox(
+            parent->parent->mailbox_manager,
+            [&](signal_t *, const std::vector<backfill_digest_t> &digests) {
+                their_digests.pulse(digests);
+            });
+        send(parent->parent->mailbox_manager, parent->intro.digests_mailbox,
+            ranges, reply_mailbox.get_address());
+        wait_interruptible(their_digests.get_ready_signal(), interruptor);
+        std::vector<backfill_digest_t> digests = their_digests.assert_get_value();
+        guarantee(digests.size() == ranges.size());
+
+        size_t i = 0;
+        items->modify_items([&](backfill_item_t *item) {
+            if (i < ranges.size() && item->range == ranges[i]) {
+                if (our_digests[i] == digests[i]) {
+                    item->omit_values();
+                }
+                ++i;
+            }
+        });
+        guarantee(i == ranges.size());
+    }
+
+    /* A chunk from a sub-range other than the leftmost one may have been read before
+    some of the chunks to its left, so its items can be older than the ones the
+    backfillee already has to its left. But the backfillee needs the timestamps to
+    increase from left to right, or it can't tell which streaming writes to apply where
+    (see `timestamp_range_tracker_t` in `remote_replicator_client.cc`). So instead of
+    sending such a chunk, `reread_and_send_chunk()` reads its part of the key range
+    again and sends that. The new reads happen after everything to their left has been
+    read, so they can't be older. */
+    void reread_and_send_chunk(chunk_t &&stale_chunk, signal_t *interruptor) {
+        guarantee(stale_chunk.items.get_left_key() == threshold);
+        const key_range_t::right_bound_t right = stale_chunk.items.get_right_key();
+        while (threshold != right) {
+            backfill_item_seq_t<backfill_item_t> items(
+                parent->full_region.beg, parent->full_region.end, threshold);
+            region_map_t<version_t> metainfo = region_map_t<version_t>::empty();
+            read_chunk(threshold, right, &items, &metainfo, interruptor);
+            if (!items.empty_domain()) {
+                send_chunk(
+                    chunk_t(std::move(items), std::move(metainfo), new_semaphore_acq_t()),
+                    interruptor);
+            }
+        }
+    }
+
+    static state_timestamp_t min_timestamp(const region_map_t<version_t> &metainfo) {
+        state_timestamp_t res = state_timestamp_t::max();
+        metainfo.visit(metainfo.get_domain(),
+        [&](const region_t &, const version_t &version) {
+            res = std::min(res, version.timestamp);
+        });
+        return res;
+    }
+
+    /* `send_chunk()` sends the next chunk to the backfillee. The chunk must start at
+    `threshold`. */
+    void send_chunk(chunk_t &&chunk, signal_t *interruptor) {
+        /* Stay within the rate limit for sending backfills */
+        parent->parent->backfill_throttler->limit_rate(
+            backfill_throttler_t::direction_t::SEND, chunk.items.get_mem_size(),
+            parent->parent->store, interruptor);
+
+        /* Wait until there's room in the backfillee's queue for the chunk, and then
+        transfer the semaphore ownership. */
+        new_semaphore_acq_t sem_acq(&parent->item_throttler, chunk.items.get_mem_size());
+        wait_interruptible(sem_acq.acquisition_signal(), interruptor);
+        parent->item_throttler_acq.transfer_in(std::move(sem_acq));
+
+        /* Update `threshold` */
+        guarantee(chunk.items.get_left_key() == threshold);
+        threshold = chunk.items.get_right_key();
+
+        /* Note: It's essential that we update `common_version` and `pre_items` if and
+        only if we send the chunk over the network. So we shouldn't e.g. check the
+        interruptor in between. This is because we want to make sure that
+        `common_version` and `pre_items` accurately represent the state of the
+        backfillee after it applies all the chunks we've sent. */
+        try {
+            /* Send the chunk over the network */
+            send(parent->parent->mailbox_manager,
+                parent->intro.items_mailbox,
+                parent->fifo_source.enter_write(), chunk.metainfo, chunk.items);
+
+            chunk.metainfo.visit(chunk.metainfo.get_domain(),
+            [&](const region_t &, const version_t &version) {
+                sent_timestamp = std::max(sent_timestamp, version.timestamp);
+            });
+
+            /* Update `common_version` to reflect the changes that will happen on the
+            backfillee in response to the chunk */
+            parent->common_version.update(
+                chunk.metainfo.map(chunk.metainfo.get_domain(),
+                    [](const version_t &v) { return v.timestamp; }));
+
+            /* Discard pre-items we don't need anymore. This has two purposes: it saves
+            memory, and it keeps `pre_items` consistent with `common_version`. However,
+            we note that the domain of the `pre_items` seq still starts at the left-hand
+            end of the range to be backfilled, representing that there are no pre items
+            there. This is correct because after the backfillee applies the item we just
+            sent, it won't have any divergent data relative to us in that region. */
+            size_t old_size = parent->pre_items.get_mem_size();
+            parent->pre_items.delete_to_key(threshold);
+            parent->pre_items.push_front_nothing(
+                key_range_t::right_bound_t(parent->full_region.inner.left));
+            size_t new_size = parent->pre_items.get_mem_size();
+
+            /* Notify the backfiller that it's OK to send us more pre items.
+
+            Note that the way we acknowledge pre-items is different from how the
+            backfillee acknowledges items; the backfillee acknowledges items periodically
+            during the call to `receive_backfill()`, but we wait until the chunk is sent
+            to acknowledge the pre-items. This way of doing things is simpler; the reason
+            we can't do things the same way in the backfillee is because the call to
+            `receive_backfill()` might run for a long time, but our call to
+            `send_backfill()` will only go until it fills up the chunk. */
+            if (old_size != new_size) {
+                send(parent->parent->mailbox_manager,
+                    parent->intro.ack_pre_items_mailbox,
+                    parent->fifo_source.enter_write(), old_size - new_size);
+            }
+        } catch (const interrupted_exc_t &) {
+            /* This is just a sanity check in case someone unthinkingly makes something
+            interruptible in the above code block */
+            crash("We shouldn't be interrupted during this block");
         }
     }
 
     client_t *const parent;
 
-    /* This is the current location we've backfilled up to. Initially it's set to the
+    /* This is the current location we've sent items up to. Initially it's set to the
     point that the backfillee sent us with the begin-session message, and it moves right
     from there. */
     key_range_t::right_bound_t threshold;
 
-    /* This exists if we're waiting for more pre items. `on_pre_items()` pulses it if it
-    exists. */
-    cond_t *pulse_when_pre_items_arrive;
+    /* This is the highest timestamp in the metainfo of the chunks we've sent so far. A
+    chunk with older metainfo must be read again before it's sent. */
+    state_timestamp_t sent_timestamp;
+
+    /* The sub-ranges of the session's key range, from left to right */
+    std::vector<scoped_ptr_t<range_t> > ranges;
+
+    /* These are the `read_ahead()` calls that are waiting for more pre items.
+    `on_pre_items()` pulses all of them. */
+    std::set<cond_t *> pulse_when_pre_items_arrive;
+
+    /* This exists if `run()` is waiting for `read_ahead()` to produce another chunk. */
+    cond_t *pulse_when_chunk_ready;
 
     /* Destructor order matters here: `drainer` must be destroyed before the other member
-    variables because `drainer` stops `run()`, which accesses the other member
-    variables. */
+    variables because `drainer` stops `run()` and `read_ahead()`, which access the other
+    member variables. */
     auto_drainer_t drainer;
 };
 
@@ -11,6 +11,7 @@
 #include "store_view.hpp"
 
 class backfill_progress_tracker_t;
+class backfill_throttler_t;
 
 /* `backfiller_t` is responsible for copying the given store's state to other servers via
 `backfillee_t`.
@@ -26,6 +27,7 @@ class backfiller_t : public home_thread_mixin_debug_only_t {
 public:
     backfiller_t(mailbox_manager_t *_mailbox_manager,
                  branch_history_manager_t *_branch_history_manager,
+                 backfill_throttler_t *_backfill_throttler,
                  store_view_t *_store);
 
     backfiller_bcard_t get_business_card() {
@@ -70,6 +72,16 @@ private:
         same as `intro.initial_version.get_domain()`. */
         region_t const full_region;
 
+        /* `distribution_counts` is the key distribution of our store at the time the
+        backfill started, as partial sums. It's sent to the backfillee and also used to
+        split sessions into sub-ranges that are read concurrently. */
+        std::map<store_key_t, int64_t> distribution_counts;
+
+        /* `compare_digests` is `true` if `intro.config.compare_digests` is set and the
+        backfillee has any data, so that the sessions should ask for its digests. A
+        backfillee whose version is zero everywhere is empty, so no digest would match. */
+        bool compare_digests;
+
         /* `fifo_source` is used to attach order tokens to the messages we send to the
         backfillee. `fifo_sink` is used to interpret the order tokens on messages we
         receive from the backfillee. */
@@ -110,6 +122,7 @@ private:
 
     mailbox_manager_t *const mailbox_manager;
     branch_history_manager_t *const branch_history_manager;
+    backfill_throttler_t *const backfill_throttler;
     store_view_t *const store;
 
     registrar_t<backfiller_bcard_t::intro_1_t, backfiller_t *, client_t> registrar;
@@ -2,6 +2,7 @@
 #include "clustering/immediate_consistency/local_replicator.hpp"
 
 #include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/pmap.hpp"
 
 local_replicator_t::local_replicator_t(
         mailbox_manager_t *mailbox_manager,
@@ -9,12 +10,14 @@ local_replicator_t::local_replicator_t(
         primary_dispatcher_t *primary,
         store_view_t *_store,
         branch_history_manager_t *bhm,
+        backfill_throttler_t *backfill_throttler,
         signal_t *interruptor) :
     store(_store),
     replica(
         mailbox_manager,
         store,
         bhm,
+        backfill_throttler,
         primary->get_branch_id(),
         primary->get_branch_birth_certificate().initial_timestamp)
 {
@@ -83,16 +86,25 @@ void local_replicator_t::do_read(
     replica.do_read(read, min_timestamp, interruptor, response_out);
 }
 
-void local_replicator_t::do_write_sync(
-        const write_t &write,
-        state_timestamp_t timestamp,
-        order_token_t order_token,
-        write_durability_t durability,
+void local_replicator_t::do_write_sync_batch(
+        const std::vector<replicated_write_t> &writes,
         signal_t *interruptor,
-        write_response_t *response_out) {
-    replica.do_write(
-        write, timestamp, order_token, durability,
-        interruptor, response_out);
+        std::vector<write_response_t> *responses_out) {
+    /* There's no round trip to save here, so we just run the writes in parallel. The
+    `replica_t` puts them in timestamp order. */
+    responses_out->resize(writes.size());
+    pmap(writes.size(), [&](int64_t i) {
+        try {
+            replica.do_write(
+                writes[i].write, writes[i].timestamp, writes[i].order_token,
+                writes[i].durability, interruptor, &(*responses_out)[i]);
+        } catch (const interrupted_exc_t &) {
+            /* We check `interruptor` below. */
+        }
+    });
+    if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    }
 }
 
 void local_replicator_t::do_write_async(
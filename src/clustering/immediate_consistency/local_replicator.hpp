@@ -25,6 +25,7 @@ public:
         primary_dispatcher_t *primary,
         store_view_t *store,
         branch_history_manager_t *bhm,
+        backfill_throttler_t *backfill_throttler,
         signal_t *interruptor);
 
     /* This destructor can block */
@@ -44,13 +45,10 @@ public:
         signal_t *interruptor,
         read_response_t *response_out);
 
-    void do_write_sync(
-        const write_t &write,
-        state_timestamp_t timestamp,
-        order_token_t order_token,
-        write_durability_t durability,
+    void do_write_sync_batch(
+        const std::vector<replicated_write_t> &writes,
         signal_t *interruptor,
-        write_response_t *response_out);
+        std::vector<write_response_t> *responses_out);
 
     void do_write_async(
         const write_t &write,
@@ -4,6 +4,9 @@
 /* Limits how many writes should be sent to a dispatchee at once. */
 const size_t DISPATCH_WRITES_CORO_POOL_SIZE = 64;
 
+/* Limits how many writes can be coalesced into a single batch for a dispatchee. */
+const size_t MAX_DISPATCH_WRITE_BATCH_SIZE = 64;
+
 primary_dispatcher_t::dispatchee_registration_t::dispatchee_registration_t(
         primary_dispatcher_t *_parent,
         dispatchee_t *_dispatchee,
@@ -185,9 +188,25 @@ void primary_dispatcher_t::spawn_write(
     cb->write = incomplete_write.get();
 
     for (const auto &pair : dispatchees) {
-        pair.first->background_write_queue.push(
-            std::bind(&primary_dispatcher_t::background_write, this,
-                pair.first, pair.second, incomplete_write));
+        dispatchee_registration_t *dispatchee = pair.first;
+        if (!dispatchee->is_ready) {
+            dispatchee->background_write_queue.push(
+                std::bind(&primary_dispatcher_t::background_write, this,
+                    dispatchee, pair.second, incomplete_write));
+            continue;
+        }
+        /* Join the batch that's still waiting to be sent, unless it's full or has a
+        different durability. */
+        write_batch_t *batch = dispatchee->open_write_batch.get();
+        if (batch == nullptr
+                || batch->writes.size() >= MAX_DISPATCH_WRITE_BATCH_SIZE
+                || batch->writes.back()->durability != durability) {
+            dispatchee->open_write_batch = make_counted<write_batch_t>();
+            dispatchee->background_write_queue.push(
+                std::bind(&primary_dispatcher_t::background_write_batch, this,
+                    dispatchee, pair.second, dispatchee->open_write_batch));
+        }
+        dispatchee->open_write_batch->writes.push_back(incomplete_write);
     }
 }
 
@@ -209,34 +228,66 @@ void primary_dispatcher_t::background_write(
         dispatchee_registration_t *dispatchee,
         auto_drainer_t::lock_t dispatchee_lock,
         counted_t<incomplete_write_t> write) THROWS_NOTHING {
+    if (dispatchee->is_ready) {
+        /* The dispatchee became ready while the write was queued. */
+        counted_t<write_batch_t> batch = make_counted<write_batch_t>();
+        batch->writes.push_back(write);
+        background_write_batch(dispatchee, dispatchee_lock, batch);
+        return;
+    }
+    try {
+        dispatchee->dispatchee->do_write_async(
+            write->write, write->timestamp, write->order_token,
+            dispatchee_lock.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        /* ignore */
+    }
+}
+
+void primary_dispatcher_t::background_write_batch(
+        dispatchee_registration_t *dispatchee,
+        auto_drainer_t::lock_t dispatchee_lock,
+        counted_t<write_batch_t> batch) THROWS_NOTHING {
+    /* Close the batch, so that writes that arrive from now on go into a new one. */
+    if (dispatchee->open_write_batch.get() == batch.get()) {
+        dispatchee->open_write_batch.reset();
+    }
+
+    std::vector<replicated_write_t> writes;
+    writes.reserve(batch->writes.size());
+    for (const counted_t<incomplete_write_t> &write : batch->writes) {
+        writes.push_back(replicated_write_t {
+            write->write, write->timestamp, write->order_token, write->durability });
+    }
+
     try {
-        if (dispatchee->is_ready) {
-            write_response_t response;
-            dispatchee->dispatchee->do_write_sync(
-                write->write, write->timestamp, write->order_token, write->durability,
-                dispatchee_lock.get_drain_signal(), &response);
-
-            /* Update latest acked write on the distpatchee so we can route queries
-            to the fastest replica and avoid blocking there. */
-            dispatchee->latest_acked_write =
-                std::max(dispatchee->latest_acked_write, write->timestamp);
-
-            /* The write could potentially get acked when we call `on_ack()` on the
-            callback. So make sure all reads started after this point will see this
-            write. This is more conservative than necessary, since the write might not
-            actually be acked to the client just because it was acked by this mirror; but
-            this is the easiest thing to do. */
-            most_recent_acked_write_timestamp
-                = std::max(most_recent_acked_write_timestamp, write->timestamp);
+        std::vector<write_response_t> responses;
+        dispatchee->dispatchee->do_write_sync_batch(
+            writes, dispatchee_lock.get_drain_signal(), &responses);
+        guarantee(responses.size() == batch->writes.size());
+
+        /* The writes in a batch are in timestamp order. */
+        const state_timestamp_t timestamp = batch->writes.back()->timestamp;
+
+        /* Update latest acked write on the distpatchee so we can route queries
+        to the fastest replica and avoid blocking there. */
+        dispatchee->latest_acked_write =
+            std::max(dispatchee->latest_acked_write, timestamp);
 
+        /* The writes could potentially get acked when we call `on_ack()` on the
+        callbacks. So make sure all reads started after this point will see these
+        writes. This is more conservative than necessary, since the writes might not
+        actually be acked to the client just because they were acked by this mirror;
+        but this is the easiest thing to do. */
+        most_recent_acked_write_timestamp
+            = std::max(most_recent_acked_write_timestamp, timestamp);
+
+        for (size_t i = 0; i < batch->writes.size(); ++i) {
+            const counted_t<incomplete_write_t> &write = batch->writes[i];
             if (write->callback != nullptr) {
                 guarantee(write->callback->write == write.get());
-                write->callback->on_ack(dispatchee->server_id, std::move(response));
+                write->callback->on_ack(dispatchee->server_id, std::move(responses[i]));
             }
-        } else {
-            dispatchee->dispatchee->do_write_async(
-                write->write, write->timestamp, write->order_token,
-                dispatchee_lock.get_drain_signal());
         }
     } catch (const interrupted_exc_t &) {
         /* ignore */
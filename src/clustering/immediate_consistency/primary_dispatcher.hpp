@@ -2,7 +2,10 @@
 #ifndef CLUSTERING_IMMEDIATE_CONSISTENCY_PRIMARY_DISPATCHER_HPP_
 #define CLUSTERING_IMMEDIATE_CONSISTENCY_PRIMARY_DISPATCHER_HPP_
 
+#include <vector>
+
 #include "clustering/immediate_consistency/history.hpp"
+#include "clustering/immediate_consistency/replicated_write.hpp"
 #include "concurrency/coro_pool.hpp"
 #include "concurrency/queue/unlimited_fifo.hpp"
 #include "concurrency/watchable.hpp"
@@ -24,6 +27,7 @@ replica server. `primary_execution_t` constructs it. */
 class primary_dispatcher_t : public home_thread_mixin_debug_only_t {
 private:
     class incomplete_write_t;
+    class write_batch_t;
 
 public:
     /* `dispatchee_t` represents a replica from the `primary_dispatcher_t`'s point of
@@ -41,18 +45,17 @@ public:
             signal_t *interruptor,
             read_response_t *response_out) = 0;
 
-        /* `do_write_sync()` blocks until the write has been performed with the given
-        durability level, and it produces a `write_response_t`. `do_write_async()` makes
-        no promises about when it returns and it does not return a response. However,
-        `do_write_async()` may block in order to limit the rate at which the
-        `primary_dispatcher_t` sends writes. */
-        virtual void do_write_sync(
-            const write_t &write,
-            state_timestamp_t timestamp,
-            order_token_t order_token,
-            write_durability_t durability,
+        /* `do_write_sync_batch()` blocks until each of the writes has been performed
+        with its own durability level, and it produces a `write_response_t` for each
+        write, in the same order. The writes in a batch have increasing timestamps, but
+        other writes may be interleaved with them, so the dispatchee must still order
+        writes by timestamp. `do_write_async()` makes no promises about when it returns
+        and it does not return a response. However, `do_write_async()` may block in
+        order to limit the rate at which the `primary_dispatcher_t` sends writes. */
+        virtual void do_write_sync_batch(
+            const std::vector<replicated_write_t> &writes,
             signal_t *interruptor,
-            write_response_t *response_out) = 0;
+            std::vector<write_response_t> *responses_out) = 0;
         virtual void do_write_async(
             const write_t &write,
             state_timestamp_t timestamp,
@@ -85,7 +88,7 @@ public:
 
         /* Initially, dispatchees will only receive `do_write_async()` calls. But after
         `mark_ready()` is called, the `primary_dispatcher_t` may also send them reads and
-        `do_write_sync()` calls. */
+        `do_write_sync_batch()` calls. */
         void mark_ready();
 
     private:
@@ -98,6 +101,12 @@ public:
 
         bool is_ready;
 
+        /* Once the dispatchee is ready, writes are sent to it in batches. A batch stays
+        open while it waits in `background_write_queue`, and writes that arrive in the
+        meantime join it. So the more writes are in flight, the larger the batches get,
+        and each batch only costs the dispatchee one round trip. */
+        counted_t<write_batch_t> open_write_batch;
+
         perfmon_counter_t queue_count;
         perfmon_membership_t queue_count_membership;
 
@@ -107,9 +116,9 @@ public:
         calling_callback_t background_write_caller;
         coro_pool_t<std::function<void()> > background_write_workers;
 
-        /* This is the timestamp of the latest write for which a `do_write_sync()` call
-        has completed. We use this to pick the most up-to-date dispatchee to send reads
-        to. */
+        /* This is the timestamp of the latest write in a batch for which a
+        `do_write_sync_batch()` call has completed. We use this to pick the most
+        up-to-date dispatchee to send reads to. */
         state_timestamp_t latest_acked_write;
 
         auto_drainer_t drainer;
@@ -190,11 +199,24 @@ private:
         write_callback_t *callback;
     };
 
+    /* `write_batch_t` is a group of writes that are sent to a single dispatchee
+    together. All of the writes in a batch have the same durability, so that soft writes
+    don't wait for hard ones. */
+    class write_batch_t : public single_threaded_countable_t<write_batch_t> {
+    public:
+        std::vector<counted_t<incomplete_write_t> > writes;
+    };
+
     void background_write(
         dispatchee_registration_t *dispatchee,
         auto_drainer_t::lock_t dispatchee_lock,
         counted_t<incomplete_write_t> write) THROWS_NOTHING;
 
+    void background_write_batch(
+        dispatchee_registration_t *dispatchee,
+        auto_drainer_t::lock_t dispatchee_lock,
+        counted_t<write_batch_t> batch) THROWS_NOTHING;
+
     void refresh_ready_dispatchees_as_set();
 
     branch_id_t branch_id;
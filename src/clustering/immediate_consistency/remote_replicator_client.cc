@@ -4,6 +4,7 @@
 #include "clustering/immediate_consistency/backfill_throttler.hpp"
 #include "clustering/immediate_consistency/backfillee.hpp"
 #include "clustering/table_manager/backfill_progress_tracker.hpp"
+#include "concurrency/pmap.hpp"
 #include "stl_utils.hpp"
 #include "store_view.hpp"
 
@@ -166,7 +167,7 @@ remote_replicator_client_t::remote_replicator_client_t(
             ph::_1, ph::_2, ph::_3, ph::_4, ph::_5)),
     write_sync_mailbox_(mailbox_manager,
         std::bind(&remote_replicator_client_t::on_write_sync, this,
-            ph::_1, ph::_2, ph::_3, ph::_4, ph::_5, ph::_6)),
+            ph::_1, ph::_2, ph::_3)),
     read_mailbox_(mailbox_manager,
         std::bind(&remote_replicator_client_t::on_read, this,
             ph::_1, ph::_2, ph::_3, ph::_4))
@@ -217,7 +218,8 @@ remote_replicator_client_t::remote_replicator_client_t(
     they arrive because `tracker_` indicates that nothing has been backfilled. */
 
     backfillee_t backfillee(mailbox_manager, branch_history_manager, store,
-        replica_bcard.backfiller_bcard, backfill_config, progress_tracker, interruptor);
+        replica_bcard.backfiller_bcard, backfill_config, backfill_throttler,
+        progress_tracker, interruptor);
 
     while (tracker_->get_backfill_threshold() != region_.inner.right) {
 
@@ -340,7 +342,8 @@ remote_replicator_client_t::remote_replicator_client_t(
         /* Now we're completely up-to-date and synchronized with the primary, it's time
         to create a `replica_t`. */
         replica_.init(new replica_t(mailbox_manager_, store_, branch_history_manager,
-            branch_id, timestamp_enforcer_->get_latest_all_before_completed()));
+            backfill_throttler, branch_id,
+            timestamp_enforcer_->get_latest_all_before_completed()));
 
         mode_ = backfill_mode_t::STREAMING;
 
@@ -442,22 +445,33 @@ void remote_replicator_client_t::on_write_async(
 
 void remote_replicator_client_t::on_write_sync(
         signal_t *interruptor,
-        const write_t &write,
-        state_timestamp_t timestamp,
-        order_token_t order_token,
-        write_durability_t durability,
-        const mailbox_t<void(write_response_t)>::address_t &ack_addr)
+        const std::vector<replicated_write_t> &writes,
+        const mailbox_t<void(std::vector<write_response_t>)>::address_t &ack_addr)
         THROWS_ONLY(interrupted_exc_t) {
     /* The current implementation of the dispatcher will never send us an async write
     once it's started sending sync writes, but we don't want to rely on that detail, so
     we pass sync writes through the timestamp enforcer too. */
-    timestamp_enforcer_->complete(timestamp);
+    for (const replicated_write_t &write : writes) {
+        timestamp_enforcer_->complete(write.timestamp);
+    }
 
-    write_response_t response;
-    replica_->do_write(
-        write, timestamp, order_token, durability,
-        interruptor, &response);
-    send(mailbox_manager_, ack_addr, response);
+    /* The writes in the batch are applied in parallel; `replica_` puts them in
+    timestamp order. Each one uses its own durability, but they're acknowledged
+    together. */
+    std::vector<write_response_t> responses(writes.size());
+    pmap(writes.size(), [&](int64_t i) {
+        try {
+            replica_->do_write(
+                writes[i].write, writes[i].timestamp, writes[i].order_token,
+                writes[i].durability, interruptor, &responses[i]);
+        } catch (const interrupted_exc_t &) {
+            /* We check `interruptor` below. */
+        }
+    });
+    if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    }
+    send(mailbox_manager_, ack_addr, responses);
 }
 
 void remote_replicator_client_t::on_read(
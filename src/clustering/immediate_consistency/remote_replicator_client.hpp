@@ -90,11 +90,8 @@ private:
 
     void on_write_sync(
             signal_t *interruptor,
-            const write_t &write,
-            state_timestamp_t timestamp,
-            order_token_t order_token,
-            write_durability_t durability,
-            const mailbox_t<void(write_response_t)>::address_t &ack_addr)
+            const std::vector<replicated_write_t> &writes,
+            const mailbox_t<void(std::vector<write_response_t>)>::address_t &ack_addr)
         THROWS_ONLY(interrupted_exc_t);
 
     void on_read(
@@ -4,6 +4,7 @@
 
 #include "clustering/generic/registration_metadata.hpp"
 #include "clustering/immediate_consistency/history.hpp"
+#include "clustering/immediate_consistency/replicated_write.hpp"
 #include "rdb_protocol/protocol.hpp"
 
 class remote_replicator_client_intro_t {
@@ -26,8 +27,8 @@ public:
         mailbox_t<void()>::address_t
         )> write_async_mailbox_t;
     typedef mailbox_t<void(
-        write_t, state_timestamp_t, order_token_t, write_durability_t,
-        mailbox_t<void(write_response_t)>::address_t
+        std::vector<replicated_write_t>,
+        mailbox_t<void(std::vector<write_response_t>)>::address_t
         )> write_sync_mailbox_t;
     typedef mailbox_t<void(
         read_t, state_timestamp_t,
@@ -45,23 +45,20 @@ void remote_replicator_server_t::proxy_replica_t::do_read(
     wait_interruptible(&got_response, interruptor);
 }
 
-void remote_replicator_server_t::proxy_replica_t::do_write_sync(
-        const write_t &write,
-        state_timestamp_t timestamp,
-        order_token_t order_token,
-        write_durability_t durability,
+void remote_replicator_server_t::proxy_replica_t::do_write_sync_batch(
+        const std::vector<replicated_write_t> &writes,
         signal_t *interruptor,
-        write_response_t *response_out) {
+        std::vector<write_response_t> *responses_out) {
     guarantee(is_ready);
     cond_t got_response;
-    mailbox_t<void(write_response_t)> response_mailbox(
+    mailbox_t<void(std::vector<write_response_t>)> response_mailbox(
         parent->mailbox_manager,
-        [&](signal_t *, const write_response_t &response) {
-            *response_out = response;
+        [&](signal_t *, const std::vector<write_response_t> &responses) {
+            *responses_out = responses;
             got_response.pulse();
         });
     send(parent->mailbox_manager, client_bcard.write_sync_mailbox,
-        write, timestamp, order_token, durability, response_mailbox.get_address());
+        writes, response_mailbox.get_address());
     wait_interruptible(&got_response, interruptor);
 }
 
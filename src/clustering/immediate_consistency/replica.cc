@@ -7,6 +7,7 @@ replica_t::replica_t(
         mailbox_manager_t *_mailbox_manager,
         store_view_t *_store,
         branch_history_manager_t *_bhm,
+        backfill_throttler_t *_backfill_throttler,
         const branch_id_t &_branch_id,
         state_timestamp_t _timestamp) :
     mailbox_manager(_mailbox_manager),
@@ -14,7 +15,7 @@ replica_t::replica_t(
     branch_id(_branch_id),
     start_enforcer(_timestamp),
     end_enforcer(_timestamp),
-    backfiller(_mailbox_manager, _bhm, _store),
+    backfiller(_mailbox_manager, _bhm, _backfill_throttler, _store),
     synchronize_mailbox(mailbox_manager,
         std::bind(&replica_t::on_synchronize, this, ph::_1, ph::_2, ph::_3))
     { }
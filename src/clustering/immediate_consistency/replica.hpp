@@ -19,6 +19,7 @@ public:
         mailbox_manager_t *mailbox_manager,
         store_view_t *store,
         branch_history_manager_t *bhm,
+        backfill_throttler_t *backfill_throttler,
         const branch_id_t &branch_id,
         state_timestamp_t timestamp);
 
@@ -0,0 +1,5 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "clustering/immediate_consistency/replicated_write.hpp"
+
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(replicated_write_t,
+    write, timestamp, order_token, durability);
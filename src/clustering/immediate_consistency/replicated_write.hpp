@@ -0,0 +1,24 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef CLUSTERING_IMMEDIATE_CONSISTENCY_REPLICATED_WRITE_HPP_
+#define CLUSTERING_IMMEDIATE_CONSISTENCY_REPLICATED_WRITE_HPP_
+
+#include "buffer_cache/types.hpp"
+#include "concurrency/fifo_checker.hpp"
+#include "rdb_protocol/protocol.hpp"
+#include "rpc/serialize_macros.hpp"
+#include "timestamps.hpp"
+
+/* `replicated_write_t` is a write together with the information that a replica needs in
+order to apply it. The `primary_dispatcher_t` sends these to the dispatchees in batches;
+see `dispatchee_t::do_write_sync_batch()`. */
+class replicated_write_t {
+public:
+    write_t write;
+    state_timestamp_t timestamp;
+    order_token_t order_token;
+    write_durability_t durability;
+};
+
+RDB_DECLARE_SERIALIZABLE(replicated_write_t);
+
+#endif /* CLUSTERING_IMMEDIATE_CONSISTENCY_REPLICATED_WRITE_HPP_ */
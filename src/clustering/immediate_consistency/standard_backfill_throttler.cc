@@ -1,16 +1,171 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
 #include "clustering/immediate_consistency/standard_backfill_throttler.hpp"
 
+#include <algorithm>
+#include <cmath>
+
+#include "arch/timing.hpp"
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/wait_any.hpp"
+#include "rdb_protocol/protocol.hpp"
+#include "store_view.hpp"
+#include "time.hpp"
 
 static const size_t max_active_backfills = 8;
 
+/* A token bucket can save up at most this much time's worth of tokens, so an idle
+period can't be followed by an arbitrarily large burst. */
+static const microtime_t max_burst_us = 250 * 1000;
+
+/* How often the latency feedback adjusts the rate */
+static const microtime_t rate_adjust_interval_us = 500 * 1000;
+
+/* The latency feedback never reduces the rate below this, so that backfills always make
+some progress. */
+static const double min_feedback_bytes_per_sec = 1024 * 1024;
+
+/* While the latency is below the target, the rate grows by this factor every
+`rate_adjust_interval_us`. */
+static const double rate_increase_factor = 1.25;
+
+/* `rate_limiter_t` is a token bucket for one direction. `rate` is the rate it currently
+enforces; it's the same as `limit` unless the latency feedback has reduced it. Either
+can be empty for "no limit". */
+class standard_backfill_throttler_t::rate_limiter_t {
+public:
+    rate_limiter_t() :
+        tokens(0),
+        last_refill(current_microtime()),
+        period_start(last_refill),
+        period_bytes(0),
+        period_max_latency_ms(0) { }
+
+    void set_limit(const boost::optional<uint64_t> &new_limit) {
+        if (static_cast<bool>(new_limit)) {
+            limit = static_cast<double>(*new_limit);
+        } else {
+            limit = boost::none;
+        }
+        rate = limit;
+    }
+
+    /* Takes `bytes` tokens from the bucket and returns how many milliseconds the
+    caller has to wait before it may go ahead. */
+    int64_t take(
+            size_t bytes,
+            double latency_ms,
+            const boost::optional<uint64_t> &latency_target_ms) {
+        microtime_t now = current_microtime();
+        period_bytes += bytes;
+        period_max_latency_ms = std::max(period_max_latency_ms, latency_ms);
+        if (now - period_start >= rate_adjust_interval_us) {
+            adjust_rate(now, latency_target_ms);
+        }
+
+        if (!static_cast<bool>(rate)) {
+            return 0;
+        }
+        double elapsed_sec = static_cast<double>(now - last_refill) / MILLION;
+        tokens = std::min(tokens + elapsed_sec * *rate,
+                          *rate * max_burst_us / MILLION);
+        last_refill = now;
+
+        /* Tokens can go negative. The caller waits until the debt is paid off, and
+        later callers wait for their own tokens on top of that. */
+        tokens -= bytes;
+        if (tokens >= 0) {
+            return 0;
+        }
+        return static_cast<int64_t>(std::ceil(-tokens * 1000 / *rate));
+    }
+
+private:
+    void adjust_rate(
+            microtime_t now,
+            const boost::optional<uint64_t> &latency_target_ms) {
+        double observed_rate = period_bytes * MILLION
+            / static_cast<double>(now - period_start);
+        double latency_ms = period_max_latency_ms;
+        period_start = now;
+        period_bytes = 0;
+        period_max_latency_ms = 0;
+
+        if (!static_cast<bool>(latency_target_ms)) {
+            rate = limit;
+            return;
+        }
+        double floor = static_cast<bool>(limit)
+            ? std::min(*limit, min_feedback_bytes_per_sec)
+            : min_feedback_bytes_per_sec;
+        if (latency_ms > *latency_target_ms) {
+            /* Back off. If there was no limit, start from what we actually achieved. */
+            double base = static_cast<bool>(rate) ? *rate : observed_rate;
+            rate = std::max(base / 2, floor);
+            tokens = std::min(tokens, 0.0);
+        } else if (static_cast<bool>(rate)) {
+            double raised = *rate * rate_increase_factor;
+            if (static_cast<bool>(limit)) {
+                rate = std::min(raised, *limit);
+            } else if (observed_rate < *rate / 2) {
+                /* We aren't the bottleneck anymore, so we can lift the limit that the
+                feedback imposed. */
+                rate = boost::none;
+            } else {
+                rate = raised;
+            }
+        }
+    }
+
+    boost::optional<double> limit, rate;
+
+    /* The token bucket, in bytes */
+    double tokens;
+    microtime_t last_refill;
+
+    /* What has happened since the rate was last adjusted */
+    microtime_t period_start;
+    double period_bytes;
+    double period_max_latency_ms;
+
+    DISABLE_COPYING(rate_limiter_t);
+};
+
+standard_backfill_throttler_t::standard_backfill_throttler_t() :
+    send_limiter(new rate_limiter_t),
+    receive_limiter(new rate_limiter_t) { }
+
 standard_backfill_throttler_t::~standard_backfill_throttler_t() {
     guarantee(active.empty());
     guarantee(waiting.empty());
 }
 
+void standard_backfill_throttler_t::set_rate_config(
+        const backfill_rate_config_t &config) {
+    assert_thread();
+    rate_config = config;
+    send_limiter->set_limit(rate_config.send_bytes_per_sec);
+    receive_limiter->set_limit(rate_config.receive_bytes_per_sec);
+}
+
+void standard_backfill_throttler_t::limit_rate(
+        direction_t direction,
+        size_t bytes,
+        store_view_t *store,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    double latency_ms = store->get_foreground_latency_ms();
+    int64_t wait_ms;
+    {
+        on_thread_t thread_switcher(home_thread());
+        rate_limiter_t *limiter = direction == direction_t::SEND
+            ? send_limiter.get() : receive_limiter.get();
+        wait_ms = limiter->take(bytes, latency_ms, rate_config.latency_target_ms);
+    }
+    if (wait_ms > 0) {
+        nap(wait_ms, interruptor);
+    }
+}
+
 void standard_backfill_throttler_t::enter(lock_t *lock, signal_t *interruptor_on_lock) {
     cross_thread_signal_t interruptor_on_home(interruptor_on_lock, home_thread());
     on_thread_t thread_switcher(home_thread());
@@ -10,14 +10,32 @@
 /* `standard_backfill_throttler_t` is the `backfill_throttler_t` that is used in
 production. It allows a fixed number of backfills total (currently 8); if there are more
 than 8 backfills trying to run, it will always allow the highest-priority backfills to go
-first, preempting the lower-priority backfills if necessary. */
+first, preempting the lower-priority backfills if necessary.
+
+It also limits the rate of all the backfills together according to a
+`backfill_rate_config_t`, with a token bucket for each direction. If the config has a
+latency target, the rate of each bucket is halved whenever the foreground latency of the
+stores involved in the backfills is above the target, and raised slowly again while it's
+below the target. */
 
 class standard_backfill_throttler_t : public backfill_throttler_t {
 public:
-    standard_backfill_throttler_t() { }
+    standard_backfill_throttler_t();
     ~standard_backfill_throttler_t();
 
+    /* Must be called on the home thread. */
+    void set_rate_config(const backfill_rate_config_t &config);
+
+    void limit_rate(
+            direction_t direction,
+            size_t bytes,
+            store_view_t *store,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t);
+
 private:
+    class rate_limiter_t;
+
     void enter(lock_t *lock, signal_t *interruptor);
     void exit(lock_t *lock);
 
@@ -25,6 +43,9 @@ private:
     std::set<std::pair<priority_t, lock_t *> > active;
 
     new_mutex_t mutex;
+
+    backfill_rate_config_t rate_config;
+    scoped_ptr_t<rate_limiter_t> send_limiter, receive_limiter;
 };
 
 #endif /* CLUSTERING_IMMEDIATE_CONSISTENCY_STANDARD_BACKFILL_THROTTLER_HPP_ */
@@ -179,6 +179,7 @@ void primary_execution_t::run(auto_drainer_t::lock_t keepalive) {
             &primary_dispatcher,
             store,
             context->branch_history_manager,
+            context->backfill_throttler,
             &interruptor_store_thread);
 
         remote_replicator_server_t remote_replicator_server(
@@ -114,6 +114,10 @@ public:
         return &table_basic_configs;
     }
 
+    standard_backfill_throttler_t *get_backfill_throttler() {
+        return &backfill_throttler;
+    }
+
     /* Calls `callable` for each active table, it must have a signature of:
            void(const namespace_id_t &table_id, multistore_ptr_t *, table_manager_t *)
      */
@@ -73,6 +73,11 @@
 // 0 = minimal priority
 #define SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY   5
 
+// How much memory secondary index post construction uses to sort the index
+// entries before it spills them to disk. It is split between the indexes that
+// are constructed together.
+#define SINDEX_POST_CONSTRUCTION_SORT_MEMORY      (64 * MEGABYTE)
+
 // Size of the buffer used to perform IO operations (in bytes).
 #define IO_BUFFER_SIZE                            (4 * KILOBYTE)
 
@@ -102,6 +107,14 @@
 // small values of this variable.
 #define MERGER_SERIALIZER_MAX_ACTIVE_WRITES       1
 
+// How long the merger serializer waits for more transactions to join a group
+// commit, if the previous group consisted of more than one transaction.
+#define MERGER_SERIALIZER_GROUP_COMMIT_WINDOW_MS  1
+
+// A store's write-ahead log gets checkpointed, which flushes the B-tree and empties the
+// log, whenever the active segment of the log grows beyond this size.
+#define WRITE_AHEAD_LOG_CHECKPOINT_SIZE           (32 * MEGABYTE)
+
 // I/O priority of block writes in the merger_serializer_t
 #define MERGER_BLOCK_WRITE_IO_PRIORITY            64
 
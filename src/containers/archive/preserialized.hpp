@@ -0,0 +1,58 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_ARCHIVE_PRESERIALIZED_HPP_
+#define CONTAINERS_ARCHIVE_PRESERIALIZED_HPP_
+
+#include <string.h>
+
+#include "containers/archive/archive.hpp"
+#include "containers/counted.hpp"
+#include "containers/shared_buffer.hpp"
+#include "version.hpp"
+
+/* `preserialized_t<T>` holds the cluster serialization of a `T` in a shared,
+reference-counted buffer. Serializing a `preserialized_t<T>` writes exactly the bytes
+that serializing the original `T` would have, so the other side just deserializes a
+`T`. This is useful for a value that is sent to many peers (e.g. a changefeed message
+sent to every subscribed client), because it only has to be serialized once. Copying
+a `preserialized_t` doesn't copy the buffer. */
+template <class T>
+class preserialized_t {
+public:
+    preserialized_t() { }
+    explicit preserialized_t(const T &value) {
+        write_message_t wm;
+        serialize<cluster_version_t::CLUSTER>(&wm, value);
+        counted_t<shared_buf_t> b = shared_buf_t::create(wm.size());
+        size_t offset = 0;
+        intrusive_list_t<write_buffer_t> *list = wm.unsafe_expose_buffers();
+        for (write_buffer_t *p = list->head(); p != NULL; p = list->next(p)) {
+            memcpy(b->data(offset), p->data, p->size);
+            offset += p->size;
+        }
+        buf = std::move(b);
+    }
+
+    bool has() const { return buf.has(); }
+
+    size_t size() const {
+        guarantee(buf.has());
+        return buf->size();
+    }
+
+    const char *data() const {
+        guarantee(buf.has());
+        return buf->data();
+    }
+
+private:
+    counted_t<const shared_buf_t> buf;
+};
+
+template <cluster_version_t W, class T>
+void serialize(write_message_t *wm, const preserialized_t<T> &p) {
+    static_assert(W == cluster_version_t::CLUSTER,
+                  "preserialized_t is only used for cluster messages.");
+    wm->append(p.data(), p.size());
+}
+
+#endif  // CONTAINERS_ARCHIVE_PRESERIALIZED_HPP_
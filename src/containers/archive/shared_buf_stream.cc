@@ -0,0 +1,34 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "containers/archive/shared_buf_stream.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Each chunk is twice the size of the previous one, up to this size.
+static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+shared_buf_stream_t::shared_buf_stream_t(size_t first_chunk_size)
+    : next_chunk_size_(std::max<size_t>(first_chunk_size, 1)), size_(0) { }
+
+shared_buf_stream_t::~shared_buf_stream_t() { }
+
+int64_t shared_buf_stream_t::write(const void *p, int64_t n) {
+    const char *chp = static_cast<const char *>(p);
+    size_t left = n;
+    while (left > 0) {
+        if (chunks_.empty() || chunks_.back().size == current_->size()) {
+            current_ = shared_buf_t::create(next_chunk_size_);
+            chunks_.push_back(chunk_t{current_, 0});
+            next_chunk_size_ = std::min(next_chunk_size_ * 2, MAX_CHUNK_SIZE);
+        }
+        chunk_t *chunk = &chunks_.back();
+        size_t to_copy = std::min(left, current_->size() - chunk->size);
+        memcpy(current_->data(chunk->size), chp, to_copy);
+        chunk->size += to_copy;
+        chp += to_copy;
+        left -= to_copy;
+    }
+    size_ += n;
+    return n;
+}
@@ -0,0 +1,43 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_ARCHIVE_SHARED_BUF_STREAM_HPP_
+#define CONTAINERS_ARCHIVE_SHARED_BUF_STREAM_HPP_
+
+#include <vector>
+
+#include "containers/archive/archive.hpp"
+#include "containers/shared_buffer.hpp"
+
+/* `shared_buf_stream_t` is a `write_stream_t` that writes into a list of
+reference-counted `shared_buf_t` chunks. Unlike `vector_stream_t`, it never copies
+what was already written when it grows, and the chunks can be handed to
+`tcp_conn_t::write_shared_buffered()`, which sends them without copying them into
+the connection's write buffer. */
+class shared_buf_stream_t : public write_stream_t {
+public:
+    struct chunk_t {
+        counted_t<const shared_buf_t> buf;
+        /* The number of bytes of `buf` that have been written to. */
+        size_t size;
+    };
+
+    explicit shared_buf_stream_t(size_t first_chunk_size = 1024);
+    virtual ~shared_buf_stream_t();
+
+    virtual MUST_USE int64_t write(const void *p, int64_t n);
+
+    /* The total number of bytes written. */
+    size_t size() const { return size_; }
+
+    const std::vector<chunk_t> &chunks() const { return chunks_; }
+
+private:
+    std::vector<chunk_t> chunks_;
+    /* The chunk we're writing to, which is also `chunks_.back().buf`. */
+    counted_t<shared_buf_t> current_;
+    size_t next_chunk_size_;
+    size_t size_;
+
+    DISABLE_COPYING(shared_buf_stream_t);
+};
+
+#endif  // CONTAINERS_ARCHIVE_SHARED_BUF_STREAM_HPP_
@@ -70,6 +70,17 @@ int64_t tcp_conn_stream_t::write_buffered(const void *p, int64_t n) {
     }
 }
 
+int64_t tcp_conn_stream_t::write_shared_buffered(
+        const counted_t<const shared_buf_t> &buf, size_t offset, int64_t n) {
+    try {
+        cond_t non_closer;
+        conn_->write_shared_buffered(buf, offset, n, &non_closer);
+        return n;
+    } catch (const tcp_conn_write_closed_exc_t &) {
+        return -1;
+    }
+}
+
 bool tcp_conn_stream_t::flush_buffer() {
     try {
         cond_t non_closer;
@@ -156,6 +167,15 @@ int64_t keepalive_tcp_conn_stream_t::write_buffered(const void *p, int64_t n) {
     return tcp_conn_stream_t::write_buffered(p, n);
 }
 
+int64_t keepalive_tcp_conn_stream_t::write_shared_buffered(
+        const counted_t<const shared_buf_t> &buf, size_t offset, int64_t n) {
+    if (keepalive_callback != NULL) {
+        keepalive_callback->keepalive_write();
+    }
+
+    return tcp_conn_stream_t::write_shared_buffered(buf, offset, n);
+}
+
 bool keepalive_tcp_conn_stream_t::flush_buffer() {
     if (keepalive_callback != NULL) {
         keepalive_callback->keepalive_write();
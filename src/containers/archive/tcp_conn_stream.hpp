@@ -5,6 +5,7 @@
 #include "arch/address.hpp"
 #include "arch/types.hpp"
 #include "containers/archive/archive.hpp"
+#include "containers/shared_buffer.hpp"
 #include "threading.hpp"
 
 class signal_t;
@@ -20,6 +21,10 @@ public:
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
     virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
+    // Like `write_buffered()`, but sends `n` bytes at `offset` in `buf` without
+    // copying them; see `linux_tcp_conn_t::write_shared_buffered()`.
+    virtual MUST_USE int64_t write_shared_buffered(
+        const counted_t<const shared_buf_t> &buf, size_t offset, int64_t n);
     virtual bool flush_buffer();
 
     void rethread(threadnum_t new_thread);
@@ -70,6 +75,8 @@ public:
     virtual MUST_USE int64_t read(void *p, int64_t n);
     virtual MUST_USE int64_t write(const void *p, int64_t n);
     virtual MUST_USE int64_t write_buffered(const void *p, int64_t n);
+    virtual MUST_USE int64_t write_shared_buffered(
+        const counted_t<const shared_buf_t> &buf, size_t offset, int64_t n);
     virtual bool flush_buffer();
 
 private:
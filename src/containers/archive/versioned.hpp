@@ -34,7 +34,7 @@ inline MUST_USE archive_result_t deserialize_cluster_version(
     } else {
         // This is the same rassert in `ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE`.
         rassert(raw >= static_cast<int8_t>(cluster_version_t::v1_14)
-                && raw <= static_cast<int8_t>(cluster_version_t::v2_1_is_latest));
+                && raw <= static_cast<int8_t>(cluster_version_t::v2_2_is_latest));
         *thing = static_cast<cluster_version_t>(raw);
     }
     return res;
@@ -71,8 +71,10 @@ archive_result_t deserialize_for_version(cluster_version_t version,
         return deserialize<cluster_version_t::v1_16>(s, thing);
     case cluster_version_t::v2_0:
         return deserialize<cluster_version_t::v2_0>(s, thing);
-    case cluster_version_t::v2_1_is_latest:
-        return deserialize<cluster_version_t::v2_1_is_latest>(s, thing);
+    case cluster_version_t::v2_1:
+        return deserialize<cluster_version_t::v2_1>(s, thing);
+    case cluster_version_t::v2_2_is_latest:
+        return deserialize<cluster_version_t::v2_2_is_latest>(s, thing);
     default:
         unreachable();
     }
@@ -96,8 +98,10 @@ size_t serialized_size_for_version(cluster_version_t version,
         return serialized_size<cluster_version_t::v1_16>(thing);
     case cluster_version_t::v2_0:
         return serialized_size<cluster_version_t::v2_0>(thing);
-    case cluster_version_t::v2_1_is_latest:
-        return serialized_size<cluster_version_t::v2_1_is_latest>(thing);
+    case cluster_version_t::v2_1:
+        return serialized_size<cluster_version_t::v2_1>(thing);
+    case cluster_version_t::v2_2_is_latest:
+        return serialized_size<cluster_version_t::v2_2_is_latest>(thing);
     default:
         unreachable();
     }
@@ -145,7 +149,9 @@ size_t serialized_size_for_version(cluster_version_t version,
             read_stream_t *, typ *);                                             \
     template archive_result_t deserialize<cluster_version_t::v2_0>(              \
             read_stream_t *, typ *);                                             \
-    template archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(    \
+    template archive_result_t deserialize<cluster_version_t::v2_1>(              \
+            read_stream_t *, typ *);                                             \
+    template archive_result_t deserialize<cluster_version_t::v2_2_is_latest>(    \
             read_stream_t *, typ *)
 
 #define INSTANTIATE_SERIALIZABLE_SINCE_v1_13(typ)        \
@@ -157,7 +163,9 @@ size_t serialized_size_for_version(cluster_version_t version,
             read_stream_t *, typ *);                                             \
     template archive_result_t deserialize<cluster_version_t::v2_0>(              \
             read_stream_t *, typ *);                                             \
-    template archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(    \
+    template archive_result_t deserialize<cluster_version_t::v2_1>(              \
+            read_stream_t *, typ *);                                             \
+    template archive_result_t deserialize<cluster_version_t::v2_2_is_latest>(    \
             read_stream_t *, typ *)
 
 #define INSTANTIATE_SERIALIZABLE_SINCE_v1_16(typ)        \
@@ -165,7 +173,9 @@ size_t serialized_size_for_version(cluster_version_t version,
     INSTANTIATE_DESERIALIZE_SINCE_v1_16(typ)
 
 #define INSTANTIATE_DESERIALIZE_SINCE_v2_1(typ)                                  \
-    template archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(    \
+    template archive_result_t deserialize<cluster_version_t::v2_1>(              \
+            read_stream_t *, typ *);                                             \
+    template archive_result_t deserialize<cluster_version_t::v2_2_is_latest>(    \
             read_stream_t *, typ *)
 
 #define INSTANTIATE_SERIALIZABLE_SINCE_v2_1(typ)         \
@@ -56,6 +56,17 @@ ql::datum_t artificial_table_t::read_row(ql::env_t *env,
     return row;
 }
 
+std::vector<ql::datum_t> artificial_table_t::read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) {
+    /* Backends only know how to look up one row at a time. */
+    std::vector<ql::datum_t> rows;
+    rows.reserve(pvals.size());
+    for (const auto &pval : pvals) {
+        rows.push_back(read_row(env, pval, read_mode));
+    }
+    return rows;
+}
+
 counted_t<ql::datum_stream_t> artificial_table_t::read_all(
         ql::env_t *env,
         const std::string &get_all_sindex_id,
@@ -83,9 +94,15 @@ counted_t<ql::datum_stream_t> artificial_table_t::read_changes(
     counted_t<ql::datum_stream_t> maybe_src,
     const ql::datum_t &,
     bool include_states,
+    const ql::changefeed::resume_spec_t &resume,
     ql::changefeed::keyspec_t::spec_t &&spec,
     ql::backtrace_id_t bt,
     UNUSED const std::string &table_name) {
+    rcheck_src(bt,
+               !resume.include_resume_tokens && !resume.resume_from,
+               ql::base_exc_t::LOGIC,
+               "System tables don't support `include_resume_tokens` or "
+               "`resume_from`.");
 
     counted_t<ql::datum_stream_t> stream;
     admin_err_t error;
@@ -1,6 +1,7 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/btree.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <iterator>
 #include <set>
@@ -10,7 +11,9 @@
 #include "errors.hpp"
 #include <boost/optional.hpp>
 
+#include "btree/bulk_load.hpp"
 #include "btree/concurrent_traversal.hpp"
+#include "btree/count_keys.hpp"
 #include "btree/get_distribution.hpp"
 #include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
@@ -18,10 +21,15 @@
 #include "btree/superblock.hpp"
 #include "buffer_cache/serialize_onto_blob.hpp"
 #include "concurrency/coro_pool.hpp"
+#include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/new_semaphore.hpp"
+#include "concurrency/pmap.hpp"
 #include "concurrency/queue/unlimited_fifo.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/buffer_stream.hpp"
+#include "containers/archive/stl_types.hpp"
+#include "containers/archive/vector_stream.hpp"
 #include "containers/scoped.hpp"
 #include "rdb_protocol/geo/exceptions.hpp"
 #include "rdb_protocol/geo/indexing.hpp"
@@ -32,7 +40,9 @@
 #include "rdb_protocol/pseudo_geometry.hpp"
 #include "rdb_protocol/serialize_datum_onto_blob.hpp"
 #include "rdb_protocol/shards.hpp"
+#include "rdb_protocol/sindex_construction.hpp"
 #include "rdb_protocol/table_common.hpp"
+#include "stl_utils.hpp"
 
 #include "debug.hpp"
 
@@ -105,6 +115,28 @@ void rdb_get(const store_key_t &store_key, btree_slice_t *slice,
     }
 }
 
+class rdb_multi_get_callback_t : public multi_keyvalue_location_callback_t {
+public:
+    explicit rdb_multi_get_callback_t(multi_point_read_response_t *_response)
+        : response(_response) { }
+    void on_value(const btree_key_t *key, const void *value, buf_parent_t parent) {
+        response->data.insert(std::make_pair(
+            store_key_t(key),
+            get_data(static_cast<const rdb_value_t *>(value), parent)));
+    }
+private:
+    multi_point_read_response_t *response;
+};
+
+void rdb_multi_get(const std::vector<store_key_t> &keys, btree_slice_t *slice,
+                   superblock_t *superblock, multi_point_read_response_t *response,
+                   profile::trace_t *trace) {
+    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+    rdb_multi_get_callback_t callback(response);
+    find_keyvalue_locations_for_read(&sizer, superblock, keys, &callback,
+                                     &slice->stats, trace);
+}
+
 void kv_location_delete(keyvalue_location_t *kv_location,
                         const store_key_t &key,
                         repli_timestamp_t timestamp,
@@ -551,6 +583,32 @@ private:
     const sindex_multi_bool_t multi;
 };
 
+/* Copies the serialized row that `rdb_value` refers to into `*serialized_row_out`,
+so that it can be deserialized later, possibly on another thread. */
+static void copy_serialized_row(const rdb_value_t *rdb_value,
+                                buf_parent_t parent,
+                                std::vector<char> *serialized_row_out) {
+    rdb_blob_wrapper_t blob(parent.cache()->max_block_size(),
+                            const_cast<rdb_value_t *>(rdb_value)->value_ref(),
+                            blob::btree_maxreflen);
+    blob_acq_t acq_group;
+    buffer_group_t buffer_group;
+    blob.expose_all(parent, access_t::read, &buffer_group, &acq_group);
+    serialized_row_out->resize(buffer_group.get_size());
+    buffer_group_t row_group;
+    row_group.add_buffer(serialized_row_out->size(), serialized_row_out->data());
+    buffer_group_copy_data(&row_group, const_view(&buffer_group));
+}
+
+void rdb_copy_backfill_value(
+        buf_parent_t parent,
+        const void *value_in_leaf_node,
+        UNUSED signal_t *interruptor,
+        std::vector<char> *value_out) {
+    copy_serialized_row(
+        static_cast<const rdb_value_t *>(value_in_leaf_node), parent, value_out);
+}
+
 class job_data_t {
 public:
     job_data_t(ql::env_t *_env, const ql::batchspec_t &batchspec,
@@ -732,6 +790,334 @@ continue_bool_t rget_cb_t::handle_pair(
     }
 }
 
+// The most sub-ranges that an unordered aggregation over the primary index is split
+// into.  Each sub-range is evaluated on its own thread.
+const size_t MAX_PARALLEL_RGET_PARTS = 4;
+
+// The number of rows that a part of a parallel range read hands to its thread at a
+// time.
+const size_t PARALLEL_RGET_BATCH_SIZE = 100;
+
+template <class T>
+static std::vector<char> serialize_for_parallel_rget(const T &value) {
+    write_message_t wm;
+    serialize<cluster_version_t::CLUSTER>(&wm, value);
+    vector_stream_t stream;
+    stream.reserve(wm.size());
+    int res = send_write_message(&stream, &wm);
+    guarantee(res == 0);
+    std::vector<char> data;
+    stream.swap(&data);
+    return data;
+}
+
+template <class T>
+static void deserialize_for_parallel_rget(const std::vector<char> &data, T *value_out) {
+    buffer_read_stream_t stream(data.data(), data.size());
+    archive_result_t res = deserialize<cluster_version_t::CLUSTER>(&stream, value_out);
+    guarantee_deserialization(res, "parallel range read");
+}
+
+/* What the parts of a parallel range read evaluate. The functions are serialized, so
+that each part can deserialize its own copy on its own thread. */
+struct rget_parallel_job_t {
+    // `nullptr` for stores in unit tests.
+    rdb_context_t *ctx;
+    reql_version_t reql_version;
+    bool profile;
+    std::vector<char> optargs;
+    std::vector<char> transforms;
+    std::vector<char> terminal;
+};
+
+/* A row that `rget_parallel_cb_t` copied out of the B-tree. */
+struct rget_parallel_row_t {
+    store_key_t key;
+    // Empty if the job doesn't use the rows' values.
+    std::vector<char> serialized_row;
+};
+
+/* `rget_parallel_cb_t` handles the rows of one sub-range of a parallel range read. It
+copies the rows out of the B-tree on the store's thread and hands them to `thread` in
+batches, where they are run through the transforms and the terminal. Datums, functions
+and `ql::env_t` aren't thread safe, so everything that evaluates ReQL is created, used
+and destroyed on `thread`, and only serialized data crosses threads. */
+class rget_parallel_cb_t : public concurrent_traversal_callback_t {
+public:
+    rget_parallel_cb_t(btree_slice_t *slice,
+                       const rget_parallel_job_t *job,
+                       bool uses_values,
+                       signal_t *interruptor,
+                       threadnum_t thread,
+                       const key_range_t &range)
+        : slice_(slice), job_(job), uses_values_(uses_values), thread_(thread),
+          interruptor_(interruptor, thread), last_key_(range.left), aborted_(false) { }
+
+    ~rget_parallel_cb_t() {
+        if (eval_.has()) {
+            on_thread_t rethreader(thread_);
+            eval_.reset();
+        }
+    }
+
+    continue_bool_t handle_pair(
+            scoped_key_value_t &&keyvalue,
+            concurrent_traversal_fifo_enforcer_signal_t waiter)
+            THROWS_ONLY(interrupted_exc_t) {
+        if (aborted_) {
+            return continue_bool_t::ABORT;
+        }
+
+        rget_parallel_row_t row;
+        row.key = store_key_t(keyvalue.key());
+        slice_->stats.pm_keys_read.record();
+        slice_->stats.pm_total_keys_read += 1;
+        // We only copy the value if we actually use it (`count` does not).
+        if (uses_values_) {
+            copy_serialized_row(static_cast<const rdb_value_t *>(keyvalue.value()),
+                                keyvalue.expose_buf(),
+                                &row.serialized_row);
+        }
+        keyvalue.reset();
+        waiter.wait_interruptible();
+
+        if (last_key_ < row.key) {
+            last_key_ = row.key;
+        }
+        rows_.push_back(std::move(row));
+        if (rows_.size() >= PARALLEL_RGET_BATCH_SIZE) {
+            evaluate_rows();
+        }
+        return aborted_ ? continue_bool_t::ABORT : continue_bool_t::CONTINUE;
+    }
+
+    /* Evaluates the remaining rows and returns the part's result, along with the
+    event log of its profiling trace. */
+    void finish(rget_read_response_t *response_out,
+                profile::event_log_t *event_log_out) {
+        if (!aborted_ && !rows_.empty()) {
+            evaluate_rows();
+        }
+        std::vector<char> serialized_result;
+        {
+            on_thread_t rethreader(thread_);
+            init_eval();
+            if (boost::get<ql::exc_t>(&eval_->result) == NULL) {
+                try {
+                    eval_->accumulator->finish(&eval_->result);
+                } catch (const ql::exc_t &e) {
+                    eval_->result = e;
+                }
+            }
+            serialized_result = serialize_for_parallel_rget(eval_->result);
+            eval_->sampler.reset();
+            if (eval_->trace.has()) {
+                *event_log_out = std::move(*eval_->trace).extract_event_log();
+            }
+            eval_.reset();
+        }
+        event_log_out->push_back(profile::stop_t());
+        deserialize_for_parallel_rget(serialized_result, &response_out->result);
+        response_out->last_key = last_key_;
+    }
+
+private:
+    // Lives on `thread_`.  Mind the destructor ordering: everything refers to
+    // `trace`, and the sampler must be stopped before the trace goes away.
+    struct eval_state_t {
+        scoped_ptr_t<profile::trace_t> trace;
+        scoped_ptr_t<ql::env_t> env;
+        std::vector<scoped_ptr_t<ql::op_t> > transformers;
+        scoped_ptr_t<ql::accumulator_t> accumulator;
+        scoped_ptr_t<profile::sampler_t> sampler;
+        ql::result_t result;
+    };
+
+    void init_eval() {
+        assert_thread();
+        if (eval_.has()) {
+            return;
+        }
+        eval_.init(new eval_state_t);
+        if (job_->profile) {
+            eval_->trace.init(new profile::trace_t());
+        }
+        if (job_->ctx != nullptr) {
+            std::map<std::string, ql::wire_func_t> optargs;
+            deserialize_for_parallel_rget(job_->optargs, &optargs);
+            eval_->env.init(new ql::env_t(
+                job_->ctx, ql::return_empty_normal_batches_t::NO, &interruptor_,
+                std::move(optargs), eval_->trace.get_or_null()));
+        } else {
+            eval_->env.init(new ql::env_t(
+                &interruptor_, ql::return_empty_normal_batches_t::NO,
+                job_->reql_version));
+        }
+        std::vector<transform_variant_t> transforms;
+        deserialize_for_parallel_rget(job_->transforms, &transforms);
+        for (const auto &transform : transforms) {
+            eval_->transformers.push_back(ql::make_op(transform));
+        }
+        terminal_variant_t terminal;
+        deserialize_for_parallel_rget(job_->terminal, &terminal);
+        eval_->accumulator = ql::make_terminal(terminal);
+        eval_->sampler.init(new profile::sampler_t("Range traversal doc evaluation.",
+                                                   eval_->trace));
+    }
+
+    void assert_thread() {
+        rassert(get_thread_id() == thread_);
+    }
+
+    // Hands the rows copied so far to `thread_`.  Called from within the
+    // exclusive region of `handle_pair()`, so there's only one batch in flight.
+    // Like the traversal, we stop early if we're interrupted.
+    void evaluate_rows() {
+        std::vector<rget_parallel_row_t> rows;
+        rows.swap(rows_);
+        bool aborted = false;
+        {
+            on_thread_t rethreader(thread_);
+            init_eval();
+            try {
+                for (auto &&row : rows) {
+                    eval_->sampler->new_sample();
+                    if (continue_bool_t::ABORT == evaluate_row(std::move(row))) {
+                        aborted = true;
+                        break;
+                    }
+                }
+            } catch (const interrupted_exc_t &) {
+                aborted = true;
+            }
+        }
+        aborted_ = aborted;
+    }
+
+    continue_bool_t evaluate_row(rget_parallel_row_t &&row)
+            THROWS_ONLY(interrupted_exc_t) {
+        assert_thread();
+        ql::datum_t val;
+        if (uses_values_) {
+            buffer_read_stream_t read_stream(row.serialized_row.data(),
+                                             row.serialized_row.size());
+            archive_result_t res = datum_deserialize(&read_stream, &val);
+            guarantee_deserialization(res, "rdb value");
+        }
+        try {
+            ql::groups_t data;
+            data = {{ql::datum_t(), ql::datums_t{val}}};
+            for (auto it = eval_->transformers.begin();
+                 it != eval_->transformers.end();
+                 ++it) {
+                (**it)(eval_->env.get(), &data, ql::datum_t());
+            }
+            return (*eval_->accumulator)(eval_->env.get(),
+                                         &data,
+                                         std::move(row.key),
+                                         ql::datum_t());
+        } catch (const ql::exc_t &e) {
+            eval_->result = e;
+            return continue_bool_t::ABORT;
+        } catch (const ql::datum_exc_t &e) {
+#ifndef NDEBUG
+            unreachable();
+#else
+            eval_->result = ql::exc_t(e, ql::backtrace_id_t::empty());
+            return continue_bool_t::ABORT;
+#endif // NDEBUG
+        }
+    }
+
+    btree_slice_t *const slice_;
+    const rget_parallel_job_t *const job_;
+    const bool uses_values_;
+    const threadnum_t thread_;
+    cross_thread_signal_t interruptor_;
+
+    // The state on the store's thread.
+    store_key_t last_key_;
+    std::vector<rget_parallel_row_t> rows_;
+    bool aborted_;
+
+    scoped_ptr_t<eval_state_t> eval_;
+
+    DISABLE_COPYING(rget_parallel_cb_t);
+};
+
+/* Traverses the sub-ranges in `ranges` concurrently and evaluates each one on a
+different thread, with its own accumulator. Then combines their results the same way
+the results of different shards are combined. Only valid for terminals of unordered
+reads, where the order in which rows are accumulated doesn't matter. */
+void rdb_rget_slice_parallel(
+        btree_slice_t *slice,
+        const std::vector<key_range_t> &ranges,
+        superblock_t *superblock,
+        ql::env_t *ql_env,
+        const std::vector<transform_variant_t> &transforms,
+        const terminal_variant_t &terminal,
+        rget_read_response_t *response,
+        release_superblock_t release_superblock) {
+    rget_parallel_job_t job;
+    job.ctx = ql_env->get_rdb_ctx();
+    job.reql_version = ql_env->reql_version();
+    job.profile = ql_env->trace != nullptr;
+    job.optargs = serialize_for_parallel_rget(ql_env->get_all_optargs());
+    job.transforms = serialize_for_parallel_rget(transforms);
+    job.terminal = serialize_for_parallel_rget(terminal);
+    const bool uses_values =
+        !transforms.empty() || ql::make_terminal(terminal)->uses_val();
+
+    std::vector<rget_read_response_t> responses(ranges.size());
+    std::vector<profile::event_log_t> event_logs(ranges.size());
+    {
+        // The parts are profiled separately and their traces are merged back in
+        // as parallel tasks.
+        profile::splitter_t splitter(ql_env->trace);
+        std::vector<scoped_ptr_t<rget_parallel_cb_t> > callbacks;
+        std::vector<concurrent_traversal_callback_t *> callback_ptrs;
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            // Spread the parts over the threads after this one.
+            threadnum_t thread((get_thread_id().threadnum + 1 + static_cast<int>(i))
+                               % get_num_db_threads());
+            callbacks.push_back(make_scoped<rget_parallel_cb_t>(
+                slice, &job, uses_values, ql_env->interruptor, thread, ranges[i]));
+            callback_ptrs.push_back(callbacks[i].get());
+        }
+        btree_parallel_concurrent_traversal(
+            superblock, ranges, callback_ptrs, FORWARD, release_superblock);
+        pmap(callbacks.size(), [&](int64_t i) {
+            callbacks[i]->finish(&responses[i], &event_logs[i]);
+        });
+
+        profile::event_log_t event_log;
+        for (auto &&log : event_logs) {
+            event_log.insert(event_log.end(), log.begin(), log.end());
+        }
+        splitter.give_splits(ranges.size(), event_log);
+    }
+
+    std::vector<ql::result_t *> results;
+    results.reserve(responses.size());
+    for (auto &&resp : responses) {
+        if (boost::get<ql::exc_t>(&resp.result) != NULL) {
+            response->result = std::move(resp.result);
+            return;
+        }
+        if (response->last_key < resp.last_key) {
+            response->last_key = resp.last_key;
+        }
+        results.push_back(&resp.result);
+    }
+    try {
+        scoped_ptr_t<ql::accumulator_t> acc(ql::make_terminal(terminal));
+        acc->unshard(ql_env, response->last_key, results);
+        acc->finish(&response->result);
+    } catch (const ql::exc_t &e) {
+        response->result = e;
+    }
+}
+
 // TODO: Having two functions which are 99% the same sucks.
 void rdb_rget_slice(
         btree_slice_t *slice,
@@ -747,6 +1133,42 @@ void rdb_rget_slice(
 
     r_sanity_check(boost::get<ql::exc_t>(&response->result) == NULL);
     profile::starter_t starter("Do range scan on primary index.", ql_env->trace);
+    if (terminal && boost::get<ql::count_wire_func_t>(&*terminal) != nullptr
+        && transforms.empty()) {
+        // A plain `count` only needs the keys, so we count whole leaves at a time
+        // instead of handing every row to an accumulator.
+        uint64_t count = btree_count_keys(superblock, range, nullptr,
+                                          release_superblock, ql_env->trace,
+                                          ql_env->interruptor);
+        slice->stats.pm_keys_read.record(count);
+        slice->stats.pm_total_keys_read += count;
+        ql::grouped_t<uint64_t> counts;
+        if (count != 0) {
+            counts.insert(std::make_pair(ql::datum_t(), count));
+        }
+        response->result = std::move(counts);
+        // We looked at the whole range.
+        if (!reversed(sorting)) {
+            response->last_key = !range.right.unbounded
+                ? range.right.key() : store_key_t::max();
+        } else {
+            response->last_key = range.left;
+        }
+        return;
+    }
+    if (terminal && sorting == sorting_t::UNORDERED) {
+        // Aggregations don't care about the order of the rows, so we can scan
+        // several parts of the range at once.
+        std::vector<key_range_t> ranges = split_range_for_parallel_traversal(
+            superblock, range, MAX_PARALLEL_RGET_PARTS, ql_env->trace);
+        if (ranges.size() > 1) {
+            response->last_key = range.left;
+            rdb_rget_slice_parallel(slice, ranges, superblock, ql_env,
+                                    transforms, *terminal, response,
+                                    release_superblock);
+            return;
+        }
+    }
     rget_cb_t callback(
         rget_io_data_t(response, slice),
         job_data_t(ql_env, batchspec, transforms, terminal, sorting),
@@ -758,6 +1180,89 @@ void rdb_rget_slice(
     callback.finish();
 }
 
+/* Decides which keys of a non-multi secondary index fall into `range` for a plain
+`count`. The index is ordered by the encoded secondary values, so a key whose
+secondary part lies strictly between the truncated keys of the range's bounds can be
+counted without looking at the row. Only keys that were truncated, or that share a
+prefix with the left bound, need the index function to be evaluated on their row. */
+class sindex_count_filter_t : public count_keys_filter_t {
+public:
+    sindex_count_filter_t(const key_range_t &_pkey_range,
+                          const ql::datum_range_t &_range,
+                          ql::skey_version_t skey_version,
+                          reql_version_t _func_reql_version,
+                          const ql::map_wire_func_t &wire_func)
+        : pkey_range(_pkey_range),
+          pkey_range_is_universe(_pkey_range == key_range_t::universe()),
+          range(_range),
+          left_key(key_to_unescaped_str(range.left_sindex_key(skey_version))),
+          right_key(key_to_unescaped_str(range.right_sindex_key(skey_version))),
+          func_reql_version(_func_reql_version),
+          func(wire_func.compile_wire_func()) { }
+
+    decision_t check_key(const btree_key_t *btree_key) {
+        store_key_t key(btree_key);
+        std::string key_str = key_to_unescaped_str(key);
+        ql::components_t components = ql::datum_t::extract_all(key_str);
+        if (!pkey_range_is_universe
+            && !pkey_range.contains_key(store_key_t(components.primary))) {
+            return decision_t::SKIP;
+        }
+        if (ql::datum_t::key_is_truncated(key)) {
+            return decision_t::CHECK_VALUE;
+        }
+        const std::string &secondary = components.secondary;
+        if (secondary.compare(0, left_key.size(), left_key) > 0
+            && secondary.compare(right_key) < 0) {
+            return decision_t::COUNT;
+        }
+        if (secondary.compare(0, left_key.size(), left_key) < 0
+            || secondary.compare(0, right_key.size(), right_key) > 0) {
+            // The traversal range includes every key that starts with the right
+            // bound's key, but anything past that can't be in range.
+            return decision_t::SKIP;
+        }
+        return decision_t::CHECK_VALUE;
+    }
+
+    continue_bool_t check_value(scoped_key_value_t &&keyvalue,
+                                signal_t *interruptor,
+                                bool *count_out) {
+        lazy_json_t row(static_cast<const rdb_value_t *>(keyvalue.value()),
+                        keyvalue.expose_buf());
+        ql::datum_t val = row.get();
+        guarantee(!row.references_parent());
+        keyvalue.reset();
+        try {
+            // See `rget_cb_t::handle_pair()`.
+            ql::env_t sindex_env(interruptor,
+                                 ql::return_empty_normal_batches_t::NO,
+                                 func_reql_version);
+            ql::datum_t sindex_val = func->call(&sindex_env, val)->as_datum();
+            *count_out = range.contains(sindex_val);
+            return continue_bool_t::CONTINUE;
+        } catch (const ql::exc_t &e) {
+            error = e;
+            return continue_bool_t::ABORT;
+        } catch (const ql::datum_exc_t &e) {
+            error = ql::exc_t(e, ql::backtrace_id_t::empty());
+            return continue_bool_t::ABORT;
+        }
+    }
+
+    const boost::optional<ql::exc_t> &get_error() const { return error; }
+
+private:
+    const key_range_t pkey_range;
+    const bool pkey_range_is_universe;
+    const ql::datum_range_t range;
+    const std::string left_key;
+    const std::string right_key;
+    const reql_version_t func_reql_version;
+    const counted_t<const ql::func_t> func;
+    boost::optional<ql::exc_t> error;
+};
+
 void rdb_rget_secondary_slice(
         btree_slice_t *slice,
         const ql::datum_range_t &sindex_range,
@@ -779,6 +1284,40 @@ void rdb_rget_secondary_slice(
 
     const reql_version_t sindex_func_reql_version =
         sindex_info.mapping_version_info.latest_compatible_reql_version;
+    const ql::skey_version_t skey_version =
+        ql::skey_version_from_reql_version(sindex_func_reql_version);
+    if (terminal && boost::get<ql::count_wire_func_t>(&*terminal) != nullptr
+        && transforms.empty()
+        && sindex_info.multi == sindex_multi_bool_t::SINGLE
+        && skey_version == ql::skey_version_t::post_1_16) {
+        // Like in `rdb_rget_slice()`, a plain `count` doesn't need the rows. Keys
+        // of multi indexes don't map one-to-one to rows in range, and keys from
+        // before 1.16 don't sort like their values, so those still go through
+        // `rget_cb_t` below.
+        sindex_count_filter_t filter(pk_range, sindex_range, skey_version,
+                                     sindex_func_reql_version, sindex_info.mapping);
+        uint64_t count = btree_count_keys(superblock, sindex_region.inner, &filter,
+                                          release_superblock, ql_env->trace,
+                                          ql_env->interruptor);
+        if (filter.get_error()) {
+            response->result = *filter.get_error();
+            return;
+        }
+        slice->stats.pm_keys_read.record(count);
+        slice->stats.pm_total_keys_read += count;
+        ql::grouped_t<uint64_t> counts;
+        if (count != 0) {
+            counts.insert(std::make_pair(ql::datum_t(), count));
+        }
+        response->result = std::move(counts);
+        if (!reversed(sorting)) {
+            response->last_key = !sindex_region.inner.right.unbounded
+                ? sindex_region.inner.right.key() : store_key_t::max();
+        } else {
+            response->last_key = sindex_region.inner.left;
+        }
+        return;
+    }
     rget_cb_t callback(
         rget_io_data_t(response, slice),
         job_data_t(ql_env, batchspec, transforms, terminal, sorting),
@@ -1229,7 +1768,8 @@ void deserialize_sindex_info(const std::vector<char> &data,
     case cluster_version_t::v1_15:
     case cluster_version_t::v1_16:
     case cluster_version_t::v2_0:
-    case cluster_version_t::v2_1_is_latest:
+    case cluster_version_t::v2_1:
+    case cluster_version_t::v2_2_is_latest:
         success = deserialize_for_version(
                 cluster_version,
                 &read_stream,
@@ -1262,7 +1802,8 @@ void deserialize_sindex_info(const std::vector<char> &data,
     case cluster_version_t::v1_15: // fallthru
     case cluster_version_t::v1_16: // fallthru
     case cluster_version_t::v2_0: // fallthru
-    case cluster_version_t::v2_1_is_latest:
+    case cluster_version_t::v2_1: // fallthru
+    case cluster_version_t::v2_2_is_latest:
         success = deserialize_for_version(cluster_version, &read_stream, &info_out->geo);
         throw_if_bad_deserialization(success, "sindex description");
         break;
@@ -1534,121 +2075,151 @@ void rdb_update_sindexes(
     }
 }
 
-class post_construct_traversal_helper_t : public btree_traversal_helper_t {
+/* A row of the primary B-tree whose index entries are yet to be computed. */
+struct post_construct_row_t {
+    store_key_t primary_key;
+    // The serialized row, as it is stored in the row's blob.
+    std::vector<char> serialized_row;
+    std::vector<char> value_ref;
+};
+
+/* `post_construct_pipeline_t` computes the index entries of batches of rows and feeds
+them to the sorter of each index. It hands the batches to all threads in turn, so that
+index construction can use all cores, and it keeps at most `max_batches` of them in
+flight at a time. */
+class post_construct_pipeline_t {
 public:
-    post_construct_traversal_helper_t(
-            store_t *store,
-            const std::set<uuid_u> &sindexes_to_post_construct,
-            cond_t *interrupt_myself,
-            signal_t *interruptor
-            )
-        : store_(store),
-          sindexes_to_post_construct_(sindexes_to_post_construct),
-          interrupt_myself_(interrupt_myself), interruptor_(interruptor)
-    { }
+    post_construct_pipeline_t(
+            const std::map<uuid_u, std::pair<std::vector<char>, sindex_sorter_t *> >
+                &sindexes,
+            int64_t max_batches)
+        : batches_in_flight_(max_batches), next_thread_(0) {
+        for (const auto &pair : sindexes) {
+            definitions_.push_back(pair.second.first);
+            sorters_.push_back(pair.second.second);
+        }
+    }
 
-    void process_a_leaf(buf_lock_t *leaf_node_buf,
-                        const btree_key_t *, const btree_key_t *,
-                        signal_t *, int *) THROWS_ONLY(interrupted_exc_t) {
+    void process(const std::vector<post_construct_row_t> &rows) {
+        new_semaphore_acq_t acq(&batches_in_flight_, 1);
+        acq.acquisition_signal()->wait();
 
-        scoped_ptr_t<txn_t> wtxn;
-        store_t::sindex_access_vector_t sindexes;
+        threadnum_t thread(next_thread_);
+        next_thread_ = (next_thread_ + 1) % get_num_db_threads();
 
-        buf_read_t leaf_read(leaf_node_buf);
-        const leaf_node_t *leaf_node
-            = static_cast<const leaf_node_t *>(leaf_read.get_data_read());
+        std::vector<std::vector<sindex_entry_t> > entries(sorters_.size());
+        compute_entries(thread, rows, &entries);
+        for (size_t i = 0; i < sorters_.size(); ++i) {
+            for (auto &&entry : entries[i]) {
+                sorters_[i]->add(std::move(entry));
+            }
+        }
+    }
+
+private:
+    void compute_entries(threadnum_t thread,
+                         const std::vector<post_construct_row_t> &rows,
+                         std::vector<std::vector<sindex_entry_t> > *entries_out) {
+        on_thread_t rethreader(thread);
+
+        // Datums aren't thread safe, so everything below is created and destroyed
+        // on `thread`.
+        std::vector<sindex_disk_info_t> sindex_infos(definitions_.size());
+        for (size_t i = 0; i < definitions_.size(); ++i) {
+            try {
+                deserialize_sindex_info(definitions_[i], &sindex_infos[i]);
+            } catch (const archive_exc_t &e) {
+                crash("%s", e.what());
+            }
+        }
 
-        // Number of key/value pairs we process before yielding
+        // Number of rows we process before yielding
         const int MAX_CHUNK_SIZE = 10;
         int current_chunk_size = 0;
-        const rdb_post_construction_deletion_context_t deletion_context;
-        for (auto it = leaf::begin(*leaf_node); it != leaf::end(*leaf_node); ++it) {
-            if (current_chunk_size == 0) {
-                // Start a write transaction and acquire the secondary index
-                // at the beginning of each chunk. We reset the transaction
-                // after each chunk because large write transactions can cause
-                // the cache to go into throttling, and that would interfere
-                // with other transactions on this table.
+        for (const auto &row : rows) {
+            ql::datum_t datum;
+            buffer_read_stream_t read_stream(row.serialized_row.data(),
+                                             row.serialized_row.size());
+            archive_result_t res = datum_deserialize(&read_stream, &datum);
+            guarantee_deserialization(res, "rdb value");
+
+            for (size_t i = 0; i < sindex_infos.size(); ++i) {
+                std::vector<std::pair<store_key_t, ql::datum_t> > keys;
                 try {
-                    write_token_t token;
-                    store_->new_write_token(&token);
-
-                    scoped_ptr_t<real_superblock_t> superblock;
-
-                    // We use HARD durability because we want post construction
-                    // to be throttled if we insert data faster than it can
-                    // be written to disk. Otherwise we might exhaust the cache's
-                    // dirty page limit and bring down the whole table.
-                    // Other than that, the hard durability guarantee is not actually
-                    // needed here.
-                    store_->acquire_superblock_for_write(
-                            2 + MAX_CHUNK_SIZE,
-                            write_durability_t::HARD,
-                            &token,
-                            &wtxn,
-                            &superblock,
-                            interruptor_);
-
-                    // Acquire the sindex block.
-                    const block_id_t sindex_block_id = superblock->get_sindex_block_id();
-
-                    buf_lock_t sindex_block(superblock->expose_buf(), sindex_block_id,
-                                            access_t::write);
-
-                    superblock.reset();
-
-                    store_->acquire_sindex_superblocks_for_write(
-                            sindexes_to_post_construct_,
-                            &sindex_block,
-                            &sindexes);
-
-                    if (sindexes.empty()) {
-                        interrupt_myself_->pulse_if_not_already_pulsed();
-                        return;
-                    }
-                } catch (const interrupted_exc_t &e) {
-                    return;
+                    compute_keys(row.primary_key, datum, sindex_infos[i], &keys);
+                } catch (const ql::base_exc_t &) {
+                    // Drop the row from the index, as `rdb_update_single_sindex()`
+                    // does.
+                    continue;
+                }
+                for (const auto &pair : keys) {
+                    (*entries_out)[i].push_back(sindex_entry_t(pair.first, row.value_ref));
                 }
             }
 
-            store_->btree->stats.pm_keys_read.record();
-            store_->btree->stats.pm_total_keys_read += 1;
+            ++current_chunk_size;
+            if (current_chunk_size >= MAX_CHUNK_SIZE) {
+                current_chunk_size = 0;
+                coro_t::yield();
+            }
+        }
+    }
+
+    std::vector<std::vector<char> > definitions_;
+    std::vector<sindex_sorter_t *> sorters_;
+    new_semaphore_t batches_in_flight_;
+    int next_thread_;
+
+    DISABLE_COPYING(post_construct_pipeline_t);
+};
+
+/* `post_construct_scan_helper_t` copies the rows in `range` out of the primary B-tree
+and passes them to the pipeline, one leaf node at a time. */
+class post_construct_scan_helper_t : public btree_traversal_helper_t {
+public:
+    post_construct_scan_helper_t(store_t *store,
+                                 const key_range_t &range,
+                                 post_construct_pipeline_t *pipeline)
+        : store_(store), range_(range), pipeline_(pipeline) { }
 
+    void process_a_leaf(buf_lock_t *leaf_node_buf,
+                        const btree_key_t *, const btree_key_t *,
+                        signal_t *, int *) THROWS_ONLY(interrupted_exc_t) {
+        buf_read_t leaf_read(leaf_node_buf);
+        const leaf_node_t *leaf_node
+            = static_cast<const leaf_node_t *>(leaf_read.get_data_read());
+        const max_block_size_t block_size = leaf_node_buf->cache()->max_block_size();
+
+        std::vector<post_construct_row_t> rows;
+        for (auto it = leaf::begin(*leaf_node); it != leaf::end(*leaf_node); ++it) {
             /* Grab relevant values from the leaf node. */
             const btree_key_t *key = (*it).first;
             const void *value = (*it).second;
             guarantee(key);
+            if (!range_.contains_key(key)) {
+                // The traversal of a neighbouring range takes care of this one.
+                continue;
+            }
+
+            store_->btree->stats.pm_keys_read.record();
+            store_->btree->stats.pm_total_keys_read += 1;
 
-            const store_key_t pk(key);
-            rdb_modification_report_t mod_report(pk);
+            post_construct_row_t row;
+            row.primary_key = store_key_t(key);
             const rdb_value_t *rdb_value = static_cast<const rdb_value_t *>(value);
-            const max_block_size_t block_size = leaf_node_buf->cache()->max_block_size();
-            mod_report.info.added
-                = std::make_pair(
-                    get_data(rdb_value, buf_parent_t(leaf_node_buf)),
-                    std::vector<char>(rdb_value->value_ref(),
-                        rdb_value->value_ref() + rdb_value->inline_size(block_size)));
-
-            rdb_update_sindexes(store_,
-                                sindexes,
-                                &mod_report,
-                                wtxn.get(),
-                                &deletion_context,
-                                NULL,
-                                NULL,
-                                NULL);
-            store_->btree->stats.pm_keys_set.record();
-            store_->btree->stats.pm_total_keys_set += 1;
+            row.value_ref.assign(rdb_value->value_ref(),
+                rdb_value->value_ref() + rdb_value->inline_size(block_size));
 
-            ++current_chunk_size;
-            if (current_chunk_size >= MAX_CHUNK_SIZE) {
-                current_chunk_size = 0;
-                // Release the write transaction and yield.
-                // We continue later where we have left off.
-                sindexes.clear();
-                wtxn.reset();
-                coro_t::yield();
-            }
+            // We copy the serialized row instead of deserializing it here, so that
+            // all of the work happens on the pipeline's threads.
+            copy_serialized_row(rdb_value, buf_parent_t(leaf_node_buf),
+                                &row.serialized_row);
+
+            rows.push_back(std::move(row));
+        }
+
+        if (!rows.empty()) {
+            pipeline_->process(rows);
         }
     }
 
@@ -1658,6 +2229,22 @@ public:
                                      ranged_block_ids_t *ids_source,
                                      interesting_children_callback_t *cb) {
         for (int i = 0, e = ids_source->num_block_ids(); i < e; ++i) {
+            block_id_t block_id;
+            const btree_key_t *left_excl_or_null;
+            const btree_key_t *right_incl_or_null;
+            ids_source->get_block_id_and_bounding_interval(
+                i, &block_id, &left_excl_or_null, &right_incl_or_null);
+
+            // Skip the children that lie entirely outside of `range_`.
+            if (right_incl_or_null != nullptr
+                && btree_key_cmp(right_incl_or_null, range_.left.btree_key()) < 0) {
+                continue;
+            }
+            if (left_excl_or_null != nullptr && !range_.right.unbounded
+                && btree_key_cmp(left_excl_or_null,
+                                 range_.right.key().btree_key()) >= 0) {
+                continue;
+            }
             cb->receive_interesting_child(i);
         }
         cb->no_more_interesting_children();
@@ -1667,48 +2254,300 @@ public:
     access_t btree_node_mode() { return access_t::read; }
 
     store_t *store_;
-    const std::set<uuid_u> &sindexes_to_post_construct_;
-    cond_t *interrupt_myself_;
-    signal_t *interruptor_;
+    const key_range_t range_;
+    post_construct_pipeline_t *pipeline_;
 };
 
+/* `sindex_bulk_load_source_t` passes up to `max_entries` entries from a sorter to
+`btree_bulk_load()`. `*entry` must hold the first of them. Afterwards, if `*has_entry`
+is still `true`, `*entry` holds the first entry that hasn't been passed on. */
+class sindex_bulk_load_source_t : public btree_bulk_load_source_t {
+public:
+    sindex_bulk_load_source_t(sindex_sorter_t *sorter,
+                              sindex_entry_t *entry,
+                              bool *has_entry,
+                              size_t max_entries)
+        : sorter_(sorter), entry_(entry), has_entry_(has_entry),
+          max_entries_(max_entries), num_entries_(0), done_(false) { }
+
+    bool next_pair(store_key_t *key_out, repli_timestamp_t *recency_out) {
+        if (done_) {
+            return false;
+        }
+        if (num_entries_ != 0) {
+            *has_entry_ = sorter_->next(entry_);
+        }
+        if (!*has_entry_ || num_entries_ == max_entries_) {
+            done_ = true;
+            return false;
+        }
+        *key_out = entry_->first;
+        *recency_out = repli_timestamp_t::distant_past;
+        ++num_entries_;
+        return true;
+    }
+
+    void write_value(buf_parent_t, void *value_out) {
+        // Secondary index entries refer to the blob of the row in the primary B-tree.
+        memcpy(value_out, entry_->second.data(), entry_->second.size());
+    }
+
+private:
+    sindex_sorter_t *sorter_;
+    sindex_entry_t *entry_;
+    bool *has_entry_;
+    size_t max_entries_;
+    size_t num_entries_;
+    bool done_;
+};
+
+/* Loads the sorted entries from `sorter` into the secondary index B-tree of the index
+`sindex_id`. */
+static void load_secondary_index(
+        store_t *store,
+        uuid_u sindex_id,
+        sindex_sorter_t *sorter,
+        sindex_construction_progress_t *progress_tracker,
+        signal_t *interruptor)
+    THROWS_ONLY(interrupted_exc_t) {
+    // Number of entries we load per write transaction
+    const size_t MAX_CHUNK_SIZE = 1000;
+    // Leave some room in the leaf nodes for the writes that are queued up in the
+    // meantime and for later insertions.
+    const double FILL_FACTOR = 0.9;
+    const rdb_post_construction_deletion_context_t deletion_context;
+
+    sindex_entry_t entry;
+    bool has_entry = sorter->next(&entry);
+    while (has_entry) {
+        write_token_t token;
+        store->new_write_token(&token);
+
+        scoped_ptr_t<txn_t> wtxn;
+        scoped_ptr_t<real_superblock_t> superblock;
+
+        // We use HARD durability because we want post construction
+        // to be throttled if we insert data faster than it can
+        // be written to disk. Otherwise we might exhaust the cache's
+        // dirty page limit and bring down the whole table.
+        // Other than that, the hard durability guarantee is not actually
+        // needed here.
+        store->acquire_superblock_for_write(
+                2 + MAX_CHUNK_SIZE / 10,
+                write_durability_t::HARD,
+                &token,
+                &wtxn,
+                &superblock,
+                interruptor);
+
+        buf_lock_t sindex_block(superblock->expose_buf(),
+                                superblock->get_sindex_block_id(),
+                                access_t::write);
+
+        superblock.reset();
+
+        store_t::sindex_access_vector_t sindexes;
+        store->acquire_sindex_superblocks_for_write(
+                std::set<uuid_u>{sindex_id},
+                &sindex_block,
+                &sindexes);
+        if (sindexes.empty()) {
+            // The index has been deleted in the meantime.
+            return;
+        }
+
+        // Release the sindex block early so that we don't hold up the writes to
+        // the table while we load.
+        sindex_block.reset_buf_lock();
+
+        sindex_superblock_t *sindex_superblock = sindexes[0]->superblock.get();
+        rdb_value_sizer_t sizer(sindex_superblock->cache()->max_block_size());
+        size_t num_loaded = 0;
+        if (btree_range_is_empty(sindex_superblock, &sizer,
+                key_range_t(key_range_t::closed, entry.first,
+                            key_range_t::none, store_key_t()))) {
+            sindex_bulk_load_source_t source(
+                sorter, &entry, &has_entry, MAX_CHUNK_SIZE);
+            num_loaded = btree_bulk_load(sindex_superblock,
+                                         &sizer,
+                                         deletion_context.balancing_detacher(),
+                                         FILL_FACTOR,
+                                         repli_timestamp_t::distant_past,
+                                         &source);
+        } else {
+            // A newly created index is empty, so this shouldn't happen. If it does,
+            // we insert the entries one by one instead.
+            for (; has_entry && num_loaded < MAX_CHUNK_SIZE; ++num_loaded) {
+                promise_t<superblock_t *> return_superblock_local;
+                {
+                    keyvalue_location_t kv_location;
+                    find_keyvalue_location_for_write(
+                        &sizer,
+                        sindex_superblock,
+                        entry.first.btree_key(),
+                        repli_timestamp_t::distant_past,
+                        deletion_context.balancing_detacher(),
+                        &kv_location,
+                        nullptr,
+                        &return_superblock_local);
+
+                    ql::serialization_result_t res =
+                        kv_location_set(&kv_location, entry.first, entry.second,
+                                        repli_timestamp_t::distant_past,
+                                        &deletion_context);
+                    guarantee(!bad(res));
+                }
+                sindex_superblock = static_cast<sindex_superblock_t *>(
+                    return_superblock_local.wait());
+                has_entry = sorter->next(&entry);
+            }
+        }
+        store->btree->stats.pm_total_keys_set += num_loaded;
+        progress_tracker->record_loaded(num_loaded);
+
+        // Release the write transaction and yield.
+        sindexes.clear();
+        wtxn.reset();
+        coro_t::yield();
+    }
+}
+
+/* Splits the key range of the primary B-tree into up to `max_ranges` ranges of roughly
+equal size, using the keys in the top levels of the tree as split points. */
+static std::vector<key_range_t> split_into_ranges(
+        store_t *store, size_t max_ranges, signal_t *interruptor)
+    THROWS_ONLY(interrupted_exc_t) {
+    std::vector<store_key_t> keys;
+    {
+        read_token_t read_token;
+        store->new_read_token(&read_token);
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        store->acquire_superblock_for_read(
+            &read_token, &txn, &superblock, interruptor, false /* USE_SNAPSHOT */);
+        int64_t key_count;
+        get_btree_key_distribution(superblock.get(), 2, &key_count, &keys);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<key_range_t> ranges;
+    store_key_t left = store_key_t::min();
+    for (size_t i = 1; i < max_ranges && !keys.empty(); ++i) {
+        const store_key_t &split = keys[i * keys.size() / max_ranges];
+        if (left < split) {
+            ranges.push_back(key_range_t(key_range_t::closed, left,
+                                         key_range_t::open, split));
+            left = split;
+        }
+    }
+    ranges.push_back(key_range_t(key_range_t::closed, left,
+                                 key_range_t::none, store_key_t()));
+    return ranges;
+}
+
 void post_construct_secondary_indexes(
         store_t *store,
         const std::set<uuid_u> &sindexes_to_post_construct,
         signal_t *interruptor,
-        parallel_traversal_progress_t *progress_tracker)
+        sindex_construction_progress_t *progress_tracker)
     THROWS_ONLY(interrupted_exc_t) {
-    cond_t local_interruptor;
+    std::map<uuid_u, scoped_ptr_t<sindex_sorter_t> > sorters;
 
-    wait_any_t wait_any(&local_interruptor, interruptor);
+    // We traverse several key ranges at once, so that there is enough work in flight
+    // to keep every thread busy.
+    const std::vector<key_range_t> ranges =
+        split_into_ranges(store, get_num_db_threads(), interruptor);
 
-    post_construct_traversal_helper_t helper(store,
-            sindexes_to_post_construct, &local_interruptor, interruptor);
-    helper.progress = progress_tracker;
+    {
+        read_token_t read_token;
+        store->new_read_token(&read_token);
+
+        // Mind the destructor ordering.
+        // The superblock must be released before txn.
+        // The txn must be destructed before the cache_account.
+        cache_account_t cache_account;
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+
+        store->acquire_superblock_for_read(
+            &read_token,
+            &txn,
+            &superblock,
+            interruptor,
+            true /* USE_SNAPSHOT */);
+
+        cache_account
+            = txn->cache()->create_cache_account(SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY);
+        txn->set_account(&cache_account);
+
+        /* Look up the definitions of the indexes in the same snapshot. */
+        std::map<uuid_u, std::vector<char> > definitions;
+        {
+            buf_lock_t sindex_block(superblock->expose_buf(),
+                                    superblock->get_sindex_block_id(),
+                                    access_t::read);
+            std::map<sindex_name_t, secondary_index_t> secondary_indexes;
+            get_secondary_indexes(&sindex_block, &secondary_indexes);
+            for (const auto &pair : secondary_indexes) {
+                if (!pair.second.being_deleted
+                    && std_contains(sindexes_to_post_construct, pair.second.id)) {
+                    definitions[pair.second.id] = pair.second.opaque_definition;
+                }
+            }
+        }
+        if (definitions.empty()) {
+            return;
+        }
 
-    read_token_t read_token;
-    store->new_read_token(&read_token);
+        const size_t memory_limit =
+            SINDEX_POST_CONSTRUCTION_SORT_MEMORY / definitions.size();
+        std::map<uuid_u, std::pair<std::vector<char>, sindex_sorter_t *> > sindexes;
+        for (const auto &pair : definitions) {
+            sindex_sorter_t *sorter = new sindex_sorter_t(
+                store->io_backender_,
+                store->base_path_,
+                "post_construction_sort_" + uuid_to_str(generate_uuid()),
+                &store->perfmon_collection,
+                memory_limit);
+            sorters[pair.first].init(sorter);
+            sindexes[pair.first] = std::make_pair(pair.second, sorter);
+        }
 
-    // Mind the destructor ordering.
-    // The superblock must be released before txn (`btree_parallel_traversal`
-    // usually already takes care of that).
-    // The txn must be destructed before the cache_account.
-    cache_account_t cache_account;
-    scoped_ptr_t<txn_t> txn;
-    scoped_ptr_t<real_superblock_t> superblock;
+        post_construct_pipeline_t pipeline(sindexes, 2 * get_num_db_threads());
+        std::vector<scoped_ptr_t<post_construct_scan_helper_t> > helpers;
+        for (const key_range_t &range : ranges) {
+            helpers.push_back(
+                make_scoped<post_construct_scan_helper_t>(store, range, &pipeline));
+            helpers.back()->progress = progress_tracker->add_scan_progress();
+        }
 
-    store->acquire_superblock_for_read(
-        &read_token,
-        &txn,
-        &superblock,
-        interruptor,
-        true /* USE_SNAPSHOT */);
+        // The traversals share the snapshot, so none of them may release the
+        // superblock.
+        bool interrupted = false;
+        pmap(helpers.size(), [&](int64_t i) {
+            try {
+                btree_parallel_traversal(superblock.get(), helpers[i].get(),
+                                         interruptor, release_superblock_t::KEEP);
+            } catch (const interrupted_exc_t &) {
+                interrupted = true;
+            }
+        });
+        if (interrupted) {
+            throw interrupted_exc_t();
+        }
+    }
 
-    cache_account
-        = txn->cache()->create_cache_account(SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY);
-    txn->set_account(&cache_account);
+    uint64_t num_entries = 0;
+    for (const auto &pair : sorters) {
+        pair.second->finish();
+        num_entries += pair.second->num_entries();
+    }
+    progress_tracker->start_loading(num_entries);
 
-    btree_parallel_traversal(superblock.get(), &helper, &wait_any);
+    for (const auto &pair : sorters) {
+        load_secondary_index(
+            store, pair.first, pair.second.get(), progress_tracker, interruptor);
+    }
 }
 
 void noop_value_deleter_t::delete_value(buf_parent_t, const void *) const { }
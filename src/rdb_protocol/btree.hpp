@@ -18,13 +18,11 @@ class btree_slice_t;
 enum class delete_mode_t;
 class deletion_context_t;
 class key_tester_t;
-class parallel_traversal_progress_t;
 template <class> class promise_t;
 struct rdb_value_t;
 class refcount_superblock_t;
 struct sindex_disk_info_t;
-
-class parallel_traversal_progress_t;
+class sindex_construction_progress_t;
 
 bool btree_value_fits(max_block_size_t bs, int data_length, const rdb_value_t *value);
 
@@ -65,6 +63,15 @@ void rdb_get(
     point_read_response_t *response,
     profile::trace_t *trace);
 
+/* `keys` must be sorted and must not contain duplicates. Keys that aren't in the
+table are left out of `response->data`. */
+void rdb_multi_get(
+    const std::vector<store_key_t> &keys,
+    btree_slice_t *slice,
+    superblock_t *superblock,
+    multi_point_read_response_t *response,
+    profile::trace_t *trace);
+
 struct btree_info_t {
     btree_info_t(btree_slice_t *_slice,
                  repli_timestamp_t _timestamp,
@@ -134,6 +141,15 @@ void rdb_delete(const store_key_t &key, btree_slice_t *slice, repli_timestamp_t
                 profile::trace_t *trace,
                 promise_t<superblock_t *> *pass_back_superblock = nullptr);
 
+/* Copies the serialized datum that a value in a leaf node refers to into `*value_out`.
+This is the format that backfill items carry the values in, and it fits
+`backfill_value_copier_t`. */
+void rdb_copy_backfill_value(
+    buf_parent_t parent,
+    const void *value_in_leaf_node,
+    signal_t *interruptor,
+    std::vector<char> *value_out);
+
 void rdb_rget_slice(
     btree_slice_t *slice,
     const key_range_t &range,
@@ -316,11 +332,14 @@ void rdb_update_sindexes(
     index_vals_t *old_keys_out,
     index_vals_t *new_keys_out);
 
+/* Fills the secondary indexes `sindexes_to_post_construct` with the rows of a snapshot
+of the primary B-tree. It sorts the index entries first and then bulk-loads them into
+the secondary index B-trees, which must be empty. */
 void post_construct_secondary_indexes(
         store_t *store,
         const std::set<uuid_u> &sindexes_to_post_construct,
         signal_t *interruptor,
-        parallel_traversal_progress_t *progress_tracker)
+        sindex_construction_progress_t *progress_tracker)
     THROWS_ONLY(interrupted_exc_t);
 
 /* This deleter actually deletes the value and all associated blocks. */
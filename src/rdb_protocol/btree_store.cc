@@ -22,7 +22,9 @@
 #include "rdb_protocol/erase_range.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "serializer/config.hpp"
+#include "serializer/write_ahead_log.hpp"
 #include "stl_utils.hpp"
+#include "time.hpp"
 
 // The maximal number of writes that can be in line for a superblock acquisition
 // at a time (including the write that's currently holding the superblock, if any).
@@ -41,6 +43,44 @@
 //  block out writes anyway.
 const int64_t WRITE_SUPERBLOCK_ACQ_WAITERS_LIMIT = 2;
 
+// Every read and write moves the foreground latency estimate this far towards its
+// own latency.
+const double FOREGROUND_LATENCY_WEIGHT = 0.1;
+
+// If the store hasn't served any reads or writes for this long, the foreground
+// latency estimate is considered to be out of date, and the store counts as idle.
+const microtime_t FOREGROUND_LATENCY_MAX_AGE_US = 1000 * 1000;
+
+/* `store_t::write()` puts one of these into the write-ahead log for every write. The
+record only applies to the store if the metainfo in the region of the write is still
+`old_metainfo`. Otherwise the write already made it to disk before the crash. The
+metainfo is stored as `std::vector<char>` because `binary_blob_t` isn't serializable. */
+struct write_ahead_log_record_t {
+    region_map_t<std::vector<char> > old_metainfo;
+    region_map_t<std::vector<char> > new_metainfo;
+    state_timestamp_t timestamp;
+    write_t write;
+};
+
+RDB_DECLARE_SERIALIZABLE(write_ahead_log_record_t);
+RDB_IMPL_SERIALIZABLE_4_SINCE_v2_1(write_ahead_log_record_t,
+    old_metainfo, new_metainfo, timestamp, write);
+
+static region_map_t<std::vector<char> > metainfo_to_vectors(
+        const region_map_t<binary_blob_t> &metainfo) {
+    return metainfo.map(metainfo.get_domain(), [](const binary_blob_t &blob) {
+        const char *data = static_cast<const char *>(blob.data());
+        return std::vector<char>(data, data + blob.size());
+    });
+}
+
+static region_map_t<binary_blob_t> metainfo_from_vectors(
+        const region_map_t<std::vector<char> > &metainfo) {
+    return metainfo.map(metainfo.get_domain(), [](const std::vector<char> &data) {
+        return binary_blob_t(data.begin(), data.end());
+    });
+}
+
 // Some of this implementation is in store.cc and some in btree_store.cc for no
 // particularly good reason.  Historically it turned out that way, and for now
 // there's not enough refactoring urgency to combine them into one.
@@ -88,7 +128,8 @@ store_t::store_t(const region_t &region,
                  /* TODO: We should track outdated indexes by looking at the Raft state,
                  not by looking at the `store_t`. */
                  scoped_ptr_t<outdated_index_report_t> &&_index_report,
-                 namespace_id_t _table_id)
+                 namespace_id_t _table_id,
+                 const std::string &change_log_path)
     : store_view_t(region),
       perfmon_collection(),
       io_backender_(io_backender), base_path_(base_path),
@@ -96,10 +137,19 @@ store_t::store_t(const region_t &region,
       ctx(_ctx),
       changefeed_server((ctx == NULL || ctx->manager == NULL)
                         ? NULL
-                        : new ql::changefeed::server_t(ctx->manager)),
+                        : new ql::changefeed::server_t(ctx->manager,
+                                                       io_backender,
+                                                       base_path,
+                                                       &perfmon_collection,
+                                                       change_log_path)),
       index_report(std::move(_index_report)),
       table_id(_table_id),
-      write_superblock_acq_semaphore(WRITE_SUPERBLOCK_ACQ_WAITERS_LIMIT)
+      write_superblock_acq_semaphore(WRITE_SUPERBLOCK_ACQ_WAITERS_LIMIT),
+      foreground_latency_ms(0),
+      foreground_latency_updated(0),
+      write_ahead_log_checkpoint_pending(false),
+      backfill_metainfo_updates(0),
+      backfill_metainfo_updates_flushed(0)
 {
     cache.init(new cache_t(serializer, balancer, &perfmon_collection));
     general_cache_conn.init(new cache_conn_t(cache.get()));
@@ -177,6 +227,13 @@ store_t::store_t(const region_t &region,
 store_t::~store_t() {
     assert_thread();
     drainer.drain();
+    if (write_ahead_log.has()) {
+        /* Everything in the log is on disk in the B-tree after the checkpoint, so the
+        next start doesn't have to replay it. */
+        cond_t non_interruptor;
+        checkpoint_write_ahead_log(&non_interruptor);
+        write_ahead_log->reset();
+    }
 }
 
 void store_t::read(
@@ -187,6 +244,7 @@ void store_t::read(
         signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t) {
     assert_thread();
+    microtime_t start_time = current_microtime();
     scoped_ptr_t<txn_t> txn;
     scoped_ptr_t<real_superblock_t> superblock;
 
@@ -196,6 +254,7 @@ void store_t::read(
     DEBUG_ONLY_CODE(metainfo->visit(
         superblock.get(), metainfo_checker.region, metainfo_checker.callback));
     protocol_read(read, response, superblock.get(), interruptor);
+    record_foreground_latency(start_time);
 }
 
 void store_t::write(
@@ -210,17 +269,185 @@ void store_t::write(
         signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t) {
     assert_thread();
+    microtime_t start_time = current_microtime();
+
+    write_ahead_log_t::lsn_t lsn = 0;
+    uint64_t backfill_metainfo_updates_before = 0;
+    {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> real_superblock;
+        // We assume one block per document, plus changes to the stats block and
+        // superblock.
+        const int expected_change_count = 2 + write.expected_document_changes();
+        // If there's a write-ahead log, it takes care of the durability.
+        acquire_superblock_for_write(expected_change_count,
+                                     write_ahead_log.has()
+                                         ? write_durability_t::SOFT
+                                         : durability,
+                                     token, &txn, &real_superblock, interruptor);
+        DEBUG_ONLY_CODE(metainfo->visit(
+            real_superblock.get(), metainfo_checker.region, metainfo_checker.callback));
+        if (write_ahead_log.has()) {
+            backfill_metainfo_updates_before = backfill_metainfo_updates;
+            // This must happen while we hold the superblock, so the records in the log
+            // are in the same order as the changes to the metainfo.
+            write_ahead_log_record_t record;
+            record.old_metainfo = metainfo_to_vectors(
+                metainfo->get(real_superblock.get(), new_metainfo.get_domain()));
+            record.new_metainfo = metainfo_to_vectors(new_metainfo);
+            record.timestamp = timestamp;
+            record.write = write;
+            write_message_t wm;
+            serialize_cluster_version(&wm, cluster_version_t::LATEST_DISK);
+            serialize<cluster_version_t::LATEST_DISK>(&wm, record);
+            vector_stream_t stream;
+            stream.reserve(wm.size());
+            int res = send_write_message(&stream, &wm);
+            guarantee(!res);
+            lsn = write_ahead_log->append(std::vector<char>(stream.vector()));
+        }
+        metainfo->update(real_superblock.get(), new_metainfo);
+        protocol_write(write, response, timestamp, &real_superblock, interruptor);
+    }
+    record_foreground_latency(start_time);
+
+    if (write_ahead_log.has()) {
+        if (durability == write_durability_t::HARD) {
+            /* The record is only replayed if the backfilled data that this write was
+            applied on top of survives a crash, and `receive_backfill()` doesn't log
+            that data. */
+            if (backfill_metainfo_updates_flushed < backfill_metainfo_updates_before) {
+                flush_btree(interruptor);
+                backfill_metainfo_updates_flushed = std::max(
+                    backfill_metainfo_updates_flushed, backfill_metainfo_updates_before);
+            }
+            write_ahead_log->wait_durable(lsn, interruptor);
+        }
+        if (write_ahead_log->active_segment_size() >= WRITE_AHEAD_LOG_CHECKPOINT_SIZE
+                && !write_ahead_log_checkpoint_pending) {
+            write_ahead_log_checkpoint_pending = true;
+            coro_t::spawn_sometime(std::bind(
+                &store_t::checkpoint_write_ahead_log_in_background,
+                this, drainer.lock()));
+        }
+    }
+}
+
+void store_t::open_write_ahead_log(const std::string &path, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    guarantee(!write_ahead_log.has());
+    scoped_ptr_t<write_ahead_log_t> log(new write_ahead_log_t(io_backender_, path));
+    for (const std::vector<char> &data : log->take_recovered_records()) {
+        replay_write_ahead_log_record(data);
+    }
+
+    /* The log forgets the replayed writes when it's reset, so they must be on disk in
+    the B-tree first. */
+    flush_btree(interruptor);
+    log->reset();
+    write_ahead_log = std::move(log);
+}
 
+void store_t::replay_write_ahead_log_record(const std::vector<char> &data) {
+    buffer_read_stream_t stream(data.data(), data.size());
+    cluster_version_t version;
+    archive_result_t res = deserialize_cluster_version(&stream, &version,
+        "Encountered a write-ahead log from RethinkDB 1.13, which is not supported.");
+    guarantee_deserialization(res, "write-ahead log record version");
+    if (version != cluster_version_t::LATEST_DISK) {
+        fail_due_to_user_error(
+            "The write-ahead log contains writes from a different version of "
+            "RethinkDB. Start the server with the old version to replay them, or "
+            "start it without `--write-ahead-log-directory` to discard them.");
+    }
+    write_ahead_log_record_t record;
+    res = deserialize<cluster_version_t::LATEST_DISK>(&stream, &record);
+    guarantee_deserialization(res, "write-ahead log record");
+
+    // Replaying the log happens before the store is used, so it isn't interruptible.
+    cond_t non_interruptor;
+    write_token_t token;
+    new_write_token(&token);
     scoped_ptr_t<txn_t> txn;
-    scoped_ptr_t<real_superblock_t> real_superblock;
-    // We assume one block per document, plus changes to the stats block and superblock.
-    const int expected_change_count = 2 + write.expected_document_changes();
-    acquire_superblock_for_write(expected_change_count, durability, token,
-                                 &txn, &real_superblock, interruptor);
-    DEBUG_ONLY_CODE(metainfo->visit(
-        real_superblock.get(), metainfo_checker.region, metainfo_checker.callback));
-    metainfo->update(real_superblock.get(), new_metainfo);
-    protocol_write(write, response, timestamp, &real_superblock, interruptor);
+    scoped_ptr_t<real_superblock_t> superblock;
+    acquire_superblock_for_write(2 + record.write.expected_document_changes(),
+                                 write_durability_t::SOFT,
+                                 &token, &txn, &superblock, &non_interruptor);
+    if (!(metainfo_to_vectors(metainfo->get(
+            superblock.get(), record.old_metainfo.get_domain()))
+                == record.old_metainfo)) {
+        return;
+    }
+    metainfo->update(superblock.get(), metainfo_from_vectors(record.new_metainfo));
+    write_response_t response;
+    protocol_write(record.write, &response, record.timestamp, &superblock,
+                   &non_interruptor);
+}
+
+void store_t::flush_btree(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+    write_token_t token;
+    new_write_token(&token);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    acquire_superblock_for_write(1, write_durability_t::HARD,
+                                 &token, &txn, &superblock, interruptor);
+    buf_write_t sb_write(superblock->get());
+    /* `txn`'s destructor blocks until it and all of the transactions before it are on
+    disk. */
+}
+
+void store_t::checkpoint_write_ahead_log(signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    new_mutex_acq_t acq(&write_ahead_log_checkpoint_mutex, interruptor);
+    {
+        write_token_t token;
+        new_write_token(&token);
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        acquire_superblock_for_write(1, write_durability_t::HARD,
+                                     &token, &txn, &superblock, interruptor);
+        buf_write_t sb_write(superblock->get());
+        /* Every write that is in the old segment acquired the superblock before us. */
+        write_ahead_log->start_new_segment(interruptor);
+        /* `txn`'s destructor blocks until it and all of the transactions before it are
+        on disk. */
+    }
+    write_ahead_log->discard_old_segment();
+}
+
+void store_t::checkpoint_write_ahead_log_in_background(
+        auto_drainer_t::lock_t keepalive) {
+    try {
+        checkpoint_write_ahead_log(keepalive.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        /* The store is shutting down. The log will be replayed on the next start. */
+    }
+    write_ahead_log_checkpoint_pending = false;
+}
+
+double store_t::get_foreground_latency_ms() {
+    assert_thread();
+    if (current_microtime() - foreground_latency_updated
+            > FOREGROUND_LATENCY_MAX_AGE_US) {
+        return 0;
+    }
+    return foreground_latency_ms;
+}
+
+void store_t::record_foreground_latency(microtime_t start_time) {
+    microtime_t now = current_microtime();
+    double latency_ms = static_cast<double>(now - start_time) / 1000;
+    if (now - foreground_latency_updated > FOREGROUND_LATENCY_MAX_AGE_US) {
+        /* Don't let an old estimate from before the store became idle skew the new
+        one. */
+        foreground_latency_ms = latency_ms;
+    } else {
+        foreground_latency_ms += FOREGROUND_LATENCY_WEIGHT
+            * (latency_ms - foreground_latency_ms);
+    }
+    foreground_latency_updated = now;
 }
 
 void store_t::reset_data(
@@ -233,6 +460,11 @@ void store_t::reset_data(
     assert_thread();
     with_priority_t p(CORO_PRIORITY_RESET_DATA);
 
+    // Changefeeds aren't told about the erased rows.
+    if (changefeed_server.has()) {
+        changefeed_server->note_unlogged_changes();
+    }
+
     // Erase the data in small chunks
     always_true_key_tester_t key_tester;
     const uint64_t max_erased_per_pass = 100;
@@ -281,6 +513,12 @@ void store_t::reset_data(
             update_sindexes(txn.get(), &sindex_block, mod_reports, true);
         }
     }
+
+    // Writes that get logged to the write-ahead log after this are only replayed on
+    // top of the erased data, so it must not get lost.
+    if (write_ahead_log.has()) {
+        checkpoint_write_ahead_log(interruptor);
+    }
 }
 
 std::map<std::string, std::pair<sindex_config_t, sindex_status_t> > store_t::sindex_list(
@@ -563,9 +801,9 @@ void store_t::sindex_queue_push(const rdb_modification_report_t &mod_report,
     if (!sindex_queues.empty()) {
         // This is for a disk backed queue so there's no versioning issues.
         // (deserializating_viewer_t in disk_backed_queue.hpp also uses the
-        // LATEST_DISK version, and such queues are ephemeral).
+        // LATEST_OVERALL version, and such queues are ephemeral).
         write_message_t wm;
-        serialize<cluster_version_t::LATEST_DISK>(&wm, mod_report);
+        serialize<cluster_version_t::LATEST_OVERALL>(&wm, mod_report);
 
         for (auto it = sindex_queues.begin(); it != sindex_queues.end(); ++it) {
             (*it)->push(wm);
@@ -583,7 +821,7 @@ void store_t::sindex_queue_push(
         scoped_array_t<write_message_t> wms(mod_reports.size());
         for (size_t i = 0; i < mod_reports.size(); ++i) {
             // This is for a disk backed queue so there are no versioning issues.
-            serialize<cluster_version_t::LATEST_DISK>(&wms[i], mod_reports[i]);
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[i], mod_reports[i]);
         }
 
         for (auto it = sindex_queues.begin(); it != sindex_queues.end(); ++it) {
@@ -1174,8 +1412,12 @@ void store_t::set_metainfo(const region_map_t<binary_blob_t> &new_metainfo,
 
     scoped_ptr_t<txn_t> txn;
     scoped_ptr_t<real_superblock_t> superblock;
+    // Writes that get logged to the write-ahead log after this one are only replayed
+    // on top of this metainfo, so it must not get lost.
     acquire_superblock_for_write(1,
-                                 durability,
+                                 write_ahead_log.has()
+                                     ? write_durability_t::HARD
+                                     : durability,
                                  token,
                                  &txn,
                                  &superblock,
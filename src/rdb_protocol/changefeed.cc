@@ -1,5 +1,7 @@
 #include "rdb_protocol/changefeed.hpp"
 
+#include <iterator>
+#include <limits>
 #include <queue>
 
 #include "boost_utils.hpp"
@@ -7,12 +9,21 @@
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/interruptor.hpp"
 #include "containers/archive/boost_types.hpp"
+#include "containers/archive/buffer_stream.hpp"
+#include "containers/archive/preserialized.hpp"
+#include "containers/archive/string_stream.hpp"
+#include "containers/archive/vector_stream.hpp"
+#include "containers/archive/versioned.hpp"
+#include "perfmon/perfmon.hpp"
 #include "rdb_protocol/artificial_table/backend.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/val.hpp"
 #include "rpc/mailbox/typed.hpp"
+#include "serializer/write_ahead_log.hpp"
+#include "time.hpp"
 
 #include "debug.hpp"
 
@@ -50,11 +61,13 @@ struct stamped_range_t {
 
 struct change_val_t {
     change_val_t(std::pair<uuid_u, uint64_t> _source_stamp,
+                 uint64_t _log_seq,
                  store_key_t _pkey,
                  boost::optional<indexed_datum_t> _old_val,
                  boost::optional<indexed_datum_t> _new_val
                  DEBUG_ONLY(, boost::optional<std::string> _sindex))
         : source_stamp(std::move(_source_stamp)),
+          log_seq(_log_seq),
           pkey(std::move(_pkey)),
           old_val(std::move(_old_val)),
           new_val(std::move(_new_val))
@@ -66,6 +79,8 @@ struct change_val_t {
         }
     }
     std::pair<uuid_u, uint64_t> source_stamp;
+    // The sequence number of the change in the source's change log.
+    uint64_t log_seq;
     store_key_t pkey;
     boost::optional<indexed_datum_t> old_val, new_val;
     DEBUG_ONLY(boost::optional<std::string> sindex;);
@@ -286,13 +301,502 @@ boost::optional<datum_t> apply_ops(
     }
 }
 
+template <cluster_version_t W>
+void serialize(write_message_t *wm, const stamped_msg_t &msg) {
+    serialize<W>(wm, msg.server_uuid);
+    serialize<W>(wm, msg.stamp);
+    serialize<W>(wm, msg.log_seq);
+    if (msg.serialized_submsg.has()) {
+        serialize<W>(wm, msg.serialized_submsg);
+    } else {
+        serialize<W>(wm, msg.submsg);
+    }
+}
+
+template <cluster_version_t W>
+archive_result_t deserialize(read_stream_t *s, stamped_msg_t *msg) {
+    archive_result_t res = deserialize<W>(s, &msg->server_uuid);
+    if (bad(res)) { return res; }
+    res = deserialize<W>(s, &msg->stamp);
+    if (bad(res)) { return res; }
+    res = deserialize<W>(s, &msg->log_seq);
+    if (bad(res)) { return res; }
+    return deserialize<W>(s, &msg->submsg);
+}
+INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(stamped_msg_t);
+
+// `server_t::send_all` sends the changes it has batched up for a client once there
+// are this many of them, or once they take up this many bytes...
+const size_t CHANGEFEED_BATCH_MAX_MSGS = 256;
+const size_t CHANGEFEED_BATCH_MAX_BYTES = 64 * KILOBYTE;
+// ...or, at the latest, after this many milliseconds.  A change for a client that
+// hasn't been sent anything for this long isn't batched at all.
+const int64_t CHANGEFEED_BATCH_WINDOW_MS = 5;
+
+struct server_t::batch_t {
+    batch_t() : size(0), flush_pending(false), last_sent(0), position(0) { }
+    std::vector<stamped_msg_t> msgs;
+    // The serialized size of the changes in `msgs`.
+    size_t size;
+    // True if a `flush_batch_cb` coroutine will send `msgs`.
+    bool flush_pending;
+    // When we last sent the client anything.
+    ticks_t last_sent;
+    // If this isn't 0, the client missed out on the changes up to this sequence
+    // number, and `flush_batch_cb` sends it a `position_t` so that its resume
+    // tokens move past them.
+    uint64_t position;
+};
+
+// The stats of a `server_t`, which show up as `changefeeds` in the stats of its
+// `store_t`.
+struct server_t::stats_t {
+    explicit stats_t(perfmon_collection_t *parent)
+        : collection_membership(parent, &collection, "changefeeds"),
+          pm_messages_sent(secs_to_ticks(1)),
+          pm_bytes_serialized(secs_to_ticks(1)),
+          pm_membership(&collection,
+              &pm_messages_sent, "messages_sent",
+              &pm_total_messages_sent, "total_messages_sent",
+              &pm_bytes_serialized, "bytes_serialized",
+              &pm_total_bytes_serialized, "total_bytes_serialized",
+              &pm_queue_depth, "queue_depth") { }
+
+    perfmon_collection_t collection;
+    perfmon_membership_t collection_membership;
+    // Every stamped message sent to a client counts, including changes sent as
+    // part of a batch.
+    perfmon_rate_monitor_t pm_messages_sent;
+    perfmon_counter_t pm_total_messages_sent;
+    // Changes are serialized once for all the clients (see `send_all`).
+    perfmon_rate_monitor_t pm_bytes_serialized;
+    perfmon_counter_t pm_total_bytes_serialized;
+    // The number of changes waiting in the clients' batches.
+    perfmon_counter_t pm_queue_depth;
+    perfmon_multi_membership_t pm_membership;
+};
+
+// A `change_log_t` keeps the changes a `server_t` sent in a `write_ahead_log_t`,
+// which has two segments.  Changes are appended to the active segment until it
+// holds `CHANGE_LOG_SEGMENT_BYTES`, or until its newest change is more than
+// `CHANGE_LOG_MAX_AGE_SECS` old, at which point the other segment is emptied and
+// becomes the active one.  The inactive segment is also emptied once its newest
+// change is too old.
+const int64_t CHANGE_LOG_SEGMENT_BYTES = 32 * MEGABYTE;
+const microtime_t CHANGE_LOG_MAX_AGE_SECS = 60 * 60;
+// `change_log_t::read` seeks to the newest indexed change before the ones it
+// wants, so it deserializes at most this many changes it doesn't need.
+const uint64_t CHANGE_LOG_INDEX_INTERVAL = 64;
+
+// Every segment starts with a `START` record, and a log that was closed cleanly
+// ends with a `CLOSE` record.  A `GAP` record means the changes before it don't
+// cover everything that happened to the data (see
+// `server_t::note_unlogged_changes`).
+enum class change_log_record_type_t {
+    START = 0,
+    CHANGE = 1,
+    GAP = 2,
+    CLOSE = 3
+};
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(change_log_record_type_t, int8_t,
+                                      change_log_record_type_t::START,
+                                      change_log_record_type_t::CLOSE);
+
+struct change_log_record_t {
+    change_log_record_t() : type(change_log_record_type_t::START), seq(0), time(0) { }
+    change_log_record_type_t type;
+    // The UUID of the `server_t` that wrote the log.  Only set for `START`.
+    uuid_u server_uuid;
+    // For `CHANGE`, the sequence number of the change.  For the others, the
+    // sequence number of the last change before the record.
+    uint64_t seq;
+    // When the change was appended.  Only set for `CHANGE`.
+    microtime_t time;
+    // Only set for `CHANGE`.
+    msg_t::change_t change;
+};
+RDB_MAKE_SERIALIZABLE_5(change_log_record_t, type, server_uuid, seq, time, change);
+INSTANTIATE_SERIALIZABLE_SINCE_v2_1(change_log_record_t);
+
+// The records are written with the latest disk version.  A log from another
+// version is thrown away rather than read, which only means that feeds can't
+// resume from the positions it handed out.  (That's also why we don't use
+// `deserialize_cluster_version`, which fails on some versions.)
+static std::vector<char> serialize_change_log_record(const change_log_record_t &record) {
+    write_message_t wm;
+    serialize_cluster_version(&wm, cluster_version_t::LATEST_DISK);
+    serialize<cluster_version_t::LATEST_DISK>(&wm, record);
+    vector_stream_t stream;
+    stream.reserve(wm.size());
+    int res = send_write_message(&stream, &wm);
+    guarantee(!res);
+    std::vector<char> data;
+    stream.swap(&data);
+    return data;
+}
+
+static bool deserialize_change_log_record(const std::vector<char> &data,
+                                          change_log_record_t *record_out) {
+    buffer_read_stream_t stream(data.data(), data.size());
+    int8_t version;
+    archive_result_t res =
+        deserialize<cluster_version_t::LATEST_OVERALL>(&stream, &version);
+    if (bad(res) || version != static_cast<int8_t>(cluster_version_t::LATEST_DISK)) {
+        return false;
+    }
+    res = deserialize<cluster_version_t::LATEST_DISK>(&stream, record_out);
+    return !bad(res) && stream.tell() == static_cast<int64_t>(data.size());
+}
+
+class change_log_t {
+public:
+    // Creates an empty log at `path` for the changes `server_uuid` sends after
+    // `seq`.  If `persistent` is false, the log is deleted when we're destroyed.
+    change_log_t(io_backender_t *io_backender,
+                 const std::string &_path,
+                 bool _persistent,
+                 uuid_u _server_uuid,
+                 uint64_t seq)
+        : path(_path),
+          persistent(_persistent),
+          log(new write_ahead_log_t(io_backender, path)),
+          server_uuid(_server_uuid),
+          start_seq(seq),
+          last_seq(seq),
+          active_time(0),
+          old_seq(0),
+          old_time(0) {
+        log->take_recovered_records();
+        log->reset();
+        append_start(seq);
+    }
+
+    // Opens the log that a persistent `change_log_t` left at `path`.  Returns an
+    // empty pointer if there isn't one, or if it wasn't closed cleanly, because
+    // then we can't tell which changes are missing from it.
+    static scoped_ptr_t<change_log_t> reopen(io_backender_t *io_backender,
+                                             const std::string &path) {
+        scoped_ptr_t<change_log_t> res(new change_log_t(io_backender, path));
+        std::vector<std::pair<uint64_t, std::vector<char> > > changes;
+        bool started = false, closed = false;
+        for (auto &&data : res->log->take_recovered_records()) {
+            change_log_record_t record;
+            if (closed || !deserialize_change_log_record(data, &record)) {
+                started = false;
+                break;
+            }
+            switch (record.type) {
+            case change_log_record_type_t::START:
+                if (!started) {
+                    started = true;
+                    res->server_uuid = record.server_uuid;
+                    res->start_seq = res->last_seq = record.seq;
+                } else if (record.server_uuid != res->server_uuid
+                           || record.seq != res->last_seq) {
+                    started = false;
+                }
+                break;
+            case change_log_record_type_t::CHANGE:
+                if (record.seq != res->last_seq + 1) {
+                    started = false;
+                    break;
+                }
+                res->last_seq = record.seq;
+                res->active_time = record.time;
+                changes.push_back(std::make_pair(record.seq, std::move(data)));
+                break;
+            case change_log_record_type_t::GAP:
+                changes.clear();
+                res->start_seq = res->last_seq = record.seq;
+                break;
+            case change_log_record_type_t::CLOSE:
+                closed = record.seq == res->last_seq;
+                break;
+            default:
+                unreachable();
+            }
+            if (!started) {
+                break;
+            }
+        }
+        res->log->reset();
+        if (!started || !closed) {
+            // We keep the files, but the new `reset()` means nothing in them
+            // will be mistaken for a record again.
+            return scoped_ptr_t<change_log_t>();
+        }
+        // The `CLOSE` record is gone, so the log counts as closed uncleanly
+        // again until we're destroyed.
+        res->append_start(res->start_seq);
+        for (auto &&pair : changes) {
+            res->note_appended(pair.first, res->log->append(std::move(pair.second)));
+        }
+        return res;
+    }
+
+    ~change_log_t() {
+        if (persistent) {
+            change_log_record_t record;
+            record.type = change_log_record_type_t::CLOSE;
+            record.seq = last_seq;
+            cond_t non_interruptor;
+            log->wait_durable(log->append(serialize_change_log_record(record)),
+                              &non_interruptor);
+        } else {
+            log.reset();
+            write_ahead_log_t::remove(path);
+        }
+    }
+
+    uuid_u get_server_uuid() const { return server_uuid; }
+    uint64_t get_last_seq() const { return last_seq; }
+
+    // `append` and `note_gap` must not be called concurrently with each other.
+    // They only block when a segment has to be emptied.
+    void append(uint64_t seq, const msg_t::change_t &change) {
+        guarantee(seq == last_seq + 1);
+        const microtime_t now = current_microtime();
+        maybe_switch_segments(now);
+        change_log_record_t record;
+        record.type = change_log_record_type_t::CHANGE;
+        record.seq = seq;
+        record.time = now;
+        record.change = change;
+        note_appended(seq, log->append(serialize_change_log_record(record)));
+        last_seq = seq;
+        active_time = now;
+    }
+
+    // Forgets the changes up to `seq`, which weren't logged.
+    void note_gap(uint64_t seq) {
+        guarantee(seq > last_seq);
+        change_log_record_t record;
+        record.type = change_log_record_type_t::GAP;
+        record.seq = seq;
+        log->append(serialize_change_log_record(record));
+        start_seq = last_seq = seq;
+        index.clear();
+    }
+
+    // Reads the changes in `(seq, upto]` into `changes_out`, oldest first.
+    // Returns false if some of them are no longer in the log.  All the changes up
+    // to `upto` must have been appended already.
+    bool read(uint64_t seq,
+              uint64_t upto,
+              std::vector<msg_t::change_t> *changes_out,
+              signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        std::vector<std::vector<char> > records;
+        {
+            rwlock_acq_t acq(&segments_lock, access_t::read, interruptor);
+            guarantee(upto <= last_seq);
+            if (seq < start_seq || seq > upto) {
+                return false;
+            }
+            if (seq == upto) {
+                return true;
+            }
+            // We start reading at the newest indexed change up to `seq + 1`.
+            write_ahead_log_t::lsn_t since = 0;
+            auto it = std::upper_bound(
+                index.begin(), index.end(),
+                std::make_pair(seq + 1,
+                               std::numeric_limits<write_ahead_log_t::lsn_t>::max()));
+            if (it != index.begin()) {
+                since = std::prev(it)->second;
+            }
+            records = log->read_records(since, interruptor);
+        }
+        for (const auto &data : records) {
+            change_log_record_t record;
+            guarantee(deserialize_change_log_record(data, &record));
+            if (record.type == change_log_record_type_t::CHANGE
+                && record.seq > seq && record.seq <= upto) {
+                changes_out->push_back(std::move(record.change));
+            }
+        }
+        guarantee(changes_out->size() == upto - seq);
+        return true;
+    }
+
+private:
+    // Used by `reopen`.
+    change_log_t(io_backender_t *io_backender, const std::string &_path)
+        : path(_path),
+          persistent(true),
+          log(new write_ahead_log_t(io_backender, path)),
+          start_seq(0),
+          last_seq(0),
+          active_time(0),
+          old_seq(0),
+          old_time(0) { }
+
+    // Adds the change `seq`, which was appended as the record `lsn`, to `index`
+    // if the last indexed change is far enough back or in the other segment.
+    void note_appended(uint64_t seq, write_ahead_log_t::lsn_t lsn) {
+        if (index.empty()
+            || seq >= index.back().first + CHANGE_LOG_INDEX_INTERVAL
+            || index.back().first <= old_seq) {
+            index.push_back(std::make_pair(seq, lsn));
+        }
+    }
+
+    void append_start(uint64_t seq) {
+        change_log_record_t record;
+        record.type = change_log_record_type_t::START;
+        record.server_uuid = server_uuid;
+        record.seq = seq;
+        log->append(serialize_change_log_record(record));
+    }
+
+    void maybe_switch_segments(microtime_t now) {
+        const microtime_t max_age = CHANGE_LOG_MAX_AGE_SECS * MILLION;
+        const bool old_expired = old_seq != 0 && old_time + max_age < now;
+        const bool switch_segments = log->active_segment_size() >= CHANGE_LOG_SEGMENT_BYTES
+            || (active_time != 0 && active_time + max_age < now);
+        if (!old_expired && !switch_segments) {
+            return;
+        }
+        // Nothing can read the segments while we empty one.
+        rwlock_acq_t acq(&segments_lock, access_t::write);
+        if (old_seq != 0) {
+            log->discard_old_segment();
+            while (!index.empty() && index.front().first <= old_seq) {
+                index.pop_front();
+            }
+            start_seq = std::max(start_seq, old_seq);
+            old_seq = 0;
+        }
+        if (switch_segments) {
+            cond_t non_interruptor;
+            log->start_new_segment(&non_interruptor);
+            old_seq = last_seq;
+            old_time = active_time;
+            active_time = 0;
+            append_start(last_seq);
+        }
+    }
+
+    const std::string path;
+    const bool persistent;
+    scoped_ptr_t<write_ahead_log_t> log;
+    uuid_u server_uuid;
+
+    // The log holds all the changes with sequence numbers in
+    // `(start_seq, last_seq]`.
+    uint64_t start_seq;
+    uint64_t last_seq;
+    // When the newest change in the active segment was appended, or 0 if it
+    // doesn't have any.
+    microtime_t active_time;
+    // The sequence number and time of the newest change in the inactive
+    // segment, or 0 if it doesn't have any.
+    uint64_t old_seq;
+    microtime_t old_time;
+    // Every `CHANGE_LOG_INDEX_INTERVAL`th change in the log, and the first one in
+    // each segment, with its log sequence number, oldest first.
+    std::deque<std::pair<uint64_t, write_ahead_log_t::lsn_t> > index;
+    // Held for writing while a segment is emptied.
+    rwlock_t segments_lock;
+
+    DISABLE_COPYING(change_log_t);
+};
+
+// Subscriptions are only given the same filters if `shard_filters_key` returns
+// the same key for them.  The key doesn't depend on the variable numbers and
+// backtraces the query happened to give its functions.
+std::string shard_filters_key(const std::vector<filter_wire_func_t> &filters) {
+    std::vector<std::pair<std::string, std::string> > keys;
+    for (const auto &filter : filters) {
+        keys.push_back(std::make_pair(
+            filter.filter_func.canonical_key(),
+            filter.default_filter_val
+                ? filter.default_filter_val->canonical_key()
+                : std::string()));
+    }
+    write_message_t wm;
+    serialize<cluster_version_t::CLUSTER>(&wm, keys);
+    string_stream_t stream;
+    int write_res = send_write_message(&stream, &wm);
+    guarantee(write_res == 0);
+    return std::move(stream.str());
+}
+
+class shard_filter_t : public single_threaded_countable_t<shard_filter_t> {
+public:
+    shard_filter_t(rdb_context_t *ctx, const std::vector<filter_wire_func_t> &filters) {
+        // The final `NULL` argument means we don't profile any work done with
+        // this `env`.
+        env = make_scoped<env_t>(
+            ctx, return_empty_normal_batches_t::NO, drainer.get_drain_signal(),
+            std::map<std::string, wire_func_t>(), nullptr);
+        for (const auto &filter : filters) {
+            funcs.push_back(std::make_pair(
+                filter.filter_func.compile_wire_func(),
+                filter.default_filter_val
+                    ? filter.default_filter_val->compile_wire_func()
+                    : counted_t<const func_t>()));
+        }
+    }
+    // Returns `false` only if `range_sub_t` would drop `change`, i.e. if neither
+    // of its values passes the filters.
+    bool passes(const msg_t::change_t &change) {
+        auto_drainer_t::lock_t lock(&drainer);
+        return (change.old_val.has() && passes(change.old_val))
+            || (change.new_val.has() && passes(change.new_val));
+    }
+private:
+    bool passes(const datum_t &val) {
+        try {
+            for (const auto &pair : funcs) {
+                if (!pair.first->filter_call(env.get(), val, pair.second)) {
+                    return false;
+                }
+            }
+            return true;
+        } catch (const base_exc_t &) {
+            // Our `env` doesn't have the optargs (e.g. `array_limit`) of the
+            // subscribed queries, so we let the client decide.
+            return true;
+        }
+    }
+
+    std::vector<std::pair<counted_t<const func_t>, counted_t<const func_t> > > funcs;
+    scoped_ptr_t<env_t> env;
+    auto_drainer_t drainer;
+};
+
 server_t::client_info_t::client_info_t()
-    : limit_clients(&opt_lt<std::string>),
+    : wants_positions(false),
+      batch(new batch_t()),
+      limit_clients(&opt_lt<std::string>),
       limit_clients_lock(new rwlock_t()) { }
 
-server_t::server_t(mailbox_manager_t *_manager)
-    : uuid(generate_uuid()),
+server_t::server_t(mailbox_manager_t *_manager,
+                   io_backender_t *_io_backender,
+                   const base_path_t &_base_path,
+                   perfmon_collection_t *_perfmon_collection,
+                   const std::string &_change_log_path)
+    : server_t(_manager, _io_backender, _base_path, _perfmon_collection,
+               _change_log_path,
+               _change_log_path.empty()
+                   ? scoped_ptr_t<change_log_t>()
+                   : change_log_t::reopen(_io_backender, _change_log_path)) { }
+
+server_t::server_t(mailbox_manager_t *_manager,
+                   io_backender_t *_io_backender,
+                   const base_path_t &_base_path,
+                   perfmon_collection_t *_perfmon_collection,
+                   const std::string &_change_log_path,
+                   scoped_ptr_t<change_log_t> &&reopened_log)
+    : uuid(reopened_log.has() ? reopened_log->get_server_uuid() : generate_uuid()),
       manager(_manager),
+      io_backender(_io_backender),
+      base_path(_base_path),
+      change_log_path(_change_log_path),
+      perfmon_collection(_perfmon_collection),
+      stats(new stats_t(_perfmon_collection)),
+      log_seq(reopened_log.has() ? reopened_log->get_last_seq() : 0),
+      change_log(std::move(reopened_log)),
       stop_mailbox(manager,
                    std::bind(&server_t::stop_mailbox_cb, this, ph::_1, ph::_2)),
       limit_stop_mailbox(manager, std::bind(&server_t::limit_stop_mailbox_cb,
@@ -300,6 +804,25 @@ server_t::server_t(mailbox_manager_t *_manager)
 
 server_t::~server_t() { }
 
+void server_t::note_unlogged_changes() {
+    auto_drainer_t::lock_t lock(&drainer);
+    uint64_t seq;
+    fifo_enforcer_write_token_t log_token;
+    {
+        rwlock_acq_t stamp_acq(&stamp_lock, access_t::write);
+        if (!change_log.has()) {
+            return;
+        }
+        // The gap gets its own sequence number, so that no feed has it as its
+        // position yet.
+        seq = ++log_seq;
+        log_token = log_fifo_source.enter_write();
+    }
+    fifo_enforcer_sink_t::exit_write_t exit_write(&log_fifo_sink, log_token);
+    exit_write.wait_lazily_unordered();
+    change_log->note_gap(seq);
+}
+
 void server_t::stop_mailbox_cb(signal_t *, client_t::addr_t addr) {
     rwlock_in_line_t spot(&clients_lock, access_t::read);
     spot.read_signal()->wait_lazily_unordered();
@@ -361,7 +884,10 @@ void server_t::limit_stop_mailbox_cb(signal_t *,
     }
 }
 
-void server_t::add_client(const client_t::addr_t &addr, region_t region) {
+void server_t::add_client(const client_t::addr_t &addr,
+                          region_t region,
+                          const std::vector<filter_wire_func_t> &filters,
+                          rdb_context_t *ctx) {
     auto_drainer_t::lock_t lock(&drainer);
     rwlock_in_line_t spot(&clients_lock, access_t::write);
     spot.write_signal()->wait_lazily_unordered();
@@ -377,6 +903,19 @@ void server_t::add_client(const client_t::addr_t &addr, region_t region) {
     // that's fine.
     if (!info->cond.has()) {
         info->stamp = 0;
+        if (filters.size() != 0) {
+            info->filter_key = shard_filters_key(filters);
+            for (const auto &pair : clients) {
+                if (pair.second.filter.has()
+                    && pair.second.filter_key == info->filter_key) {
+                    info->filter = pair.second.filter;
+                    break;
+                }
+            }
+            if (!info->filter.has()) {
+                info->filter = make_counted<shard_filter_t>(ctx, filters);
+            }
+        }
         cond_t *stopped = new cond_t();
         info->cond.init(stopped);
         // We spawn now so the auto drainer lock is acquired immediately.
@@ -446,19 +985,6 @@ void server_t::add_client_cb(signal_t *stopped, client_t::addr_t addr) {
     guarantee(erased == 1);
 }
 
-struct stamped_msg_t {
-    stamped_msg_t() { }
-    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, msg_t _submsg)
-        : server_uuid(std::move(_server_uuid)),
-          stamp(_stamp),
-          submsg(std::move(_submsg)) { }
-    uuid_u server_uuid;
-    uint64_t stamp;
-    msg_t submsg;
-};
-
-RDB_MAKE_SERIALIZABLE_3(stamped_msg_t, server_uuid, stamp, submsg);
-
 // This function takes a `lock_t` to make sure you have one.  (We can't just
 // always acquire a drainer lock before sending because we sometimes send a
 // `stop_t` during destruction, and you can't acquire a drain lock on a draining
@@ -467,14 +993,55 @@ void server_t::send_one_with_lock(
     const auto_drainer_t::lock_t &,
     std::pair<const client_t::addr_t, client_info_t> *client,
     msg_t msg) {
-    uint64_t stamp;
+    std::vector<stamped_msg_t> msgs;
     {
         // We don't need a write lock as long as we make sure the coroutine
         // doesn't block between reading and updating the stamp.
         ASSERT_NO_CORO_WAITING;
-        stamp = client->second.stamp++;
+        // We send any changes still waiting in the batch along with `msg`, so
+        // that e.g. a `stop_t` doesn't overtake them.
+        batch_t *batch = client->second.batch.get();
+        msgs.swap(batch->msgs);
+        batch->size = 0;
+        batch->last_sent = get_ticks();
+        stats->pm_queue_depth -= msgs.size();
+        msgs.push_back(stamped_msg_t(uuid, client->second.stamp++, std::move(msg)));
+    }
+    send_msgs(client->first, msgs);
+}
+
+void server_t::send_msgs(const client_t::addr_t &addr,
+                         const std::vector<stamped_msg_t> &msgs) {
+    stats->pm_messages_sent.record(msgs.size());
+    stats->pm_total_messages_sent += msgs.size();
+    send(manager, addr, msgs);
+}
+
+std::set<client_t::addr_t> server_t::filtered_clients(
+        const msg_t::change_t &change) {
+    // We take references to the filters, so that they stay alive if their
+    // clients are removed while we evaluate them.
+    std::map<shard_filter_t *,
+             std::pair<counted_t<shard_filter_t>, std::vector<client_t::addr_t> > >
+        filters;
+    {
+        rwlock_acq_t acq(&clients_lock, access_t::read);
+        ASSERT_NO_CORO_WAITING;
+        for (const auto &pair : clients) {
+            if (pair.second.filter.has()) {
+                auto *entry = &filters[pair.second.filter.get()];
+                entry->first = pair.second.filter;
+                entry->second.push_back(pair.first);
+            }
+        }
+    }
+    std::set<client_t::addr_t> ret;
+    for (const auto &pair : filters) {
+        if (!pair.second.first->passes(change)) {
+            ret.insert(pair.second.second.begin(), pair.second.second.end());
+        }
     }
-    send(manager, client->first, stamped_msg_t(uuid, stamp, std::move(msg)));
+    return ret;
 }
 
 void server_t::send_all(const msg_t &msg,
@@ -482,24 +1049,154 @@ void server_t::send_all(const msg_t &msg,
                         rwlock_in_line_t *stamp_spot) {
     auto_drainer_t::lock_t lock(&drainer);
     stamp_spot->guarantee_is_for_lock(&stamp_lock);
+    const msg_t::change_t *change = boost::get<msg_t::change_t>(&msg.op);
+    // Evaluating the filters may block, so we do it before our turn on
+    // `stamp_lock` comes up, while the writes ahead of us are still stamping.
+    // A client whose filters reject a change doesn't get a stamp for it either,
+    // so it doesn't wait for a message that will never arrive.  Clients that
+    // subscribe in the meantime just aren't filtered for this change.
+    std::set<client_t::addr_t> filtered;
+    if (change != nullptr) {
+        filtered = filtered_clients(*change);
+    }
     stamp_spot->write_signal()->wait_lazily_unordered();
 
     rwlock_acq_t acq(&clients_lock, access_t::read);
+    // Every change gets a sequence number, which feeds use as their position in
+    // the change log.  We only log the change if a feed asked for the log, and
+    // we don't do that until we've released `stamp_lock`.
+    uint64_t seq = 0;
+    boost::optional<fifo_enforcer_write_token_t> log_token;
+    if (change != nullptr) {
+        seq = ++log_seq;
+        if (change_log.has()) {
+            log_token = log_fifo_source.enter_write();
+        }
+    }
     std::map<client_t::addr_t, uint64_t> stamps;
+    // The clients that need a `position_t` because they don't get the change.
+    std::vector<client_t::addr_t> skipped;
     for (auto &&pair : clients) {
         // We don't need a write lock as long as we make sure the coroutine
         // doesn't block between reading and updating the stamp.
         ASSERT_NO_CORO_WAITING;
-        if (std::any_of(pair.second.regions.begin(),
-                        pair.second.regions.end(),
-                        std::bind(&region_contains_key, ph::_1, std::cref(key)))) {
+        if (filtered.count(pair.first) == 0
+            && std::any_of(pair.second.regions.begin(),
+                           pair.second.regions.end(),
+                           std::bind(&region_contains_key, ph::_1, std::cref(key)))) {
             stamps[pair.first] = pair.second.stamp++;
+        } else if (change != nullptr && pair.second.wants_positions) {
+            skipped.push_back(pair.first);
         }
     }
-    acq.reset();
     stamp_spot->reset(); // Done stamping, no need to hold onto it while we send.
+    if (log_token) {
+        fifo_enforcer_sink_t::exit_write_t exit_write(&log_fifo_sink, *log_token);
+        exit_write.wait_lazily_unordered();
+        change_log->append(seq, *change);
+    }
+
+    // Rather than sending a `position_t` for every change a client misses out
+    // on, we send one along with its next batch.
+    for (const auto &addr : skipped) {
+        ASSERT_NO_CORO_WAITING;
+        auto it = clients.find(addr);
+        guarantee(it != clients.end());
+        batch_t *batch = it->second.batch.get();
+        batch->position = std::max(batch->position, seq);
+        if (!batch->flush_pending) {
+            batch->flush_pending = true;
+            coro_t::spawn_sometime(
+                std::bind(&server_t::flush_batch_cb, this, lock, addr));
+        }
+    }
+    if (stamps.size() == 0) {
+        return;
+    }
+
+    // Only the stamp differs between clients, so we serialize `msg` once and
+    // share the buffer between all the sends.
+    preserialized_t<msg_t> serialized_msg(msg);
+    stats->pm_bytes_serialized.record(serialized_msg.size());
+    stats->pm_total_bytes_serialized += serialized_msg.size();
+
+    // Rather than sending every change to each client right away, we add it to
+    // the client's batch, which is sent when it grows too big or after
+    // `CHANGEFEED_BATCH_WINDOW_MS`, whichever comes first.  This cuts down on
+    // the number of messages when a table has many writes.  If the client hasn't
+    // been sent anything during the last window there's no backlog to batch the
+    // change with, so it goes out right away instead of waiting for the window.
+    const ticks_t now = get_ticks();
+    std::vector<std::pair<client_t::addr_t, std::vector<stamped_msg_t> > > ready;
     for (const auto &pair : stamps) {
-        send(manager, pair.first, stamped_msg_t(uuid, pair.second, msg));
+        ASSERT_NO_CORO_WAITING;
+        auto it = clients.find(pair.first);
+        guarantee(it != clients.end());
+        batch_t *batch = it->second.batch.get();
+        batch->msgs.push_back(stamped_msg_t(uuid, pair.second, seq, serialized_msg));
+        batch->size += serialized_msg.size();
+        if (batch->position <= seq) {
+            // The change moves the client past the position.
+            batch->position = 0;
+        }
+        ++stats->pm_queue_depth;
+        const bool idle = !batch->flush_pending
+            && now - batch->last_sent
+                >= static_cast<ticks_t>(CHANGEFEED_BATCH_WINDOW_MS * MILLION);
+        if (idle
+            || batch->msgs.size() >= CHANGEFEED_BATCH_MAX_MSGS
+            || batch->size >= CHANGEFEED_BATCH_MAX_BYTES) {
+            stats->pm_queue_depth -= batch->msgs.size();
+            ready.push_back(std::make_pair(pair.first, std::move(batch->msgs)));
+            batch->msgs.clear();
+            batch->size = 0;
+            batch->last_sent = now;
+        } else if (!batch->flush_pending) {
+            batch->flush_pending = true;
+            coro_t::spawn_sometime(
+                std::bind(&server_t::flush_batch_cb, this, lock, pair.first));
+        }
+    }
+    acq.reset();
+    for (const auto &pair : ready) {
+        send_msgs(pair.first, pair.second);
+    }
+}
+
+void server_t::flush_batch_cb(auto_drainer_t::lock_t lock, client_t::addr_t addr) {
+    try {
+        nap(CHANGEFEED_BATCH_WINDOW_MS, lock.get_drain_signal());
+    } catch (const interrupted_exc_t &) {
+        // We still send what we have, so that the client sees every stamp.
+    }
+    std::vector<stamped_msg_t> msgs;
+    {
+        rwlock_acq_t acq(&clients_lock, access_t::read);
+        auto it = clients.find(addr);
+        // The client may have been removed in the meantime, in which case its
+        // batch was sent along with the `stop_t`.
+        if (it == clients.end()) {
+            return;
+        }
+        batch_t *batch = it->second.batch.get();
+        msgs.swap(batch->msgs);
+        batch->size = 0;
+        batch->flush_pending = false;
+        batch->last_sent = get_ticks();
+        stats->pm_queue_depth -= msgs.size();
+        if (batch->position != 0) {
+            // Every change up to `position` was stamped before we get here, so
+            // the client will have seen the ones it was sent by the time it gets
+            // to this.  We don't need `stamp_lock` for the same reason as
+            // `send_one_with_lock`.
+            ASSERT_NO_CORO_WAITING;
+            msgs.push_back(stamped_msg_t(uuid, it->second.stamp++, batch->position,
+                                         msg_t(msg_t::position_t())));
+            batch->position = 0;
+        }
+    }
+    if (msgs.size() != 0) {
+        send_msgs(addr, msgs);
     }
 }
 
@@ -532,6 +1229,74 @@ boost::optional<uint64_t> server_t::get_stamp(const client_t::addr_t &addr) {
     }
 }
 
+boost::optional<uint64_t> server_t::get_stamp(
+        const client_t::addr_t &addr,
+        const boost::optional<log_position_t> &resume_from,
+        log_read_t *log_out,
+        signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+    auto_drainer_t::lock_t lock(&drainer);
+    if (!change_log.has()) {
+        // Creating the log does file I/O, so we don't hold `stamp_lock` for it, or
+        // every write to the table would wait for it.
+        mutex_t::acq_t create_acq(&change_log_create_mutex);
+        if (!change_log.has()) {
+            const bool persistent = !change_log_path.empty();
+            const uint64_t start_seq = log_seq;
+            scoped_ptr_t<change_log_t> new_log(new change_log_t(
+                io_backender,
+                persistent
+                    ? change_log_path
+                    : strprintf("%s/%s/changefeed_log_%s",
+                                base_path.path().c_str(),
+                                TEMPORARY_DIRECTORY_NAME,
+                                uuid_to_str(uuid).c_str()),
+                persistent,
+                uuid,
+                start_seq));
+            rwlock_acq_t stamp_acq(&stamp_lock, access_t::write);
+            guarantee(!change_log.has());
+            // The changes sent while we were creating the log aren't in it.
+            if (log_seq != start_seq) {
+                new_log->note_gap(log_seq);
+            }
+            change_log = std::move(new_log);
+        }
+    }
+    boost::optional<uint64_t> stamp;
+    boost::optional<uint64_t> resume_seq;
+    fifo_enforcer_read_token_t log_token;
+    {
+        rwlock_acq_t stamp_acq(&stamp_lock, access_t::read);
+        log_out->seq = log_seq;
+        if (resume_from) {
+            // If the position doesn't include us, the feed would miss our changes.
+            auto it = resume_from->find(uuid);
+            if (it == resume_from->end()) {
+                log_out->expired = true;
+            } else {
+                resume_seq = it->second;
+                log_token = log_fifo_source.enter_read();
+            }
+        }
+        rwlock_acq_t client_acq(&clients_lock, access_t::read);
+        auto it = clients.find(addr);
+        if (it != clients.end()) {
+            it->second.wants_positions = true;
+            stamp = it->second.stamp;
+        }
+    }
+    if (resume_seq) {
+        {
+            // Waits for the changes up to `log_out->seq` to be appended.
+            fifo_enforcer_sink_t::exit_read_t exit_read(&log_fifo_sink, log_token);
+            wait_interruptible(&exit_read, interruptor);
+        }
+        log_out->expired = !change_log->read(
+            *resume_seq, log_out->seq, &log_out->changes, interruptor);
+    }
+    return stamp;
+}
+
 uuid_u server_t::get_uuid() {
     return uuid;
 }
@@ -782,6 +1547,11 @@ bool limit_order_t::operator()(const std::string &a, const std::string &b) const
     unreachable();
 }
 
+// A `limit_manager_t` buffers as many rows past the limit as the limit itself, but
+// at least `LIMIT_BUFFER_MIN_ROWS` and at most `LIMIT_BUFFER_MAX_ROWS` of them.
+const size_t LIMIT_BUFFER_MIN_ROWS = 32;
+const size_t LIMIT_BUFFER_MAX_ROWS = 1000;
+
 void limit_manager_t::send(msg_t &&msg) {
     if (!parent->drainer.is_draining()) {
         auto_drainer_t::lock_t drain_lock(&parent->drainer);
@@ -811,6 +1581,9 @@ limit_manager_t::limit_manager_t(
       spec(std::move(_spec)),
       gt(std::move(_gt)),
       item_queue(gt),
+      buffer(gt),
+      buffer_size(limit_buffer_size(spec.limit)),
+      buffer_complete(item_vec.size() < spec.limit + buffer_size),
       aborted(false) {
     guarantee(clients_lock->read_signal()->is_pulsed());
 
@@ -824,7 +1597,17 @@ limit_manager_t::limit_manager_t(
         ops.push_back(make_op(transform));
     }
 
+    // `item_vec` is sorted best-first, so the first `spec.limit` rows are the ones
+    // we send and the rest go in the buffer.
     guarantee(item_queue.size() == 0);
+    guarantee(buffer.size() == 0);
+    for (size_t i = spec.limit; i < item_vec.size(); ++i) {
+        bool inserted = buffer.insert(std::move(item_vec[i])).second;
+        guarantee(inserted);
+    }
+    if (item_vec.size() > spec.limit) {
+        item_vec.resize(spec.limit);
+    }
     for (const auto &pair : item_vec) {
         bool inserted = item_queue.insert(pair).second;
         guarantee(inserted);
@@ -832,6 +1615,10 @@ limit_manager_t::limit_manager_t(
     send(msg_t(msg_t::limit_start_t(uuid, std::move(item_vec))));
 }
 
+size_t limit_buffer_size(size_t limit) {
+    return std::min(std::max(limit, LIMIT_BUFFER_MIN_ROWS), LIMIT_BUFFER_MAX_ROWS);
+}
+
 void limit_manager_t::add(
     rwlock_in_line_t *spot,
     store_key_t sk,
@@ -994,6 +1781,17 @@ void limit_manager_t::commit(
     if (added.size() == 0 && deleted.size() == 0) {
         return;
     }
+    // Rows past the end of the buffer are unknown to us, so new rows which fall past
+    // the limit are only buffered if they come before the last row we know of.
+    boost::optional<item_t> last_known;
+    if (!buffer_complete) {
+        if (buffer.size() != 0) {
+            last_known = item_t(**buffer.begin());
+        } else if (item_queue.size() != 0) {
+            last_known = item_t(**item_queue.begin());
+        }
+    }
+
     item_queue_t real_added(gt);
     std::set<std::string> real_deleted;
     for (auto &&id : deleted) {
@@ -1001,6 +1799,9 @@ void limit_manager_t::commit(
         if (data_deleted) {
             bool inserted = real_deleted.insert(std::move(id)).second;
             guarantee(inserted);
+        } else {
+            // The client never saw rows in the buffer, so there's nothing to send.
+            UNUSED bool buffer_deleted = buffer.del_id(id);
         }
     }
     deleted.clear();
@@ -1014,6 +1815,8 @@ void limit_manager_t::commit(
             item_queue.erase(it);
             real_added.erase(sub_it);
         }
+        // Same as above, but the earlier version fell past the limit.
+        UNUSED bool buffer_deleted = buffer.del_id(pair.first);
         bool inserted = item_queue.insert(pair).second;
         guarantee(inserted);
         inserted = real_added.insert(std::move(pair)).second;
@@ -1021,23 +1824,51 @@ void limit_manager_t::commit(
     }
     added.clear();
 
-    std::vector<std::string> truncated = item_queue.truncate_top(spec.limit);
-    for (auto &&id : truncated) {
-        auto it = real_added.find_id(id);
-        if (it != real_added.end()) {
-            real_added.erase(it);
+    while (item_queue.size() > spec.limit) {
+        auto it = item_queue.begin();
+        item_t item(**it);
+        item_queue.erase(it);
+        auto sub_it = real_added.find_id(item.first);
+        if (sub_it != real_added.end()) {
+            real_added.erase(sub_it);
+            if (last_known && !gt(*last_known, item)) {
+                continue;
+            }
         } else {
-            bool inserted = real_deleted.insert(std::move(id)).second;
+            bool inserted = real_deleted.insert(item.first).second;
             guarantee(inserted);
         }
+        bool inserted = buffer.insert(std::move(item)).second;
+        guarantee(inserted);
+    }
+    while (buffer.size() > buffer_size) {
+        buffer.erase(buffer.begin());
+        buffer_complete = false;
+    }
+
+    // Replace rows that left the top `spec.limit` with the best rows in the buffer.
+    while (item_queue.size() < spec.limit && buffer.size() != 0) {
+        auto it = std::prev(buffer.end());
+        item_t item(**it);
+        buffer.erase(it);
+        bool ins = item_queue.insert(item).second;
+        guarantee(ins);
+        size_t erased = real_deleted.erase(item.first);
+        if (erased == 0) {
+            ins = real_added.insert(std::move(item)).second;
+            guarantee(ins);
+        }
     }
-    // TODO: we should try to avoid this read if we know we only added rows.
-    if (item_queue.size() < spec.limit) {
+    // We only need to read from the btree if we ran out of buffered rows, in which
+    // case we read enough to refill the buffer as well.
+    if (item_queue.size() < spec.limit && !buffer_complete) {
+        guarantee(buffer.size() == 0);
         auto data_it = item_queue.begin();
         boost::optional<item_queue_t::iterator> start;
         if (data_it != item_queue.end()) {
             start = data_it;
         }
+        size_t missing = spec.limit - item_queue.size();
         std::vector<item_t> s;
         boost::optional<exc_t> exc;
         try {
@@ -1045,7 +1876,7 @@ void limit_manager_t::commit(
                 sindex_ref,
                 spec.range.sorting,
                 start,
-                spec.limit - item_queue.size());
+                missing + buffer_size);
         } catch (const exc_t &e) {
             exc = e;
         }
@@ -1055,13 +1886,20 @@ void limit_manager_t::commit(
             abort(*exc);
             return;
         }
-        guarantee(s.size() <= spec.limit - item_queue.size());
-        for (auto &&pair : s) {
-            bool ins = item_queue.insert(pair).second;
+        guarantee(s.size() <= missing + buffer_size);
+        buffer_complete = s.size() < missing + buffer_size;
+        // `s` is sorted best-first.
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (i >= missing) {
+                bool ins = buffer.insert(std::move(s[i])).second;
+                guarantee(ins);
+                continue;
+            }
+            bool ins = item_queue.insert(s[i]).second;
             guarantee(ins);
-            size_t erased = real_deleted.erase(pair.first);
+            size_t erased = real_deleted.erase(s[i].first);
             if (erased == 0) {
-                ins = real_added.insert(pair).second;
+                ins = real_added.insert(std::move(s[i])).second;
                 guarantee(ins);
             }
         }
@@ -1118,8 +1956,11 @@ INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::limit_stop_t);
 RDB_IMPL_SERIALIZABLE_5(
     msg_t::change_t,
     old_indexes, new_indexes, pkey, old_val, new_val);
-INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::change_t);
+// `change_log_t` writes changes to disk.
+INSTANTIATE_SERIALIZABLE_SINCE_v2_1(msg_t::change_t);
 RDB_IMPL_SERIALIZABLE_0_SINCE_v1_13(msg_t::stop_t);
+RDB_IMPL_SERIALIZABLE_0(msg_t::position_t);
+INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(msg_t::position_t);
 
 enum class detach_t { NO, YES };
 
@@ -1251,6 +2092,7 @@ public:
     virtual void add_el(
         const uuid_u &shard_uuid,
         uint64_t stamp,
+        uint64_t log_seq,
         const store_key_t &pkey,
         const boost::optional<std::string> &DEBUG_ONLY(sindex),
         boost::optional<indexed_datum_t> old_val,
@@ -1259,6 +2101,7 @@ public:
         if (update_stamp(shard_uuid, stamp)) {
             queue->add(change_val_t(
                 std::make_pair(shard_uuid, stamp),
+                log_seq,
                 pkey,
                 old_val,
                 new_val
@@ -1361,24 +2204,25 @@ public:
                 client_t *client,
                 mailbox_manager_t *manager,
                 namespace_interface_t *ns_if,
-                uuid_u uuid,
+                client_t::feed_key_t key,
+                std::vector<filter_wire_func_t> filters,
                 signal_t *interruptor);
     ~real_feed_t();
 
     client_t::addr_t get_addr() const;
 private:
     virtual auto_drainer_t::lock_t get_drainer_lock() { return drainer.lock(); }
-    virtual void maybe_remove_feed() { client->maybe_remove_feed(client_lock, uuid); }
+    virtual void maybe_remove_feed() { client->maybe_remove_feed(client_lock, key); }
     virtual void stop_limit_sub(limit_sub_t *sub);
 
-    void mailbox_cb(signal_t *interruptor, stamped_msg_t msg);
+    void mailbox_cb(signal_t *interruptor, std::vector<stamped_msg_t> msgs);
     void constructor_cb();
 
     auto_drainer_t::lock_t client_lock;
     client_t *client;
-    uuid_u uuid;
+    client_t::feed_key_t key;
     mailbox_manager_t *manager;
-    mailbox_t<void(stamped_msg_t)> mailbox;
+    mailbox_t<void(std::vector<stamped_msg_t>)> mailbox;
     std::vector<server_t::addr_t> stop_addrs;
     std::vector<scoped_ptr_t<disconnect_watcher_t> > disconnect_watchers;
 
@@ -1406,15 +2250,16 @@ real_feed_t::real_feed_t(auto_drainer_t::lock_t _client_lock,
                          client_t *_client,
                          mailbox_manager_t *_manager,
                          namespace_interface_t *ns_if,
-                         uuid_u _uuid,
+                         client_t::feed_key_t _key,
+                         std::vector<filter_wire_func_t> filters,
                          signal_t *interruptor)
     : client_lock(std::move(_client_lock)),
       client(_client),
-      uuid(_uuid),
+      key(std::move(_key)),
       manager(_manager),
       mailbox(manager, std::bind(&real_feed_t::mailbox_cb, this, ph::_1, ph::_2)) {
     try {
-        read_t read(changefeed_subscribe_t(mailbox.get_address()),
+        read_t read(changefeed_subscribe_t(mailbox.get_address(), std::move(filters)),
                     profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE);
         read_response_t read_resp;
         ns_if->read(read, &read_resp, order_token_t::ignore, interruptor);
@@ -1489,7 +2334,7 @@ void real_feed_t::constructor_cb() {
     // longer than necessary.
     disconnect_watchers.clear();
     if (!detached) {
-        scoped_ptr_t<feed_t> self = client->detach_feed(client_lock, uuid);
+        scoped_ptr_t<feed_t> self = client->detach_feed(client_lock, key);
         detached = true;
         if (self.has()) {
             const char *msg = "Disconnected from peer.";
@@ -1588,6 +2433,7 @@ public:
         uint64_t start_stamp = resp->stamp.second;
         initial_val = change_val_t(
                resp->stamp,
+               0, // Initial values aren't logged changes.
                store_key_t(pkey.print_primary()),
                boost::none,
                indexed_datum_t(resp->initial_val, datum_t(), boost::none)
@@ -1640,6 +2486,7 @@ public:
         }
         initial_val = change_val_t(
             std::make_pair(nil_uuid(), 0),
+            0,
             store_key_t(pkey.print_primary()),
             boost::none,
             indexed_datum_t(initial, datum_t(), boost::none)
@@ -1672,8 +2519,10 @@ class range_sub_t : public flat_sub_t {
 public:
     // Throws QL exceptions.
     range_sub_t(feed_t *feed, const datum_t &squash,
-                bool include_states, keyspec_t::range_t _spec)
+                bool include_states, keyspec_t::range_t _spec,
+                resume_spec_t _resume)
         : flat_sub_t(feed, squash, include_states),
+          resume(std::move(_resume)),
           spec(std::move(_spec)),
           state(state_t::READY),
           sent_state(state_t::NONE),
@@ -1721,6 +2570,93 @@ public:
         return changefeed::apply_ops(val, ops, env.get(), datum_t());
     }
 
+    // Works out what `change` looks like to us (applying `ops`, and splitting it
+    // up by index value if we're on a secondary index) and calls `f` with each
+    // resulting element.
+    template<class F>
+    void on_change(const msg_t::change_t &change, const F &f) {
+        datum_t null = datum_t::null();
+        datum_t new_val = null, old_val = null;
+        if (has_ops()) {
+            if (change.new_val.has()) {
+                if (boost::optional<datum_t> d = apply_ops(change.new_val)) {
+                    new_val = *d;
+                }
+            }
+            if (change.old_val.has()) {
+                if (boost::optional<datum_t> d = apply_ops(change.old_val)) {
+                    old_val = *d;
+                }
+            }
+            // Duplicate values are caught before being written to disk and
+            // don't generate a `mod_report`, but if we have transforms the
+            // values might have changed.
+            if (new_val == old_val) {
+                return;
+            }
+        } else {
+            guarantee(change.old_val.has() || change.new_val.has());
+            if (change.new_val.has()) {
+                new_val = change.new_val;
+            }
+            if (change.old_val.has()) {
+                old_val = change.old_val;
+            }
+        }
+        boost::optional<std::string> index = sindex();
+        if (index) {
+            std::vector<std::pair<datum_t, boost::optional<uint64_t> > >
+                old_idxs, new_idxs;
+            auto old_it = change.old_indexes.find(*index);
+            if (old_it != change.old_indexes.end()) {
+                for (const auto &idx : old_it->second) {
+                    if (contains(idx.first)) old_idxs.push_back(idx);
+                }
+            }
+            auto new_it = change.new_indexes.find(*index);
+            if (new_it != change.new_indexes.end()) {
+                for (const auto &idx : new_it->second) {
+                    if (contains(idx.first)) new_idxs.push_back(idx);
+                }
+            }
+            while (old_idxs.size() > 0 && new_idxs.size() > 0) {
+                f(index,
+                  indexed_datum_t(old_val,
+                                  std::move(old_idxs.back().first),
+                                  std::move(old_idxs.back().second)),
+                  indexed_datum_t(new_val,
+                                  std::move(new_idxs.back().first),
+                                  std::move(new_idxs.back().second)));
+                old_idxs.pop_back();
+                new_idxs.pop_back();
+            }
+            while (old_idxs.size() > 0) {
+                guarantee(new_idxs.size() == 0);
+                f(index,
+                  indexed_datum_t(old_val,
+                                  std::move(old_idxs.back().first),
+                                  std::move(old_idxs.back().second)),
+                  boost::none);
+                old_idxs.pop_back();
+            }
+            while (new_idxs.size() > 0) {
+                guarantee(old_idxs.size() == 0);
+                f(index,
+                  boost::none,
+                  indexed_datum_t(new_val,
+                                  std::move(new_idxs.back().first),
+                                  std::move(new_idxs.back().second)));
+                new_idxs.pop_back();
+            }
+        } else {
+            if (contains(change.pkey)) {
+                f(index,
+                  indexed_datum_t(old_val, datum_t(), boost::none),
+                  indexed_datum_t(new_val, datum_t(), boost::none));
+            }
+        }
+    }
+
     bool update_stamp(const uuid_u &uuid, uint64_t new_stamp) final {
         guarantee(active());
         auto it = start_stamps.find(uuid);
@@ -1745,11 +2681,18 @@ public:
             }
             return vals_to_change(datum_t(), d, true);
         }
-        return change_val_to_change(pop_change_val());
+        // The logged changes we're resuming from come before any new ones.
+        if (replayed.size() != 0) {
+            change_val_t cv = std::move(replayed.front());
+            replayed.pop_front();
+            return change_val_to_resumable_change(cv);
+        }
+        return change_val_to_resumable_change(pop_change_val());
     }
     bool has_el() final {
         return (include_states && state != sent_state)
             || artificial_initial_vals.size() != 0
+            || replayed.size() != 0
             || has_change_val();
     }
 
@@ -1764,10 +2707,15 @@ public:
         assert_thread();
         r_sanity_check(self.get() == this);
 
+        changefeed_stamp_t stamp(addr);
+        if (resume.include_resume_tokens || resume.resume_from) {
+            stamp.read_log = true;
+            stamp.resume_from = resume.resume_from;
+        }
         read_response_t read_resp;
         // Note that we use the `outer_env`'s interruptor for the read.
         nif->read(
-            read_t(changefeed_stamp_t(addr),
+            read_t(stamp,
                    profile_bool_t::DONT_PROFILE,
                    read_mode_t::SINGLE),
             &read_resp, order_token_t::ignore, outer_env->interruptor);
@@ -1777,6 +2725,9 @@ public:
         guarantee(start_stamps.size() != 0);
 
         env = make_env(outer_env);
+        if (stamp.read_log) {
+            start_from_logs(resp->logs, bt);
+        }
         if (maybe_src) {
             // Nothing can happen between constructing the new `scoped_ptr_t` and
             // releasing the old one.
@@ -1816,7 +2767,98 @@ public:
         return make_counted<stream_t<subscription_t> >(std::move(self), bt);
     }
     const std::map<uuid_u, uint64_t> &get_start_stamps() { return start_stamps; }
+
+    // Called with the sequence number of every change we get from a server,
+    // whether or not we keep it, and with the position of every `position_t`.
+    // This way our resume tokens move on even when we don't return anything
+    // from the server.
+    void note_position(const uuid_u &server_uuid, uint64_t seq) {
+        if (!resume.include_resume_tokens) {
+            return;
+        }
+        // We can't move past changes we haven't returned yet, so in that case
+        // we wait until they've all been returned (see
+        // `change_val_to_resumable_change`).
+        uint64_t *position = (has_change_val() || replayed.size() != 0)
+            ? &pending_positions[server_uuid]
+            : &resume_token[server_uuid];
+        *position = std::max(*position, seq);
+    }
 private:
+    // Sets `resume_token` to where we start in each `server_t`'s change log, and
+    // if we're resuming, queues up the logged changes after `resume.resume_from`.
+    // The logs were read at the same point as `start_stamps`, so the logged
+    // changes end right where the changes we'll receive begin.
+    void start_from_logs(const std::map<uuid_u, log_read_t> &logs,
+                         backtrace_id_t bt) {
+        if (!resume.resume_from) {
+            for (const auto &pair : logs) {
+                resume_token[pair.first] = pair.second.seq;
+            }
+            return;
+        }
+        const char *unavailable =
+            "Cannot resume changefeed: the changes since `resume_from` are no longer "
+            "available (the token is too old, or the table's servers or shards have "
+            "changed since it was returned).";
+        for (const auto &pair : *resume.resume_from) {
+            rcheck_src(bt, logs.count(pair.first) != 0,
+                       base_exc_t::OP_FAILED, unavailable);
+        }
+        for (const auto &pair : logs) {
+            rcheck_src(bt, !pair.second.expired, base_exc_t::OP_FAILED, unavailable);
+        }
+        for (const auto &pair : logs) {
+            const uuid_u &server_uuid = pair.first;
+            auto stamp_it = start_stamps.find(server_uuid);
+            guarantee(stamp_it != start_stamps.end());
+            uint64_t seq = resume.resume_from->at(server_uuid);
+            resume_token[server_uuid] = seq;
+            for (const auto &change : pair.second.changes) {
+                seq += 1;
+                on_change(
+                    change,
+                    [&](const boost::optional<std::string> &sindex,
+                        boost::optional<indexed_datum_t> old_val,
+                        boost::optional<indexed_datum_t> new_val) {
+                        replayed.push_back(change_val_t(
+                            std::make_pair(server_uuid, stamp_it->second),
+                            seq,
+                            change.pkey,
+                            std::move(old_val),
+                            std::move(new_val)
+                            DEBUG_ONLY(, sindex)));
+                    });
+            }
+        }
+    }
+
+    datum_t change_val_to_resumable_change(const change_val_t &cv) {
+        datum_t change = change_val_to_change(cv);
+        if (!resume.include_resume_tokens) {
+            return change;
+        }
+        // Changes from each server arrive in the order they were logged, so
+        // this is where the feed would have to resume to see the next change.
+        uint64_t *position = &resume_token[cv.source_stamp.first];
+        *position = std::max(*position, cv.log_seq);
+        if (!has_change_val() && replayed.size() == 0) {
+            for (const auto &pair : pending_positions) {
+                position = &resume_token[pair.first];
+                *position = std::max(*position, pair.second);
+            }
+            pending_positions.clear();
+        }
+        std::map<datum_string_t, datum_t> token;
+        for (const auto &pair : resume_token) {
+            token[datum_string_t(uuid_to_str(pair.first))] =
+                datum_t(static_cast<double>(pair.second));
+        }
+        datum_object_builder_t builder(change);
+        builder.overwrite("resume_token", datum_t(std::move(token)));
+        return std::move(builder).to_datum();
+    }
+
     scoped_ptr_t<env_t> make_env(env_t *outer_env) {
         // This is to support fake environments from the unit tests that don't
         // actually have a context.
@@ -1839,6 +2881,15 @@ private:
     // read.  We use these to make sure we don't see changes from writes before
     // our subscription.
     std::map<uuid_u, uint64_t> start_stamps;
+    resume_spec_t resume;
+    // Our position in the change logs, which we add to the changes we return if
+    // `resume.include_resume_tokens` is set.
+    log_position_t resume_token;
+    // Positions we've seen but can't move `resume_token` to yet (see
+    // `note_position`).
+    log_position_t pending_positions;
+    // The logged changes we resumed from, which we return before any others.
+    std::deque<change_val_t> replayed;
     keyspec_t::range_t spec;
     state_t state, sent_state;
     std::vector<datum_t> artificial_initial_vals;
@@ -2163,8 +3214,9 @@ void real_feed_t::stop_limit_sub(limit_sub_t *sub) {
 class msg_visitor_t : public boost::static_visitor<void> {
 public:
     msg_visitor_t(feed_t *_feed, const auto_drainer_t::lock_t *_lock,
-                  uuid_u _server_uuid, uint64_t _stamp)
-        : feed(_feed), lock(_lock), server_uuid(_server_uuid), stamp(_stamp) {
+                  uuid_u _server_uuid, uint64_t _stamp, uint64_t _log_seq)
+        : feed(_feed), lock(_lock), server_uuid(_server_uuid), stamp(_stamp),
+          log_seq(_log_seq) {
         guarantee(feed != nullptr);
         guarantee(lock != nullptr);
         guarantee(lock->has_lock());
@@ -2188,92 +3240,18 @@ public:
     }
     void operator()(const msg_t::change_t &change) const {
         configured_limits_t default_limits;
-        datum_t null = datum_t::null();
 
         feed->each_active_range_sub(*lock, [&](range_sub_t *sub) {
-            datum_t new_val = null, old_val = null;
-            if (sub->has_ops()) {
-                if (change.new_val.has()) {
-                    if (boost::optional<datum_t> d = sub->apply_ops(change.new_val)) {
-                        new_val = *d;
-                    }
-                }
-                if (change.old_val.has()) {
-                    if (boost::optional<datum_t> d = sub->apply_ops(change.old_val)) {
-                        old_val = *d;
-                    }
-                }
-                // Duplicate values are caught before being written to disk and
-                // don't generate a `mod_report`, but if we have transforms the
-                // values might have changed.
-                if (new_val == old_val) {
-                    return;
-                }
-            } else {
-                guarantee(change.old_val.has() || change.new_val.has());
-                if (change.new_val.has()) {
-                    new_val = change.new_val;
-                }
-                if (change.old_val.has()) {
-                    old_val = change.old_val;
-                }
-            }
-            boost::optional<std::string> sindex = sub->sindex();
-            if (sindex) {
-                std::vector<std::pair<datum_t, boost::optional<uint64_t> > >
-                    old_idxs, new_idxs;
-                auto old_it = change.old_indexes.find(*sindex);
-                if (old_it != change.old_indexes.end()) {
-                    for (const auto &idx : old_it->second) {
-                        if (sub->contains(idx.first)) old_idxs.push_back(idx);
-                    }
-                }
-                auto new_it = change.new_indexes.find(*sindex);
-                if (new_it != change.new_indexes.end()) {
-                    for (const auto &idx : new_it->second) {
-                        if (sub->contains(idx.first)) new_idxs.push_back(idx);
-                    }
-                }
-                while (old_idxs.size() > 0 && new_idxs.size() > 0) {
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val,
-                                                std::move(old_idxs.back().first),
-                                                std::move(old_idxs.back().second)),
-                                indexed_datum_t(new_val,
-                                                std::move(new_idxs.back().first),
-                                                std::move(new_idxs.back().second)),
-                                default_limits);
-                    old_idxs.pop_back();
-                    new_idxs.pop_back();
-                }
-                while (old_idxs.size() > 0) {
-                    guarantee(new_idxs.size() == 0);
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val,
-                                                std::move(old_idxs.back().first),
-                                                std::move(old_idxs.back().second)),
-                                boost::none,
-                                default_limits);
-                    old_idxs.pop_back();
-                }
-                while (new_idxs.size() > 0) {
-                    guarantee(old_idxs.size() == 0);
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                boost::none,
-                                indexed_datum_t(new_val,
-                                                std::move(new_idxs.back().first),
-                                                std::move(new_idxs.back().second)),
+            sub->on_change(
+                change,
+                [&](const boost::optional<std::string> &sindex,
+                    boost::optional<indexed_datum_t> old_val,
+                    boost::optional<indexed_datum_t> new_val) {
+                    sub->add_el(server_uuid, stamp, log_seq, change.pkey, sindex,
+                                std::move(old_val), std::move(new_val),
                                 default_limits);
-                    new_idxs.pop_back();
-                }
-            } else {
-                if (sub->contains(change.pkey)) {
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val, datum_t(), boost::none),
-                                indexed_datum_t(new_val, datum_t(), boost::none),
-                                default_limits);
-                }
-            }
+                });
+            sub->note_position(server_uuid, log_seq);
         });
         feed->on_point_sub(
             change.pkey,
@@ -2282,6 +3260,7 @@ public:
                       ph::_1,
                       std::cref(server_uuid),
                       stamp,
+                      log_seq,
                       change.pkey,
                       boost::none,
                       change.old_val.has()
@@ -2294,6 +3273,11 @@ public:
                           : boost::none,
                       default_limits));
     }
+    void operator()(const msg_t::position_t &) const {
+        feed->each_active_range_sub(*lock, [&](range_sub_t *sub) {
+            sub->note_position(server_uuid, log_seq);
+        });
+    }
     void operator()(const msg_t::stop_t &) const {
         const char *msg = "Changefeed aborted (table unavailable).";
         feed->each_sub(*lock,
@@ -2308,9 +3292,10 @@ private:
     const auto_drainer_t::lock_t *lock;
     uuid_u server_uuid;
     uint64_t stamp;
+    uint64_t log_seq;
 };
 
-void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
+void real_feed_t::mailbox_cb(signal_t *, std::vector<stamped_msg_t> msgs) {
     // We stop receiving messages when detached (we're only receiving
     // messages because we haven't managed to get a message to the
     // stop mailboxes for some of the primary replicas yet).  This also stops
@@ -2323,10 +3308,12 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
         // We wait for the write to complete and the queues to be ready.
         wait_any_t wait_any(&queues_ready, lock.get_drain_signal());
         wait_any.wait_lazily_unordered();
-        if (!lock.get_drain_signal()->is_pulsed()) {
+        // All the messages in a batch come from the same server.
+        if (!lock.get_drain_signal()->is_pulsed() && msgs.size() != 0) {
             // We don't need a lock for this because the set of `uuid_u`s never
             // changes after it's initialized.
-            auto it = queues.find(msg.server_uuid);
+            const uuid_u server_uuid = msgs[0].server_uuid;
+            auto it = queues.find(server_uuid);
             guarantee(it != queues.end());
             queue_t *queue = it->second.get();
             guarantee(queue != NULL);
@@ -2335,13 +3322,17 @@ void real_feed_t::mailbox_cb(signal_t *, stamped_msg_t msg) {
             spot.write_signal()->wait_lazily_unordered();
 
             // Add us to the queue.
-            guarantee(msg.stamp >= queue->next);
-            queue->map.push(std::move(msg));
+            for (auto &&msg : msgs) {
+                guarantee(msg.server_uuid == server_uuid);
+                guarantee(msg.stamp >= queue->next);
+                queue->map.push(std::move(msg));
+            }
 
             // Read as much as we can from the queue (this enforces ordering.)
             while (queue->map.size() != 0 && queue->map.top().stamp == queue->next) {
                 const stamped_msg_t &curmsg = queue->map.top();
-                msg_visitor_t visitor(this, &lock, curmsg.server_uuid, curmsg.stamp);
+                msg_visitor_t visitor(
+                    this, &lock, curmsg.server_uuid, curmsg.stamp, curmsg.log_seq);
                 boost::apply_visitor(visitor, curmsg.submsg.op);
                 queue->map.pop();
                 queue->next += 1;
@@ -2659,6 +3650,7 @@ RDB_MAKE_SERIALIZABLE_4_FOR_CLUSTER(
     keyspec_t::range_t, transforms, sindex, sorting, range);
 RDB_MAKE_SERIALIZABLE_2_FOR_CLUSTER(keyspec_t::limit_t, range, limit);
 RDB_MAKE_SERIALIZABLE_1_FOR_CLUSTER(keyspec_t::point_t, key);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(log_read_t, seq, changes, expired);
 
 void feed_t::add_sub_with_lock(
     rwlock_t *rwlock, const std::function<void()> &f) THROWS_NOTHING {
@@ -2919,31 +3911,63 @@ client_t::client_t(
 }
 client_t::~client_t() { }
 
+// The leading `filter` transforms of a range changefeed can be evaluated on the
+// shards by `server_t::send_all`, since a change is dropped by `range_sub_t`
+// if neither of its values passes them.  We stop at the first transform that
+// isn't a deterministic filter, since the transforms after it don't see the
+// rows from the table.
+std::vector<filter_wire_func_t> shard_filters(const keyspec_t::spec_t &spec) {
+    std::vector<filter_wire_func_t> ret;
+    if (const keyspec_t::range_t *range = boost::get<keyspec_t::range_t>(&spec)) {
+        for (const auto &transform : range->transforms) {
+            const filter_wire_func_t *filter =
+                boost::get<filter_wire_func_t>(&transform);
+            if (filter == nullptr
+                || !filter->filter_func.compile_wire_func()->is_deterministic()
+                || (filter->default_filter_val
+                    && !filter->default_filter_val->compile_wire_func()
+                           ->is_deterministic())) {
+                break;
+            }
+            ret.push_back(*filter);
+        }
+    }
+    return ret;
+}
+
 scoped_ptr_t<subscription_t> new_sub(
     feed_t *feed,
     const datum_t &squash,
     bool include_states,
+    const resume_spec_t &resume,
     const keyspec_t::spec_t &spec) {
 
     struct spec_visitor_t : public boost::static_visitor<subscription_t *> {
         explicit spec_visitor_t(
-            feed_t *_feed, const datum_t *_squash, bool _include_states)
-            : feed(_feed), squash(_squash), include_states(_include_states) { }
+            feed_t *_feed, const datum_t *_squash, bool _include_states,
+            const resume_spec_t *_resume)
+            : feed(_feed), squash(_squash), include_states(_include_states),
+              resume(_resume) { }
         subscription_t *operator()(const keyspec_t::range_t &range) const {
-            return new range_sub_t(feed, *squash, include_states, range);
+            return new range_sub_t(feed, *squash, include_states, range, *resume);
         }
         subscription_t *operator()(const keyspec_t::limit_t &limit) const {
+            // `changes_term_t` only allows resuming range changefeeds.
+            r_sanity_check(!resume->include_resume_tokens && !resume->resume_from);
             return new limit_sub_t(feed, *squash, include_states, limit);
         }
         subscription_t *operator()(const keyspec_t::point_t &point) const {
+            r_sanity_check(!resume->include_resume_tokens && !resume->resume_from);
             return new point_sub_t(feed, *squash, include_states, point.key);
         }
         feed_t *feed;
         const datum_t *squash;
         bool include_states;
+        const resume_spec_t *resume;
     };
     return scoped_ptr_t<subscription_t>(
-        boost::apply_visitor(spec_visitor_t(feed, &squash, include_states), spec));
+        boost::apply_visitor(
+            spec_visitor_t(feed, &squash, include_states, &resume), spec));
 }
 
 counted_t<datum_stream_t> client_t::new_stream(
@@ -2951,6 +3975,7 @@ counted_t<datum_stream_t> client_t::new_stream(
     counted_t<datum_stream_t> maybe_src,
     const datum_t &squash,
     bool include_states,
+    const resume_spec_t &resume,
     const namespace_id_t &uuid,
     backtrace_id_t bt,
     const std::string &table_name,
@@ -2966,9 +3991,12 @@ counted_t<datum_stream_t> client_t::new_stream(
             // If the `client_t` is being destroyed, we're shutting down, so we
             // consider it an interruption.
             auto_drainer_t::lock_t lock(&drainer, throw_if_draining_t::YES);
+            std::vector<filter_wire_func_t> filters = shard_filters(spec);
+            feed_key_t key(uuid, shard_filters_key(filters));
+
             rwlock_in_line_t spot(&feeds_lock, access_t::write);
             spot.read_signal()->wait_lazily_unordered();
-            auto feed_it = feeds.find(uuid);
+            auto feed_it = feeds.find(key);
             if (feed_it == feeds.end()) {
                 spot.write_signal()->wait_lazily_unordered();
                 namespace_interface_access_t access =
@@ -2978,8 +4006,9 @@ counted_t<datum_stream_t> client_t::new_stream(
                 // only be run for the first one.  Rather than mess
                 // about, just use the defaults.
                 auto val = make_scoped<real_feed_t>(
-                    lock, this, manager, access.get(), uuid, &interruptor);
-                feed_it = feeds.insert(std::make_pair(uuid, std::move(val))).first;
+                    lock, this, manager, access.get(), key, std::move(filters),
+                    &interruptor);
+                feed_it = feeds.insert(std::make_pair(key, std::move(val))).first;
             }
 
             // We need to do this while holding `feeds_lock` to make sure the
@@ -2987,7 +4016,7 @@ counted_t<datum_stream_t> client_t::new_stream(
             on_thread_t th2(old_thread);
             real_feed_t *feed = feed_it->second.get();
             addr = feed->get_addr();
-            sub = new_sub(feed, squash, include_states, spec);
+            sub = new_sub(feed, squash, include_states, resume, spec);
         }
         namespace_interface_access_t access = namespace_source(uuid, env->interruptor);
         return sub->to_stream(env, table_name, access.get(),
@@ -3000,13 +4029,13 @@ counted_t<datum_stream_t> client_t::new_stream(
 }
 
 void client_t::maybe_remove_feed(
-    const auto_drainer_t::lock_t &lock, const uuid_u &uuid) {
+    const auto_drainer_t::lock_t &lock, const feed_key_t &key) {
     assert_thread();
     lock.assert_is_holding(&drainer);
     scoped_ptr_t<real_feed_t> destroy;
     rwlock_in_line_t spot(&feeds_lock, access_t::write);
     spot.write_signal()->wait_lazily_unordered();
-    auto feed_it = feeds.find(uuid);
+    auto feed_it = feeds.find(key);
     // The feed might have disappeared because it may have been detached while
     // we held the lock, in which case we don't need to do anything.  The feed
     // might also have gotten a new subscriber, in which case we don't want to
@@ -3020,7 +4049,7 @@ void client_t::maybe_remove_feed(
 }
 
 scoped_ptr_t<real_feed_t> client_t::detach_feed(
-    const auto_drainer_t::lock_t &lock, const uuid_u &uuid) {
+    const auto_drainer_t::lock_t &lock, const feed_key_t &key) {
     assert_thread();
     lock.assert_is_holding(&drainer);
     scoped_ptr_t<real_feed_t> ret;
@@ -3028,7 +4057,7 @@ scoped_ptr_t<real_feed_t> client_t::detach_feed(
     spot.write_signal()->wait_lazily_unordered();
     // The feed might have been removed in `maybe_remove_feed`, in which case
     // there's nothing to detach.
-    auto feed_it = feeds.find(uuid);
+    auto feed_it = feeds.find(key);
     if (feed_it != feeds.end()) {
         ret.swap(feed_it->second);
         feeds.erase(feed_it);
@@ -3069,7 +4098,7 @@ counted_t<datum_stream_t> artificial_t::subscribe(
     // on the thread you want to use them on.
     guarantee(feed.has());
     scoped_ptr_t<subscription_t> sub = new_sub(
-        feed.get(), datum_t::boolean(false), include_states, spec);
+        feed.get(), datum_t::boolean(false), include_states, resume_spec_t(), spec);
     return sub->to_artificial_stream(
         env, uuid, primary_key_name, initial_values,
         include_initial_vals, std::move(sub), bt);
@@ -3084,7 +4113,8 @@ void artificial_t::send_all(const msg_t &msg) {
         }
     }
     auto_drainer_t::lock_t lock = feed->get_drainer_lock();
-    msg_visitor_t visitor(feed.get(), &lock, uuid, stamp++);
+    // Artificial tables don't keep a change log.
+    msg_visitor_t visitor(feed.get(), &lock, uuid, stamp++, 0);
     boost::apply_visitor(visitor, msg.op);
 }
 
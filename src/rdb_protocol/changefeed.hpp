@@ -6,6 +6,7 @@
 #include <exception>
 #include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <utility>
@@ -14,8 +15,11 @@
 #include <boost/variant.hpp>
 
 #include "btree/keys.hpp"
+#include "concurrency/fifo_enforcer.hpp"
+#include "concurrency/mutex.hpp"
 #include "concurrency/promise.hpp"
 #include "concurrency/rwlock.hpp"
+#include "containers/archive/preserialized.hpp"
 #include "containers/counted.hpp"
 #include "containers/scoped.hpp"
 #include "protocol_api.hpp"
@@ -27,13 +31,16 @@
 #include "rpc/connectivity/peer_id.hpp"
 #include "rpc/mailbox/typed.hpp"
 #include "rpc/serialize_macros.hpp"
+#include "utils.hpp"
 
 class artificial_table_backend_t;
 class auto_drainer_t;
 class base_table_t;
 class btree_slice_t;
+class io_backender_t;
 class mailbox_manager_t;
 class namespace_interface_access_t;
+class perfmon_collection_t;
 class real_superblock_t;
 class sindex_superblock_t;
 struct rdb_modification_report_t;
@@ -98,6 +105,12 @@ struct msg_t {
     struct stop_t {
         RDB_DECLARE_ME_SERIALIZABLE(stop_t);
     };
+    // Tells a client that asked for change log positions (see
+    // `server_t::get_stamp`) that it has seen all the changes up to the
+    // `log_seq` of the `stamped_msg_t`, even though it wasn't sent all of them.
+    struct position_t {
+        RDB_DECLARE_ME_SERIALIZABLE(position_t);
+    };
 
     msg_t() { }
     msg_t(msg_t &&msg) : op(std::move(msg.op)) { }
@@ -105,7 +118,8 @@ struct msg_t {
     msg_t &operator=(const msg_t &) = default;
 
     // Starts with STOP to avoid doing work for default initialization.
-    boost::variant<stop_t, change_t, limit_start_t, limit_change_t, limit_stop_t> op;
+    boost::variant<stop_t, change_t, limit_start_t, limit_change_t, limit_stop_t,
+                   position_t> op;
 
     // Accursed reference collapsing!
     template<class T, class = typename std::enable_if<std::is_object<T>::value>::type>
@@ -114,10 +128,75 @@ struct msg_t {
 
 RDB_DECLARE_SERIALIZABLE(msg_t);
 
+// What a `server_t` sends to a `client_t`: a `msg_t` along with the stamp that
+// lets the client put the messages from each server in order.
+struct stamped_msg_t {
+    stamped_msg_t() : log_seq(0) { }
+    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, msg_t _submsg)
+        : server_uuid(std::move(_server_uuid)),
+          stamp(_stamp),
+          log_seq(0),
+          submsg(std::move(_submsg)) { }
+    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, uint64_t _log_seq,
+                  msg_t _submsg)
+        : server_uuid(std::move(_server_uuid)),
+          stamp(_stamp),
+          log_seq(_log_seq),
+          submsg(std::move(_submsg)) { }
+    stamped_msg_t(uuid_u _server_uuid, uint64_t _stamp, uint64_t _log_seq,
+                  preserialized_t<msg_t> _serialized_submsg)
+        : server_uuid(std::move(_server_uuid)),
+          stamp(_stamp),
+          log_seq(_log_seq),
+          serialized_submsg(std::move(_serialized_submsg)) { }
+    uuid_u server_uuid;
+    uint64_t stamp;
+    // The sequence number of the change in the server's change log (see
+    // `server_t::log_seq`), the position if `submsg` is a `position_t`, or 0
+    // otherwise.
+    uint64_t log_seq;
+    msg_t submsg;
+    // If this is set, it's sent in place of `submsg`.  `server_t::send_all` uses
+    // it so that a change sent to many clients is only serialized once.  It's
+    // never set on the receiving side.
+    preserialized_t<msg_t> serialized_submsg;
+};
+
+RDB_DECLARE_SERIALIZABLE(stamped_msg_t);
+
+// A position in the change logs of a table's `server_t`s: the sequence number of
+// the last logged change a feed has seen from each `server_t`.  Feeds created
+// with `include_resume_tokens` hand these out so that they can be resumed.
+typedef std::map<uuid_u, uint64_t> log_position_t;
+
+// What a `server_t` returns when its change log is read (see `get_stamp`).
+struct log_read_t {
+    log_read_t() : seq(0), expired(false) { }
+    // The sequence number of the newest change in the log.
+    uint64_t seq;
+    // The logged changes after the position we were asked to resume from,
+    // oldest first.
+    std::vector<msg_t::change_t> changes;
+    // True if we can't resume from that position, because the changes after it
+    // are no longer (or were never) in the log.
+    bool expired;
+};
+
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(log_read_t);
+
+// How a range feed uses the change logs.
+struct resume_spec_t {
+    resume_spec_t() : include_resume_tokens(false) { }
+    // Whether to add the feed's `log_position_t` to each change it returns.
+    bool include_resume_tokens;
+    // If set, the feed starts with the logged changes after this position.
+    boost::optional<log_position_t> resume_from;
+};
+
 class real_feed_t;
-struct stamped_msg_t;
 
-typedef mailbox_addr_t<void(stamped_msg_t)> client_addr_t;
+// Servers batch the messages they send to a client (see `server_t::send_all`).
+typedef mailbox_addr_t<void(std::vector<stamped_msg_t>)> client_addr_t;
 
 struct keyspec_t {
     struct range_t {
@@ -191,14 +270,20 @@ public:
         counted_t<datum_stream_t> maybe_src,
         const datum_t &squash,
         bool include_states,
+        const resume_spec_t &resume,
         const namespace_id_t &table,
         backtrace_id_t bt,
         const std::string &table_name,
         const keyspec_t::spec_t &spec);
+    // Feeds are keyed by table and by the filters that the `server_t`s evaluate
+    // on the shards for them (see `shard_filters` and `shard_filters_key`).  All
+    // the subscriptions on a table with the same shard filters share a feed,
+    // even if they come from different queries.
+    typedef std::pair<namespace_id_t, std::string> feed_key_t;
     void maybe_remove_feed(
-        const auto_drainer_t::lock_t &lock, const namespace_id_t &uuid);
+        const auto_drainer_t::lock_t &lock, const feed_key_t &key);
     scoped_ptr_t<real_feed_t> detach_feed(
-        const auto_drainer_t::lock_t &lock, const namespace_id_t &uuid);
+        const auto_drainer_t::lock_t &lock, const feed_key_t &key);
 private:
     friend class subscription_t;
     mailbox_manager_t *const manager;
@@ -207,7 +292,7 @@ private:
             const namespace_id_t &,
             signal_t *)
         > const namespace_source;
-    std::map<namespace_id_t, scoped_ptr_t<real_feed_t> > feeds;
+    std::map<feed_key_t, scoped_ptr_t<real_feed_t> > feeds;
     // This lock manages access to the `feeds` map.  The `feeds` map needs to be
     // read whenever `new_stream` is called, and needs to be written to whenever
     // `new_stream` is called with a table not already in the `feeds` map, or
@@ -347,6 +432,10 @@ struct sindex_ref_t {
     const sindex_disk_info_t *sindex_info;
 };
 
+// The number of rows past the limit that a `limit_manager_t` keeps in memory for
+// a limit of `limit` rows.
+size_t limit_buffer_size(size_t limit);
+
 class server_t;
 class limit_manager_t {
 public:
@@ -364,6 +453,7 @@ public:
         client_t::addr_t _parent_client,
         keyspec_t::limit_t _spec,
         limit_order_t _lt,
+        // The first `limit + limit_buffer_size(limit)` rows in the range.
         std::vector<item_t> &&item_vec);
 
     void add(rwlock_in_line_t *spot,
@@ -403,6 +493,15 @@ private:
 
     limit_order_t gt;
     item_queue_t item_queue;
+    // The rows right past the limit, so that we can replace rows which leave
+    // `item_queue` without reading from the btree.  Every row in `buffer` comes
+    // after every row in `item_queue`, and there are no rows in the range
+    // between the two or between the rows in `buffer` (so the rows past the end of
+    // `buffer` are the only ones we don't know about).
+    item_queue_t buffer;
+    const size_t buffer_size;
+    // True if there are no rows past the end of `buffer`.
+    bool buffer_complete;
 
     std::vector<std::pair<std::string, std::pair<datum_t, datum_t> > > added;
     std::vector<std::string> deleted;
@@ -413,6 +512,16 @@ public:
     auto_drainer_t drainer;
 };
 
+// Evaluates the filters a `client_t` subscribed with against the changes on a
+// shard, so that `server_t::send_all` doesn't send a change to a client which
+// would drop it anyway.
+class shard_filter_t;
+
+// Keeps the most recent changes on a `store_t` on disk, so that feeds can be
+// resumed from a `log_position_t` (see `server_t::get_stamp`), even after the
+// server restarts (see the `server_t` constructor).
+class change_log_t;
+
 // There is one `server_t` per `store_t`, and it is used to send changes that
 // occur on that `store_t` to any subscribed `real_feed_t`s contained in a
 // `client_t`.
@@ -421,9 +530,24 @@ public:
     typedef server_addr_t addr_t;
     typedef mailbox_addr_t<void(client_t::addr_t, boost::optional<std::string>, uuid_u)>
         limit_addr_t;
-    explicit server_t(mailbox_manager_t *_manager);
+    // If `change_log_path` isn't empty, the change log is kept there, so that it
+    // survives restarts.  If there's a log there that the last `server_t` closed
+    // cleanly, we take over its UUID and keep logging, so feeds can resume from
+    // the positions it handed out.
+    server_t(mailbox_manager_t *_manager,
+             io_backender_t *_io_backender,
+             const base_path_t &_base_path,
+             perfmon_collection_t *_perfmon_collection,
+             const std::string &_change_log_path);
     ~server_t();
-    void add_client(const client_t::addr_t &addr, region_t region);
+    // Must be called when the `store_t`'s data changes without `send_all` being
+    // called (e.g. by a backfill), so that feeds can't resume from a position
+    // before the changes they never saw.
+    void note_unlogged_changes();
+    void add_client(const client_t::addr_t &addr,
+                    region_t region,
+                    const std::vector<filter_wire_func_t> &filters,
+                    rdb_context_t *ctx);
     void add_limit_client(
         const client_t::addr_t &addr,
         const region_t &region,
@@ -442,6 +566,15 @@ public:
     addr_t get_stop_addr();
     limit_addr_t get_limit_stop_addr();
     boost::optional<uint64_t> get_stamp(const client_t::addr_t &addr);
+    // Like the above, but also reads the change log at the same point: its
+    // position, and the changes after `resume_from` if it's set.  This starts
+    // logging changes if we weren't already, and from now on the client is sent
+    // a `position_t` when it misses out on changes.
+    boost::optional<uint64_t> get_stamp(const client_t::addr_t &addr,
+                                        const boost::optional<log_position_t> &resume_from,
+                                        log_read_t *log_out,
+                                        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
     uuid_u get_uuid();
     // `f` will be called with a read lock on `clients` and a write lock on the
     // limit manager.
@@ -463,18 +596,70 @@ private:
                                boost::optional<std::string> sindex,
                                uuid_u uuid);
     void add_client_cb(signal_t *stopped, client_t::addr_t addr);
+    void flush_batch_cb(auto_drainer_t::lock_t lock, client_t::addr_t addr);
+    // Returns the clients whose filters reject `change`.  Each distinct filter
+    // is evaluated once, and without holding `clients_lock`.
+    std::set<client_t::addr_t> filtered_clients(const msg_t::change_t &change);
+    // Sends `msgs` to the client at `addr` and records them in `stats`.
+    void send_msgs(const client_t::addr_t &addr,
+                   const std::vector<stamped_msg_t> &msgs);
+
+    // Used by the public constructor once it has tried to reopen the log.
+    server_t(mailbox_manager_t *_manager,
+             io_backender_t *_io_backender,
+             const base_path_t &_base_path,
+             perfmon_collection_t *_perfmon_collection,
+             const std::string &_change_log_path,
+             scoped_ptr_t<change_log_t> &&reopened_log);
 
     // The UUID of the server, used so that `real_feed_t`s can enforce on ordering on
     // changefeed messages on a per-server basis (and drop changefeed messages
-    // from before their own creation timestamp on a per-server basis).
+    // from before their own creation timestamp on a per-server basis).  It's the
+    // UUID of a previous `server_t` if we took over its change log.
     const uuid_u uuid;
     mailbox_manager_t *const manager;
 
+    // Used to create the change log the first time a feed asks for it.  If
+    // `change_log_path` is empty, the log goes into a temporary file instead.
+    io_backender_t *const io_backender;
+    const base_path_t base_path;
+    const std::string change_log_path;
+    perfmon_collection_t *const perfmon_collection;
+
+    struct stats_t;
+    scoped_ptr_t<stats_t> stats;
+
+    // The sequence number of the last change `send_all` sent.  Protected by
+    // `stamp_lock`, like the stamps.
+    uint64_t log_seq;
+    // Empty until a feed asks to be resumable, so that tables without such feeds
+    // don't pay for it, unless the constructor reopened one.  Only set while
+    // holding `stamp_lock`, and never reset.
+    scoped_ptr_t<change_log_t> change_log;
+    // Held while creating `change_log`, so that only one feed creates it.
+    mutex_t change_log_create_mutex;
+    // Changes are appended to `change_log` after `stamp_lock` is released, so we
+    // get a write token while holding it to keep them in order.  Reads of the
+    // log get a read token, so they wait for the changes before them.
+    fifo_enforcer_source_t log_fifo_source;
+    fifo_enforcer_sink_t log_fifo_sink;
+
+    // The stamped messages that `send_all` hasn't sent to a client yet.
+    struct batch_t;
+
     struct client_info_t {
         client_info_t();
         scoped_ptr_t<cond_t> cond;
         uint64_t stamp;
+        // True once the client has read the change log (see `get_stamp`).
+        bool wants_positions;
         std::vector<region_t> regions;
+        // Empty if the client subscribed without any filters.  Clients with the
+        // same filters share one `shard_filter_t`, and `filter_key` identifies
+        // them (see `shard_filters_key`).
+        counted_t<shard_filter_t> filter;
+        std::string filter_key;
+        scoped_ptr_t<batch_t> batch;
         std::map<boost::optional<std::string>,
                  std::vector<scoped_ptr_t<limit_manager_t> >,
                  // Be careful not to remove this, since optionals are
@@ -133,6 +133,10 @@ public:
 
     virtual ql::datum_t read_row(ql::env_t *env,
         ql::datum_t pval, read_mode_t read_mode) = 0;
+    /* Returns one row per entry in `pvals`, in the same order; missing rows are
+    returned as `null`. */
+    virtual std::vector<ql::datum_t> read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) = 0;
     virtual counted_t<ql::datum_stream_t> read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -146,6 +150,7 @@ public:
         counted_t<ql::datum_stream_t> maybe_src,
         const ql::datum_t &squash,
         bool include_states,
+        const ql::changefeed::resume_spec_t &resume,
         ql::changefeed::keyspec_t::spec_t &&spec,
         ql::backtrace_id_t bt,
         const std::string &table_name) = 0;
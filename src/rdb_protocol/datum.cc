@@ -2168,10 +2168,18 @@ key_range_t datum_range_t::to_primary_keyrange() const {
 
 key_range_t datum_range_t::to_sindex_keyrange(skey_version_t skey_version) const {
     r_sanity_check(left_bound.has() && right_bound.has());
-    object_buffer_t<store_key_t> lb, rb;
     return rdb_protocol::sindex_key_range(
-        store_key_t(left_bound.truncated_secondary(skey_version, extrema_ok_t::OK)),
-        store_key_t(right_bound.truncated_secondary(skey_version, extrema_ok_t::OK)));
+        left_sindex_key(skey_version), right_sindex_key(skey_version));
+}
+
+store_key_t datum_range_t::left_sindex_key(skey_version_t skey_version) const {
+    r_sanity_check(left_bound.has());
+    return left_bound.truncated_secondary(skey_version, extrema_ok_t::OK);
+}
+
+store_key_t datum_range_t::right_sindex_key(skey_version_t skey_version) const {
+    r_sanity_check(right_bound.has());
+    return right_bound.truncated_secondary(skey_version, extrema_ok_t::OK);
 }
 
 datum_range_t datum_range_t::with_left_bound(datum_t d, key_range_t::bound_t type) {
@@ -445,6 +445,10 @@ public:
     // truncated sindexes.
     key_range_t to_primary_keyrange() const;
     key_range_t to_sindex_keyrange(skey_version_t skey_version) const;
+    // The truncated secondary keys of the two bounds, which `to_sindex_keyrange()`
+    // is built from.
+    store_key_t left_sindex_key(skey_version_t skey_version) const;
+    store_key_t right_sindex_key(skey_version_t skey_version) const;
 
     datum_range_t with_left_bound(datum_t d, key_range_t::bound_t type);
     datum_range_t with_right_bound(datum_t d, key_range_t::bound_t type);
@@ -1,12 +1,15 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/datum_stream.hpp"
 
+#include <iterator>
 #include <map>
 
 #include "boost_utils.hpp"
+#include "concurrency/pmap.hpp"
 #include "rdb_protocol/batching.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
+#include "rdb_protocol/pseudo_geometry.hpp"
 #include "rdb_protocol/term.hpp"
 #include "rdb_protocol/val.hpp"
 #include "utils.hpp"
@@ -1092,6 +1095,217 @@ ordered_distinct_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &b
     return ret;
 }
 
+// EQ_JOIN_DATUM_STREAM_T
+const int64_t MAX_CONCURRENT_EQ_JOIN_READS = 32;
+
+eq_join_datum_stream_t::eq_join_datum_stream_t(
+        counted_t<datum_stream_t> _source,
+        counted_t<const func_t> _key_func,
+        counted_t<table_t> _table,
+        std::string _index)
+    : wrapper_datum_stream_t(_source),
+      key_func(std::move(_key_func)),
+      table(std::move(_table)),
+      index(std::move(_index)) {
+    guarantee(key_func.has() && table.has() && source.has());
+}
+
+std::vector<datum_t>
+eq_join_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &bs) {
+    std::vector<datum_t> ret;
+    while (ret.size() == 0) {
+        std::vector<datum_t> rows = source->next_batch(env, bs);
+        if (rows.size() == 0) break;
+
+        // The join key of every row, or an empty datum if the row can't match
+        // anything.  This mirrors the `.default([])` in the old rewrite: a null
+        // row, a missing field and a `null` key (which makes `get_all` raise a
+        // non-existence error) all produce no matches.  Every other error,
+        // including the one for geometry keys, is still raised.
+        std::vector<datum_t> row_keys;
+        row_keys.reserve(rows.size());
+        std::set<datum_t> keys;
+        for (const auto &row : rows) {
+            datum_t key;
+            if (row.get_type() != datum_t::R_NULL) {
+                try {
+                    key = key_func->call(env, row)->as_datum();
+                } catch (const base_exc_t &e) {
+                    if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                        throw;
+                    }
+                }
+            }
+            if (key.has() && key.get_type() == datum_t::R_NULL) {
+                key.reset();
+            }
+            if (key.has()) {
+                rcheck(!key.is_ptype(pseudo::geometry_string),
+                       base_exc_t::LOGIC,
+                       "Cannot use a geospatial index with `get_all`. "
+                       "Use `get_intersecting` instead.");
+                keys.insert(key);
+            }
+            row_keys.push_back(std::move(key));
+        }
+
+        std::map<datum_t, std::vector<datum_t> > matches = get_matches(env, keys);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (!row_keys[i].has()) continue;
+            auto it = matches.find(row_keys[i]);
+            r_sanity_check(it != matches.end());
+            for (const auto &match : it->second) {
+                datum_object_builder_t pair;
+                bool dup = pair.add("left", rows[i]);
+                r_sanity_check(!dup);
+                dup = pair.add("right", match);
+                r_sanity_check(!dup);
+                ret.push_back(std::move(pair).to_datum());
+            }
+        }
+    }
+    return ret;
+}
+
+std::map<datum_t, std::vector<datum_t> > eq_join_datum_stream_t::get_matches(
+        env_t *env, const std::set<datum_t> &keys) {
+    std::map<datum_t, std::vector<datum_t> > matches;
+    std::vector<datum_t> key_vec;
+    key_vec.reserve(keys.size());
+    for (const auto &key : keys) {
+        key_vec.push_back(key);
+        matches[key];
+    }
+
+    if (index == table->get_pkey()) {
+        // Every key matches at most one row, so all of them can be fetched with a
+        // single multi-key read.
+        std::vector<datum_t> rows = table->get_rows(env, key_vec);
+        r_sanity_check(rows.size() == key_vec.size());
+        for (size_t i = 0; i < key_vec.size(); ++i) {
+            if (rows[i].get_type() != datum_t::R_NULL) {
+                matches[key_vec[i]].push_back(std::move(rows[i]));
+            }
+        }
+        return matches;
+    }
+
+    // The lookups run in parallel, so they get their own environment without a
+    // profiling trace (the trace can only record one thing at a time).
+    scoped_ptr_t<profile::trace_t> trace;
+    scoped_ptr_t<profile::disabler_t> disabler;
+    if (env->trace != nullptr) {
+        trace = make_scoped<profile::trace_t>();
+        disabler = make_scoped<profile::disabler_t>(trace.get());
+    }
+    env_t lookup_env(env->get_rdb_ctx(),
+                     env->return_empty_normal_batches,
+                     env->interruptor,
+                     env->get_all_optargs(),
+                     trace.has() ? trace.get() : nullptr);
+
+    std::vector<std::vector<datum_t> > results(key_vec.size());
+    std::exception_ptr exc;
+    throttled_pmap(key_vec.size(), [&](int64_t i) {
+        try {
+            counted_t<datum_stream_t> stream =
+                table->get_all(&lookup_env, key_vec[i], index, backtrace());
+            batchspec_t lookup_bs = batchspec_t::all();
+            for (;;) {
+                std::vector<datum_t> batch = stream->next_batch(&lookup_env, lookup_bs);
+                if (batch.size() == 0) break;
+                std::move(batch.begin(), batch.end(), std::back_inserter(results[i]));
+            }
+        } catch (...) {
+            if (!exc) {
+                exc = std::current_exception();
+            }
+        }
+    }, MAX_CONCURRENT_EQ_JOIN_READS);
+    if (exc) {
+        std::rethrow_exception(exc);
+    }
+
+    for (size_t i = 0; i < key_vec.size(); ++i) {
+        matches[key_vec[i]] = std::move(results[i]);
+    }
+    return matches;
+}
+
+// MULTI_GET_DATUM_STREAM_T
+multi_get_datum_stream_t::multi_get_datum_stream_t(
+        counted_t<table_t> _table,
+        std::vector<datum_t> &&_keys,
+        std::vector<counted_t<datum_stream_t> > &&_key_streams,
+        backtrace_id_t bt)
+    : eager_datum_stream_t(bt),
+      table(std::move(_table)),
+      keys(std::move(_keys)),
+      key_streams(std::move(_key_streams)),
+      started(false),
+      index(0) {
+    guarantee(table.has());
+    guarantee(key_streams.size() == keys.size());
+}
+
+std::vector<datum_t>
+multi_get_datum_stream_t::next_raw_batch(env_t *_env, const batchspec_t &bs) {
+    if (!started) {
+        started = true;
+        std::vector<datum_t> found = table->get_rows(_env, keys);
+        rows.reserve(found.size());
+        for (auto &&row : found) {
+            if (row.get_type() != datum_t::R_NULL) {
+                rows.push_back(std::move(row));
+            }
+        }
+    }
+
+    std::vector<datum_t> v;
+    batcher_t batcher = bs.to_batcher();
+    while (index < rows.size()) {
+        batcher.note_el(rows[index]);
+        v.push_back(std::move(rows[index++]));
+        if (batcher.should_send_batch()) {
+            break;
+        }
+    }
+    return v;
+}
+
+void multi_get_datum_stream_t::add_transformation(
+    transform_variant_t &&tv, backtrace_id_t bt) {
+    for (const auto &stream : key_streams) {
+        stream->add_transformation(transform_variant_t(tv), bt);
+    }
+    eager_datum_stream_t::add_transformation(std::move(tv), bt);
+}
+
+std::vector<changespec_t> multi_get_datum_stream_t::get_changespecs() {
+    std::vector<changespec_t> specs;
+    for (const auto &stream : key_streams) {
+        auto subspecs = stream->get_changespecs();
+        std::move(subspecs.begin(), subspecs.end(), std::back_inserter(specs));
+    }
+    return specs;
+}
+
+bool multi_get_datum_stream_t::is_exhausted() const {
+    return started && index == rows.size();
+}
+
+feed_type_t multi_get_datum_stream_t::cfeed_type() const {
+    return feed_type_t::not_feed;
+}
+
+bool multi_get_datum_stream_t::is_array() const {
+    return false;
+}
+
+bool multi_get_datum_stream_t::is_infinite() const {
+    return false;
+}
+
 // OFFSETS_OF_DATUM_STREAM_T
 offsets_of_datum_stream_t::offsets_of_datum_stream_t(counted_t<const func_t> _f,
                                                      counted_t<datum_stream_t> _source)
@@ -1602,6 +1816,164 @@ bool map_datum_stream_t::is_exhausted() const {
     return false;
 }
 
+hash_join_datum_stream_t::hash_join_datum_stream_t(
+        counted_t<datum_stream_t> _left,
+        std::vector<datum_t> &&_left_prefix,
+        datum_string_t _left_field,
+        build_table_t &&_build_table,
+        datum_t _build_missing_field,
+        datum_string_t _right_field,
+        backtrace_id_t bt)
+    : eager_datum_stream_t(bt),
+      left(std::move(_left)),
+      left_rows(std::move(_left_prefix)),
+      left_index(0),
+      left_field(std::move(_left_field)),
+      build_table(std::move(_build_table)),
+      build_missing_field(std::move(_build_missing_field)),
+      right_field(std::move(_right_field)) { }
+
+std::vector<datum_t>
+hash_join_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batchspec) {
+    std::vector<datum_t> batch;
+    if (build_table.empty() && !build_missing_field.has()) {
+        // Nothing can match, and the nested-loop join wouldn't have looked at
+        // any of the left rows either.
+        return batch;
+    }
+
+    batcher_t batcher = batchspec.to_batcher();
+    batchspec_t batchspec_inner = batchspec_t::default_for(batch_type_t::NORMAL);
+    for (;;) {
+        if (left_index >= left_rows.size()) {
+            left_rows.clear();
+            left_index = 0;
+            if (left->is_exhausted()) {
+                break;
+            }
+            left_rows = left->next_batch(env, batchspec_inner);
+            if (left_rows.empty()) {
+                break;
+            }
+        }
+        const datum_t &row = left_rows[left_index++];
+        if (build_missing_field.has()) {
+            // Throws the same error the join predicate would have.
+            build_missing_field.get_field(right_field);
+        }
+        auto it = build_table.find(row.get_field(left_field));
+        if (it != build_table.end()) {
+            for (const datum_t &match : it->second) {
+                datum_object_builder_t pair;
+                bool dup = pair.add("left", row);
+                r_sanity_check(!dup);
+                dup = pair.add("right", match);
+                r_sanity_check(!dup);
+                datum_t datum = std::move(pair).to_datum();
+                batcher.note_el(datum);
+                batch.push_back(std::move(datum));
+            }
+        }
+        if (batcher.should_send_batch()) {
+            break;
+        }
+    }
+    return batch;
+}
+
+bool hash_join_datum_stream_t::is_exhausted() const {
+    if (build_table.empty() && !build_missing_field.has()) {
+        return batch_cache_exhausted();
+    }
+    return left_index >= left_rows.size()
+        && left->is_exhausted()
+        && batch_cache_exhausted();
+}
+
+nested_loop_join_datum_stream_t::nested_loop_join_datum_stream_t(
+        counted_t<datum_stream_t> _left,
+        std::vector<datum_t> &&_left_prefix,
+        datum_string_t _left_field,
+        std::vector<datum_t> &&_right_prefix,
+        counted_t<datum_stream_t> _right,
+        datum_string_t _right_field,
+        std::function<counted_t<datum_stream_t>(env_t *)> &&_eval_right,
+        backtrace_id_t bt)
+    : eager_datum_stream_t(bt),
+      left(std::move(_left)),
+      left_rows(std::move(_left_prefix)),
+      left_index(0),
+      left_field(std::move(_left_field)),
+      right(std::move(_right)),
+      right_rows(std::move(_right_prefix)),
+      right_index(0),
+      right_field(std::move(_right_field)),
+      right_used(false),
+      eval_right(std::move(_eval_right)) { }
+
+std::vector<datum_t>
+nested_loop_join_datum_stream_t::next_raw_batch(
+        env_t *env, const batchspec_t &batchspec) {
+    std::vector<datum_t> batch;
+    batcher_t batcher = batchspec.to_batcher();
+    batchspec_t batchspec_inner = batchspec_t::default_for(batch_type_t::NORMAL);
+    for (;;) {
+        if (!left_row.has()) {
+            if (left_index >= left_rows.size()) {
+                left_rows.clear();
+                left_index = 0;
+                if (left->is_exhausted()) {
+                    break;
+                }
+                left_rows = left->next_batch(env, batchspec_inner);
+                if (left_rows.empty()) {
+                    break;
+                }
+            }
+            left_row = left_rows[left_index++];
+            if (right_used) {
+                right = eval_right(env);
+                right_rows.clear();
+                right_index = 0;
+            }
+            right_used = true;
+        }
+        if (right_index >= right_rows.size()) {
+            right_rows.clear();
+            right_index = 0;
+            if (!right->is_exhausted()) {
+                right_rows = right->next_batch(env, batchspec_inner);
+            }
+            if (right_rows.empty()) {
+                left_row = datum_t();
+                continue;
+            }
+        }
+        const datum_t &right_row = right_rows[right_index++];
+        if (left_row.get_field(left_field) == right_row.get_field(right_field)) {
+            datum_object_builder_t pair;
+            bool dup = pair.add("left", left_row);
+            r_sanity_check(!dup);
+            dup = pair.add("right", right_row);
+            r_sanity_check(!dup);
+            datum_t datum = std::move(pair).to_datum();
+            batcher.note_el(datum);
+            batch.push_back(std::move(datum));
+            if (batcher.should_send_batch()) {
+                break;
+            }
+        }
+    }
+    return batch;
+}
+
+bool nested_loop_join_datum_stream_t::is_exhausted() const {
+    return !left_row.has()
+        && left_index >= left_rows.size()
+        && left->is_exhausted()
+        && batch_cache_exhausted();
+}
+
 vector_datum_stream_t::vector_datum_stream_t(
         backtrace_id_t bt,
         std::vector<datum_t> &&_rows,
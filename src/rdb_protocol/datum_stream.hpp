@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <deque>
+#include <functional>
 #include <list>
 #include <map>
 #include <queue>
@@ -31,6 +32,7 @@ namespace ql {
 class env_t;
 class scope_env_t;
 class func_t;
+class table_t;
 
 enum class return_empty_normal_batches_t { NO, YES };
 
@@ -203,6 +205,58 @@ private:
     datum_t last_val;
 };
 
+// Used by `eq_join`.  Rather than issuing a `get_all` for every row of the left
+// input, this reads a batch of left rows, looks up all of that batch's distinct
+// join keys in `table` concurrently and then pairs each left row with its
+// matches, in the order of the left input.
+class eq_join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    eq_join_datum_stream_t(counted_t<datum_stream_t> _source,
+                           counted_t<const func_t> _key_func,
+                           counted_t<table_t> _table,
+                           std::string _index);
+private:
+    std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    std::map<datum_t, std::vector<datum_t> > get_matches(
+        env_t *env, const std::set<datum_t> &keys);
+
+    counted_t<const func_t> key_func;
+    counted_t<table_t> table;
+    std::string index;
+};
+
+// `getAll` on the primary key with several keys.  All of the rows are fetched
+// with a single multi-key read the first time the stream is read, rather than
+// with one range read per key.  Changefeeds still need one range spec per key, so
+// the caller also passes a regular `get_all` stream for each key.  They are never
+// read; they get our transformations and provide the changespecs.
+class multi_get_datum_stream_t : public eager_datum_stream_t {
+public:
+    multi_get_datum_stream_t(counted_t<table_t> _table,
+                             std::vector<datum_t> &&_keys,
+                             std::vector<counted_t<datum_stream_t> > &&_key_streams,
+                             backtrace_id_t bt);
+private:
+    virtual std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+    virtual void add_transformation(transform_variant_t &&tv, backtrace_id_t bt);
+    virtual std::vector<changespec_t> get_changespecs();
+
+    virtual bool is_exhausted() const;
+    virtual feed_type_t cfeed_type() const;
+    virtual bool is_array() const;
+    virtual bool is_infinite() const;
+
+    counted_t<table_t> table;
+    std::vector<datum_t> keys;
+    std::vector<counted_t<datum_stream_t> > key_streams;
+    bool started;
+    std::vector<datum_t> rows;
+    size_t index;
+};
+
 class array_datum_stream_t : public eager_datum_stream_t {
 public:
     array_datum_stream_t(datum_t _arr,
@@ -389,6 +443,100 @@ private:
     std::vector<datum_t> args;
 };
 
+// Used by `inner_join` when the predicate compares a field of each side for
+// equality.  The right input has already been read into `build_table` (keyed by
+// the joined field); this stream reads the left input, starting with the rows in
+// `left_prefix` that were already read from it, and looks each row up in the
+// table, producing the same `{left: ..., right: ...}` objects in the same order
+// as the nested-loop rewrite.
+class hash_join_datum_stream_t : public eager_datum_stream_t {
+public:
+    typedef std::map<datum_t, std::vector<datum_t> > build_table_t;
+
+    hash_join_datum_stream_t(counted_t<datum_stream_t> _left,
+                             std::vector<datum_t> &&_left_prefix,
+                             datum_string_t _left_field,
+                             build_table_t &&_build_table,
+                             datum_t _build_missing_field,
+                             datum_string_t _right_field,
+                             backtrace_id_t bt);
+
+    virtual std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    virtual bool is_array() const {
+        return left->is_array();
+    }
+    virtual bool is_exhausted() const;
+    virtual feed_type_t cfeed_type() const {
+        return feed_type_t::not_feed;
+    }
+    virtual bool is_infinite() const {
+        return left->is_infinite();
+    }
+
+private:
+    counted_t<datum_stream_t> left;
+    std::vector<datum_t> left_rows;
+    size_t left_index;
+    const datum_string_t left_field;
+
+    const build_table_t build_table;
+    // The first right row that doesn't have `right_field`.  The nested-loop join
+    // would fail on it as soon as it saw any left row, so we do too.
+    const datum_t build_missing_field;
+    const datum_string_t right_field;
+};
+
+// Used by `inner_join` in place of `hash_join_datum_stream_t` when the right
+// input turned out to be too big for a lookup table.  It is the nested-loop
+// rewrite done by hand, so that the right rows that were already read while
+// trying to build the table are used for the first left row instead of being
+// read again.  Like the hash join, it starts with the left rows in `left_prefix`.  Every further left row gets a fresh copy of the right input from
+// `eval_right`, like it would in the rewrite.
+class nested_loop_join_datum_stream_t : public eager_datum_stream_t {
+public:
+    nested_loop_join_datum_stream_t(
+            counted_t<datum_stream_t> _left,
+            std::vector<datum_t> &&_left_prefix,
+            datum_string_t _left_field,
+            std::vector<datum_t> &&_right_prefix,
+            counted_t<datum_stream_t> _right,
+            datum_string_t _right_field,
+            std::function<counted_t<datum_stream_t>(env_t *)> &&_eval_right,
+            backtrace_id_t bt);
+
+    virtual std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    virtual bool is_array() const {
+        return left->is_array();
+    }
+    virtual bool is_exhausted() const;
+    virtual feed_type_t cfeed_type() const {
+        return feed_type_t::not_feed;
+    }
+    virtual bool is_infinite() const {
+        return left->is_infinite();
+    }
+
+private:
+    counted_t<datum_stream_t> left;
+    std::vector<datum_t> left_rows;
+    size_t left_index;
+    const datum_string_t left_field;
+    // The left row that is being joined with `right`, if any.
+    datum_t left_row;
+
+    counted_t<datum_stream_t> right;
+    std::vector<datum_t> right_rows;
+    size_t right_index;
+    const datum_string_t right_field;
+    // Whether `right` has been joined with a left row yet.
+    bool right_used;
+    const std::function<counted_t<datum_stream_t>(env_t *)> eval_right;
+};
+
 // This class generates the `read_t`s used in range reads.  It's used by
 // `reader_t` below.  Its subclasses are the different types of range reads we
 // need to do.
@@ -91,6 +91,7 @@ public:
 
 private:
     template <cluster_version_t> friend class wire_func_serialization_visitor_t;
+    friend class wire_func_key_visitor_t;
     bool filter_helper(env_t *env, datum_t arg) const;
 
     // Only contains the parts of the scope that `body` uses.
@@ -128,6 +129,7 @@ public:
 
 private:
     template <cluster_version_t> friend class wire_func_serialization_visitor_t;
+    friend class wire_func_key_visitor_t;
     bool filter_helper(env_t *env, datum_t arg) const;
 
     std::string js_source;
@@ -198,6 +200,8 @@ public:
     // going by way of val_t, and without requiring a full-blown env.
     counted_t<const func_t> eval_to_func(const var_scope_t &env_scope) const;
 
+    const counted_t<const term_t> &get_body() const { return body; }
+
 private:
     virtual void accumulate_captures(var_captures_t *captures) const;
     virtual bool is_deterministic() const;
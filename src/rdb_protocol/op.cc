@@ -189,6 +189,14 @@ op_term_t::op_term_t(compile_env_t *env, const protob_t<const Term> term,
 }
 op_term_t::~op_term_t() { }
 
+const std::vector<counted_t<const term_t> > &op_term_t::get_original_args() const {
+    return arg_terms->get_original_args();
+}
+
+const std::map<std::string, counted_t<const term_t> > &op_term_t::get_optargs() const {
+    return optargs;
+}
+
 scoped_ptr_t<val_t> op_term_t::term_eval(scope_env_t *env,
                                          eval_flags_t eval_flags) const {
     argvec_t argv = arg_terms->start_eval(env, eval_flags);
@@ -196,28 +204,55 @@ scoped_ptr_t<val_t> op_term_t::term_eval(scope_env_t *env,
         counted_t<grouped_data_t> gd;
         scoped_ptr_t<val_t> arg0;
         maybe_grouped_data(env, &argv, eval_flags, &gd, &arg0);
-        if (gd.has()) {
-            // (arg0 is empty, because maybe_grouped_data sets at most one of gd and
-            // arg0, so we don't have to worry about re-evaluating it.
-            counted_t<grouped_data_t> out(new grouped_data_t());
-            // We're processing gd into another grouped_data_t -- so gd's order
-            // doesn't matter.
-            for (auto kv = gd->begin(); kv != gd->end(); ++kv) {
-                arg_terms->start_eval(env, eval_flags);
-                args_t args(this, argv, make_scoped<val_t>(kv->second, backtrace()));
-                (*out)[kv->first] = eval_impl(env, &args, eval_flags)->as_datum();
-            }
-            return make_scoped<val_t>(out, backtrace());
-        } else {
-            args_t args(this, std::move(argv), std::move(arg0));
-            return eval_impl(env, &args, eval_flags);
-        }
+        return eval_maybe_grouped(
+            env, std::move(argv), eval_flags, std::move(gd), std::move(arg0));
     } else {
         args_t args(this, std::move(argv));
         return eval_impl(env, &args, eval_flags);
     }
 }
 
+scoped_ptr_t<val_t> op_term_t::eval_with_arg0(scope_env_t *env,
+                                              scoped_ptr_t<val_t> &&arg0,
+                                              eval_flags_t eval_flags) const {
+    argvec_t argv = arg_terms->start_eval(env, eval_flags);
+    // We already have the value of the first argument, so its term is dropped.
+    UNUSED counted_t<const runtime_term_t> arg0_term = argv.remove(0);
+    if (can_be_grouped()) {
+        counted_t<grouped_data_t> gd;
+        scoped_ptr_t<val_t> ungrouped_arg0;
+        maybe_grouped_data(env, std::move(arg0), &gd, &ungrouped_arg0);
+        return eval_maybe_grouped(
+            env, std::move(argv), eval_flags, std::move(gd), std::move(ungrouped_arg0));
+    } else {
+        args_t args(this, std::move(argv), std::move(arg0));
+        return eval_impl(env, &args, eval_flags);
+    }
+}
+
+scoped_ptr_t<val_t> op_term_t::eval_maybe_grouped(scope_env_t *env,
+                                                  argvec_t &&argv,
+                                                  eval_flags_t eval_flags,
+                                                  counted_t<grouped_data_t> &&gd,
+                                                  scoped_ptr_t<val_t> &&arg0) const {
+    if (gd.has()) {
+        // (arg0 is empty, because maybe_grouped_data sets at most one of gd and
+        // arg0, so we don't have to worry about re-evaluating it.
+        counted_t<grouped_data_t> out(new grouped_data_t());
+        // We're processing gd into another grouped_data_t -- so gd's order
+        // doesn't matter.
+        for (auto kv = gd->begin(); kv != gd->end(); ++kv) {
+            arg_terms->start_eval(env, eval_flags);
+            args_t args(this, argv, make_scoped<val_t>(kv->second, backtrace()));
+            (*out)[kv->first] = eval_impl(env, &args, eval_flags)->as_datum();
+        }
+        return make_scoped<val_t>(out, backtrace());
+    } else {
+        args_t args(this, std::move(argv), std::move(arg0));
+        return eval_impl(env, &args, eval_flags);
+    }
+}
+
 bool op_term_t::can_be_grouped() const { return true; }
 bool op_term_t::is_grouped_seq_op() const { return false; }
 
@@ -288,19 +323,25 @@ void op_term_t::maybe_grouped_data(scope_env_t *env,
         grouped_data_out->reset();
         arg0_out->reset();
     } else {
-        scoped_ptr_t<val_t> arg0 = argv->remove(0)->eval(env, flags);
+        maybe_grouped_data(env, argv->remove(0)->eval(env, flags),
+                           grouped_data_out, arg0_out);
+    }
+}
 
-        counted_t<grouped_data_t> gd = is_grouped_seq_op()
-            ? arg0->maybe_as_grouped_data()
-            : arg0->maybe_as_promiscuous_grouped_data(env->env);
+void op_term_t::maybe_grouped_data(scope_env_t *env,
+                                   scoped_ptr_t<val_t> &&arg0,
+                                   counted_t<grouped_data_t> *grouped_data_out,
+                                   scoped_ptr_t<val_t> *arg0_out) const {
+    counted_t<grouped_data_t> gd = is_grouped_seq_op()
+        ? arg0->maybe_as_grouped_data()
+        : arg0->maybe_as_promiscuous_grouped_data(env->env);
 
-        if (gd.has()) {
-            *grouped_data_out = std::move(gd);
-            arg0_out->reset();
-        } else {
-            grouped_data_out->reset();
-            *arg0_out = std::move(arg0);
-        }
+    if (gd.has()) {
+        *grouped_data_out = std::move(gd);
+        arg0_out->reset();
+    } else {
+        grouped_data_out->reset();
+        *arg0_out = std::move(arg0);
     }
 }
 
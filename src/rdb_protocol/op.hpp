@@ -109,6 +109,19 @@ void accumulate_all_captures(
 // Almost all terms will inherit from this and use its member functions to
 // access their arguments.
 class op_term_t : public term_t {
+public:
+    // The compiled arguments, before any `r.args` are expanded.
+    const std::vector<counted_t<const term_t> > &get_original_args() const;
+    // The compiled optional arguments.
+    const std::map<std::string, counted_t<const term_t> > &get_optargs() const;
+
+    // Like `eval`, but with the first argument already evaluated to `arg0`.
+    // Rewrites use this so that they don't evaluate their input a second time when
+    // they fall back to the rewritten term.
+    scoped_ptr_t<val_t> eval_with_arg0(scope_env_t *env,
+                                       scoped_ptr_t<val_t> &&arg0,
+                                       eval_flags_t eval_flags = NO_FLAGS) const;
+
 protected:
     op_term_t(compile_env_t *env, protob_t<const Term> term,
               argspec_t argspec, optargspec_t optargspec = optargspec_t({}));
@@ -141,6 +154,17 @@ private:
                             eval_flags_t flags,
                             counted_t<grouped_data_t> *grouped_data_out,
                             scoped_ptr_t<val_t> *arg0_out) const;
+    // Like the above, but for an `arg0` that has already been evaluated.
+    void maybe_grouped_data(scope_env_t *env,
+                            scoped_ptr_t<val_t> &&arg0,
+                            counted_t<grouped_data_t> *grouped_data_out,
+                            scoped_ptr_t<val_t> *arg0_out) const;
+    // Evaluates the term once any grouped data in the first argument is known.
+    scoped_ptr_t<val_t> eval_maybe_grouped(scope_env_t *env,
+                                           argvec_t &&argv,
+                                           eval_flags_t eval_flags,
+                                           counted_t<grouped_data_t> &&gd,
+                                           scoped_ptr_t<val_t> &&arg0) const;
 
     virtual scoped_ptr_t<val_t> term_eval(scope_env_t *env,
                                           eval_flags_t eval_flags) const;
@@ -16,6 +16,7 @@
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/ql2.pb.h"
+#include "rdb_protocol/sindex_construction.hpp"
 #include "rdb_protocol/store.hpp"
 
 #include "debug.hpp"
@@ -135,7 +136,7 @@ void post_construct_and_drain_queue(
     THROWS_NOTHING
 {
     std::set<uuid_u> sindexes_to_bring_up_to_date;
-    parallel_traversal_progress_t progress_tracker;
+    sindex_construction_progress_t progress_tracker;
     std::vector<map_insertion_sentry_t<
         store_t::sindex_context_map_t::key_type,
         store_t::sindex_context_map_t::mapped_type> > sindex_context_sentries;
@@ -322,12 +323,18 @@ key_range_t sindex_key_range(const store_key_t &start,
 
 }  // namespace rdb_protocol
 
+region_t region_from_keys(const std::vector<store_key_t> &keys);
+
 /* read_t::get_region implementation */
 struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const point_read_t &pr) const {
         return rdb_protocol::monokey_region(pr.key);
     }
 
+    region_t operator()(const multi_point_read_t &mpr) const {
+        return region_from_keys(mpr.keys);
+    }
+
     region_t operator()(const rget_read_t &rg) const {
         return rg.region;
     }
@@ -389,6 +396,21 @@ struct rdb_r_shard_visitor_t : public boost::static_visitor<bool> {
         return keyed_read(pr, pr.key);
     }
 
+    bool operator()(const multi_point_read_t &mpr) const {
+        multi_point_read_t tmp;
+        for (const auto &key : mpr.keys) {
+            if (region_contains_key(*region, key)) {
+                tmp.keys.push_back(key);
+            }
+        }
+        if (!tmp.keys.empty()) {
+            *payload_out = std::move(tmp);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     template <class T>
     bool rangey_read(const T &arg) const {
         const hash_region_t<key_range_t> intersection
@@ -500,6 +522,7 @@ public:
           ctx(_ctx), interruptor(_interruptor) { }
 
     void operator()(const point_read_t &);
+    void operator()(const multi_point_read_t &);
 
     void operator()(const rget_read_t &rg);
     void operator()(const intersecting_geo_read_t &gr);
@@ -571,6 +594,10 @@ void unshard_stamps(const std::vector<changefeed_stamp_response_t *> &resps,
             auto pair = out->stamps.insert(std::make_pair(stamp.first, stamp.second));
             guarantee(pair.second);
         }
+        for (auto &&log : resp->logs) {
+            auto pair = out->logs.insert(std::make_pair(log.first, std::move(log.second)));
+            guarantee(pair.second);
+        }
     }
 }
 
@@ -600,6 +627,18 @@ void rdb_r_unshard_visitor_t::operator()(const point_read_t &) {
     *response_out = responses[0];
 }
 
+void rdb_r_unshard_visitor_t::operator()(const multi_point_read_t &) {
+    response_out->response = multi_point_read_response_t();
+    auto *out = boost::get<multi_point_read_response_t>(&response_out->response);
+    for (size_t i = 0; i < count; ++i) {
+        auto *resp = boost::get<multi_point_read_response_t>(&responses[i].response);
+        guarantee(resp != nullptr);
+        for (auto &&pair : resp->data) {
+            out->data.insert(std::move(pair));
+        }
+    }
+}
+
 void rdb_r_unshard_visitor_t::operator()(const intersecting_geo_read_t &query) {
     unshard_range_batch<rget_read_response_t>(query, sorting_t::UNORDERED);
 }
@@ -845,6 +884,7 @@ void read_t::unshard(read_response_t *responses, size_t count,
 
 struct use_snapshot_visitor_t : public boost::static_visitor<bool> {
     bool operator()(const point_read_t &) const {                 return false; }
+    bool operator()(const multi_point_read_t &) const {           return true;  }
     bool operator()(const dummy_read_t &) const {                 return false; }
     bool operator()(const rget_read_t &) const {                  return true;  }
     bool operator()(const intersecting_geo_read_t &) const {      return true;  }
@@ -866,6 +906,7 @@ struct route_to_primary_visitor_t : public boost::static_visitor<bool> {
         return static_cast<bool>(rget.stamp);
     }
     bool operator()(const point_read_t &) const {                 return false; }
+    bool operator()(const multi_point_read_t &) const {           return false; }
     bool operator()(const dummy_read_t &) const {                 return false; }
     bool operator()(const intersecting_geo_read_t &) const {      return false; }
     bool operator()(const nearest_geo_read_t &) const {           return false; }
@@ -1172,6 +1213,7 @@ int write_t::expected_document_changes() const {
 }
 
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(point_read_response_t, data);
+RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(multi_point_read_response_t, data);
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
     ql::skey_version_t, int8_t,
     ql::skey_version_t::pre_1_16, ql::skey_version_t::post_1_16);
@@ -1183,13 +1225,14 @@ RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
     changefeed_subscribe_response_t, server_uuids, addrs);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
     changefeed_limit_subscribe_response_t, shards, limit_addrs);
-RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(changefeed_stamp_response_t, stamps);
+RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_stamp_response_t, stamps, logs);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(
     changefeed_point_stamp_response_t, stamp, initial_val);
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(read_response_t, response, event_log, n_shards);
 RDB_IMPL_SERIALIZABLE_0_FOR_CLUSTER(dummy_read_response_t);
 
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(point_read_t, key);
+RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(multi_point_read_t, keys);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(dummy_read_t, region);
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(sindex_rangespec_t, id, region, original_range);
 
@@ -1209,10 +1252,10 @@ RDB_IMPL_SERIALIZABLE_8_FOR_CLUSTER(
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(
         distribution_read_t, max_depth, result_limit, region);
 
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_subscribe_t, addr, region);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(changefeed_subscribe_t, addr, region, filters);
 RDB_IMPL_SERIALIZABLE_5_FOR_CLUSTER(
     changefeed_limit_subscribe_t, addr, uuid, spec, table, region);
-RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_stamp_t, addr, region);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(changefeed_stamp_t, addr, region, read_log, resume_from);
 RDB_IMPL_SERIALIZABLE_2_FOR_CLUSTER(changefeed_point_stamp_t, addr, key);
 
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(read_t, read, profile, read_mode);
@@ -1224,17 +1267,17 @@ RDB_IMPL_SERIALIZABLE_0_FOR_CLUSTER(dummy_write_response_t);
 
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(write_response_t, response, event_log, n_shards);
 
-RDB_IMPL_SERIALIZABLE_5_FOR_CLUSTER(
+RDB_IMPL_SERIALIZABLE_5_SINCE_v2_1(
         batched_replace_t, keys, pkey, f, optargs, return_changes);
-RDB_IMPL_SERIALIZABLE_5_FOR_CLUSTER(
+RDB_IMPL_SERIALIZABLE_5_SINCE_v2_1(
         batched_insert_t, inserts, pkey, conflict_behavior, limits, return_changes);
 
 RDB_IMPL_SERIALIZABLE_3_SINCE_v1_13(point_write_t, key, data, overwrite);
 RDB_IMPL_SERIALIZABLE_1_SINCE_v1_13(point_delete_t, key);
 RDB_IMPL_SERIALIZABLE_1_SINCE_v1_13(sync_t, region);
-RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(dummy_write_t, region);
+RDB_IMPL_SERIALIZABLE_1_SINCE_v2_1(dummy_write_t, region);
 
-RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+RDB_IMPL_SERIALIZABLE_4_SINCE_v2_1(
     write_t, write, durability_requirement, profile, limits);
 
 
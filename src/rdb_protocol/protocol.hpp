@@ -113,12 +113,21 @@ struct point_read_response_t {
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(point_read_response_t);
 
+struct multi_point_read_response_t {
+    // Only the keys that exist are present.
+    std::map<store_key_t, ql::datum_t> data;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(multi_point_read_response_t);
+
 struct changefeed_stamp_response_t {
     changefeed_stamp_response_t() { }
     // The `uuid_u` below is the uuid of the changefeed `server_t`.  (We have
     // different timestamps for each `server_t` because they're on different
     // servers and don't synchronize with each other.)
     std::map<uuid_u, uint64_t> stamps;
+    // Only filled in if the `changefeed_stamp_t` had `read_log` set.  Each
+    // `server_t` reads its change log at the same point it reads its stamp.
+    std::map<uuid_u, ql::changefeed::log_read_t> logs;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_stamp_response_t);
 
@@ -224,7 +233,8 @@ struct read_response_t {
                            changefeed_stamp_response_t,
                            changefeed_point_stamp_response_t,
                            distribution_read_response_t,
-                           dummy_read_response_t> variant_t;
+                           dummy_read_response_t,
+                           multi_point_read_response_t> variant_t;
     variant_t response;
     profile::event_log_t event_log;
     size_t n_shards;
@@ -244,6 +254,19 @@ public:
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(point_read_t);
 
+// Reads many primary keys at once.  Each shard looks up all of its keys in a
+// single descent of its btree.
+class multi_point_read_t {
+public:
+    multi_point_read_t() { }
+    // `_keys` must be sorted and must not contain duplicates.
+    explicit multi_point_read_t(std::vector<store_key_t> &&_keys)
+        : keys(std::move(_keys)) { }
+
+    std::vector<store_key_t> keys;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(multi_point_read_t);
+
 // `dummy_read_t` can be used to poll for table readiness - it will go through all
 // the clustering layers, but is a no-op in the protocol layer.
 class dummy_read_t {
@@ -272,11 +295,15 @@ struct sindex_rangespec_t {
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(sindex_rangespec_t);
 
 struct changefeed_stamp_t {
-    changefeed_stamp_t() : region(region_t::universe()) { }
+    changefeed_stamp_t() : region(region_t::universe()), read_log(false) { }
     explicit changefeed_stamp_t(ql::changefeed::client_t::addr_t _addr)
-        : addr(std::move(_addr)), region(region_t::universe()) { }
+        : addr(std::move(_addr)), region(region_t::universe()), read_log(false) { }
     ql::changefeed::client_t::addr_t addr;
     region_t region;
+    // Whether to read the `server_t`s' change logs along with their stamps (see
+    // `server_t::get_stamp`), and where to read them from.
+    bool read_log;
+    boost::optional<ql::changefeed::log_position_t> resume_from;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_stamp_t);
 
@@ -411,10 +438,13 @@ RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(distribution_read_t);
 
 struct changefeed_subscribe_t {
     changefeed_subscribe_t() { }
-    explicit changefeed_subscribe_t(ql::changefeed::client_t::addr_t _addr)
-        : addr(_addr), region(region_t::universe()) { }
+    changefeed_subscribe_t(ql::changefeed::client_t::addr_t _addr,
+                           std::vector<ql::filter_wire_func_t> _filters)
+        : addr(_addr), region(region_t::universe()), filters(std::move(_filters)) { }
     ql::changefeed::client_t::addr_t addr;
     region_t region;
+    // Evaluated on the shards, so that changes which don't pass them aren't sent.
+    std::vector<ql::filter_wire_func_t> filters;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(changefeed_subscribe_t);
 
@@ -459,7 +489,8 @@ struct read_t {
                            changefeed_limit_subscribe_t,
                            changefeed_point_stamp_t,
                            distribution_read_t,
-                           dummy_read_t> variant_t;
+                           dummy_read_t,
+                           multi_point_read_t> variant_t;
     variant_t read;
     profile_bool_t profile;
     read_mode_t read_mode;
@@ -556,7 +587,7 @@ struct batched_replace_t {
     std::map<std::string, ql::wire_func_t > optargs;
     return_changes_t return_changes;
 };
-RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(batched_replace_t);
+RDB_DECLARE_SERIALIZABLE(batched_replace_t);
 
 struct batched_insert_t {
     batched_insert_t() { }
@@ -593,7 +624,7 @@ struct batched_insert_t {
     ql::configured_limits_t limits;
     return_changes_t return_changes;
 };
-RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(batched_insert_t);
+RDB_DECLARE_SERIALIZABLE(batched_insert_t);
 
 class point_write_t {
 public:
@@ -699,7 +730,7 @@ struct write_t {
           profile(_profile),
           limits(_limits) { }
 };
-RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(write_t);
+RDB_DECLARE_SERIALIZABLE(write_t);
 
 class store_t;
 
@@ -82,6 +82,48 @@ ql::datum_t real_table_t::read_row(ql::env_t *env,
     return p_res->data;
 }
 
+std::vector<ql::datum_t> real_table_t::read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) {
+    // A key that is too long to be a primary key can't match any row, so we
+    // leave it empty rather than failing the way `print_primary()` would.
+    std::vector<boost::optional<store_key_t> > keys;
+    keys.reserve(pvals.size());
+    std::vector<store_key_t> sorted_keys;
+    sorted_keys.reserve(pvals.size());
+    for (const auto &pval : pvals) {
+        std::string key = pval.print_primary_internal();
+        if (key.size() <= rdb_protocol::MAX_PRIMARY_KEY_SIZE) {
+            keys.push_back(store_key_t(key));
+            sorted_keys.push_back(*keys.back());
+        } else {
+            keys.push_back(boost::none);
+        }
+    }
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()),
+                      sorted_keys.end());
+
+    multi_point_read_response_t mp_res;
+    if (!sorted_keys.empty()) {
+        read_t read(multi_point_read_t(std::move(sorted_keys)),
+                    env->profile(), read_mode);
+        read_response_t res;
+        read_with_profile(env, read, &res);
+        multi_point_read_response_t *p_res =
+            boost::get<multi_point_read_response_t>(&res.response);
+        r_sanity_check(p_res);
+        mp_res = std::move(*p_res);
+    }
+
+    std::vector<ql::datum_t> rows;
+    rows.reserve(pvals.size());
+    for (const auto &key : keys) {
+        auto it = key ? mp_res.data.find(*key) : mp_res.data.end();
+        rows.push_back(it != mp_res.data.end() ? it->second : ql::datum_t::null());
+    }
+    return rows;
+}
+
 counted_t<ql::datum_stream_t> real_table_t::read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -111,11 +153,13 @@ counted_t<ql::datum_stream_t> real_table_t::read_changes(
     counted_t<ql::datum_stream_t> maybe_src,
     const ql::datum_t &squash,
     bool include_states,
+    const ql::changefeed::resume_spec_t &resume,
     ql::changefeed::keyspec_t::spec_t &&spec,
     ql::backtrace_id_t bt,
     const std::string &table_name) {
     return changefeed_client->new_stream(
-        env, maybe_src, squash, include_states, uuid, bt, table_name, std::move(spec));
+        env, maybe_src, squash, include_states, resume, uuid, bt, table_name,
+        std::move(spec));
 }
 
 counted_t<ql::datum_stream_t> real_table_t::read_intersecting(
@@ -66,6 +66,8 @@ public:
 
     ql::datum_t read_row(ql::env_t *env,
         ql::datum_t pval, read_mode_t read_mode);
+    std::vector<ql::datum_t> read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode);
     counted_t<ql::datum_stream_t> read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -79,6 +81,7 @@ public:
         counted_t<ql::datum_stream_t> maybe_src,
         const ql::datum_t &squash,
         bool include_states,
+        const ql::changefeed::resume_spec_t &resume,
         ql::changefeed::keyspec_t::spec_t &&spec,
         ql::backtrace_id_t bt,
         const std::string &table_name);
@@ -0,0 +1,295 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/sindex_construction.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include "containers/archive/stl_types.hpp"
+#include "containers/disk_backed_queue.hpp"
+
+/* How many runs of the same size are merged into one. */
+static const size_t SINDEX_SORTER_MERGE_FAN_IN = 16;
+
+/* How many entries are written to a run in one transaction. */
+static const size_t SINDEX_SORTER_WRITE_BATCH_SIZE = 1000;
+
+struct sindex_sorter_t::run_t {
+    run_t(int _level, scoped_ptr_t<internal_disk_backed_queue_t> &&_queue)
+        : level(_level), queue(std::move(_queue)) { }
+
+    /* How many times the entries of this run have been merged. */
+    int level;
+    scoped_ptr_t<internal_disk_backed_queue_t> queue;
+};
+
+/* `merger_t` merges sorted runs into a single sorted stream. Entries with equal keys
+come out in the order of their runs. */
+class sindex_sorter_t::merger_t {
+public:
+    explicit merger_t(std::vector<internal_disk_backed_queue_t *> &&_sources)
+        : sources(std::move(_sources)) {
+        for (size_t i = 0; i < sources.size(); ++i) {
+            refill(i);
+        }
+    }
+
+    bool next(sindex_entry_t *entry_out) {
+        if (heads.empty()) {
+            return false;
+        }
+        std::pop_heap(heads.begin(), heads.end(), &comes_after);
+        *entry_out = std::move(heads.back().first);
+        size_t source = heads.back().second;
+        heads.pop_back();
+        refill(source);
+        return true;
+    }
+
+private:
+    /* `std::push_heap()` and friends put the greatest element first, so this orders
+    the heap with the smallest key first. */
+    static bool comes_after(const std::pair<sindex_entry_t, size_t> &a,
+                            const std::pair<sindex_entry_t, size_t> &b) {
+        if (a.first.first != b.first.first) {
+            return b.first.first < a.first.first;
+        }
+        return b.second < a.second;
+    }
+
+    void refill(size_t source) {
+        if (sources[source]->empty()) {
+            return;
+        }
+        sindex_entry_t entry;
+        // This is a disk backed queue, so there are no versioning issues.
+        deserializing_viewer_t<sindex_entry_t> viewer(&entry);
+        sources[source]->pop(&viewer);
+        heads.push_back(std::make_pair(std::move(entry), source));
+        std::push_heap(heads.begin(), heads.end(), &comes_after);
+    }
+
+    std::vector<internal_disk_backed_queue_t *> sources;
+    std::vector<std::pair<sindex_entry_t, size_t> > heads;
+
+    DISABLE_COPYING(merger_t);
+};
+
+/* Writes the entries that `next` produces to `queue`, in batches. */
+static void write_run(internal_disk_backed_queue_t *queue,
+                      const std::function<bool(sindex_entry_t *)> &next) {
+    std::vector<sindex_entry_t> batch;
+    bool done = false;
+    while (!done) {
+        batch.clear();
+        sindex_entry_t entry;
+        while (batch.size() < SINDEX_SORTER_WRITE_BATCH_SIZE && !done) {
+            if (next(&entry)) {
+                batch.push_back(std::move(entry));
+            } else {
+                done = true;
+            }
+        }
+        if (batch.empty()) {
+            break;
+        }
+        scoped_array_t<write_message_t> wms(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            // This is a disk backed queue, so there are no versioning issues.
+            serialize<cluster_version_t::LATEST_OVERALL>(&wms[i], batch[i]);
+        }
+        queue->push(wms);
+    }
+}
+
+static size_t entry_memory_size(const sindex_entry_t &entry) {
+    return sizeof(sindex_entry_t) + entry.second.capacity();
+}
+
+sindex_sorter_t::sindex_sorter_t(io_backender_t *io_backender,
+                                 const base_path_t &base_path,
+                                 const std::string &name,
+                                 perfmon_collection_t *stats_parent,
+                                 size_t memory_limit)
+    : io_backender_(io_backender),
+      base_path_(base_path),
+      name_(name),
+      stats_parent_(stats_parent),
+      memory_limit_(memory_limit),
+      buffer_size_(0),
+      num_entries_(0),
+      next_run_id_(0),
+      finished_(false),
+      buffer_position_(0),
+      has_last_key_(false) { }
+
+sindex_sorter_t::~sindex_sorter_t() { }
+
+void sindex_sorter_t::add(sindex_entry_t &&entry) {
+    guarantee(!finished_);
+    buffer_size_ += entry_memory_size(entry);
+    buffer_.push_back(std::move(entry));
+    ++num_entries_;
+
+    if (buffer_size_ >= memory_limit_) {
+        // Other coroutines can keep on adding entries while we write this run.
+        std::vector<sindex_entry_t> entries;
+        entries.swap(buffer_);
+        buffer_size_ = 0;
+        new_mutex_acq_t acq(&runs_mutex_);
+        spill(std::move(entries));
+    }
+}
+
+void sindex_sorter_t::finish() {
+    guarantee(!finished_);
+    finished_ = true;
+
+    new_mutex_acq_t acq(&runs_mutex_);
+    if (runs_.empty()) {
+        // Everything fits into memory, so there is no need to touch the disk.
+        std::sort(buffer_.begin(), buffer_.end(),
+            [](const sindex_entry_t &a, const sindex_entry_t &b) {
+                return a.first < b.first;
+            });
+        buffer_position_ = 0;
+        return;
+    }
+
+    if (!buffer_.empty()) {
+        std::vector<sindex_entry_t> entries;
+        entries.swap(buffer_);
+        buffer_size_ = 0;
+        spill(std::move(entries));
+    }
+    std::vector<internal_disk_backed_queue_t *> sources;
+    for (const auto &run : runs_) {
+        sources.push_back(run->queue.get());
+    }
+    merger_.init(new merger_t(std::move(sources)));
+}
+
+bool sindex_sorter_t::next(sindex_entry_t *entry_out) {
+    guarantee(finished_);
+    for (;;) {
+        if (merger_.has()) {
+            if (!merger_->next(entry_out)) {
+                return false;
+            }
+        } else {
+            if (buffer_position_ == buffer_.size()) {
+                return false;
+            }
+            *entry_out = std::move(buffer_[buffer_position_]);
+            ++buffer_position_;
+        }
+
+        // `btree_bulk_load()` requires strictly increasing keys.
+        if (has_last_key_ && entry_out->first == last_key_) {
+            continue;
+        }
+        has_last_key_ = true;
+        last_key_ = entry_out->first;
+        return true;
+    }
+}
+
+void sindex_sorter_t::spill(std::vector<sindex_entry_t> &&entries) {
+    std::sort(entries.begin(), entries.end(),
+        [](const sindex_entry_t &a, const sindex_entry_t &b) {
+            return a.first < b.first;
+        });
+    scoped_ptr_t<run_t> run(new run_t(0, new_run_queue()));
+    size_t position = 0;
+    write_run(run->queue.get(), [&](sindex_entry_t *entry_out) {
+        if (position == entries.size()) {
+            return false;
+        }
+        *entry_out = std::move(entries[position]);
+        ++position;
+        return true;
+    });
+    entries.clear();
+    runs_.push_back(std::move(run));
+
+    // Merge the last `SINDEX_SORTER_MERGE_FAN_IN` runs for as long as they have the
+    // same level. Runs that were merged fewer times always come later.
+    while (runs_.size() >= SINDEX_SORTER_MERGE_FAN_IN) {
+        const size_t first = runs_.size() - SINDEX_SORTER_MERGE_FAN_IN;
+        const int level = runs_.back()->level;
+        if (runs_[first]->level != level) {
+            break;
+        }
+        std::vector<internal_disk_backed_queue_t *> sources;
+        for (size_t i = first; i < runs_.size(); ++i) {
+            sources.push_back(runs_[i]->queue.get());
+        }
+        scoped_ptr_t<run_t> merged(new run_t(level + 1, new_run_queue()));
+        {
+            merger_t merger(std::move(sources));
+            write_run(merged->queue.get(), [&](sindex_entry_t *entry_out) {
+                return merger.next(entry_out);
+            });
+        }
+        // This removes the merged runs' files.
+        runs_.resize(first);
+        runs_.push_back(std::move(merged));
+    }
+}
+
+scoped_ptr_t<internal_disk_backed_queue_t> sindex_sorter_t::new_run_queue() {
+    scoped_ptr_t<internal_disk_backed_queue_t> queue(
+        new internal_disk_backed_queue_t(
+            io_backender_,
+            serializer_filepath_t(
+                base_path_, strprintf("%s_%d", name_.c_str(), next_run_id_)),
+            stats_parent_));
+    ++next_run_id_;
+    return queue;
+}
+
+sindex_construction_progress_t::sindex_construction_progress_t()
+    : loading_(false), entries_total_(0), entries_loaded_(0) { }
+
+parallel_traversal_progress_t *sindex_construction_progress_t::add_scan_progress() {
+    assert_thread();
+    scan_progress_.push_back(make_scoped<parallel_traversal_progress_t>());
+    return scan_progress_.back().get();
+}
+
+void sindex_construction_progress_t::start_loading(uint64_t num_entries) {
+    assert_thread();
+    loading_ = true;
+    entries_total_ = num_entries;
+    entries_loaded_ = 0;
+}
+
+void sindex_construction_progress_t::record_loaded(uint64_t num_entries) {
+    assert_thread();
+    entries_loaded_ = std::min(entries_total_, entries_loaded_ + num_entries);
+}
+
+progress_completion_fraction_t
+sindex_construction_progress_t::guess_completion() const {
+    assert_thread();
+    // Traversals that don't know the height of their part of the tree yet don't count.
+    int64_t released = 0;
+    int64_t total = 0;
+    for (const auto &progress : scan_progress_) {
+        progress_completion_fraction_t scan = progress->guess_completion();
+        if (!scan.invalid()) {
+            released += scan.estimate_of_released_nodes;
+            total += scan.estimate_of_total_nodes;
+        }
+    }
+    if (total == 0) {
+        return progress_completion_fraction_t();
+    }
+    if (!loading_) {
+        return progress_completion_fraction_t(released, 2 * total);
+    }
+    int64_t loaded = entries_total_ == 0
+        ? total
+        : static_cast<int64_t>(static_cast<double>(total) * entries_loaded_
+                               / entries_total_);
+    return progress_completion_fraction_t(total + loaded, 2 * total);
+}
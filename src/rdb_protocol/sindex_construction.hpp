@@ -0,0 +1,116 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_SINDEX_CONSTRUCTION_HPP_
+#define RDB_PROTOCOL_SINDEX_CONSTRUCTION_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree/keys.hpp"
+#include "btree/parallel_traversal.hpp"
+#include "btree/traversal_progress.hpp"
+#include "concurrency/new_mutex.hpp"
+#include "containers/scoped.hpp"
+#include "utils.hpp"
+
+class internal_disk_backed_queue_t;
+class io_backender_t;
+class perfmon_collection_t;
+
+/* An entry of a secondary index B-tree: the secondary index key, and the `value_ref`
+of the row that it refers to. */
+typedef std::pair<store_key_t, std::vector<char> > sindex_entry_t;
+
+/* `sindex_sorter_t` sorts the entries of a secondary index that is being constructed,
+so they can be bulk-loaded into the secondary index B-tree in key order. It keeps up to
+`memory_limit` bytes of entries in memory. Beyond that it sorts them and spills them to
+a disk backed queue as a sorted run. Whenever `SINDEX_SORTER_MERGE_FAN_IN` runs of the
+same size have accumulated it merges them into one bigger run, so that the number of
+open files stays logarithmic in the size of the index. */
+class sindex_sorter_t {
+public:
+    sindex_sorter_t(io_backender_t *io_backender,
+                    const base_path_t &base_path,
+                    const std::string &name,
+                    perfmon_collection_t *stats_parent,
+                    size_t memory_limit);
+    ~sindex_sorter_t();
+
+    /* Can be called from several coroutines at once. Blocks while a run is written to
+    disk. */
+    void add(sindex_entry_t &&entry);
+
+    /* Must be called once all entries have been added and before calling `next()`. */
+    void finish();
+
+    /* Returns the entries in increasing key order, each key only once. Returns `false`
+    once all entries have been returned. */
+    bool next(sindex_entry_t *entry_out);
+
+    /* The number of entries that have been added so far. */
+    uint64_t num_entries() const { return num_entries_; }
+
+private:
+    class merger_t;
+    struct run_t;
+
+    void spill(std::vector<sindex_entry_t> &&entries);
+    scoped_ptr_t<internal_disk_backed_queue_t> new_run_queue();
+
+    io_backender_t *const io_backender_;
+    const base_path_t base_path_;
+    const std::string name_;
+    perfmon_collection_t *const stats_parent_;
+    const size_t memory_limit_;
+
+    std::vector<sindex_entry_t> buffer_;
+    size_t buffer_size_;
+    uint64_t num_entries_;
+
+    /* Held while a run is written or merged. */
+    new_mutex_t runs_mutex_;
+    std::vector<scoped_ptr_t<run_t> > runs_;
+    int next_run_id_;
+
+    /* Set up by `finish()`. If there are no runs, `next()` goes through `buffer_`
+    instead. */
+    bool finished_;
+    scoped_ptr_t<merger_t> merger_;
+    size_t buffer_position_;
+    bool has_last_key_;
+    store_key_t last_key_;
+
+    DISABLE_COPYING(sindex_sorter_t);
+};
+
+/* `sindex_construction_progress_t` is what index construction reports as its progress
+to `sindex_status` and to the `jobs` table. Constructing an index has two phases: first
+the primary B-tree is scanned and the index entries are sorted, then the sorted entries
+are loaded into the secondary index B-trees. Both phases are measured in blocks of the
+primary B-tree, and each of them accounts for half of the total. The scan can consist of
+several traversals of different key ranges. */
+class sindex_construction_progress_t : public traversal_progress_t {
+public:
+    sindex_construction_progress_t();
+
+    /* Returns the progress of one more traversal of the scan, to be passed to
+    `btree_parallel_traversal()`. */
+    parallel_traversal_progress_t *add_scan_progress();
+
+    /* Ends the scan phase. `num_entries` is the number of entries that are going to
+    be loaded. */
+    void start_loading(uint64_t num_entries);
+    void record_loaded(uint64_t num_entries);
+
+    progress_completion_fraction_t guess_completion() const;
+
+private:
+    std::vector<scoped_ptr_t<parallel_traversal_progress_t> > scan_progress_;
+    bool loading_;
+    uint64_t entries_total_;
+    uint64_t entries_loaded_;
+
+    DISABLE_COPYING(sindex_construction_progress_t);
+};
+
+#endif  // RDB_PROTOCOL_SINDEX_CONSTRUCTION_HPP_
@@ -266,7 +266,7 @@ void do_read(ql::env_t *env,
 struct rdb_read_visitor_t : public boost::static_visitor<void> {
     void operator()(const changefeed_subscribe_t &s) {
         guarantee(store->changefeed_server.has());
-        store->changefeed_server->add_client(s.addr, s.region);
+        store->changefeed_server->add_client(s.addr, s.region, s.filters, ctx);
         response->response = changefeed_subscribe_response_t();
         auto res = boost::get<changefeed_subscribe_response_t>(&response->response);
         guarantee(res != NULL);
@@ -277,6 +277,8 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
     void operator()(const changefeed_limit_subscribe_t &s) {
         ql::env_t env(ctx, ql::return_empty_normal_batches_t::NO,
                       interruptor, s.optargs, trace);
+        // We read past the limit to fill the `limit_manager_t`'s buffer.
+        size_t n = s.spec.limit + ql::changefeed::limit_buffer_size(s.spec.limit);
         ql::stream_t stream;
         {
             std::vector<scoped_ptr_t<ql::op_t> > ops;
@@ -290,7 +292,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             if (s.spec.range.sindex) {
                 rget.terminal = ql::limit_read_t{
                     is_primary_t::NO,
-                    s.spec.limit,
+                    n,
                     s.spec.range.sorting,
                     &ops};
                 rget.sindex = sindex_rangespec_t(
@@ -300,7 +302,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             } else {
                 rget.terminal = ql::limit_read_t{
                     is_primary_t::YES,
-                    s.spec.limit,
+                    n,
                     s.spec.range.sorting,
                     &ops};
             }
@@ -323,7 +325,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             std::move(stream),
             s.spec.range.sindex ? is_primary_t::NO : is_primary_t::YES,
             s.spec.range.sorting,
-            s.spec.limit);
+            n);
 
         guarantee(store->changefeed_server.has());
         store->changefeed_server->add_limit_client(
@@ -343,10 +345,17 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
 
     boost::optional<changefeed_stamp_response_t> do_stamp(const changefeed_stamp_t &s) {
         guarantee(store->changefeed_server.has());
-        if (boost::optional<uint64_t> stamp
-            = store->changefeed_server->get_stamp(s.addr)) {
-            changefeed_stamp_response_t out;
-            out.stamps[store->changefeed_server->get_uuid()] = *stamp;
+        const uuid_u server_uuid = store->changefeed_server->get_uuid();
+        changefeed_stamp_response_t out;
+        boost::optional<uint64_t> stamp;
+        if (s.read_log) {
+            stamp = store->changefeed_server->get_stamp(
+                s.addr, s.resume_from, &out.logs[server_uuid], interruptor);
+        } else {
+            stamp = store->changefeed_server->get_stamp(s.addr);
+        }
+        if (stamp) {
+            out.stamps[server_uuid] = *stamp;
             return out;
         } else {
             return boost::none;
@@ -390,6 +399,13 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         rdb_get(get.key, btree, superblock, res, trace);
     }
 
+    void operator()(const multi_point_read_t &get) {
+        response->response = multi_point_read_response_t();
+        multi_point_read_response_t *res =
+            boost::get<multi_point_read_response_t>(&response->response);
+        rdb_multi_get(get.keys, btree, superblock, res, trace);
+    }
+
     void operator()(const intersecting_geo_read_t &geo_read) {
         ql::env_t ql_env(ctx, ql::return_empty_normal_batches_t::NO,
                          interruptor, geo_read.optargs, trace);
@@ -83,6 +83,8 @@ public:
         const std::map<std::string, std::string> &name_changes) = 0;
 };
 
+class write_ahead_log_t;
+
 class store_t final : public store_view_t {
 public:
     using home_thread_mixin_t::assert_thread;
@@ -97,11 +99,21 @@ public:
             io_backender_t *io_backender,
             const base_path_t &base_path,
             scoped_ptr_t<outdated_index_report_t> &&_index_report,
-            namespace_id_t table_id);
+            namespace_id_t table_id,
+            /* If not empty, the changefeed change log is kept at `change_log_path`,
+            so that feeds can be resumed after a restart. */
+            const std::string &change_log_path = std::string());
     ~store_t();
 
     void note_reshard();
 
+    /* Puts the write-ahead log at `path` in front of the B-tree. The writes that are in
+    the log from before a crash are replayed first. From then on every call to `write()`
+    is logged, writes with hard durability are acknowledged once they are durable in the
+    log, and the B-tree is flushed lazily. */
+    void open_write_ahead_log(const std::string &path, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
+
     /* store_view_t interface */
 
     void new_read_token(read_token_t *token_out);
@@ -153,6 +165,11 @@ public:
             backfill_item_consumer_t *item_consumer,
             signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t);
+    void compute_backfill_digests(
+            const std::vector<key_range_t> &ranges,
+            std::vector<backfill_digest_t> *digests_out,
+            signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
     continue_bool_t receive_backfill(
             const region_t &region,
             backfill_item_producer_t *item_producer,
@@ -162,6 +179,8 @@ public:
     void wait_until_ok_to_receive_backfill(signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t);
 
+    double get_foreground_latency_ms();
+
     void reset_data(
             const binary_blob_t &zero_version,
             const region_t &subregion,
@@ -347,6 +366,17 @@ private:
 
     void help_construct_bring_sindexes_up_to_date();
 
+    // Updates `foreground_latency_ms` after a read or write that started at
+    // `start_time`.
+    void record_foreground_latency(microtime_t start_time);
+
+    // Helper functions for the write-ahead log. See `open_write_ahead_log()`.
+    void replay_write_ahead_log_record(const std::vector<char> &data);
+    void flush_btree(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t);
+    void checkpoint_write_ahead_log(signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t);
+    void checkpoint_write_ahead_log_in_background(auto_drainer_t::lock_t keepalive);
+
     MUST_USE bool mark_secondary_index_deleted(
             buf_lock_t *sindex_block,
             const sindex_name_t &name);
@@ -355,7 +385,7 @@ public:
     namespace_id_t const &get_table_id() const;
 
     typedef std::map<
-        uuid_u, std::pair<microtime_t, parallel_traversal_progress_t const *>
+        uuid_u, std::pair<microtime_t, traversal_progress_t const *>
     > sindex_context_map_t;
     sindex_context_map_t *get_sindex_context_map();
 
@@ -400,6 +430,26 @@ private:
     // the superblock, if any).
     new_semaphore_t write_superblock_acq_semaphore;
 
+    // A moving average of the latency of `read()` and `write()`, and the time when it
+    // was last updated. See `get_foreground_latency_ms()`.
+    double foreground_latency_ms;
+    microtime_t foreground_latency_updated;
+
+    // Only set if `open_write_ahead_log()` was called. Every checkpoint of the log
+    // holds `write_ahead_log_checkpoint_mutex`, and
+    // `write_ahead_log_checkpoint_pending` is set while one is going to run in the
+    // background.
+    scoped_ptr_t<write_ahead_log_t> write_ahead_log;
+    new_mutex_t write_ahead_log_checkpoint_mutex;
+    bool write_ahead_log_checkpoint_pending;
+
+    // `receive_backfill()` counts the times it applies metainfo to the superblock in
+    // `backfill_metainfo_updates`. Writes that were logged on top of those updates can
+    // only be acknowledged once the first `backfill_metainfo_updates_flushed` of them
+    // are on disk, because backfills don't go through the write-ahead log.
+    uint64_t backfill_metainfo_updates;
+    uint64_t backfill_metainfo_updates_flushed;
+
 public:
     // This lock is used to pause backfills while secondary indexes are being
     // post constructed. Secondary index post construction gets in line for a write
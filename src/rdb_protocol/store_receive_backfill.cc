@@ -1,8 +1,12 @@
 #include "rdb_protocol/store.hpp"
 
 #include "btree/backfill.hpp"
+#include "btree/bulk_load.hpp"
 #include "btree/reql_specific.hpp"
+#include "buffer_cache/serialize_onto_blob.hpp"
 #include "rdb_protocol/btree.hpp"
+#include "rdb_protocol/lazy_json.hpp"
+#include "rdb_protocol/serialize_datum_onto_blob.hpp"
 
 /* `MAX_CONCURRENT_BACKFILL_ITEMS` is the maximum number of coroutines we'll spawn in
 parallel to apply backfill items to the B-tree. */
@@ -19,6 +23,15 @@ flushing our changes out to disk. This prevents the backfill from using too much
 cache's unsaved data limit, which would slow down queries on other shards. */
 static const int MAX_UNSAVED_CHANGES = 1000;
 
+/* `MAX_BULK_CHANGES_PER_TXN` is roughly the maximum number of keys we'll collect from
+the backfill items before we hand them to `apply_bulk_items()`. It can be exceeded by the
+size of a single backfill item. */
+static const int MAX_BULK_CHANGES_PER_TXN = 250;
+
+/* `BULK_LOAD_FILL_FACTOR` is how full `apply_bulk_items()` makes the leaf nodes. We leave
+some room because the replica goes on to receive writes in random key order. */
+static const double BULK_LOAD_FILL_FACTOR = 0.9;
+
 void flush_cache(cache_conn_t *cache, UNUSED signal_t *interruptor) {
     scoped_ptr_t<txn_t> txn;
     scoped_ptr_t<real_superblock_t> superblock;
@@ -178,6 +191,26 @@ void apply_empty_range(
     }
 }
 
+/* `load_omitted_values()` fills in the values of `item` from our B-tree if the
+backfiller omitted them because our digest for the item's range matched (see
+`backfill_digest_t`). This is safe because nothing writes to the part of the region that
+we haven't received items for, so the range still has the pairs that the digest was
+computed from; and the other items that are being applied at the same time don't overlap
+`item`. Afterwards the item is applied as usual. */
+void load_omitted_values(
+        const receive_backfill_tokens_t &tokens,
+        backfill_item_t *item) {
+    if (!item->values_omitted) {
+        return;
+    }
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_backfilling(tokens.info->cache_conn,
+        tokens.info->slice->get_backfill_account(), &superblock, &txn);
+    btree_load_omitted_backfill_values(superblock.get(), release_superblock_t::RELEASE,
+        &rdb_copy_backfill_value, item, tokens.keepalive.get_drain_signal());
+}
+
 /* `apply_item_pair()` is a helper function for `apply_single_key_item()` and
 `apply_multi_key_item()`. It applies a single `backfill_item_t::pair_t` to the B-tree.
 It doesn't call `on_commit()` or modify the metainfo. */
@@ -221,6 +254,8 @@ void apply_single_key_item(
         backfill_item_t &item   // NOLINT runtime/references
         ) {
     try {
+        load_omitted_values(tokens, &item);
+
         /* Acquire the superblock */
         scoped_ptr_t<txn_t> txn;
         scoped_ptr_t<real_superblock_t> superblock;
@@ -275,6 +310,10 @@ void apply_multi_key_item(
         backfill_item_t &item   // NOLINT runtime/references
         ) {
     try {
+        /* We load the values before we wait for our turn, so that it can overlap with
+        the items ahead of us. */
+        load_omitted_values(tokens, &item);
+
         /* Acquire and hold both `fifo_enforcer_sink_t`s until we're completely finished;
         since we're going to be making multiple B-tree queries in separate B-tree
         transactions, we can't pipeline with other backfill items */
@@ -372,6 +411,154 @@ void apply_multi_key_item(
     }
 }
 
+/* `bulk_item_source_t` passes the key-value pairs from a batch of backfill items to
+`btree_bulk_load()`, and records a modification report for each of them so that the
+secondary indexes can be updated. */
+class bulk_item_source_t : public btree_bulk_load_source_t {
+public:
+    bulk_item_source_t(
+            std::vector<backfill_item_t> *_items,
+            max_block_size_t _block_size,
+            std::vector<rdb_modification_report_t> *_mod_reports) :
+        items(_items), block_size(_block_size), mod_reports(_mod_reports),
+        item_index(0), pair_index(0), current(nullptr) { }
+
+    bool next_pair(store_key_t *key_out, repli_timestamp_t *recency_out) {
+        while (item_index < items->size()) {
+            std::vector<backfill_item_t::pair_t> *pairs = &(*items)[item_index].pairs;
+            if (pair_index == pairs->size()) {
+                ++item_index;
+                pair_index = 0;
+                continue;
+            }
+            current = &(*pairs)[pair_index];
+            ++pair_index;
+            /* Deletions are skipped, because there's nothing in the B-tree for them
+            to delete. */
+            if (static_cast<bool>(current->value)) {
+                *key_out = current->key;
+                *recency_out = current->recency;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void write_value(buf_parent_t leaf, void *value_out) {
+        vector_read_stream_t read_stream(std::move(*current->value));
+        ql::datum_t datum;
+        archive_result_t res = datum_deserialize(&read_stream, &datum);
+        guarantee(res == archive_result_t::SUCCESS);
+
+        rdb_value_t *value = static_cast<rdb_value_t *>(value_out);
+        memset(value, 0, blob::btree_maxreflen);
+        {
+            blob_t blob(block_size, value->value_ref(), blob::btree_maxreflen);
+            ql::serialization_result_t ser_res
+                = datum_serialize_onto_blob(leaf, &blob, datum);
+            guarantee(!bad(ser_res));
+        }
+
+        mod_reports->push_back(rdb_modification_report_t(current->key));
+        mod_reports->back().info.added = std::make_pair(datum, std::vector<char>(
+            value->value_ref(), value->value_ref() + value->inline_size(block_size)));
+    }
+
+private:
+    std::vector<backfill_item_t> *items;
+    max_block_size_t block_size;
+    std::vector<rdb_modification_report_t> *mod_reports;
+    size_t item_index, pair_index;
+    backfill_item_t::pair_t *current;
+};
+
+/* `apply_bulk_items()` is used instead of the other `apply_*()` functions when the
+B-tree has no entries in the range being backfilled, which is always the case when we're
+backfilling a brand-new replica. Then rather than inserting the keys one at a time, we
+apply a whole batch of items with `btree_bulk_load()`, which fills leaf nodes directly.
+There's nothing to erase first, and deletions are no-ops, just like they are in
+`apply_item_pair()` for keys that aren't present. */
+void apply_bulk_items(
+        const receive_backfill_tokens_t &tokens,
+        const key_range_t &range,
+        /* `items` is conceptually passed by move, but `std::bind()` isn't smart enough
+        to handle that. */
+        std::vector<backfill_item_t> &items   // NOLINT runtime/references
+        ) {
+    try {
+        for (backfill_item_t &item : items) {
+            load_omitted_values(tokens, &item);
+        }
+
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        buf_lock_t sindex_block;
+        std::vector<rdb_modification_report_t> mod_reports;
+        {
+            fifo_enforcer_sink_t::exit_write_t exiter(
+                &tokens.info->btree_fifo_sink, tokens.write_token);
+            wait_interruptible(&exiter, tokens.keepalive.get_drain_signal());
+
+            size_t num_pairs = 0;
+            repli_timestamp_t min_deletion_timestamp = repli_timestamp_t::distant_past;
+            for (const backfill_item_t &item : items) {
+                num_pairs += item.pairs.size();
+                min_deletion_timestamp = superceding_recency(
+                    min_deletion_timestamp, item.min_deletion_timestamp);
+            }
+
+            /* As in `apply_single_key_item()`, we only acquire `limiter` while we hold
+            `btree_fifo_sink`, to prevent deadlocks. */
+            tokens.info->limiter->prepare_for_changes(
+                std::min<size_t>(num_pairs, MAX_UNSAVED_CHANGES),
+                tokens.keepalive.get_drain_signal());
+
+            get_btree_superblock_and_txn_for_writing(tokens.info->cache_conn, nullptr,
+                write_access_t::write, 1, write_durability_t::SOFT, &superblock, &txn);
+            sindex_block = buf_lock_t(superblock->expose_buf(),
+                superblock->get_sindex_block_id(), access_t::write);
+
+            rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+            rdb_live_deletion_context_t deletion_context;
+            bulk_item_source_t source(
+                &items, superblock->cache()->max_block_size(), &mod_reports);
+            size_t num_inserted = btree_bulk_load(superblock.get(), &sizer,
+                deletion_context.balancing_detacher(), BULK_LOAD_FILL_FACTOR,
+                min_deletion_timestamp, &source);
+            tokens.info->slice->stats.pm_keys_set.record(num_inserted);
+            tokens.info->slice->stats.pm_total_keys_set += num_inserted;
+
+            if (num_inserted == 0
+                    && min_deletion_timestamp != repli_timestamp_t::distant_past) {
+                /* `btree_bulk_load()` only applies the min deletion timestamp to the
+                leaf nodes that it fills. If it didn't fill any, then the range belongs
+                to the leaf nodes that were already there. */
+                backfill_item_t range_item;
+                range_item.range = range;
+                range_item.min_deletion_timestamp = min_deletion_timestamp;
+                btree_receive_backfill_item_update_deletion_timestamps(
+                    superblock.get(), release_superblock_t::KEEP, &sizer, range_item,
+                    tokens.keepalive.get_drain_signal());
+            }
+
+            tokens.update_metainfo_cb(range.right, superblock.get());
+            superblock->release();
+        }
+
+        /* Notify that we're done and update the sindexes */
+        fifo_enforcer_sink_t::exit_write_t exiter(
+            &tokens.info->commit_fifo_sink, tokens.write_token);
+        /* Note: This must not be interruptible, or we might miss updating secondary
+        indexes. */
+        exiter.wait_lazily_unordered();
+        tokens.commit_cb(range.right, std::move(txn), std::move(sindex_block),
+            std::move(mod_reports));
+
+    } catch (const interrupted_exc_t &exc) {
+        /* The call to `receive_backfill()` was interrupted. Ignore. */
+    }
+}
+
 continue_bool_t store_t::receive_backfill(
         const region_t &region,
         backfill_item_producer_t *item_producer,
@@ -379,6 +566,11 @@ continue_bool_t store_t::receive_backfill(
         THROWS_ONLY(interrupted_exc_t) {
     guarantee(region.beg == get_region().beg && region.end == get_region().end);
 
+    /* Changefeeds aren't told about the changes a backfill makes. */
+    if (changefeed_server.has()) {
+        changefeed_server->note_unlogged_changes();
+    }
+
     unsaved_data_limiter_t unsaved_data_limiter(general_cache_conn.get());
     receive_backfill_info_t info(
         general_cache_conn.get(), btree.get(), &unsaved_data_limiter);
@@ -395,36 +587,14 @@ continue_bool_t store_t::receive_backfill(
     /* We'll set `result` to `false` to record if `item_producer` returns `ABORT`. */
     continue_bool_t result = continue_bool_t::CONTINUE;
 
-    /* Repeatedly request items from `item_producer` and spawn coroutines to handle them,
-    but limit the number of simultaneously active coroutines. */
-    while (spawn_threshold != region.inner.right) {
-        bool is_item;
-        backfill_item_t item;
-        key_range_t::right_bound_t empty_range;
-        if (continue_bool_t::ABORT ==
-                item_producer->next_item(&is_item, &item, &empty_range)) {
-            /* By breaking out of the loop instead of returning immediately, we ensure
-            that we commit every item that we got from the item producer, as we are
-            required to. */
-            result = continue_bool_t::ABORT;
-            break;
-        }
-
-        receive_backfill_tokens_t tokens(&info, interruptor);
-
-        if (is_item) {
-            rassert(key_range_t::right_bound_t(item.get_range().left)
-                >= spawn_threshold);
-            spawn_threshold = item.get_range().right;
-        } else {
-            rassert(empty_range >= spawn_threshold);
-            spawn_threshold = empty_range;
-        }
-
-        /* The `apply_*()` functions will call back to `update_metainfo_cb` when they
-        want to apply the metainfo to the superblock. They may make multiple calls, but
-        the last call will have `progress` equal to `item.get_range().right`. */
-        tokens.update_metainfo_cb = [this, &region, &metainfo_threshold, &item_producer,
+    /* The `apply_*()` functions will call back to `update_metainfo_cb` when they want to
+    apply the metainfo to the superblock, and to `commit_cb` when they're done applying
+    the changes for a given sub-region. They may make multiple calls to each, but the last
+    calls will have `progress` equal to the right-hand side of what they were given. */
+    auto set_callbacks = [this, &region, item_producer, &spawn_threshold,
+            &metainfo_threshold, &commit_threshold](
+            receive_backfill_tokens_t *tokens) {
+        tokens->update_metainfo_cb = [this, &region, &metainfo_threshold, item_producer,
                     &spawn_threshold](
                 const key_range_t::right_bound_t &progress,
                 real_superblock_t *superblock) {
@@ -442,12 +612,10 @@ continue_bool_t store_t::receive_backfill(
 
             /* Actually apply the metainfo */
             metainfo->update(superblock, item_producer->get_metainfo()->mask(mask));
+            ++backfill_metainfo_updates;
         };
 
-        /* The `apply_*()` functions will call back to `commit_cb` when they're done
-        applying the changes for a given sub-region. They may make multiple calls, but
-        the last call will have `progress` equal to `item.get_range().right`. */
-        tokens.commit_cb = [this, item_producer, &commit_threshold, &metainfo_threshold](
+        tokens->commit_cb = [this, item_producer, &commit_threshold, &metainfo_threshold](
                 const key_range_t::right_bound_t &progress,
                 scoped_ptr_t<txn_t> &&txn,
                 buf_lock_t &&sindex_block,
@@ -471,6 +639,86 @@ continue_bool_t store_t::receive_backfill(
             commit_threshold = progress;
             item_producer->on_commit(progress);
         };
+    };
+
+    /* If the B-tree has nothing in `region`, which is always the case for a brand-new
+    replica, then we collect the items into batches and apply them with
+    `apply_bulk_items()` instead of spawning a coroutine for each item. Nothing else can
+    write to `region` while we're receiving the backfill, so the part of `region` that
+    we haven't applied yet stays empty until we return. */
+    bool bulk_mode;
+    {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn_for_reading(general_cache_conn.get(),
+            CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+        rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+        bulk_mode = btree_range_is_empty(superblock.get(), &sizer, region.inner);
+    }
+
+    /* `bulk_items` is the batch of items that we've collected in bulk mode, which
+    extends from `bulk_threshold` to `spawn_threshold`. */
+    std::vector<backfill_item_t> bulk_items;
+    size_t bulk_items_pairs = 0;
+    key_range_t::right_bound_t bulk_threshold(region.inner.left);
+    auto spawn_bulk_items = [&]() {
+        receive_backfill_tokens_t tokens(&info, interruptor);
+        set_callbacks(&tokens);
+        key_range_t range;
+        range.left = bulk_threshold.key();
+        range.right = spawn_threshold;
+        coro_t::spawn_sometime(std::bind(
+            &apply_bulk_items, std::move(tokens), range, std::move(bulk_items)));
+        bulk_items.clear();
+        bulk_items_pairs = 0;
+        bulk_threshold = spawn_threshold;
+    };
+
+    /* Repeatedly request items from `item_producer` and spawn coroutines to handle them,
+    but limit the number of simultaneously active coroutines. */
+    while (spawn_threshold != region.inner.right) {
+        bool is_item;
+        backfill_item_t item;
+        key_range_t::right_bound_t empty_range;
+        if (continue_bool_t::ABORT ==
+                item_producer->next_item(&is_item, &item, &empty_range)) {
+            /* By breaking out of the loop instead of returning immediately, we ensure
+            that we commit every item that we got from the item producer, as we are
+            required to. */
+            result = continue_bool_t::ABORT;
+            break;
+        }
+
+        if (bulk_mode) {
+            if (is_item) {
+                rassert(key_range_t::right_bound_t(item.get_range().left)
+                    >= spawn_threshold);
+                spawn_threshold = item.get_range().right;
+                bulk_items_pairs += item.pairs.size();
+                bulk_items.push_back(std::move(item));
+            } else {
+                rassert(empty_range >= spawn_threshold);
+                spawn_threshold = empty_range;
+            }
+            if (bulk_items_pairs >= static_cast<size_t>(MAX_BULK_CHANGES_PER_TXN)
+                    || spawn_threshold == region.inner.right) {
+                spawn_bulk_items();
+            }
+            continue;
+        }
+
+        receive_backfill_tokens_t tokens(&info, interruptor);
+
+        if (is_item) {
+            rassert(key_range_t::right_bound_t(item.get_range().left)
+                >= spawn_threshold);
+            spawn_threshold = item.get_range().right;
+        } else {
+            rassert(empty_range >= spawn_threshold);
+            spawn_threshold = empty_range;
+        }
+
+        set_callbacks(&tokens);
 
         if (!is_item) {
             coro_t::spawn_sometime(std::bind(
@@ -484,6 +732,12 @@ continue_bool_t store_t::receive_backfill(
         }
     }
 
+    /* If `item_producer` ran out of items in the middle of a batch, we still have to
+    apply the part of the batch that we got. */
+    if (bulk_mode && bulk_threshold != spawn_threshold) {
+        spawn_bulk_items();
+    }
+
     /* Wait for any running coroutines to finish. We construct an `exit_write_t` instead
     of just destroying `info.drainer` because we don't want to interrupt the coroutines
     unless `interruptor` is pulsed. */
@@ -501,8 +755,12 @@ continue_bool_t store_t::receive_backfill(
     correctness; it's potentially dangerous to report that we finished the backfill when
     there is data that's not yet safely on disk. The other is to make sure that we don't
     use increasingly large amounts of the unsaved data limit if `receive_backfill()` is
-    called repeatedly. */
+    called repeatedly. Afterwards, writes in the write-ahead log that depend on the
+    backfilled data don't have to flush it themselves (see `store_t::write()`). */
+    uint64_t backfill_metainfo_updates_before = backfill_metainfo_updates;
     flush_cache(general_cache_conn.get(), interruptor);
+    backfill_metainfo_updates_flushed = std::max(
+        backfill_metainfo_updates_flushed, backfill_metainfo_updates_before);
 
     return result;
 }
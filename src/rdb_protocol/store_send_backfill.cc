@@ -3,7 +3,6 @@
 #include "btree/backfill.hpp"
 #include "btree/reql_specific.hpp"
 #include "btree/operations.hpp"
-#include "rdb_protocol/blob_wrapper.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/lazy_json.hpp"
 
@@ -176,26 +175,9 @@ public:
     void copy_value(
             buf_parent_t parent,
             const void *value_in_leaf_node,
-            UNUSED signal_t *interruptor2,
+            signal_t *interruptor2,
             std::vector<char> *value_out) {
-        const rdb_value_t *v =
-            static_cast<const rdb_value_t *>(value_in_leaf_node);
-        rdb_blob_wrapper_t blob_wrapper(
-            parent.cache()->max_block_size(),
-            const_cast<rdb_value_t *>(v)->value_ref(),
-            blob::btree_maxreflen);
-        blob_acq_t acq_group;
-        buffer_group_t buffer_group;
-        blob_wrapper.expose_all(
-            parent, access_t::read, &buffer_group, &acq_group);
-        value_out->resize(buffer_group.get_size());
-        size_t offset = 0;
-        for (size_t i = 0; i < buffer_group.num_buffers(); ++i) {
-            buffer_group_t::buffer_t b = buffer_group.get_buffer(i);
-            memcpy(value_out->data() + offset, b.data, b.size);
-            offset += b.size;
-        }
-        guarantee(offset == value_out->size());
+        rdb_copy_backfill_value(parent, value_in_leaf_node, interruptor2, value_out);
     }
     bool inner_aborted;
     size_t remaining;
@@ -267,3 +249,20 @@ continue_bool_t store_t::send_backfill(
     return continue_bool_t::CONTINUE;
 }
 
+
+void store_t::compute_backfill_digests(
+        const std::vector<key_range_t> &ranges,
+        std::vector<backfill_digest_t> *digests_out,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    if (ranges.empty()) {
+        return;
+    }
+    /* The superblock is snapshotted, so it's OK to keep it for all of the ranges. */
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> sb;
+    get_btree_superblock_and_txn_for_backfilling(
+        general_cache_conn.get(), btree->get_backfill_account(), &sb, &txn);
+    btree_compute_backfill_digests(sb.get(), release_superblock_t::RELEASE, ranges,
+        &rdb_copy_backfill_value, digests_out, interruptor);
+}
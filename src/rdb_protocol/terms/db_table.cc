@@ -742,6 +742,24 @@ private:
         counted_t<table_t> table = args->arg(env, 0)->as_table();
         scoped_ptr_t<val_t> index = args->optarg(env, "index");
         std::string index_str = index ? index->as_str().to_std() : table->get_pkey();
+        if (index_str == table->get_pkey() && args->num_args() > 2) {
+            // Look up all of the primary keys with a single multi-key read.  The
+            // `get_all` streams are only there for changefeeds, and they don't
+            // read anything unless they're read from.
+            std::vector<datum_t> keys;
+            std::vector<counted_t<datum_stream_t> > key_streams;
+            keys.reserve(args->num_args() - 1);
+            key_streams.reserve(args->num_args() - 1);
+            for (size_t i = 1; i < args->num_args(); ++i) {
+                keys.push_back(get_key_arg(args->arg(env, i)));
+                key_streams.push_back(
+                    table->get_all(env->env, keys.back(), index_str, backtrace()));
+            }
+            counted_t<datum_stream_t> stream =
+                make_counted<multi_get_datum_stream_t>(
+                    table, std::move(keys), std::move(key_streams), backtrace());
+            return new_val(make_counted<selection_t>(table, stream));
+        }
         std::vector<counted_t<datum_stream_t> > streams;
         for (size_t i = 1; i < args->num_args(); ++i) {
             datum_t key = get_key_arg(args->arg(env, i));
@@ -1,13 +1,20 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include "rdb_protocol/terms/terms.hpp"
 
+#include <iterator>
 #include <string>
+#include <vector>
 
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
 #include "rdb_protocol/error.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/op.hpp"
 #include "rdb_protocol/pb_utils.hpp"
+#include "rdb_protocol/term.hpp"
 #include "rdb_protocol/term_walker.hpp"
+#include "rdb_protocol/var_types.hpp"
 
 namespace ql {
 
@@ -31,6 +38,13 @@ public:
         real = compile_term(env, out);
     }
 
+protected:
+    const counted_t<const term_t> &get_real() const { return real; }
+
+    virtual scoped_ptr_t<val_t> term_eval(scope_env_t *env, eval_flags_t) const {
+        return real->eval(env);
+    }
+
 private:
     virtual void accumulate_captures(var_captures_t *captures) const {
         return real->accumulate_captures(captures);
@@ -39,20 +53,97 @@ private:
         return real->is_deterministic();
     }
 
-    virtual scoped_ptr_t<val_t> term_eval(scope_env_t *env, eval_flags_t) const {
-        return real->eval(env);
-    }
-
     protob_t<const Term> in;
     protob_t<Term> out;
 
     counted_t<const term_t> real;
 };
 
+// Returns the field name if `t` is `VAR(var)(field)` or `VAR(var).get_field(field)`
+// for a literal string `field`.
+boost::optional<datum_string_t> var_field_access(const Term &t, double var) {
+    if ((t.type() != Term::BRACKET && t.type() != Term::GET_FIELD)
+        || t.args_size() != 2 || t.optargs_size() != 0) {
+        return boost::none;
+    }
+    const Term &v = t.args(0);
+    if (v.type() != Term::VAR || v.args_size() != 1
+        || v.args(0).type() != Term::DATUM
+        || v.args(0).datum().type() != Datum::R_NUM
+        || v.args(0).datum().r_num() != var) {
+        return boost::none;
+    }
+    const Term &field = t.args(1);
+    if (field.type() != Term::DATUM || field.datum().type() != Datum::R_STR) {
+        return boost::none;
+    }
+    return datum_string_t(field.datum().r_str());
+}
+
+// Recognizes `function(l, r) { return l(a).eq(r(b)); }` (in either operand
+// order) and returns the fields `a` and `b`.
+bool parse_field_equality_func(const Term &func,
+                               datum_string_t *left_field_out,
+                               datum_string_t *right_field_out) {
+    if (func.type() != Term::FUNC || func.args_size() != 2) {
+        return false;
+    }
+    std::vector<double> vars;
+    const Term &params = func.args(0);
+    if (params.type() == Term::MAKE_ARRAY) {
+        for (int i = 0; i < params.args_size(); ++i) {
+            if (params.args(i).type() != Term::DATUM
+                || params.args(i).datum().type() != Datum::R_NUM) {
+                return false;
+            }
+            vars.push_back(params.args(i).datum().r_num());
+        }
+    } else if (params.type() == Term::DATUM
+               && params.datum().type() == Datum::R_ARRAY) {
+        for (int i = 0; i < params.datum().r_array_size(); ++i) {
+            if (params.datum().r_array(i).type() != Datum::R_NUM) {
+                return false;
+            }
+            vars.push_back(params.datum().r_array(i).r_num());
+        }
+    }
+    if (vars.size() != 2 || vars[0] == vars[1]) {
+        return false;
+    }
+
+    const Term &body = func.args(1);
+    if (body.type() != Term::EQ || body.args_size() != 2 || body.optargs_size() != 0) {
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        boost::optional<datum_string_t> l = var_field_access(body.args(i), vars[0]);
+        boost::optional<datum_string_t> r = var_field_access(body.args(1 - i), vars[1]);
+        if (l && r) {
+            *left_field_out = *l;
+            *right_field_out = *r;
+            return true;
+        }
+    }
+    return false;
+}
+
+// `inner_join` is rewritten into a nested loop, which is O(N*M).  When the
+// predicate just compares a field of each side for equality we instead read the
+// right input into a lookup table and stream the left one past it.  If the right
+// input doesn't fit within the array size limit we run the nested loop by hand.
 class inner_join_term_t : public rewrite_term_t {
 public:
     inner_join_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
+        : rewrite_term_t(env, term, argspec_t(3), rewrite) {
+        if (parse_field_equality_func(term->args(2), &left_field, &right_field)
+            && find_inputs(get_real(), &left, &right)
+            && (!left->is_deterministic() || !right->is_deterministic())) {
+            // The inputs may get evaluated again by the fallback rewrite, and
+            // the nested loop evaluates the right input once per left row.
+            left.reset();
+            right.reset();
+        }
+    }
 
     static r::reql_t rewrite(protob_t<const Term> in,
                              protob_t<const Term> optargs_in) {
@@ -78,6 +169,149 @@ public:
     }
 
     virtual const char *name() const { return "inner_join"; }
+
+private:
+    // Finds the inputs in the compiled rewrite, which is
+    // `left.concat_map(func(n, right.concat_map(...)))`, so that we don't
+    // compile them a second time.
+    static bool find_inputs(const counted_t<const term_t> &real,
+                            counted_t<const term_t> *left_out,
+                            counted_t<const term_t> *right_out) {
+        const op_term_t *outer = dynamic_cast<const op_term_t *>(real.get());
+        if (outer == nullptr || outer->get_original_args().size() != 2) {
+            return false;
+        }
+        const func_term_t *func = dynamic_cast<const func_term_t *>(
+            outer->get_original_args()[1].get());
+        if (func == nullptr) {
+            return false;
+        }
+        const op_term_t *inner = dynamic_cast<const op_term_t *>(
+            func->get_body().get());
+        if (inner == nullptr || inner->get_original_args().size() != 2) {
+            return false;
+        }
+        const counted_t<const term_t> &l = outer->get_original_args()[0];
+        const counted_t<const term_t> &r = inner->get_original_args()[0];
+        // `r.args` inputs are only expanded when the rewrite is evaluated.
+        if (l->get_src()->type() == Term::ARGS || r->get_src()->type() == Term::ARGS) {
+            return false;
+        }
+        // The right input was compiled inside the function, where `r.row` would
+        // refer to the function's argument.
+        var_captures_t captures;
+        r->accumulate_captures(&captures);
+        if (captures.implicit_is_captured) {
+            return false;
+        }
+        *left_out = l;
+        *right_out = r;
+        return true;
+    }
+
+    static bool can_hash_join(const counted_t<datum_stream_t> &stream) {
+        return !stream->is_grouped()
+            && stream->cfeed_type() == feed_type_t::not_feed;
+    }
+
+    virtual scoped_ptr_t<val_t> term_eval(scope_env_t *env,
+                                          eval_flags_t eval_flags) const {
+        if (!left.has()) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+        scoped_ptr_t<val_t> left_val = left->eval(env);
+        if (!left_val->get_type().is_convertible(val_t::type_t::SEQUENCE)) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+        counted_t<datum_stream_t> left_stream = left_val->as_seq(env->env);
+        if (!can_hash_join(left_stream)) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+
+        // Like the nested loop, we don't evaluate the right input at all if the
+        // left one is empty.
+        batchspec_t batchspec = batchspec_t::default_for(batch_type_t::NORMAL);
+        std::vector<datum_t> left_rows;
+        while (left_rows.empty() && !left_stream->is_exhausted()) {
+            left_rows = left_stream->next_batch(env->env, batchspec);
+        }
+        if (left_rows.empty()) {
+            counted_t<datum_stream_t> join = make_counted<hash_join_datum_stream_t>(
+                left_stream,
+                std::move(left_rows),
+                left_field,
+                hash_join_datum_stream_t::build_table_t(),
+                datum_t(),
+                right_field,
+                backtrace());
+            return new_val(env->env, join);
+        }
+
+        scoped_ptr_t<val_t> right_val = right->eval(env);
+        if (!right_val->get_type().is_convertible(val_t::type_t::SEQUENCE)) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+        counted_t<datum_stream_t> right_stream = right_val->as_seq(env->env);
+        if (!can_hash_join(right_stream) || right_stream->is_infinite()) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+
+        // The nested loop produces its results in the order of the left input,
+        // so the left input is always the one that gets streamed.  The right
+        // input is read into a lookup table unless it's too big, in which case
+        // we run the nested loop ourselves, starting with the rows we already
+        // read.
+        const size_t limit = env->env->limits().array_size_limit();
+        std::vector<datum_t> right_rows;
+        while (!right_stream->is_exhausted()) {
+            if (right_rows.size() > limit) {
+                counted_t<const term_t> right_term = right;
+                var_scope_t scope = env->scope;
+                auto eval_right = [right_term, scope](env_t *e) {
+                    scope_env_t scope_env(e, var_scope_t(scope));
+                    return right_term->eval(&scope_env)->as_seq(e);
+                };
+                counted_t<datum_stream_t> join =
+                    make_counted<nested_loop_join_datum_stream_t>(
+                        left_stream,
+                        std::move(left_rows),
+                        left_field,
+                        std::move(right_rows),
+                        right_stream,
+                        right_field,
+                        std::move(eval_right),
+                        backtrace());
+                return new_val(env->env, join);
+            }
+            std::vector<datum_t> batch = right_stream->next_batch(env->env, batchspec);
+            std::move(batch.begin(), batch.end(), std::back_inserter(right_rows));
+        }
+
+        hash_join_datum_stream_t::build_table_t build_table;
+        datum_t build_missing_field;
+        for (const datum_t &row : right_rows) {
+            datum_t key = row.get_field(right_field, NOTHROW);
+            if (key.has()) {
+                build_table[key].push_back(row);
+            } else if (!build_missing_field.has()) {
+                build_missing_field = row;
+            }
+        }
+
+        counted_t<datum_stream_t> join = make_counted<hash_join_datum_stream_t>(
+            left_stream,
+            std::move(left_rows),
+            left_field,
+            std::move(build_table),
+            std::move(build_missing_field),
+            right_field,
+            backtrace());
+        return new_val(env->env, join);
+    }
+
+    datum_string_t left_field, right_field;
+    // Only set if the predicate can be evaluated as a hash join.
+    counted_t<const term_t> left, right;
 };
 
 class outer_join_term_t : public rewrite_term_t {
@@ -118,10 +352,18 @@ public:
     virtual const char *name() const { return "outer_join"; }
 };
 
+// `eq_join` used to be evaluated purely as a rewrite into a `concat_map` that
+// issues one `get_all` per left row.  We now evaluate it with
+// `eq_join_datum_stream_t`, which batches those lookups, and only use the rewrite
+// when the left input is something that stream can't handle (grouped data or a
+// changefeed).
 class eq_join_term_t : public rewrite_term_t {
 public:
     eq_join_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : rewrite_term_t(env, term, argspec_t(3), rewrite) { }
+        : rewrite_term_t(env, term, argspec_t(3), rewrite),
+          concat_map(nullptr) {
+        find_inputs();
+    }
 private:
 
     static r::reql_t rewrite(protob_t<const Term> in,
@@ -147,7 +389,100 @@ private:
                                                r::optarg("right", v)))))));
 
     }
+
+    // Returns `t` as an `op_term_t` if it is one with `num_args` arguments.
+    static const op_term_t *as_op_term(const counted_t<const term_t> &t,
+                                       size_t num_args) {
+        const op_term_t *op = dynamic_cast<const op_term_t *>(t.get());
+        return op != nullptr && op->get_original_args().size() == num_args
+            ? op
+            : nullptr;
+    }
+
+    // Finds the inputs in the compiled rewrite, which is
+    // `left.concat_map(func(row, branch(..., ..., right.get_all(left_attr(row),
+    // index).default(...).map(...))))`, so that we don't compile them a second
+    // time.
+    void find_inputs() {
+        const op_term_t *outer = as_op_term(get_real(), 2);
+        if (outer == nullptr) {
+            return;
+        }
+        const func_term_t *func = dynamic_cast<const func_term_t *>(
+            outer->get_original_args()[1].get());
+        if (func == nullptr) {
+            return;
+        }
+        const op_term_t *branch = as_op_term(func->get_body(), 3);
+        const op_term_t *map = branch == nullptr
+            ? nullptr : as_op_term(branch->get_original_args()[2], 2);
+        const op_term_t *default_ = map == nullptr
+            ? nullptr : as_op_term(map->get_original_args()[0], 2);
+        const op_term_t *get_all = default_ == nullptr
+            ? nullptr : as_op_term(default_->get_original_args()[0], 2);
+        const op_term_t *funcall = get_all == nullptr
+            ? nullptr : as_op_term(get_all->get_original_args()[1], 2);
+        if (funcall == nullptr) {
+            return;
+        }
+        const counted_t<const term_t> &r = get_all->get_original_args()[0];
+        const counted_t<const term_t> &l_attr = funcall->get_original_args()[0];
+        auto index_it = get_all->get_optargs().find("index");
+        // These were compiled inside the function, where `r.row` would refer to
+        // the function's argument.
+        var_captures_t captures;
+        r->accumulate_captures(&captures);
+        l_attr->accumulate_captures(&captures);
+        if (index_it != get_all->get_optargs().end()) {
+            index_it->second->accumulate_captures(&captures);
+        }
+        if (captures.implicit_is_captured) {
+            return;
+        }
+        concat_map = outer;
+        left = outer->get_original_args()[0];
+        left_attr = l_attr;
+        right = r;
+        if (index_it != get_all->get_optargs().end()) {
+            index = index_it->second;
+        }
+    }
+
+    virtual scoped_ptr_t<val_t> term_eval(scope_env_t *env,
+                                          eval_flags_t eval_flags) const {
+        if (!left.has()) {
+            return rewrite_term_t::term_eval(env, eval_flags);
+        }
+        // If we can't use `eq_join_datum_stream_t`, we evaluate the rewrite with
+        // the left input we already have, rather than evaluating it again.
+        scoped_ptr_t<val_t> left_val = left->eval(env);
+        if (!left_val->get_type().is_convertible(val_t::type_t::SEQUENCE)) {
+            return concat_map->eval_with_arg0(env, std::move(left_val), eval_flags);
+        }
+        counted_t<datum_stream_t> left_stream = left_val->as_seq(env->env);
+        if (left_stream->is_grouped()
+            || left_stream->cfeed_type() != feed_type_t::not_feed) {
+            return concat_map->eval_with_arg0(
+                env, new_val(env->env, left_stream), eval_flags);
+        }
+
+        counted_t<const func_t> key_func =
+            left_attr->eval(env)->as_func(GET_FIELD_SHORTCUT);
+        counted_t<table_t> table = right->eval(env)->as_table();
+        std::string index_str = index.has()
+            ? index->eval(env)->as_str().to_std()
+            : table->get_pkey();
+        counted_t<datum_stream_t> join = make_counted<eq_join_datum_stream_t>(
+            left_stream, std::move(key_func), std::move(table), std::move(index_str));
+        return new_val(env->env, join);
+    }
+
     virtual const char *name() const { return "eq_join"; }
+
+    // Only set if the join can be evaluated with `eq_join_datum_stream_t`.  They
+    // point into the compiled rewrite; `concat_map` is its outermost term.
+    const op_term_t *concat_map;
+    counted_t<const term_t> left, left_attr, right, index;
 };
 
 class delete_term_t : public rewrite_term_t {
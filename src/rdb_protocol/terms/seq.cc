@@ -380,8 +380,31 @@ public:
     changes_term_t(compile_env_t *env, const protob_t<const Term> &term)
         : op_term_t(
             env, term, argspec_t(1),
-            optargspec_t({"squash", "include_initial_vals", "include_states"})) { }
+            optargspec_t({"squash", "include_initial_vals", "include_states",
+                          "include_resume_tokens", "resume_from"})) { }
 private:
+    static changefeed::log_position_t parse_resume_token(const scoped_ptr_t<val_t> &v) {
+        datum_t token = v->as_datum();
+        rcheck_target(v, token.get_type() == datum_t::R_OBJECT, base_exc_t::LOGIC,
+                      strprintf("Expected a resume token (an OBJECT) but found %s.",
+                                token.get_type_name().c_str()));
+        changefeed::log_position_t pos;
+        for (size_t i = 0; i < token.obj_size(); ++i) {
+            std::pair<datum_string_t, datum_t> pair = token.get_pair(i);
+            uuid_u server_uuid;
+            rcheck_target(v, str_to_uuid(pair.first.to_std(), &server_uuid)
+                             && pair.second.get_type() == datum_t::R_NUM,
+                          base_exc_t::LOGIC,
+                          "Invalid resume token (expected an OBJECT mapping UUIDs "
+                          "to NUMBERs, as returned with `include_resume_tokens`).");
+            int64_t seq = pair.second.as_int();
+            rcheck_target(v, seq >= 0, base_exc_t::LOGIC,
+                          "Invalid resume token (found a negative NUMBER).");
+            pos[server_uuid] = seq;
+        }
+        return pos;
+    }
+
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
 
@@ -404,12 +427,35 @@ private:
         scoped_ptr_t<val_t> include_initial_vals_val =
             args->optarg(env, "include_initial_vals");
 
+        // Resumable feeds return each change with its position in the change
+        // logs, so they can't squash changes together or interleave them with
+        // initial values.
+        changefeed::resume_spec_t resume;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "include_resume_tokens")) {
+            resume.include_resume_tokens = v->as_bool();
+        }
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "resume_from")) {
+            resume.resume_from = parse_resume_token(v);
+        }
+        const bool resumable = resume.include_resume_tokens || resume.resume_from;
+        const char *resumable_range_only =
+            "`include_resume_tokens` and `resume_from` are only supported on "
+            "changefeeds on a table or a range of a table.";
+        if (resumable) {
+            rcheck(squash == datum_t::boolean(false), base_exc_t::LOGIC,
+                   "`include_resume_tokens` and `resume_from` can't be used with "
+                   "`squash`.");
+        }
+
         scoped_ptr_t<val_t> v = args->arg(env, 0);
         if (v->get_type().is_convertible(val_t::type_t::SEQUENCE)) {
             counted_t<datum_stream_t> seq = v->as_seq(env->env);
             std::vector<counted_t<datum_stream_t> > streams;
             std::vector<changespec_t> changespecs = seq->get_changespecs();
             r_sanity_check(changespecs.size() >= 1);
+            if (resumable) {
+                rcheck(changespecs.size() == 1, base_exc_t::LOGIC, resumable_range_only);
+            }
             for (auto &&changespec : changespecs) {
                 bool include_initial_vals = include_initial_vals_val.has()
                     ? include_initial_vals_val->as_bool()
@@ -417,6 +463,14 @@ private:
                 if (include_initial_vals) {
                     r_sanity_check(changespec.stream.has());
                 }
+                if (resumable) {
+                    rcheck(boost::get<changefeed::keyspec_t::range_t>(
+                               &changespec.keyspec.spec) != nullptr,
+                           base_exc_t::LOGIC, resumable_range_only);
+                    rcheck(!include_initial_vals, base_exc_t::LOGIC,
+                           "`include_resume_tokens` and `resume_from` can't be used "
+                           "with `include_initial_vals`.");
+                }
                 boost::apply_visitor(rcheck_spec_visitor_t(env->env, backtrace()),
                                      changespec.keyspec.spec);
                 streams.push_back(
@@ -426,6 +480,7 @@ private:
                                              : counted_t<datum_stream_t>(),
                         squash,
                         include_states,
+                        resume,
                         std::move(changespec.keyspec.spec),
                         backtrace(),
                         changespec.keyspec.table_name));
@@ -442,6 +497,7 @@ private:
                         streams.size()));
             }
         } else if (v->get_type().is_convertible(val_t::type_t::SINGLE_SELECTION)) {
+            rcheck(!resumable, base_exc_t::LOGIC, resumable_range_only);
                 bool include_initial_vals = include_initial_vals_val.has()
                     ? include_initial_vals_val->as_bool()
                     : true;
@@ -44,6 +44,7 @@ public:
             maybe_src,
             squash,
             include_states,
+            changefeed::resume_spec_t(),
             changefeed::keyspec_t::point_t{key},
             bt,
             tbl->display_name());
@@ -102,6 +103,7 @@ public:
             maybe_src,
             squash,
             include_states,
+            changefeed::resume_spec_t(),
             std::move(spec),
             bt,
             slice->get_tbl()->display_name());
@@ -341,6 +343,11 @@ datum_t table_t::get_row(env_t *env, datum_t pval) {
     return tbl->read_row(env, pval, read_mode);
 }
 
+std::vector<datum_t> table_t::get_rows(env_t *env,
+                                       const std::vector<datum_t> &pvals) {
+    return tbl->read_rows(env, pvals, read_mode);
+}
+
 counted_t<datum_stream_t> table_t::get_all(
         env_t *env,
         datum_t value,
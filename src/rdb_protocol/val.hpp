@@ -37,6 +37,7 @@ public:
     ql::datum_t get_id() const;
     const std::string &get_pkey() const;
     datum_t get_row(env_t *env, datum_t pval);
+    std::vector<datum_t> get_rows(env_t *env, const std::vector<datum_t> &pvals);
     counted_t<datum_stream_t> get_all(
             env_t *env,
             datum_t value,
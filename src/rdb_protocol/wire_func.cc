@@ -4,6 +4,7 @@
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/stl_types.hpp"
 #include "containers/archive/archive.hpp"
+#include "containers/archive/string_stream.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -91,6 +92,122 @@ void serialize(write_message_t *wm, const wire_func_t &wf) {
 
 INSTANTIATE_SERIALIZE_FOR_CLUSTER_AND_DISK(wire_func_t);
 
+// Renumbers the variables bound and used in `term` in the order in which they
+// are bound, starting after the ones already in `vars`, and drops the
+// backtraces.  Returns `false` if `term` uses a variable that it doesn't bind
+// itself or that is bound twice, since then the numbers carry meaning.
+bool canonicalize_term(Term *term, std::map<double, double> *vars) {
+    term->ClearExtension(ql2::extension::backtrace_id);
+    int first_arg = 0;
+    if (term->type() == Term::FUNC || term->type() == Term::VAR) {
+        if (term->args_size() < 1) {
+            return false;
+        }
+        std::vector<Datum *> var_nums;
+        Term *var_term = term->mutable_args(0);
+        var_term->ClearExtension(ql2::extension::backtrace_id);
+        if (var_term->type() == Term::DATUM) {
+            Datum *datum = var_term->mutable_datum();
+            if (datum->type() == Datum::R_ARRAY) {
+                for (int i = 0; i < datum->r_array_size(); ++i) {
+                    var_nums.push_back(datum->mutable_r_array(i));
+                }
+            } else {
+                var_nums.push_back(datum);
+            }
+        } else if (var_term->type() == Term::MAKE_ARRAY) {
+            for (int i = 0; i < var_term->args_size(); ++i) {
+                Term *arg = var_term->mutable_args(i);
+                arg->ClearExtension(ql2::extension::backtrace_id);
+                if (arg->type() != Term::DATUM) {
+                    return false;
+                }
+                var_nums.push_back(arg->mutable_datum());
+            }
+        } else {
+            return false;
+        }
+        for (Datum *var_num : var_nums) {
+            if (var_num->type() != Datum::R_NUM) {
+                return false;
+            }
+            auto it = vars->find(var_num->r_num());
+            if (term->type() == Term::FUNC) {
+                if (it != vars->end()) {
+                    return false;
+                }
+                double renumbered = vars->size();
+                vars->insert(std::make_pair(var_num->r_num(), renumbered));
+                var_num->set_r_num(renumbered);
+            } else {
+                if (it == vars->end()) {
+                    return false;
+                }
+                var_num->set_r_num(it->second);
+            }
+        }
+        first_arg = 1;
+    }
+    for (int i = first_arg; i < term->args_size(); ++i) {
+        if (!canonicalize_term(term->mutable_args(i), vars)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < term->optargs_size(); ++i) {
+        if (!canonicalize_term(term->mutable_optargs(i)->mutable_val(), vars)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class wire_func_key_visitor_t : public func_visitor_t {
+public:
+    explicit wire_func_key_visitor_t(std::string *_key_out) : key_out(_key_out) { }
+
+    void on_reql_func(const reql_func_t *reql_func) {
+        std::map<double, double> vars;
+        for (const sym_t &arg_name : reql_func->arg_names) {
+            double renumbered = vars.size();
+            if (!vars.insert(std::make_pair(arg_name.value, renumbered)).second) {
+                return;
+            }
+        }
+        Term body;
+        body.CopyFrom(*reql_func->body->get_src());
+        if (canonicalize_term(&body, &vars)) {
+            *key_out = strprintf("reql %zu ", reql_func->arg_names.size())
+                + body.SerializeAsString();
+        }
+    }
+
+    void on_js_func(const js_func_t *js_func) {
+        *key_out = strprintf("js %" PRIu64 " ", js_func->js_timeout_ms)
+            + js_func->js_source;
+    }
+
+private:
+    std::string *key_out;
+};
+
+std::string wire_func_t::canonical_key() const {
+    r_sanity_check(func.has());
+    std::string key;
+    wire_func_key_visitor_t v(&key);
+    func->visit(&v);
+    if (key.empty()) {
+        // We couldn't get rid of the variable numbers, so we fall back to the
+        // serialization, which is at least the same for the same function.
+        write_message_t wm;
+        serialize<cluster_version_t::CLUSTER>(&wm, *this);
+        string_stream_t stream;
+        int write_res = send_write_message(&stream, &wm);
+        guarantee(write_res == 0);
+        key = "serialized " + stream.str();
+    }
+    return key;
+}
+
 // deserialize function for 2.0 and before
 template <cluster_version_t W>
 archive_result_t deserialize(read_stream_t *s, wire_func_t *wf) {
@@ -157,11 +274,9 @@ template archive_result_t deserialize<cluster_version_t::v2_0>(
         read_stream_t *, wire_func_t *);
 
 // deserialize function for 2.1 and above
-template <>
-archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(
-    read_stream_t *s, wire_func_t *wf) {
-
-    const cluster_version_t W = cluster_version_t::v2_1_is_latest;
+template <cluster_version_t W>
+archive_result_t deserialize_since_v2_1(read_stream_t *s,
+                                        counted_t<const func_t> *func_out) {
     archive_result_t res;
 
     wire_func_type_t type;
@@ -187,7 +302,7 @@ archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(
 
         compile_env_t env(
             scope.compute_visibility().with_func_arg_name_list(arg_names));
-        wf->func = make_counted<reql_func_t>(
+        *func_out = make_counted<reql_func_t>(
             bt, scope, arg_names, compile_term(&env, body));
         return res;
     }
@@ -204,7 +319,7 @@ archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(
         res = deserialize<W>(s, &bt);
         if (bad(res)) { return res; }
 
-        wf->func = make_counted<js_func_t>(js_source, js_timeout_ms, bt);
+        *func_out = make_counted<js_func_t>(js_source, js_timeout_ms, bt);
         return res;
     }
     default:
@@ -212,6 +327,17 @@ archive_result_t deserialize<cluster_version_t::v2_1_is_latest>(
     }
 }
 
+template <>
+archive_result_t deserialize<cluster_version_t::v2_1>(
+        read_stream_t *s, wire_func_t *wf) {
+    return deserialize_since_v2_1<cluster_version_t::v2_1>(s, &wf->func);
+}
+template <>
+archive_result_t deserialize<cluster_version_t::v2_2_is_latest>(
+        read_stream_t *s, wire_func_t *wf) {
+    return deserialize_since_v2_1<cluster_version_t::v2_2_is_latest>(s, &wf->func);
+}
+
 template <cluster_version_t W>
 void serialize(write_message_t *wm, const maybe_wire_func_t &mwf) {
     bool has_value = mwf.has();
@@ -38,6 +38,12 @@ public:
     counted_t<const func_t> compile_wire_func() const;
     backtrace_id_t get_bt() const;
 
+    // Returns a string that is the same for two functions that only differ in the
+    // numbering of their variables and in their backtraces, as happens when two
+    // queries send the same function.  Functions that use variables from an
+    // enclosing scope are only equal to themselves.
+    std::string canonical_key() const;
+
     template <cluster_version_t W>
     friend void serialize(write_message_t *wm, const wire_func_t &);
     template <cluster_version_t W>
@@ -15,22 +15,42 @@
 #include "concurrency/pmap.hpp"
 #include "concurrency/semaphore.hpp"
 #include "config/args.hpp"
+#include "containers/archive/shared_buf_stream.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "containers/archive/versioned.hpp"
 #include "containers/object_buffer.hpp"
 #include "containers/uuid.hpp"
 #include "logger.hpp"
+#include "math.hpp"
 #include "stl_utils.hpp"
 #include "utils.hpp"
 
 // Number of messages after which the message handling loop yields
 #define MESSAGE_HANDLER_MAX_BATCH_SIZE           16
 
+// Messages smaller than this are sent uncompressed even if the connection supports
+// compression, because they don't compress well enough to be worth the CPU time.
+#define CLUSTER_COMPRESSION_MIN_MESSAGE_SIZE     1024
+
+// Messages larger than this are sent uncompressed, and we don't accept compressed
+// messages that claim to be larger, so a corrupt header can't make us allocate an
+// arbitrary amount of memory.
+#define CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE     (256 * MEGABYTE)
+
+// How long a connection that another server opened to us waits for the other
+// server's extra connections before giving up on the connection.
+#define EXTRA_CONNECTIONS_TIMEOUT_MS             10000
+
+// Senders of messages smaller than this don't wait for their message to be flushed to
+// the TCP stack. The flush happens once the sending thread yields, so many small
+// messages written in the meantime share one write to the socket.
+#define CLUSTER_COALESCE_MAX_MESSAGE_SIZE        4096
+
 // The cluster communication protocol version.
-static_assert(cluster_version_t::CLUSTER == cluster_version_t::v2_1_is_latest,
+static_assert(cluster_version_t::CLUSTER == cluster_version_t::v2_2_is_latest,
               "We need to update CLUSTER_VERSION_STRING when we add a new cluster "
               "version.");
-#define CLUSTER_VERSION_STRING "2.1.0"
+#define CLUSTER_VERSION_STRING "2.2.0"
 
 const std::string connectivity_cluster_t::cluster_proto_header("RethinkDB cluster\n");
 const std::string connectivity_cluster_t::cluster_version_string(CLUSTER_VERSION_STRING);
@@ -112,8 +132,6 @@ const std::string connectivity_cluster_t::cluster_build_mode("debug");
 #endif
 
 void connectivity_cluster_t::connection_t::kill_connection() {
-    /* `heartbeat_manager_t` assumes this doesn't block as long as it's called on the
-    home thread. */
     guarantee(!is_loopback(), "Attempted to kill connection to myself.");
     on_thread_t thread_switcher(conn->home_thread());
 
@@ -125,29 +143,72 @@ void connectivity_cluster_t::connection_t::kill_connection() {
     }
 }
 
-connectivity_cluster_t::connection_t::connection_t(run_t *p,
-                                                   peer_id_t id,
-                                                   keepalive_tcp_conn_stream_t *c,
-                                                   const peer_address_t &a) THROWS_NOTHING :
+connectivity_cluster_t::connection_t::stripe_t::stripe_t(
+        keepalive_tcp_conn_stream_t *c,
+        bool rethread,
+        cluster_compression_t compression) :
     conn(c),
-    peer_address(a),
     flusher([&](signal_t *) {
-        guarantee(this->conn != nullptr);
         // We need to acquire the send_mutex because flushing the buffer
         // must not interleave with other writes (restriction of linux_tcp_conn_t).
         mutex_t::acq_t acq(&this->send_mutex);
+        // Everything written before this point goes out with this flush.
+        this->flusher.include_latest_notifications();
         // We ignore the return value of flush_buffer(). Closed connections
         // must be handled elsewhere.
         this->conn->flush_buffer();
-    }, 1),
+        if (!this->conn->is_write_open() && this->conn->is_read_open()) {
+            /* Senders of small messages don't wait for the flush, so make sure
+            that `handle()` notices the closed connection. */
+            this->conn->shutdown_read();
+        }
+    }, 1)
+{
+    if (rethread) {
+        rethreader.init(new rethread_tcp_conn_stream_t(conn, get_thread_id()));
+    }
+    guarantee(conn->home_thread() == get_thread_id());
+    if (compression == cluster_compression_t::ZLIB) {
+        compressor.init(new cluster_compressor_t());
+    }
+}
+
+connectivity_cluster_t::connection_t::connection_t(run_t *p,
+                                                   peer_id_t id,
+                                                   keepalive_tcp_conn_stream_t *c,
+                                                   const std::vector<keepalive_tcp_conn_stream_t *> &extra_conns,
+                                                   const peer_address_t &a,
+                                                   cluster_compression_t comp)
+        THROWS_NOTHING :
+    conn(c),
+    peer_address(a),
     pm_collection(),
     pm_bytes_sent(secs_to_ticks(1), true),
     pm_collection_membership(&p->parent->connectivity_collection, &pm_collection,
         uuid_to_str(id.get_uuid())),
     pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
+    pm_compression_membership(&pm_collection,
+        &pm_bytes_before_compression, "bytes_before_compression",
+        &pm_bytes_after_compression, "bytes_after_compression"),
     parent(p), peer_id(id),
     drainers()
 {
+    if (conn != NULL) {
+        /* Spread the stripes over consecutive threads, so that a busy connection
+        doesn't have to share a thread with itself. */
+        stripes.resize(1 + extra_conns.size());
+        pmap(stripes.size(), [&](int i) {
+            threadnum_t thread((conn->home_thread().threadnum + i) % get_num_threads());
+            on_thread_t thread_switcher(thread);
+            if (i == 0) {
+                stripes[i].init(new stripe_t(conn, false, comp));
+            } else {
+                stripes[i].init(new stripe_t(extra_conns[i - 1], true, comp));
+            }
+        });
+    } else {
+        guarantee(extra_conns.empty());
+    }
     pmap(get_num_threads(), [this](int thread_id) {
         on_thread_t thread_switcher((threadnum_t(thread_id)));
         parent->parent->connections.get()->set_key_no_equals(
@@ -164,8 +225,14 @@ connectivity_cluster_t::connection_t::~connection_t() THROWS_NOTHING {
         drainers.get()->drain();
     });
 
-    /* The drainers have been destroyed, so nothing can be holding the `send_mutex`. */
-    guarantee(!send_mutex.is_locked());
+    pmap(stripes.size(), [this](int i) {
+        on_thread_t thread_switcher(stripes[i]->conn->home_thread());
+        stripes[i]->assert_thread();
+        /* The drainers have been destroyed, so nothing can be holding the
+        `send_mutex`. */
+        guarantee(!stripes[i]->send_mutex.is_locked());
+        stripes[i].reset();
+    });
 }
 
 // Helper function for the `run_t` constructor's initialization list
@@ -203,7 +270,9 @@ static peer_address_t our_peer_address(std::set<ip_address_t> local_addresses,
 connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
                                      const std::set<ip_address_t> &local_addresses,
                                      const peer_address_t &canonical_addresses,
-                                     int port, int client_port)
+                                     int port, int client_port,
+                                     int _connections_per_peer,
+                                     cluster_compression_t compression)
         THROWS_ONLY(address_in_use_exc_t, tcp_socket_exc_t) :
     parent(p),
 
@@ -214,6 +283,14 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
     /* The local port to use when connecting to the cluster port of peers */
     cluster_client_port(client_port),
 
+    /* All of our connections come from `cluster_client_port` if it's set, so then we
+    can't open more than one connection to the same peer. */
+    connections_per_peer(client_port != 0
+        ? 1
+        : clamp<int>(_connections_per_peer, 1, max_connections_per_peer)),
+
+    offered_compression(compression),
+
     /* This sets `parent->current_run` to `this`. It's necessary to do it in the
     constructor of a subfield rather than in the body of the `run_t` constructor
     because `parent->current_run` needs to be set before `connection_to_ourself`
@@ -237,7 +314,9 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
     `connection_map` on each thread and notifying any listeners that we're now
     connected to ourself. The destructor will remove us from the
     `connection_map` and again notify any listeners. */
-    connection_to_ourself(this, parent->me, NULL, routing_table[parent->me]),
+    connection_to_ourself(this, parent->me, NULL,
+        std::vector<keepalive_tcp_conn_stream_t *>(), routing_table[parent->me],
+        cluster_compression_t::NONE),
 
     listener(new tcp_listener_t(
         cluster_listener_socket.get(),
@@ -390,10 +469,13 @@ private:
     DISABLE_COPYING(cluster_conn_closing_subscription_t);
 };
 
-/* `heartbeat_manager_t` is responsible for sending heartbeats over a single connection
-and making sure that heartbeats have arrived on time.
-`connectivity_cluster_t::run_t::handle()` constructs one after constructing the
-`connection_t`. */
+/* `heartbeat_manager_t` is responsible for sending heartbeats over a single stripe of a
+connection and making sure that heartbeats have arrived on time.
+`connectivity_cluster_t::run_t::handle()` constructs one for each stripe, on the
+stripe's thread, after constructing the `connection_t`. Every stripe needs its own
+heartbeats, since traffic on one stripe says nothing about whether another one is
+stuck. If a stripe times out, we close that stripe, which takes down the whole
+connection. */
 class connectivity_cluster_t::heartbeat_manager_t :
     public keepalive_tcp_conn_stream_t::keepalive_callback_t,
     private repeating_timer_callback_t,
@@ -405,20 +487,24 @@ public:
 
     heartbeat_manager_t(
             connectivity_cluster_t::connection_t *connection_,
+            size_t stripe_index_,
             auto_drainer_t::lock_t connection_keepalive_,
             std::string peer_str_) :
         connection(connection_),
+        stripe_index(stripe_index_),
+        stripe_conn(connection->stripes[stripe_index]->conn),
         connection_keepalive(connection_keepalive_),
         read_done(false), write_done(false),
         intervals_since_last_read_done(0),
         peer_str(peer_str_),
         timer(HEARTBEAT_INTERVAL_MS, this)
     {
-        connection->conn->set_keepalive_callback(this);
+        connection->stripes[stripe_index]->assert_thread();
+        stripe_conn->set_keepalive_callback(this);
     }
 
     ~heartbeat_manager_t() {
-        connection->conn->set_keepalive_callback(NULL);
+        stripe_conn->set_keepalive_callback(NULL);
     }
 
     /* These are called by the `keepalive_tcp_conn_stream_t`. */
@@ -433,10 +519,15 @@ public:
         if (intervals_since_last_read_done > HEARTBEAT_TIMEOUT_INTERVALS) {
             logERR("Heartbeat timeout, killing connection to peer %s", peer_str.c_str());
 
-            /* This won't block if we call it from the same thread. This is an
-            implementation detail that outside code shouldn't rely on, but since
-            `heartbeat_manager_t` is part of `connectivity_cluster_t` it's OK. */
-            connection->kill_connection();
+            /* We're on the stripe's thread, so this doesn't block. The receive loop
+            of the stripe then notices that it's closed and kills the rest of the
+            connection. */
+            if (stripe_conn->is_read_open()) {
+                stripe_conn->shutdown_read();
+            }
+            if (stripe_conn->is_write_open()) {
+                stripe_conn->shutdown_write();
+            }
             return;
         }
         if (write_done) {
@@ -447,10 +538,11 @@ public:
             auto_drainer_t::lock_t this_keepalive(&drainer);
             coro_t::spawn_later_ordered(
                 [this, this_keepalive /* important to capture */] {
-                    /* This might block, so we have to run it in a sub-coroutine. */
+                    /* This might block, so we have to run it in a sub-coroutine.
+                    The stripe index as the ordering key sends it over our stripe. */
                     connection->parent->parent->send_message(
                         connection, connection_keepalive,
-                        connectivity_cluster_t::heartbeat_tag, this);
+                        connectivity_cluster_t::heartbeat_tag, this, stripe_index);
                 });
         }
         if (read_done) {
@@ -470,6 +562,8 @@ public:
     }
 #endif
     connectivity_cluster_t::connection_t *connection;
+    size_t stripe_index;
+    keepalive_tcp_conn_stream_t *stripe_conn;
     auto_drainer_t::lock_t connection_keepalive;
     bool read_done, write_done;
     int intervals_since_last_read_done;
@@ -737,97 +831,98 @@ void fail_handshake(keepalive_tcp_conn_stream_t *conn,
     }
 }
 
-// We log error conditions as follows:
-// - silent: network error; conflict between parallel connections
-// - warning: invalid header
-// - error: id or address don't match expected id or address; deserialization range error; unknown error
-// In all cases we close the connection and quit.
-void connectivity_cluster_t::run_t::handle(
-        /* `conn` should remain valid until `handle()` returns.
-         * `handle()` does not take ownership of `conn`. */
-        keepalive_tcp_conn_stream_t *conn,
-        boost::optional<peer_id_t> expected_id,
-        boost::optional<peer_address_t> expected_address,
-        auto_drainer_t::lock_t drainer_lock,
-        bool *successful_join) THROWS_NOTHING
-{
-    parent->assert_thread();
-
-    /* TODO: If the other peer mysteriously stops talking to us, but doesn't close the
-    connection, during the initialization process but before we construct the
-    `heartbeat_manager_t`, then we might get stuck. Maybe we should add a timeout? It
-    could just be a `signal_timer_t` that is wired into `conn_closer_1` but not
-    `conn_closer_2`. */
-
-    // Get the name of our peer, for error reporting.
-    ip_and_port_t peer_addr;
-    std::string peerstr = "(unknown)";
-    if (conn->get_underlying_conn()->getpeername(&peer_addr))
-        peerstr = peer_addr.to_string();
-    const char *peername = peerstr.c_str();
-
-    // Make sure that if we're ordered to shut down, any pending read
-    // or write gets interrupted.
-    cluster_conn_closing_subscription_t conn_closer_1(conn);
-    conn_closer_1.reset(drainer_lock.get_drain_signal());
+/* What each side of a connection sends about itself in the handshake, after the
+header, version, architecture and build mode. */
+struct handshake_info_t {
+    peer_id_t id;
+    std::set<host_and_port_t> hosts;
+    uint8_t compression;
+    /* The number of TCP connections per peer that this side wants. */
+    uint8_t num_connections;
+    /* The server that initiates a connection picks a new session ID for it and sends
+    it again on each of the connection's extra TCP connections, so the other side can
+    tell which connection they belong to. Nil if we didn't initiate the connection. */
+    uuid_u session_id;
+    /* Zero for the main TCP connection, one or more for the extra ones. */
+    uint8_t connection_index;
+};
 
+/* Sends our side of the handshake, then receives and checks the other side's. Returns
+`false` if the handshake failed, in which case the connection should be closed. */
+static bool exchange_handshake(keepalive_tcp_conn_stream_t *conn,
+                               const char *peername,
+                               const handshake_info_t &our_info,
+                               cluster_version_t *resolved_version_out,
+                               handshake_info_t *other_info_out) {
     // Each side sends a header followed by its own ID and address, then receives and checks the
     // other side's.
     {
         write_message_t wm;
-        wm.append(cluster_proto_header.c_str(), cluster_proto_header.length());
+        wm.append(connectivity_cluster_t::cluster_proto_header.c_str(),
+                  connectivity_cluster_t::cluster_proto_header.length());
         // TODO: Make some serialize_compatible_string function (matching the name of
         // deserialize_compatible_string).
-        serialize_universal(&wm, static_cast<uint64_t>(cluster_version_string.length()));
-        wm.append(cluster_version_string.data(), cluster_version_string.length());
+        serialize_universal(&wm, static_cast<uint64_t>(
+            connectivity_cluster_t::cluster_version_string.length()));
+        wm.append(connectivity_cluster_t::cluster_version_string.data(),
+                  connectivity_cluster_t::cluster_version_string.length());
 
         // Everything after we send the version string COULD be moved _below_ the
         // point where we resolve the version string.  That would mean adding another
         // back and forth to the handshake?
-        serialize_universal(&wm, static_cast<uint64_t>(cluster_arch_bitsize.length()));
-        wm.append(cluster_arch_bitsize.data(), cluster_arch_bitsize.length());
-        serialize_universal(&wm, static_cast<uint64_t>(cluster_build_mode.length()));
-        wm.append(cluster_build_mode.data(), cluster_build_mode.length());
-        serialize_universal(&wm, parent->me);
-        serialize_universal(&wm, routing_table[parent->me].hosts());
+        serialize_universal(&wm, static_cast<uint64_t>(
+            connectivity_cluster_t::cluster_arch_bitsize.length()));
+        wm.append(connectivity_cluster_t::cluster_arch_bitsize.data(),
+                  connectivity_cluster_t::cluster_arch_bitsize.length());
+        serialize_universal(&wm, static_cast<uint64_t>(
+            connectivity_cluster_t::cluster_build_mode.length()));
+        wm.append(connectivity_cluster_t::cluster_build_mode.data(),
+                  connectivity_cluster_t::cluster_build_mode.length());
+        serialize_universal(&wm, our_info.id);
+        serialize_universal(&wm, our_info.hosts);
+        serialize_universal(&wm, our_info.compression);
+        serialize_universal(&wm, our_info.num_connections);
+        serialize_universal(&wm, our_info.session_id);
+        serialize_universal(&wm, our_info.connection_index);
         if (send_write_message(conn, &wm)) {
-            return; // network error.
+            return false; // network error.
         }
     }
 
     // Receive & check header.
     {
+        const std::string &header = connectivity_cluster_t::cluster_proto_header;
         const int64_t buffer_size = 64;
         char buffer[buffer_size];
         int64_t r;
-        for (uint64_t i = 0; i < cluster_proto_header.length(); i += r) {
-            r = conn->read(buffer, std::min(buffer_size, int64_t(cluster_proto_header.length() - i)));
+        for (uint64_t i = 0; i < header.length(); i += r) {
+            r = conn->read(buffer, std::min(buffer_size, int64_t(header.length() - i)));
             if (-1 == r) {
-                return; // network error.
+                return false; // network error.
             }
             rassert(r >= 0);
             // If EOF or remote_header does not match header, terminate connection.
-            if (0 == r || memcmp(cluster_proto_header.c_str() + i, buffer, r) != 0) {
+            if (0 == r || memcmp(header.c_str() + i, buffer, r) != 0) {
                 logWRN("Received invalid clustering header from %s, closing connection -- something might be connecting to the wrong port.", peername);
-                return;
+                return false;
             }
         }
     }
 
     // Check version number (e.g. 1.9.0-466-gadea67)
-    cluster_version_t resolved_version;
     {
         std::string remote_version_string;
 
         if (!deserialize_compatible_string(conn, &remote_version_string, peername)) {
-            return;
+            return false;
         }
 
-        if (!resolve_protocol_version(remote_version_string, &resolved_version)) {
+        if (!resolve_protocol_version(remote_version_string, resolved_version_out)) {
             auto reason = handshake_result_t::error(
                 handshake_result_code_t::UNRECOGNIZED_VERSION,
                 strprintf("local: %s, remote: %s",
-                          cluster_version_string.c_str(), remote_version_string.c_str()));
+                          connectivity_cluster_t::cluster_version_string.c_str(),
+                          remote_version_string.c_str()));
             // Peers before 1.14 don't support receiving a handshake error message.
             // So we must not send one.
             bool handshake_error_supported = false;
@@ -839,11 +934,11 @@ void connectivity_cluster_t::run_t::handle(
                 }
             }
             fail_handshake(conn, peername, reason, handshake_error_supported);
-            return;
+            return false;
         }
 
         // In the future we'll need to support multiple cluster versions.
-        guarantee(resolved_version == cluster_version_t::CLUSTER);
+        guarantee(*resolved_version_out == cluster_version_t::CLUSTER);
     }
 
     // Check bitsize (e.g. 32bit or 64bit)
@@ -851,16 +946,17 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_arch_bitsize;
 
         if (!deserialize_compatible_string(conn, &remote_arch_bitsize, peername)) {
-            return;
+            return false;
         }
 
-        if (remote_arch_bitsize != cluster_arch_bitsize) {
+        if (remote_arch_bitsize != connectivity_cluster_t::cluster_arch_bitsize) {
             auto reason = handshake_result_t::error(
                 handshake_result_code_t::INCOMPATIBLE_ARCH,
                 strprintf("local: %s, remote: %s",
-                          cluster_arch_bitsize.c_str(), remote_arch_bitsize.c_str()));
+                          connectivity_cluster_t::cluster_arch_bitsize.c_str(),
+                          remote_arch_bitsize.c_str()));
             fail_handshake(conn, peername, reason);
-            return;
+            return false;
         }
 
     }
@@ -870,25 +966,28 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_build_mode;
 
         if (!deserialize_compatible_string(conn, &remote_build_mode, peername)) {
-            return;
+            return false;
         }
 
-        if (remote_build_mode != cluster_build_mode) {
+        if (remote_build_mode != connectivity_cluster_t::cluster_build_mode) {
             auto reason = handshake_result_t::error(
                 handshake_result_code_t::INCOMPATIBLE_BUILD,
                 strprintf("local: %s, remote: %s",
-                          cluster_build_mode.c_str(), remote_build_mode.c_str()));
+                          connectivity_cluster_t::cluster_build_mode.c_str(),
+                          remote_build_mode.c_str()));
             fail_handshake(conn, peername, reason);
-            return;
+            return false;
         }
     }
 
-    // Receive id, host/ports.
-    peer_id_t other_id;
-    std::set<host_and_port_t> other_peer_addr_hosts;
-    if (deserialize_universal_and_check(conn, &other_id, peername) ||
-        deserialize_universal_and_check(conn, &other_peer_addr_hosts, peername)) {
-        return;
+    // Receive id, host/ports, compression, connection count and session.
+    if (deserialize_universal_and_check(conn, &other_info_out->id, peername) ||
+        deserialize_universal_and_check(conn, &other_info_out->hosts, peername) ||
+        deserialize_universal_and_check(conn, &other_info_out->compression, peername) ||
+        deserialize_universal_and_check(conn, &other_info_out->num_connections, peername) ||
+        deserialize_universal_and_check(conn, &other_info_out->session_id, peername) ||
+        deserialize_universal_and_check(conn, &other_info_out->connection_index, peername)) {
+        return false;
     }
 
     {
@@ -896,22 +995,293 @@ void connectivity_cluster_t::run_t::handle(
         write_message_t wm;
         serialize_universal(&wm, handshake_result_t::success());
         if (send_write_message(conn, &wm)) {
-            return; // network error.
+            return false; // network error.
         }
 
         // Check if there was an issue with the connection initiation
         handshake_result_t handshake_result;
         if (deserialize_universal_and_check(conn, &handshake_result, peername)) {
-            return;
+            return false;
         }
         if (handshake_result.get_code() != handshake_result_code_t::SUCCESS) {
             logWRN("Remote node refused to connect with us, peer: %s, reason: \"%s\"",
                    peername,
                    sanitize_for_logger(handshake_result.get_error_reason()).c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* `incoming_stripes_t` collects the extra TCP connections of a connection that another
+server opened to us. The main connection's `handle()` constructs it; each extra
+connection's `handle()` puts its TCP connection into `conns` and then waits until the
+`incoming_stripes_t` is destroyed, because it still owns the TCP connection. */
+class connectivity_cluster_t::run_t::incoming_stripes_t {
+public:
+    incoming_stripes_t(run_t *parent, const uuid_u &session_id,
+                       const peer_id_t &_peer_id, size_t num_extra_conns) :
+        peer_id(_peer_id),
+        conns(num_extra_conns, NULL),
+        num_arrived(0),
+        map_entry(&parent->incoming_stripes, session_id, this) { }
+
+    /* Returns `false` if we can't use `conn`, for example because another TCP
+    connection with the same index already arrived. */
+    bool attach(const peer_id_t &other_id, size_t index,
+                keepalive_tcp_conn_stream_t *conn) {
+        if (other_id != peer_id || index == 0 || index > conns.size()
+            || conns[index - 1] != NULL || all_arrived.is_pulsed()) {
+            return false;
+        }
+        conns[index - 1] = conn;
+        ++num_arrived;
+        if (num_arrived == conns.size()) {
+            all_arrived.pulse();
+        }
+        return true;
+    }
+
+    const peer_id_t peer_id;
+    std::vector<keepalive_tcp_conn_stream_t *> conns;
+    size_t num_arrived;
+    cond_t all_arrived;
+
+    /* The extra connections' `handle()`s hold locks on this until its drain signal is
+    pulsed. */
+    auto_drainer_t drainer;
+
+private:
+    map_insertion_sentry_t<uuid_u, incoming_stripes_t *> map_entry;
+
+    DISABLE_COPYING(incoming_stripes_t);
+};
+
+bool connectivity_cluster_t::run_t::connect_extra_connections(
+        const ip_and_port_t &peer_addr,
+        const peer_id_t &other_id,
+        const uuid_u &session_id,
+        size_t num_connections,
+        signal_t *interruptor,
+        std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> > *conns_out)
+        THROWS_NOTHING {
+    parent->assert_thread();
+    const std::string peerstr = peer_addr.to_string();
+    for (size_t i = 1; i < num_connections; ++i) {
+        scoped_ptr_t<keepalive_tcp_conn_stream_t> conn;
+        try {
+            conn.init(new keepalive_tcp_conn_stream_t(
+                peer_addr.ip(), peer_addr.port().value(), interruptor,
+                cluster_client_port));
+        } catch (const tcp_conn_t::connect_failed_exc_t &) {
+            logWRN("Failed to open an extra connection to %s, closing connection.",
+                   peerstr.c_str());
+            return false;
+        } catch (const interrupted_exc_t &) {
+            return false;
+        }
+
+        cluster_conn_closing_subscription_t conn_closer(conn.get());
+        conn_closer.reset(interruptor);
+
+        handshake_info_t our_info;
+        our_info.id = parent->me;
+        our_info.hosts = routing_table[parent->me].hosts();
+        our_info.compression = static_cast<uint8_t>(offered_compression);
+        our_info.num_connections = num_connections;
+        our_info.session_id = session_id;
+        our_info.connection_index = i;
+
+        cluster_version_t resolved_version;
+        handshake_info_t other_info;
+        if (!exchange_handshake(conn.get(), peerstr.c_str(), our_info,
+                                &resolved_version, &other_info)) {
+            return false;
+        }
+        if (other_info.id != other_id) {
+            logERR("Extra connection to %s reached a different server, closing "
+                   "connection.", peerstr.c_str());
+            return false;
+        }
+
+        conn_closer.reset();
+        conns_out->push_back(std::move(conn));
+    }
+    return true;
+}
+
+void connectivity_cluster_t::run_t::receive_messages(
+        connection_t *connection,
+        keepalive_tcp_conn_stream_t *conn,
+        cluster_compression_t compression) THROWS_NOTHING {
+    /* Main message-handling loop: read messages off the connection until
+    it's closed, which may be due to network events, or the other end
+    shutting down, or us shutting down. */
+    try {
+        /* Compressed messages share one zlib stream, so they have to be
+        decompressed in the order they arrive, i.e. right here. */
+        scoped_ptr_t<cluster_decompressor_t> decompressor;
+        if (compression == cluster_compression_t::ZLIB) {
+            decompressor.init(new cluster_decompressor_t());
+        }
+        std::vector<char> compressed_data;
+
+        int messages_handled_since_yield = 0;
+        while (true) {
+            message_tag_t tag;
+            archive_result_t res = deserialize_universal(conn, &tag);
+            if (bad(res)) { throw fake_archive_exc_t(); }
+
+            /* For a compressed message, read and decompress the whole message,
+            then handle it as if it had been read off the connection. */
+            scoped_ptr_t<vector_read_stream_t> decompressed_stream;
+            if (tag == compressed_tag) {
+                uint64_t raw_size, compressed_size;
+                if (!decompressor.has()
+                    || bad(deserialize_universal(conn, &tag))
+                    || tag == compressed_tag
+                    || tag == heartbeat_tag
+                    || bad(deserialize_universal(conn, &raw_size))
+                    || bad(deserialize_universal(conn, &compressed_size))
+                    || raw_size > CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE
+                    || compressed_size > cluster_compressed_size_bound(raw_size)) {
+                    throw fake_archive_exc_t();
+                }
+                compressed_data.resize(compressed_size);
+                if (force_read(conn, compressed_data.data(), compressed_size)
+                    != static_cast<int64_t>(compressed_size)) {
+                    throw fake_archive_exc_t();
+                }
+                std::vector<char> data;
+                if (!decompressor->decompress(compressed_data.data(),
+                                              compressed_size, raw_size, &data)) {
+                    throw fake_archive_exc_t();
+                }
+                decompressed_stream.init(new vector_read_stream_t(std::move(data)));
+            }
+
+            /* Ignore messages tagged with the heartbeat tag. The
+            `keepalive_tcp_conn_stream_t` will have already notified the
+            `heartbeat_manager_t` as soon as the heartbeat arrived. */
+            if (tag != heartbeat_tag) {
+                cluster_message_handler_t *handler = parent->message_handlers[tag];
+                guarantee(handler != NULL, "Got a message for an unfamiliar tag. "
+                    "Apparently we aren't compatible with the cluster on the other "
+                    "end.");
+
+                handler->on_message(
+                    connection,
+                    auto_drainer_t::lock_t(connection->drainers.get()),
+                    decompressed_stream.has()
+                        ? static_cast<read_stream_t *>(decompressed_stream.get())
+                        : conn); // might raise fake_archive_exc_t
+            }
+
+            ++messages_handled_since_yield;
+            if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
+                coro_t::yield();
+                messages_handled_since_yield = 0;
+            }
+        }
+    } catch (const fake_archive_exc_t &) {
+        /* The exception broke us out of the loop, and that's what we
+        wanted. This could either be because we lost contact with the peer
+        or because the cluster is shutting down and `close_conn()` got
+        called. */
+    }
+
+    if (conn->is_read_open()) {
+        logWRN("Received invalid data on a cluster connection. Disconnecting.");
+    }
+}
+
+// We log error conditions as follows:
+// - silent: network error; conflict between parallel connections
+// - warning: invalid header
+// - error: id or address don't match expected id or address; deserialization range error; unknown error
+// In all cases we close the connection and quit.
+void connectivity_cluster_t::run_t::handle(
+        /* `conn` should remain valid until `handle()` returns.
+         * `handle()` does not take ownership of `conn`. */
+        keepalive_tcp_conn_stream_t *conn,
+        boost::optional<peer_id_t> expected_id,
+        boost::optional<peer_address_t> expected_address,
+        auto_drainer_t::lock_t drainer_lock,
+        bool *successful_join) THROWS_NOTHING
+{
+    parent->assert_thread();
+
+    /* TODO: If the other peer mysteriously stops talking to us, but doesn't close the
+    connection, during the initialization process but before we construct the
+    `heartbeat_manager_t`, then we might get stuck. Maybe we should add a timeout? It
+    could just be a `signal_timer_t` that is wired into `conn_closer_1` but not
+    `conn_closer_2`. */
+
+    // Get the name of our peer, for error reporting.
+    ip_and_port_t peer_addr;
+    std::string peerstr = "(unknown)";
+    const bool have_peer_addr = conn->get_underlying_conn()->getpeername(&peer_addr);
+    if (have_peer_addr)
+        peerstr = peer_addr.to_string();
+    const char *peername = peerstr.c_str();
+
+    // Make sure that if we're ordered to shut down, any pending read
+    // or write gets interrupted.
+    cluster_conn_closing_subscription_t conn_closer_1(conn);
+    conn_closer_1.reset(drainer_lock.get_drain_signal());
+
+    /* We only initiate connections with an expected address, so this tells us
+    which side is responsible for opening the extra connections. */
+    const bool we_initiated = static_cast<bool>(expected_address);
+
+    handshake_info_t our_info;
+    our_info.id = parent->me;
+    our_info.hosts = routing_table[parent->me].hosts();
+    our_info.compression = static_cast<uint8_t>(offered_compression);
+    our_info.num_connections = connections_per_peer;
+    our_info.session_id = we_initiated ? generate_uuid() : nil_uuid();
+    our_info.connection_index = 0;
+
+    cluster_version_t resolved_version;
+    handshake_info_t other_info;
+    if (!exchange_handshake(conn, peername, our_info, &resolved_version, &other_info)) {
+        return;
+    }
+    const peer_id_t &other_id = other_info.id;
+    const std::set<host_and_port_t> &other_peer_addr_hosts = other_info.hosts;
+
+    if (other_info.connection_index != 0) {
+        /* This is an extra TCP connection for a connection that the other server
+        opened to us earlier. Hand it to that connection's `handle()`, which takes
+        care of it from here on, and wait until it's done with it. */
+        auto it = incoming_stripes.find(other_info.session_id);
+        if (it == incoming_stripes.end()) {
+            return;
+        }
+        auto_drainer_t::lock_t stripes_keepalive(&it->second->drainer);
+        /* The main connection's `handle()` will move `conn` to another thread. */
+        conn_closer_1.reset();
+        if (!it->second->attach(other_id, other_info.connection_index, conn)) {
+            logERR("Received an unexpected extra connection from %s, closing it.",
+                   peername);
             return;
         }
+        stripes_keepalive.get_drain_signal()->wait_lazily_unordered();
+        return;
     }
 
+    // We only compress if both sides asked for the same scheme, so a server can turn
+    // compression off (or switch to a new scheme) without breaking the handshake.
+    cluster_compression_t compression =
+        other_info.compression == static_cast<uint8_t>(offered_compression)
+            ? offered_compression
+            : cluster_compression_t::NONE;
+
+    // Both sides use the smaller of the two numbers of connections.
+    const size_t num_connections = std::max<size_t>(
+        1, std::min<size_t>(connections_per_peer, other_info.num_connections));
+
     // Look up the ip addresses for the other host
     object_buffer_t<peer_address_t> other_peer_addr;
 
@@ -964,6 +1334,20 @@ void connectivity_cluster_t::run_t::handle(
     // Just saying that we're still on the rpc listener thread.
     parent->assert_thread();
 
+    /* If the other server is going to open extra connections to us, get ready to
+    receive them. They can't arrive before the routing tables have been exchanged. */
+    scoped_ptr_t<incoming_stripes_t> stripes_from_peer;
+    if (!we_initiated && num_connections > 1) {
+        if (other_info.session_id.is_nil()
+            || incoming_stripes.count(other_info.session_id) != 0) {
+            logERR("Received invalid session ID from %s, closing connection.",
+                   peername);
+            return;
+        }
+        stripes_from_peer.init(new incoming_stripes_t(
+            this, other_info.session_id, other_id, num_connections - 1));
+    }
+
     /* The trickiest case is when there are two or more parallel connections
     that are trying to be established between the same two servers. We can get
     this when e.g. server A and server B try to connect to each other at the
@@ -1043,6 +1427,40 @@ void connectivity_cluster_t::run_t::handle(
     // Just saying: We haven't left the RPC listener thread.
     parent->assert_thread();
 
+    /* Now that both sides have accepted the connection, set up its extra TCP
+    connections. The side that initiated the connection opens them to the same
+    address; the other side waits for them to arrive. */
+    std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> > stripes_to_peer;
+    std::vector<keepalive_tcp_conn_stream_t *> extra_conns;
+    if (num_connections > 1) {
+        if (we_initiated) {
+            if (!have_peer_addr
+                || !connect_extra_connections(peer_addr, other_id,
+                                              our_info.session_id, num_connections,
+                                              drainer_lock.get_drain_signal(),
+                                              &stripes_to_peer)) {
+                return;
+            }
+            for (const auto &stripe_conn : stripes_to_peer) {
+                extra_conns.push_back(stripe_conn.get());
+            }
+        } else {
+            signal_timer_t timeout;
+            timeout.start(EXTRA_CONNECTIONS_TIMEOUT_MS);
+            wait_any_t waiter(&stripes_from_peer->all_arrived, &timeout,
+                              drainer_lock.get_drain_signal());
+            waiter.wait_lazily_unordered();
+            if (!stripes_from_peer->all_arrived.is_pulsed()) {
+                if (timeout.is_pulsed()) {
+                    logWRN("Timed out waiting for the extra connections from %s, "
+                           "closing connection.", peername);
+                }
+                return;
+            }
+            extra_conns = stripes_from_peer->conns;
+        }
+    }
+
     // This check is so that when trying multiple connections to a peer in parallel, we can
     //  make sure only one of them succeeds
     if (successful_join != NULL) {
@@ -1081,6 +1499,13 @@ void connectivity_cluster_t::run_t::handle(
 
     cross_thread_signal_t connection_thread_drain_signal(drainer_lock.get_drain_signal(), chosen_thread);
 
+    /* The `connection_t` moves the extra connections to their own threads. */
+    std::vector<scoped_ptr_t<rethread_tcp_conn_stream_t> > unregister_extra_conns;
+    for (keepalive_tcp_conn_stream_t *extra_conn : extra_conns) {
+        unregister_extra_conns.push_back(
+            make_scoped<rethread_tcp_conn_stream_t>(extra_conn, INVALID_THREAD));
+    }
+
     rethread_tcp_conn_stream_t unregister_conn(conn, INVALID_THREAD);
     on_thread_t conn_threader(chosen_thread);
     rethread_tcp_conn_stream_t reregister_conn(conn, get_thread_id());
@@ -1094,60 +1519,55 @@ void connectivity_cluster_t::run_t::handle(
         /* `connection_t` is the public interface of this coroutine. Its
         constructor registers it in the `connectivity_cluster_t`'s connection
         map. */
-        connection_t conn_structure(this, other_id, conn, *other_peer_addr.get());
-
-        /* `heartbeat_manager` will periodically send a heartbeat message to
-        other servers, and it will also close the connection if we don't
-        receive anything for a while. */
-        heartbeat_manager_t heartbeat_manager(
-            &conn_structure,
-            auto_drainer_t::lock_t(conn_structure.drainers.get()),
-            peerstr);
-
-        /* Main message-handling loop: read messages off the connection until
-        it's closed, which may be due to network events, or the other end
-        shutting down, or us shutting down. */
-        try {
-            int messages_handled_since_yield = 0;
-            while (true) {
-                message_tag_t tag;
-                archive_result_t res = deserialize_universal(conn, &tag);
-                if (bad(res)) { throw fake_archive_exc_t(); }
-
-                /* Ignore messages tagged with the heartbeat tag. The
-                `keepalive_tcp_conn_stream_t` will have already notified the
-                `heartbeat_manager_t` as soon as the heartbeat arrived. */
-                if (tag != heartbeat_tag) {
-                    cluster_message_handler_t *handler = parent->message_handlers[tag];
-                    guarantee(handler != NULL, "Got a message for an unfamiliar tag. "
-                        "Apparently we aren't compatible with the cluster on the other "
-                        "end.");
-
-                    /* If you really want to support old cluster versions, the
-                    resolved_version should be passed into the on_message() handler. */
-                    guarantee(resolved_version == cluster_version_t::CLUSTER);
-                    handler->on_message(
-                        &conn_structure,
-                        auto_drainer_t::lock_t(conn_structure.drainers.get()),
-                        conn); // might raise fake_archive_exc_t
-                }
+        // Large messages are sent with `MSG_ZEROCOPY` where the kernel supports it.
+        conn->get_underlying_conn()->enable_zerocopy();
+        for (keepalive_tcp_conn_stream_t *extra_conn : extra_conns) {
+            extra_conn->get_underlying_conn()->enable_zerocopy();
+        }
 
-                ++messages_handled_since_yield;
-                if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
-                    coro_t::yield();
-                    messages_handled_since_yield = 0;
+        connection_t conn_structure(this, other_id, conn, extra_conns,
+                                    *other_peer_addr.get(), compression);
+
+        /* If you really want to support old cluster versions, the
+        resolved_version should be passed into the on_message() handler. */
+        guarantee(resolved_version == cluster_version_t::CLUSTER);
+
+        /* Read messages off every stripe on its own thread. If any stripe goes down,
+        the whole connection goes down: closing the main stripe ends its loop, which
+        then closes the others. Shutting down closes the main stripe through
+        `conn_closer_2`. */
+        pmap(conn_structure.stripes.size(), [&](int i) {
+            keepalive_tcp_conn_stream_t *stripe_conn =
+                conn_structure.stripes[i]->conn;
+            {
+                on_thread_t thread_switcher(stripe_conn->home_thread());
+
+                /* `heartbeat_manager` will periodically send a heartbeat message
+                over the stripe, and it will also close the stripe if we don't
+                receive anything on it for a while. */
+                heartbeat_manager_t heartbeat_manager(
+                    &conn_structure, i,
+                    auto_drainer_t::lock_t(conn_structure.drainers.get()),
+                    peerstr);
+
+                receive_messages(&conn_structure, stripe_conn, compression);
+            }
+            if (i == 0) {
+                for (size_t j = 1; j < conn_structure.stripes.size(); ++j) {
+                    keepalive_tcp_conn_stream_t *extra_conn =
+                        conn_structure.stripes[j]->conn;
+                    on_thread_t thread_switcher(extra_conn->home_thread());
+                    if (extra_conn->is_read_open()) {
+                        extra_conn->shutdown_read();
+                    }
+                    if (extra_conn->is_write_open()) {
+                        extra_conn->shutdown_write();
+                    }
                 }
+            } else {
+                conn_structure.kill_connection();
             }
-        } catch (const fake_archive_exc_t &) {
-            /* The exception broke us out of the loop, and that's what we
-            wanted. This could either be because we lost contact with the peer
-            or because the cluster is shutting down and `close_conn()` got
-            called. */
-        }
-
-        if (conn->is_read_open()) {
-            logWRN("Received invalid data on a cluster connection. Disconnecting.");
-        }
+        });
 
         /* The `conn_structure` destructor removes us from the connection map. It also
         blocks until all references to `conn_structure` have been released (using its
@@ -1222,19 +1642,27 @@ connectivity_cluster_t::connection_t *connectivity_cluster_t::get_connection(
 void connectivity_cluster_t::send_message(connection_t *connection,
                                      auto_drainer_t::lock_t connection_keepalive,
                                      message_tag_t tag,
-                                     cluster_send_message_write_callback_t *callback) {
+                                     cluster_send_message_write_callback_t *callback,
+                                     uint64_t ordering_key) {
     // We could be on _any_ thread.
 
-    /* We currently write the message to a vector_stream_t, then
-       serialize that as a string. It's horribly inefficient, of course. */
+    /* We write the message to a buffer first, so that the writer doesn't have to run
+    on the connection thread. A message to ourself goes to a vector, which is what
+    `on_local_message()` takes. A message to another server goes to reference-counted
+    chunks, which the connection sends from without copying them again. */
     // TODO: If we don't do it this way, we (or the caller) will need
     // to worry about having the writer run on the connection thread.
-    vector_stream_t buffer;
-    // Reserve some space to reduce overhead (especially for small messages)
-    buffer.reserve(1024);
+    vector_stream_t local_buffer;
+    shared_buf_stream_t buffer;
     {
         ASSERT_FINITE_CORO_WAITING;
-        callback->write(&buffer);
+        if (connection->is_loopback()) {
+            // Reserve some space to reduce overhead (especially for small messages)
+            local_buffer.reserve(1024);
+            callback->write(&local_buffer);
+        } else {
+            callback->write(&buffer);
+        }
     }
 
 #ifdef CLUSTER_MESSAGE_DEBUGGING
@@ -1245,7 +1673,9 @@ void connectivity_cluster_t::send_message(connection_t *connection,
         buf.appendf(" to ");
         debug_print(&buf, dest);
         buf.appendf("\n");
-        print_hd(buffer.vector().data(), 0, buffer.vector().size());
+        for (const auto &chunk : buffer.chunks()) {
+            print_hd(chunk.buf->data(), 0, chunk.size);
+        }
     }
 #endif
 
@@ -1259,7 +1689,9 @@ void connectivity_cluster_t::send_message(connection_t *connection,
     }
 #endif
 
-    size_t bytes_sent = buffer.vector().size();
+    size_t bytes_sent = connection->is_loopback()
+        ? local_buffer.vector().size()
+        : buffer.size();
 
 #ifdef ENABLE_MESSAGE_PROFILER
     std::pair<uint64_t, uint64_t> *stats =
@@ -1271,19 +1703,39 @@ void connectivity_cluster_t::send_message(connection_t *connection,
     if (connection->is_loopback()) {
         // We could be on any thread here! Oh no!
         std::vector<char> buffer_data;
-        buffer.swap(&buffer_data);
+        local_buffer.swap(&buffer_data);
         rassert(message_handlers[tag], "No message handler for tag %" PRIu8, tag);
         message_handlers[tag]->on_local_message(connection, connection_keepalive,
             std::move(buffer_data));
     } else {
-        on_thread_t threader(connection->conn->home_thread());
+        connection_t::stripe_t *stripe =
+            connection->stripes[ordering_key % connection->stripes.size()].get();
+        on_thread_t threader(stripe->conn->home_thread());
 
         /* Acquire the send-mutex so we don't collide with other things trying
         to send on the same connection. */
         {
             /* The `true` is for eager waiting, which is a significant performance
             optimization in this case. */
-            mutex_t::acq_t acq(&connection->send_mutex, true);
+            mutex_t::acq_t acq(&stripe->send_mutex, true);
+
+            /* Compress the message if it's big enough. This has to happen while we
+            hold the `send_mutex`, because the other side decompresses messages in
+            the order they arrive. */
+            std::vector<char> compressed;
+            const bool compress = stripe->compressor.has()
+                && bytes_sent >= CLUSTER_COMPRESSION_MIN_MESSAGE_SIZE
+                && bytes_sent <= CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE;
+            if (compress) {
+                std::vector<const_charslice> pieces;
+                for (const auto &chunk : buffer.chunks()) {
+                    pieces.push_back(const_charslice(chunk.buf->data(),
+                                                     chunk.buf->data() + chunk.size));
+                }
+                stripe->compressor->compress(pieces, &compressed);
+                connection->pm_bytes_before_compression += bytes_sent;
+                connection->pm_bytes_after_compression += compressed.size();
+            }
 
             /* Write the tag to the network */
             {
@@ -1294,49 +1746,90 @@ void connectivity_cluster_t::send_message(connection_t *connection,
                               "changed, the cluster communication format has changed and "
                               "you need to ask yourself whether live cluster upgrades work."
                               );
-                serialize_universal(&wm, tag);
-                make_buffered_tcp_conn_stream_wrapper_t buffered_conn(connection->conn);
+                if (compress) {
+                    serialize_universal(&wm, compressed_tag);
+                    serialize_universal(&wm, tag);
+                    serialize_universal(&wm, static_cast<uint64_t>(bytes_sent));
+                    serialize_universal(&wm, static_cast<uint64_t>(compressed.size()));
+                } else {
+                    serialize_universal(&wm, tag);
+                }
+                make_buffered_tcp_conn_stream_wrapper_t buffered_conn(stripe->conn);
                 int res = send_write_message(&buffered_conn, &wm);
                 if (res == -1) {
                     /* Close the other half of the connection to make sure that
                        `connectivity_cluster_t::run_t::handle()` notices that something is
                        up */
-                    if (connection->conn->is_read_open()) {
-                        connection->conn->shutdown_read();
+                    if (stripe->conn->is_read_open()) {
+                        stripe->conn->shutdown_read();
                     }
                     return;
                 }
             }
 
             /* Write the message itself to the network */
-            {
-                int64_t res = connection->conn->write_buffered(buffer.vector().data(),
-                                                               buffer.vector().size());
+            if (compress) {
+                int64_t res = stripe->conn->write_buffered(compressed.data(),
+                                                           compressed.size());
                 if (res == -1) {
-                    if (connection->conn->is_read_open()) {
-                        connection->conn->shutdown_read();
+                    if (stripe->conn->is_read_open()) {
+                        stripe->conn->shutdown_read();
                     }
                     return;
                 } else {
-                    guarantee(res == static_cast<int64_t>(buffer.vector().size()));
+                    guarantee(res == static_cast<int64_t>(compressed.size()));
+                }
+            } else {
+                for (const auto &chunk : buffer.chunks()) {
+                    int64_t res = stripe->conn->write_shared_buffered(
+                        chunk.buf, 0, chunk.size);
+                    if (res == -1) {
+                        if (stripe->conn->is_read_open()) {
+                            stripe->conn->shutdown_read();
+                        }
+                        return;
+                    } else {
+                        guarantee(res == static_cast<int64_t>(chunk.size));
+                    }
                 }
             }
         } /* Releases the send_mutex */
 
-        connection->flusher.notify();
-        cond_t dummy_interruptor;
-        connection->flusher.flush(&dummy_interruptor);
-        if (!connection->conn->is_write_open()) {
-            if (connection->conn->is_read_open()) {
-                connection->conn->shutdown_read();
+        stripe->flusher.notify();
+        /* Small messages are coalesced: the flusher sends them along with whatever
+        else gets written before it runs. Large messages fill the buffer by
+        themselves, so their senders wait for the flush, which also gives them
+        backpressure. */
+        if (bytes_sent >= CLUSTER_COALESCE_MAX_MESSAGE_SIZE) {
+            cond_t dummy_interruptor;
+            stripe->flusher.flush(&dummy_interruptor);
+            if (!stripe->conn->is_write_open()) {
+                if (stripe->conn->is_read_open()) {
+                    stripe->conn->shutdown_read();
+                }
+                return;
             }
-            return;
         }
     }
 
     connection->pm_bytes_sent.record(bytes_sent);
 }
 
+void connectivity_cluster_t::flush_messages(
+        connection_t *connection,
+        UNUSED auto_drainer_t::lock_t connection_keepalive) {
+#ifndef NDEBUG
+    connection_keepalive.assert_is_holding(connection->drainers.get());
+#endif
+    pmap(connection->stripes.size(), [&](int64_t i) {
+        connection_t::stripe_t *stripe = connection->stripes[i].get();
+        on_thread_t threader(stripe->conn->home_thread());
+        stripe->flusher.notify();
+        cond_t dummy_interruptor;
+        stripe->flusher.flush(&dummy_interruptor);
+    });
+}
+
 cluster_message_handler_t::cluster_message_handler_t(
         connectivity_cluster_t *cm,
         connectivity_cluster_t::message_tag_t t) :
@@ -1346,6 +1839,9 @@ cluster_message_handler_t::cluster_message_handler_t(
     rassert(tag != connectivity_cluster_t::heartbeat_tag,
         "Tag %" PRIu8 " is reserved for heartbeat messages.",
         connectivity_cluster_t::heartbeat_tag);
+    rassert(tag != connectivity_cluster_t::compressed_tag,
+        "Tag %" PRIu8 " is reserved for compressed messages.",
+        connectivity_cluster_t::compressed_tag);
     rassert(connectivity_cluster->message_handlers[tag] == NULL);
     connectivity_cluster->message_handlers[tag] = this;
 }
@@ -15,8 +15,10 @@
 #include "concurrency/watchable_map.hpp"
 #include "containers/archive/tcp_conn_stream.hpp"
 #include "containers/map_sentries.hpp"
+#include "containers/scoped.hpp"
 #include "concurrency/pump_coro.hpp"
 #include "perfmon/perfmon.hpp"
+#include "rpc/connectivity/compression.hpp"
 #include "rpc/connectivity/peer_id.hpp"
 #include "utils.hpp"
 
@@ -67,9 +69,28 @@ connection. Once a connection is established, messages can be sent across it in
 directions. Every message is guaranteed to eventually arrive unless the connection goes
 down. Messages cannot be duplicated.
 
-Can messages be reordered? I think the current implementation doesn't ever reorder
-messages, but don't rely on this guarantee. However, some old code may rely on this
-guarantee (I'm not sure) so don't break this property without checking first. */
+A connection may be carried by more than one TCP connection (see the
+`connections_per_peer` parameter of `run_t`), which we call "stripes". Messages sent
+with the same `ordering_key` go over the same stripe, so they are never reordered
+relative to each other. Messages sent with different ordering keys may be reordered.
+Most messages use the default key of zero, so they stay on the main stripe and keep
+their order; the mailbox manager uses the mailbox ID as the key.
+
+This means that messages to different mailboxes on the same peer can overtake each
+other, which they couldn't over a single TCP connection. `send()` never promised that
+order, and the mailbox users don't depend on it:
+ - `primary_query_client_t`, the backfiller and backfillee, and `minidir_t` put a
+   `fifo_enforcer_t` token in every message that spans more than one mailbox.
+ - `remote_replicator_client_t` orders its writes by timestamp.
+ - `registrar_t` handles a deregistration that arrives before the registration.
+ - The table managers compare timestamps, because they already had to cope with
+   messages from different peers arriving in any order.
+ - Each Raft member has a single RPC mailbox.
+ - Changefeed messages are stamped, and each feed only has one mailbox per server.
+ - The rest (stats, logs, jobs, issues, server config) send a request to one mailbox
+   and wait for the reply.
+The directory doesn't go through the mailbox manager and uses the default key, so its
+messages keep their order. */
 
 class connectivity_cluster_t :
     public home_thread_mixin_debug_only_t
@@ -91,6 +112,13 @@ public:
     /* This tag is reserved exclusively for heartbeat messages. */
     static const message_tag_t heartbeat_tag = 'H';
 
+    /* This tag is reserved for compressed messages. It is followed by the message's
+    real tag, its uncompressed and compressed sizes, and the compressed message. */
+    static const message_tag_t compressed_tag = 'Z';
+
+    /* The largest number of TCP connections that we open to a single peer. */
+    static const int max_connections_per_peer = 16;
+
     class run_t;
 
     /* `connection_t` represents an open connection to another server. If we lose
@@ -128,10 +156,43 @@ public:
     private:
         friend class connectivity_cluster_t;
 
+        /* `stripe_t` is one of the TCP connections that carry a `connection_t`. Each
+        stripe lives on the thread of its TCP connection and must only be used there.
+        */
+        class stripe_t : public home_thread_mixin_debug_only_t {
+        public:
+            /* If `rethread` is true, the constructor moves `conn` from
+            `INVALID_THREAD` to the current thread and the destructor moves it back. */
+            stripe_t(keepalive_tcp_conn_stream_t *conn, bool rethread,
+                     cluster_compression_t compression);
+
+            keepalive_tcp_conn_stream_t *conn;
+            scoped_ptr_t<rethread_tcp_conn_stream_t> rethreader;
+
+            mutex_t send_mutex;
+
+            /* NULL unless the connection is compressed. Messages smaller than
+            `CLUSTER_COMPRESSION_MIN_MESSAGE_SIZE` are always sent uncompressed.
+            `compressor` is protected by `send_mutex`, since compressed messages must
+            go out in the order they went through the compressor. */
+            scoped_ptr_t<cluster_compressor_t> compressor;
+
+            /* Calls `conn->flush_buffer()`. Can be used for making sure that a
+            buffered write makes it to the TCP stack. */
+            pump_coro_t flusher;
+
+        private:
+            DISABLE_COPYING(stripe_t);
+        };
+
         /* The constructor registers us in every thread's `connections` map, thereby
-        notifying event subscribers. */
+        notifying event subscribers. `extra_conns` must have been moved to
+        `INVALID_THREAD`; the i'th one is moved to the i'th thread after the thread
+        of the main connection `conn`. */
         connection_t(run_t *, peer_id_t, keepalive_tcp_conn_stream_t *,
-                const peer_address_t &peer) THROWS_NOTHING;
+                const std::vector<keepalive_tcp_conn_stream_t *> &extra_conns,
+                const peer_address_t &peer,
+                cluster_compression_t compression) THROWS_NOTHING;
         ~connection_t() THROWS_NOTHING;
 
         /* NULL for the loopback connection (i.e. our "connection" to ourself) */
@@ -142,16 +203,18 @@ public:
         cross-thread to access the routing table. */
         peer_address_t peer_address;
 
-        /* Unused for our connection to ourself */
-        mutex_t send_mutex;
-
-        /* Calls `conn->flush_buffer()`. Can be used for making sure that a
-        buffered write makes it to the TCP stack. */
-        pump_coro_t flusher;
+        /* Empty for our connection to ourself. Otherwise `stripes[0]` is the stripe of
+        `conn` and the rest are the extra connections. Each stripe carries its own
+        heartbeats. */
+        std::vector<scoped_ptr_t<stripe_t> > stripes;
 
         perfmon_collection_t pm_collection;
         perfmon_sampler_t pm_bytes_sent;
+        /* The sizes of the compressed messages before and after compression, from
+        which the compression ratio for this peer can be computed. */
+        perfmon_counter_t pm_bytes_before_compression, pm_bytes_after_compression;
         perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
+        perfmon_multi_membership_t pm_compression_membership;
 
         /* We only hold this information so we can deregister ourself */
         run_t *parent;
@@ -171,7 +234,8 @@ public:
         run_t(connectivity_cluster_t *parent,
               const std::set<ip_address_t> &local_addresses,
               const peer_address_t &canonical_addresses,
-              int port, int client_port)
+              int port, int client_port, int connections_per_peer = 1,
+              cluster_compression_t compression = cluster_compression_t::ZLIB)
             THROWS_ONLY(address_in_use_exc_t, tcp_socket_exc_t);
 
         ~run_t();
@@ -208,6 +272,8 @@ public:
             DISABLE_COPYING(variable_setter_t);
         };
 
+        class incoming_stripes_t;
+
         void on_new_connection(const scoped_ptr_t<tcp_conn_descriptor_t> &nconn,
                 auto_drainer_t::lock_t lock) THROWS_NOTHING;
 
@@ -245,6 +311,22 @@ public:
             auto_drainer_t::lock_t,
             bool *successful_join) THROWS_NOTHING;
 
+        /* Opens the extra connections of a connection that we initiated. Returns
+        `false` if any of them couldn't be established. */
+        bool connect_extra_connections(const ip_and_port_t &peer_addr,
+                                       const peer_id_t &other_id,
+                                       const uuid_u &session_id,
+                                       size_t num_connections,
+                                       signal_t *interruptor,
+                                       std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> >
+                                           *conns_out) THROWS_NOTHING;
+
+        /* Reads messages off one stripe of `connection` and hands them to the message
+        handlers until the stripe is closed. */
+        void receive_messages(connection_t *connection,
+                              keepalive_tcp_conn_stream_t *conn,
+                              cluster_compression_t compression) THROWS_NOTHING;
+
         connectivity_cluster_t *parent;
 
         /* `attempt_table` is a table of all the host:port pairs we're currently
@@ -270,6 +352,18 @@ public:
         int cluster_listener_port;
         int cluster_client_port;
 
+        /* The number of TCP connections we want to use for each peer. The two sides
+        of a connection use the smaller of their numbers. */
+        size_t connections_per_peer;
+
+        /* The compression scheme we offer to other servers during the handshake. */
+        cluster_compression_t offered_compression;
+
+        /* Connections that other servers opened to us and that are waiting for their
+        extra connections, by the session ID that the other server sent in the
+        handshake. */
+        std::map<uuid_u, incoming_stripes_t *> incoming_stripes;
+
         variable_setter_t register_us_with_parent;
 
         map_insertion_sentry_t<peer_id_t, peer_address_t> routing_table_entry_for_ourself;
@@ -302,11 +396,20 @@ public:
 
     /* Sends a message to the other server. The message is associated with a "tag",
     which determines which message handler on the other server will receive the message.
-    */
+    Messages with the same `ordering_key` are sent over the same stripe of the
+    connection, so they arrive in the order they were sent. */
     void send_message(connection_t *connection,
                       auto_drainer_t::lock_t connection_keepalive,
                       message_tag_t tag,
-                      cluster_send_message_write_callback_t *callback);
+                      cluster_send_message_write_callback_t *callback,
+                      uint64_t ordering_key = 0);
+
+    /* `send_message()` doesn't wait for small messages to reach the TCP stack, so that
+    many of them can go out in one write. `flush_messages()` blocks until every
+    message sent over `connection` so far has been handed to the TCP stack. It does
+    nothing for the loopback connection. */
+    void flush_messages(connection_t *connection,
+                        auto_drainer_t::lock_t connection_keepalive);
 
 private:
     friend class cluster_message_handler_t;
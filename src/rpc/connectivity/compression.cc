@@ -0,0 +1,90 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rpc/connectivity/compression.hpp"
+
+#include <string.h>
+
+cluster_compressor_t::cluster_compressor_t() {
+    memset(&stream, 0, sizeof(stream));
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    // Cluster traffic is latency sensitive, so we trade ratio for speed.
+    int res = deflateInit(&stream, Z_BEST_SPEED);
+    guarantee(res == Z_OK, "deflateInit failed: %d", res);
+}
+
+cluster_compressor_t::~cluster_compressor_t() {
+    deflateEnd(&stream);
+}
+
+void cluster_compressor_t::compress(const std::vector<const_charslice> &pieces,
+                                    std::vector<char> *out) {
+    size_t total_size = 0;
+    for (const const_charslice &piece : pieces) {
+        total_size += piece.end - piece.beg;
+    }
+    /* `deflateBound()` doesn't account for the marker that `Z_SYNC_FLUSH` emits,
+    so we may have to grow the buffer. `deflate()` is done with a piece once it has
+    consumed all of it and returned with space left in the output buffer. */
+    out->resize(deflateBound(&stream, total_size) + 16);
+    size_t produced = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const int flush = i + 1 == pieces.size() ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(pieces[i].beg));
+        stream.avail_in = pieces[i].end - pieces[i].beg;
+        do {
+            if (produced == out->size()) {
+                out->resize(out->size() * 2);
+            }
+            stream.next_out = reinterpret_cast<Bytef *>(out->data() + produced);
+            stream.avail_out = out->size() - produced;
+            int res = deflate(&stream, flush);
+            guarantee(res == Z_OK || res == Z_BUF_ERROR, "deflate failed: %d", res);
+            produced = out->size() - stream.avail_out;
+        } while (stream.avail_in != 0 || stream.avail_out == 0);
+    }
+    out->resize(produced);
+}
+
+size_t cluster_compressed_size_bound(size_t raw_size) {
+    /* `compressBound()` covers a single `deflate()` call on the whole input. Each
+    `Z_SYNC_FLUSH` adds up to a few bytes for the empty stored block it emits and
+    the end of the pending block, which the fixed slack more than covers. */
+    return compressBound(raw_size) + 64;
+}
+
+cluster_decompressor_t::cluster_decompressor_t() {
+    memset(&stream, 0, sizeof(stream));
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    int res = inflateInit(&stream);
+    guarantee(res == Z_OK, "inflateInit failed: %d", res);
+}
+
+cluster_decompressor_t::~cluster_decompressor_t() {
+    inflateEnd(&stream);
+}
+
+bool cluster_decompressor_t::decompress(const char *data, size_t size,
+                                        size_t raw_size, std::vector<char> *out) {
+    /* We leave one byte of slack in the output buffer so that `inflate()` also
+    consumes the empty block that ends every flushed message, and so that we notice
+    if the message decompresses to more than `raw_size` bytes. */
+    out->resize(raw_size + 1);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = size;
+    stream.next_out = reinterpret_cast<Bytef *>(out->data());
+    stream.avail_out = out->size();
+    int res = inflate(&stream, Z_SYNC_FLUSH);
+    if (res != Z_OK) {
+        return false;
+    }
+    if (stream.avail_in != 0 || stream.avail_out != 1) {
+        return false;
+    }
+    out->resize(raw_size);
+    return true;
+}
@@ -0,0 +1,64 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RPC_CONNECTIVITY_COMPRESSION_HPP_
+#define RPC_CONNECTIVITY_COMPRESSION_HPP_
+
+#include <stdint.h>
+#include <zlib.h>
+
+#include <vector>
+
+#include "errors.hpp"
+#include "utils.hpp"
+
+/* The compression schemes that a cluster connection can use. Each side of a
+connection sends the scheme it wants during the handshake; the connection is
+compressed only if both sides sent the same scheme. You may add new schemes here, but
+don't change the values of the existing ones, because they go over the wire. */
+enum class cluster_compression_t : uint8_t {
+    NONE = 0,
+    ZLIB = 1
+};
+
+/* `cluster_compressor_t` and `cluster_decompressor_t` are the two ends of a zlib
+stream that runs for the lifetime of a connection. Every call to `compress()` flushes
+the stream, so the other end can decompress each message as soon as it arrives, but
+messages still share the compression window, which is what makes compressing the
+many small and similar messages on a cluster connection worthwhile. Because of that,
+messages must be decompressed in the same order they were compressed. */
+class cluster_compressor_t {
+public:
+    cluster_compressor_t();
+    ~cluster_compressor_t();
+
+    /* Replaces the contents of `out` with the compressed form of the concatenation
+    of `pieces`. */
+    void compress(const std::vector<const_charslice> &pieces, std::vector<char> *out);
+
+private:
+    z_stream stream;
+
+    DISABLE_COPYING(cluster_compressor_t);
+};
+
+/* An upper bound on the size that `cluster_compressor_t::compress()` produces for
+`raw_size` bytes of input, no matter how the input was split into pieces. */
+size_t cluster_compressed_size_bound(size_t raw_size);
+
+class cluster_decompressor_t {
+public:
+    cluster_decompressor_t();
+    ~cluster_decompressor_t();
+
+    /* Replaces the contents of `out` with the decompressed form of `data`. Returns
+    `false` if `data` is corrupt or doesn't decompress to exactly `raw_size`
+    bytes, after which the stream can't be used anymore. */
+    MUST_USE bool decompress(const char *data, size_t size, size_t raw_size,
+                             std::vector<char> *out);
+
+private:
+    z_stream stream;
+
+    DISABLE_COPYING(cluster_decompressor_t);
+};
+
+#endif  // RPC_CONNECTIVITY_COMPRESSION_HPP_
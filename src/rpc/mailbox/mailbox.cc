@@ -125,8 +125,21 @@ void send(mailbox_manager_t *src, raw_mailbox_t::address_t dest,
         return;
     }
     raw_mailbox_writer_t writer(dest.thread, dest.mailbox_id, callback);
+    /* Using the mailbox ID as the ordering key keeps the messages to one mailbox in
+    order, while spreading the mailboxes over all of the connection's stripes. */
     src->get_connectivity_cluster()->send_message(connection, connection_keepalive,
-        src->get_message_tag(), &writer);
+        src->get_message_tag(), &writer, dest.mailbox_id);
+}
+
+void flush_sent_messages(mailbox_manager_t *src, const peer_id_t &peer) {
+    guarantee(src);
+    connectivity_cluster_t::connection_t *connection;
+    auto_drainer_t::lock_t connection_keepalive;
+    if (!(connection = src->get_connectivity_cluster()->get_connection(
+            peer, &connection_keepalive))) {
+        return;
+    }
+    src->get_connectivity_cluster()->flush_messages(connection, connection_keepalive);
 }
 
 static const int MAX_OUTSTANDING_MAILBOX_WRITES_PER_THREAD = 4;
@@ -137,6 +150,9 @@ mailbox_manager_t::mailbox_manager_t(connectivity_cluster_t *connectivity_cluste
     semaphores(MAX_OUTSTANDING_MAILBOX_WRITES_PER_THREAD)
     { }
 
+mailbox_manager_t::incoming_queues_t::incoming_queues_t() :
+    by_dest_thread(get_num_threads()) { }
+
 mailbox_manager_t::mailbox_table_t::mailbox_table_t() {
     next_mailbox_id = (UINT64_MAX / get_num_threads()) * get_thread_id().threadnum;
 }
@@ -181,7 +197,11 @@ void read_mailbox_header(read_stream_t *stream,
     }
     header_out->data_length = data_length;
     res = deserialize_universal(stream, &header_out->dest_thread);
-    if (bad(res)) { throw fake_archive_exc_t(); }
+    if (bad(res)
+        || header_out->dest_thread < 0
+        || header_out->dest_thread >= get_num_threads()) {
+        throw fake_archive_exc_t();
+    }
     res = deserialize_universal(stream, &header_out->dest_mailbox_id);
     if (bad(res)) { throw fake_archive_exc_t(); }
 }
@@ -233,16 +253,48 @@ void mailbox_manager_t::on_message(connectivity_cluster_t::connection_t *connect
         throw fake_archive_exc_t();
     }
 
-    // We use `spawn_now_dangerously()` to avoid having to heap-allocate `stream_data`.
-    // Instead we pass in a pointer to our local automatically allocated object
-    // and `mailbox_read_coroutine()` moves the data out of it before it yields.
-    coro_t::spawn_now_dangerously(
-        [this, connection, connection_keepalive /* important to capture */,
-                mbox_header, &stream_data]() {
-            mailbox_read_coroutine(connection, connection_keepalive,
-                threadnum_t(mbox_header.dest_thread), mbox_header.dest_mailbox_id,
-                &stream_data, 0, MAYBE_YIELD);
+    std::vector<incoming_message_t> *queue =
+        &incoming_queues.get()->by_dest_thread[mbox_header.dest_thread];
+    queue->push_back(incoming_message_t{
+        connection, connection_keepalive, mbox_header.dest_mailbox_id,
+        std::move(stream_data)});
+    if (queue->size() == 1) {
+        /* The connection's read loop only yields when it runs out of data to read or
+        after a batch of messages, so every message that it reads until then for the
+        same thread goes into the queue and is delivered along with this one. */
+        threadnum_t dest_thread(mbox_header.dest_thread);
+        coro_t::spawn_later_ordered([this, dest_thread]() {
+            deliver_incoming_messages(dest_thread);
         });
+    }
+}
+
+void mailbox_manager_t::deliver_incoming_messages(threadnum_t dest_thread) {
+    std::vector<incoming_message_t> messages;
+    messages.swap(incoming_queues.get()->by_dest_thread[dest_thread.threadnum]);
+    guarantee(!messages.empty());
+
+    std::vector<bool> archive_exceptions(messages.size(), false);
+    {
+        on_thread_t rethreader(dest_thread);
+        /* Mailbox callbacks may block, so each message still gets a coroutine of its
+        own on the destination thread. `pmap()` starts them in order. */
+        pmap(messages.size(), [&](int64_t i) {
+            vector_read_stream_t stream(std::move(messages[i].data));
+            if (!deliver_to_mailbox(messages[i].dest_mailbox_id, &stream)) {
+                archive_exceptions[i] = true;
+            }
+        });
+    }
+
+    /* The connection keepalives are released when `messages` is destroyed, back on
+    the thread they were acquired on. */
+    for (size_t i = 0; i < messages.size(); ++i) {
+        if (archive_exceptions[i]) {
+            logWRN("Received an invalid cluster message from a peer. Disconnecting.");
+            messages[i].connection->kill_connection();
+        }
+    }
 }
 
 void mailbox_manager_t::mailbox_read_coroutine(
@@ -269,24 +321,7 @@ void mailbox_manager_t::mailbox_read_coroutine(
             coro_t::yield();
         }
 
-        try {
-            raw_mailbox_t *mbox = mailbox_tables.get()->find_mailbox(dest_mailbox_id);
-            if (mbox != NULL) {
-                try {
-                    auto_drainer_t::lock_t keepalive(&mbox->drainer);
-                    mbox->callback->read(&stream, keepalive.get_drain_signal());
-                } catch (const interrupted_exc_t &) {
-                    /* Do nothing. It's no longer safe to access `mbox` (because the
-                    destructor is running) but otherwise we don't need to take any
-                    special action. */
-                }
-            }
-        } catch (const fake_archive_exc_t &e) {
-            // Set a flag and handle the exception later.
-            // This is to avoid doing thread switches and other coroutine things
-            // while being in the exception handler. Just a precaution...
-            archive_exception = true;
-        }
+        archive_exception = !deliver_to_mailbox(dest_mailbox_id, &stream);
     }
     if (archive_exception) {
         logWRN("Received an invalid cluster message from a peer. Disconnecting.");
@@ -294,6 +329,29 @@ void mailbox_manager_t::mailbox_read_coroutine(
     }
 }
 
+bool mailbox_manager_t::deliver_to_mailbox(raw_mailbox_t::id_t dest_mailbox_id,
+                                           read_stream_t *stream) {
+    try {
+        raw_mailbox_t *mbox = mailbox_tables.get()->find_mailbox(dest_mailbox_id);
+        if (mbox != NULL) {
+            try {
+                auto_drainer_t::lock_t keepalive(&mbox->drainer);
+                mbox->callback->read(stream, keepalive.get_drain_signal());
+            } catch (const interrupted_exc_t &) {
+                /* Do nothing. It's no longer safe to access `mbox` (because the
+                destructor is running) but otherwise we don't need to take any
+                special action. */
+            }
+        }
+    } catch (const fake_archive_exc_t &e) {
+        // Return a flag and handle the exception later.
+        // This is to avoid doing thread switches and other coroutine things
+        // while being in the exception handler. Just a precaution...
+        return false;
+    }
+    return true;
+}
+
 raw_mailbox_t::id_t mailbox_manager_t::generate_mailbox_id() {
     raw_mailbox_t::id_t id = ++mailbox_tables.get()->next_mailbox_id;
     return id;
@@ -133,6 +133,13 @@ void send(mailbox_manager_t *src,
           raw_mailbox_t::address_t dest,
           mailbox_write_callback_t *callback);
 
+/* `send()` doesn't wait for small messages to reach the network; they go out together
+with whatever else is sent to the same peer shortly afterwards. Callers that are about
+to block on a reply should call `flush_sent_messages()` first, so that their request
+doesn't sit in the send buffer while they wait. */
+
+void flush_sent_messages(mailbox_manager_t *src, const peer_id_t &peer);
+
 /* `mailbox_manager_t` is a `cluster_message_handler_t` that takes care
 of actually routing messages to mailboxes. */
 
@@ -170,9 +177,29 @@ private:
                                       raw_mailbox_t::id_t dest_mailbox_id,
                                       mailbox_write_callback_t *callback);
 
+    /* A message that arrived over the network and is waiting to be delivered. */
+    struct incoming_message_t {
+        connectivity_cluster_t::connection_t *connection;
+        /* This ensures that the `connection` pointer remains valid. It belongs to the
+        thread that the message arrived on. */
+        auto_drainer_t::lock_t connection_keepalive;
+        raw_mailbox_t::id_t dest_mailbox_id;
+        std::vector<char> data;
+    };
+
+    /* `on_message()` doesn't deliver messages right away. Instead it queues them by
+    destination thread, and `deliver_incoming_messages()` carries all the messages
+    queued for one thread there in a single thread switch. */
+    struct incoming_queues_t {
+        incoming_queues_t();
+        std::vector<std::vector<incoming_message_t> > by_dest_thread;
+    };
+    one_per_thread_t<incoming_queues_t> incoming_queues;
+
     void on_message(connectivity_cluster_t::connection_t *connection,
                     auto_drainer_t::lock_t connection_keeepalive,
                     read_stream_t *stream);
+    void deliver_incoming_messages(threadnum_t dest_thread);
     void on_local_message(connectivity_cluster_t::connection_t *connection,
                           auto_drainer_t::lock_t connection_keepalive,
                           std::vector<char> &&data);
@@ -185,6 +212,11 @@ private:
                                 std::vector<char> *stream_data,
                                 int64_t stream_data_offset,
                                 force_yield_t force_yield);
+
+    /* Hands a message to a mailbox on the current thread. Returns `false` if the
+    message was invalid. */
+    MUST_USE bool deliver_to_mailbox(raw_mailbox_t::id_t dest_mailbox_id,
+                                     read_stream_t *stream);
 };
 
 /* Note: disconnect_watcher_t keeps the connection alive for as long as it
@@ -4,3 +4,4 @@
 #include "clustering/administration/metadata.hpp"
 template class semilattice_manager_t<cluster_semilattice_metadata_t>;
 template class semilattice_manager_t<auth_semilattice_metadata_t>;
+template class semilattice_manager_t<backfill_semilattice_metadata_t>;
@@ -6,16 +6,57 @@
 #include "errors.hpp"
 
 #include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
 #include "concurrency/new_mutex.hpp"
 #include "config/args.hpp"
 #include "serializer/types.hpp"
 
 
+merger_serializer_stats_t::merger_serializer_stats_t(perfmon_collection_t *parent)
+    : merger_collection(),
+      pm_group_size(secs_to_ticks(1), false),
+      pm_groups_1(),
+      pm_groups_2_3(),
+      pm_groups_4_7(),
+      pm_groups_8_15(),
+      pm_groups_16_plus(),
+      parent_collection_membership(parent, &merger_collection, "merger"),
+      stats_membership(&merger_collection,
+          &pm_group_size, "group_commit_size",
+          &pm_groups_1, "group_commits_1",
+          &pm_groups_2_3, "group_commits_2_3",
+          &pm_groups_4_7, "group_commits_4_7",
+          &pm_groups_8_15, "group_commits_8_15",
+          &pm_groups_16_plus, "group_commits_16_plus")
+{ }
+
+void merger_serializer_stats_t::record_group(size_t group_size) {
+    pm_group_size.record(group_size);
+    if (group_size <= 1) {
+        ++pm_groups_1;
+    } else if (group_size <= 3) {
+        ++pm_groups_2_3;
+    } else if (group_size <= 7) {
+        ++pm_groups_4_7;
+    } else if (group_size <= 15) {
+        ++pm_groups_8_15;
+    } else {
+        ++pm_groups_16_plus;
+    }
+}
+
 merger_serializer_t::merger_serializer_t(scoped_ptr_t<serializer_t> _inner,
-                                         int _max_active_writes) :
+                                         int _max_active_writes,
+                                         perfmon_collection_t *perfmon_parent,
+                                         int64_t _group_commit_window_ms) :
     inner(std::move(_inner)),
+    max_active_writes(_max_active_writes),
+    group_commit_window_ms(_group_commit_window_ms),
     block_writes_io_account(make_io_account(MERGER_BLOCK_WRITE_IO_PRIORITY)),
-    write_committer(std::bind(&merger_serializer_t::do_index_write, this),
+    outstanding_index_write_count(0),
+    last_group_size(0),
+    stats(perfmon_parent),
+    write_committer(std::bind(&merger_serializer_t::do_index_write, this, ph::_1),
                     _max_active_writes) { }
 
 merger_serializer_t::~merger_serializer_t() {
@@ -32,6 +73,7 @@ void merger_serializer_t::index_write(new_mutex_in_line_t *mutex_acq,
     for (auto op = write_ops.begin(); op != write_ops.end(); ++op) {
         push_index_write_op(*op);
     }
+    ++outstanding_index_write_count;
 
     // The caller is definitely "in line" for this merger serializer -- subsequent
     // index_write calls will get logically committed after ours.
@@ -43,9 +85,26 @@ void merger_serializer_t::index_write(new_mutex_in_line_t *mutex_acq,
     write_committer.flush(&non_interruptor);
 }
 
-void merger_serializer_t::do_index_write() {
+void merger_serializer_t::do_index_write(signal_t *interruptor) {
     assert_thread();
 
+    if (max_active_writes == 1) {
+        // Give the transactions that are about to call `index_write()` a chance to
+        // join this group. Only wait for the full window if there were concurrent
+        // transactions the last time, so that a lone writer doesn't pay for it.
+        coro_t::yield();
+        if (last_group_size > 1 && group_commit_window_ms > 0) {
+            try {
+                nap(group_commit_window_ms, interruptor);
+            } catch (const interrupted_exc_t &) {
+                // We're shutting down. Write what we have.
+            }
+        }
+        // The callers that joined the group while we were waiting are taken care of
+        // by this run of the callback.
+        write_committer.include_latest_notifications();
+    }
+
     // Assemble the currently outstanding index writes into
     // a vector of index_write_op_t-s.
     std::vector<index_write_op_t> write_ops;
@@ -58,6 +117,11 @@ void merger_serializer_t::do_index_write() {
             write_ops.push_back(op_pair->second);
         }
         outstanding_index_write_ops.clear();
+        last_group_size = outstanding_index_write_count;
+        outstanding_index_write_count = 0;
+    }
+    if (last_group_size > 0) {
+        stats.record_group(last_group_size);
     }
 
     new_mutex_in_line_t mutex_acq(&inner_index_write_mutex);
@@ -9,7 +9,9 @@
 #include "buffer_cache/types.hpp"
 #include "concurrency/new_mutex.hpp"
 #include "concurrency/pump_coro.hpp"
+#include "config/args.hpp"
 #include "containers/scoped.hpp"
+#include "perfmon/perfmon.hpp"
 #include "serializer/buf_ptr.hpp"
 #include "serializer/serializer.hpp"
 
@@ -26,11 +28,43 @@
  * for all block_writes, so reduce the amount of random disk seeks that can
  * occur when writes from multiple different accounts get interleaved (see
  * https://github.com/rethinkdb/rethinkdb/issues/3348 )
+ *
+ * Every index_write ends in a metablock write and an fdatasync, which becomes
+ * the bottleneck when many small transactions with hard durability run at the
+ * same time. So merger_serializer_t also does group commit: before it hands a
+ * group of merged index writes to the inner serializer, it lets the index writes
+ * that are already runnable join the group. If the previous group consisted of
+ * more than one transaction, it additionally waits for up to
+ * `group_commit_window_ms` for more transactions to join. A lone writer never
+ * waits for the window. This only works if `max_active_writes` is 1.
  */
 
+/* Statistics about the groups of index writes that `merger_serializer_t` commits
+together. `group_size` samples the number of transactions per group, the counters
+form a histogram of the group sizes. */
+struct merger_serializer_stats_t {
+    explicit merger_serializer_stats_t(perfmon_collection_t *parent);
+
+    void record_group(size_t group_size);
+
+    perfmon_collection_t merger_collection;
+    perfmon_sampler_t pm_group_size;
+    perfmon_counter_t pm_groups_1;
+    perfmon_counter_t pm_groups_2_3;
+    perfmon_counter_t pm_groups_4_7;
+    perfmon_counter_t pm_groups_8_15;
+    perfmon_counter_t pm_groups_16_plus;
+    perfmon_membership_t parent_collection_membership;
+    perfmon_multi_membership_t stats_membership;
+};
+
 class merger_serializer_t : public serializer_t {
 public:
-    merger_serializer_t(scoped_ptr_t<serializer_t> _inner, int _max_active_writes);
+    merger_serializer_t(scoped_ptr_t<serializer_t> _inner,
+                        int _max_active_writes,
+                        perfmon_collection_t *perfmon_parent,
+                        int64_t _group_commit_window_ms =
+                            MERGER_SERIALIZER_GROUP_COMMIT_WINDOW_MS);
     ~merger_serializer_t();
 
 
@@ -122,9 +156,11 @@ private:
     void merge_index_write_op(const index_write_op_t &to_be_merged,
                               index_write_op_t *into_out) const;
 
-    void do_index_write();
+    void do_index_write(signal_t *interruptor);
 
     const scoped_ptr_t<serializer_t> inner;
+    const int max_active_writes;
+    const int64_t group_commit_window_ms;
     const scoped_ptr_t<file_account_t> block_writes_io_account;
 
     // Used to obey the index_write API and make sure we can't possibly make
@@ -134,6 +170,14 @@ private:
     // A map of outstanding index write operations, indexed by block id
     std::map<block_id_t, index_write_op_t> outstanding_index_write_ops;
 
+    // The number of `index_write()` calls whose ops are in
+    // `outstanding_index_write_ops`, and the number of calls that the last group
+    // consisted of.
+    size_t outstanding_index_write_count;
+    size_t last_group_size;
+
+    merger_serializer_stats_t stats;
+
     pump_coro_t write_committer;
 
     DISABLE_COPYING(merger_serializer_t);
@@ -0,0 +1,359 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "serializer/write_ahead_log.hpp"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <boost/crc.hpp>
+
+#include "arch/arch.hpp"
+#include "arch/io/disk.hpp"
+#include "config/args.hpp"
+#include "logger.hpp"
+#include "math.hpp"
+
+/* The first `DEVICE_BLOCK_SIZE` bytes of each segment are taken up by a header. */
+static const char WRITE_AHEAD_LOG_MAGIC[8] = { 'r', 'd', 'b', '_', 'w', 'a', 'l', '1' };
+
+struct write_ahead_log_header_t {
+    char magic[sizeof(WRITE_AHEAD_LOG_MAGIC)];
+    uint64_t sequence;
+};
+
+/* Every record is preceded by a `write_ahead_log_record_header_t`. Records that don't
+carry the sequence number of their segment are left over from before the segment was
+last initialized, so they mark the end of the log just like a checksum mismatch. */
+struct write_ahead_log_record_header_t {
+    uint64_t sequence;
+    uint32_t size;
+    uint32_t crc;
+};
+
+static_assert(sizeof(write_ahead_log_header_t) <= DEVICE_BLOCK_SIZE,
+              "write_ahead_log_header_t doesn't fit into the first block");
+static_assert(sizeof(write_ahead_log_record_header_t) == 16,
+              "write_ahead_log_record_header_t has unexpected padding");
+
+static uint32_t compute_record_crc(uint64_t sequence, const char *data, uint32_t size) {
+    boost::crc_32_type crc_computer;
+    crc_computer.process_bytes(&sequence, sizeof(sequence));
+    crc_computer.process_bytes(&size, sizeof(size));
+    crc_computer.process_bytes(data, size);
+    return crc_computer.checksum();
+}
+
+/* Record headers never straddle a block boundary, so that the reader can tell padding
+from the start of a record. Returns where the header of a record that follows `offset`
+goes. */
+static int64_t record_header_offset(int64_t offset) {
+    if (DEVICE_BLOCK_SIZE - offset % DEVICE_BLOCK_SIZE
+            < static_cast<int64_t>(sizeof(write_ahead_log_record_header_t))) {
+        return ceil_aligned(offset, DEVICE_BLOCK_SIZE);
+    }
+    return offset;
+}
+
+/* Reads the records of a segment with the sequence number `sequence` from `size`
+bytes of the segment file, which are in `buffer`. The records start at `start` in the
+buffer. By default the buffer holds the whole segment, including its header; otherwise
+it must begin at the start of a flush, which is block-aligned. Returns the end of the
+last flush that made it to disk, relative to the buffer. */
+static int64_t parse_records(const char *buffer,
+                             int64_t size,
+                             uint64_t sequence,
+                             std::vector<std::vector<char> > *records_out,
+                             int64_t start = DEVICE_BLOCK_SIZE) {
+    int64_t offset = start;
+    int64_t end = start;
+    for (;;) {
+        offset = record_header_offset(offset);
+        if (offset + static_cast<int64_t>(sizeof(write_ahead_log_record_header_t))
+                > size) {
+            break;
+        }
+        write_ahead_log_record_header_t record_header;
+        memcpy(&record_header, buffer + offset, sizeof(record_header));
+        if (record_header.sequence == 0 && record_header.size == 0
+                && record_header.crc == 0) {
+            /* Zeroes pad each flush up to the next block. A flush never starts with
+            padding, so zeroes at the start of a block mark the end of the log. */
+            if (offset % DEVICE_BLOCK_SIZE == 0) {
+                break;
+            }
+            offset = ceil_aligned(offset, DEVICE_BLOCK_SIZE);
+            continue;
+        }
+        const int64_t data_offset = offset + sizeof(record_header);
+        if (record_header.sequence != sequence
+                || data_offset + record_header.size > size
+                || record_header.crc != compute_record_crc(record_header.sequence,
+                                                           buffer + data_offset,
+                                                           record_header.size)) {
+            /* This is either the tail of a flush that was torn by a crash, or a record
+            from before the segment was last initialized. */
+            break;
+        }
+        records_out->push_back(std::vector<char>(
+            buffer + data_offset,
+            buffer + data_offset + record_header.size));
+        offset = data_offset + record_header.size;
+        end = ceil_aligned(offset, DEVICE_BLOCK_SIZE);
+    }
+    return end;
+}
+
+static std::string segment_path(const std::string &path, int index) {
+    return strprintf("%s.%d", path.c_str(), index);
+}
+
+write_ahead_log_t::write_ahead_log_t(io_backender_t *io_backender,
+                                     const std::string &path) :
+    active(0),
+    needs_reset(true),
+    appended_lsn(0),
+    durable_lsn(0),
+    flusher(std::bind(&write_ahead_log_t::flush, this, ph::_1)) {
+    std::vector<std::vector<char> > records[2];
+    for (int i = 0; i < 2; ++i) {
+        open_segment(io_backender, segment_path(path, i), &segments[i], &records[i]);
+    }
+
+    /* Appends go to the newer segment, and its records are replayed last. */
+    active = segments[1].sequence > segments[0].sequence ? 1 : 0;
+    for (auto &&record : records[1 - active]) {
+        recovered_records.push_back(std::move(record));
+    }
+    for (auto &&record : records[active]) {
+        recovered_records.push_back(std::move(record));
+    }
+    if (!recovered_records.empty()) {
+        logNTC("Recovered %zu records from the write-ahead log `%s`.\n",
+               recovered_records.size(), path.c_str());
+    }
+}
+
+write_ahead_log_t::~write_ahead_log_t() {
+    assert_thread();
+}
+
+void write_ahead_log_t::remove(const std::string &path) {
+    for (int i = 0; i < 2; ++i) {
+        const std::string file_path = segment_path(path, i);
+        const int res = ::unlink(file_path.c_str());
+        guarantee_err(res == 0 || get_errno() == ENOENT,
+                      "unlink failed for file %s", file_path.c_str());
+    }
+}
+
+std::vector<std::vector<char> > write_ahead_log_t::take_recovered_records() {
+    assert_thread();
+    std::vector<std::vector<char> > res;
+    res.swap(recovered_records);
+    return res;
+}
+
+void write_ahead_log_t::reset() {
+    assert_thread();
+    /* The files may contain the torn tail of a flush behind the recovered records, so
+    we don't append to them as they are. The new sequence number makes sure that
+    nothing that was in them can be mistaken for a record later on. */
+    const uint64_t sequence =
+        std::max(segments[0].sequence, segments[1].sequence) + 1;
+    init_segment(&segments[1 - active], sequence);
+    init_segment(&segments[active], sequence);
+    needs_reset = false;
+}
+
+write_ahead_log_t::lsn_t write_ahead_log_t::append(std::vector<char> &&record) {
+    assert_thread();
+    guarantee(!needs_reset, "reset() must be called before append()");
+    guarantee(record.size() <= std::numeric_limits<uint32_t>::max());
+    pending_records.push_back(std::move(record));
+    ++appended_lsn;
+    flusher.notify();
+    return appended_lsn;
+}
+
+void write_ahead_log_t::wait_durable(lsn_t lsn, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    guarantee(lsn <= appended_lsn);
+    if (lsn <= durable_lsn) {
+        return;
+    }
+    /* `append()` notified the flusher, so this waits for a flush that started after the
+    record was appended. */
+    flusher.flush(interruptor);
+    guarantee(lsn <= durable_lsn);
+}
+
+std::vector<std::vector<char> > write_ahead_log_t::read_records(
+        lsn_t since, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    guarantee(!needs_reset);
+    flusher.flush(interruptor);
+    std::vector<std::vector<char> > records;
+    /* Flushes that start after this only write behind `segment->size`, so they don't
+    get in the way of the reads. */
+    for (int i : { 1 - active, active }) {
+        const segment_t *segment = &segments[i];
+        const int64_t size = segment->size;
+        if (segment->flushes.empty()) {
+            continue;
+        }
+        if (i != active && !segments[active].flushes.empty()
+                && segments[active].flushes.front().first <= since) {
+            /* All the records we want are in the active segment. */
+            continue;
+        }
+        /* We start with the last flush that begins at or before `since`. */
+        auto flush = std::upper_bound(
+            segment->flushes.begin(), segment->flushes.end(),
+            std::make_pair(since, std::numeric_limits<int64_t>::max()));
+        if (flush != segment->flushes.begin()) {
+            --flush;
+        }
+        const lsn_t first_lsn = flush->first;
+        const int64_t start = flush->second;
+        if (start >= size) {
+            continue;
+        }
+        scoped_malloc_t<char> buffer(malloc_aligned(size - start, DEVICE_BLOCK_SIZE));
+        co_read(segment->file.get(), start, size - start, buffer.get(),
+                DEFAULT_DISK_ACCOUNT);
+        std::vector<std::vector<char> > segment_records;
+        parse_records(buffer.get(), size - start, segment->sequence, &segment_records, 0);
+        lsn_t lsn = first_lsn;
+        for (auto &&record : segment_records) {
+            if (lsn >= since) {
+                records.push_back(std::move(record));
+            }
+            ++lsn;
+        }
+    }
+    return records;
+}
+
+void write_ahead_log_t::start_new_segment(signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    flusher.flush(interruptor);
+    guarantee(!needs_reset);
+    guarantee(pending_records.empty(), "append() was called during start_new_segment()");
+    guarantee(segments[1 - active].size == DEVICE_BLOCK_SIZE,
+              "The old segment wasn't discarded");
+    init_segment(&segments[1 - active], segments[active].sequence + 1);
+    active = 1 - active;
+}
+
+void write_ahead_log_t::discard_old_segment() {
+    assert_thread();
+    segment_t *old_segment = &segments[1 - active];
+    init_segment(old_segment, old_segment->sequence);
+}
+
+int64_t write_ahead_log_t::active_segment_size() const {
+    assert_thread();
+    return segments[active].size;
+}
+
+void write_ahead_log_t::open_segment(io_backender_t *io_backender,
+                                     const std::string &path,
+                                     segment_t *segment,
+                                     std::vector<std::vector<char> > *records_out) {
+    const file_open_result_t res = open_file(
+        path.c_str(),
+        linux_file_t::mode_read | linux_file_t::mode_write | linux_file_t::mode_create,
+        io_backender,
+        &segment->file);
+    if (res.outcome == file_open_result_t::ERROR) {
+        crash_due_to_inaccessible_database_file(path.c_str(), res);
+    }
+
+    const int64_t file_size =
+        floor_aligned(segment->file->get_file_size(), DEVICE_BLOCK_SIZE);
+    if (file_size < DEVICE_BLOCK_SIZE) {
+        init_segment(segment, 0);
+        return;
+    }
+
+    scoped_malloc_t<char> buffer(malloc_aligned(file_size, DEVICE_BLOCK_SIZE));
+    co_read(segment->file.get(), 0, file_size, buffer.get(), DEFAULT_DISK_ACCOUNT);
+
+    write_ahead_log_header_t header;
+    memcpy(&header, buffer.get(), sizeof(header));
+    if (memcmp(header.magic, WRITE_AHEAD_LOG_MAGIC, sizeof(header.magic)) != 0) {
+        init_segment(segment, 0);
+        return;
+    }
+    segment->sequence = header.sequence;
+
+    segment->size = parse_records(
+        buffer.get(), file_size, segment->sequence, records_out);
+}
+
+void write_ahead_log_t::init_segment(segment_t *segment, uint64_t sequence) {
+    /* This throws away the records, so there must not be a flush going on. It's safe
+    to truncate the file first: if we crash before the new header is on disk, the old
+    header and whatever records survived are still consistent. */
+    segment->file->set_file_size(DEVICE_BLOCK_SIZE);
+
+    scoped_malloc_t<char> buffer(malloc_aligned(DEVICE_BLOCK_SIZE, DEVICE_BLOCK_SIZE));
+    memset(buffer.get(), 0, DEVICE_BLOCK_SIZE);
+    write_ahead_log_header_t header;
+    memcpy(header.magic, WRITE_AHEAD_LOG_MAGIC, sizeof(header.magic));
+    header.sequence = sequence;
+    memcpy(buffer.get(), &header, sizeof(header));
+    co_write(segment->file.get(), 0, DEVICE_BLOCK_SIZE, buffer.get(),
+             DEFAULT_DISK_ACCOUNT, file_t::WRAP_IN_DATASYNCS);
+
+    segment->sequence = sequence;
+    segment->size = DEVICE_BLOCK_SIZE;
+    segment->flushes.clear();
+}
+
+void write_ahead_log_t::flush(UNUSED signal_t *interruptor) {
+    assert_thread();
+    /* Everything that was appended up to now goes into this flush. */
+    flusher.include_latest_notifications();
+    if (pending_records.empty()) {
+        return;
+    }
+    std::vector<std::vector<char> > records;
+    records.swap(pending_records);
+    const lsn_t lsn = appended_lsn;
+    segment_t *segment = &segments[active];
+
+    int64_t length = 0;
+    for (const auto &record : records) {
+        length = record_header_offset(length)
+            + sizeof(write_ahead_log_record_header_t) + record.size();
+    }
+    const int64_t padded_length = ceil_aligned(length, DEVICE_BLOCK_SIZE);
+    scoped_malloc_t<char> buffer(malloc_aligned(padded_length, DEVICE_BLOCK_SIZE));
+    memset(buffer.get(), 0, padded_length);
+    int64_t offset = 0;
+    for (const auto &record : records) {
+        offset = record_header_offset(offset);
+        write_ahead_log_record_header_t record_header;
+        record_header.sequence = segment->sequence;
+        record_header.size = record.size();
+        record_header.crc = compute_record_crc(
+            segment->sequence, record.data(), record_header.size);
+        memcpy(buffer.get() + offset, &record_header, sizeof(record_header));
+        offset += sizeof(record_header);
+        memcpy(buffer.get() + offset, record.data(), record.size());
+        offset += record.size();
+    }
+
+    segment->file->set_file_size_at_least(segment->size + padded_length);
+    co_write(segment->file.get(), segment->size, padded_length, buffer.get(),
+             DEFAULT_DISK_ACCOUNT, file_t::WRAP_IN_DATASYNCS);
+    segment->flushes.push_back(std::make_pair(lsn - records.size() + 1, segment->size));
+    segment->size += padded_length;
+    durable_lsn = lsn;
+}
@@ -0,0 +1,119 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_WRITE_AHEAD_LOG_HPP_
+#define SERIALIZER_WRITE_AHEAD_LOG_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arch/types.hpp"
+#include "concurrency/interruptor.hpp"
+#include "concurrency/pump_coro.hpp"
+#include "containers/scoped.hpp"
+
+class io_backender_t;
+
+/* `write_ahead_log_t` is a sequential log of opaque records that makes them durable
+with a single sequential `fdatasync()` per batch. The changefeed change log keeps the
+changes that a `ql::changefeed::server_t` sent in one (see `change_log_t`). A store can
+also put one in front of its B-tree, so that writes with hard durability can be
+acknowledged without waiting for a flush of the B-tree pages (see
+`store_t::open_write_ahead_log()`).
+
+The log consists of two files, `<path>.0` and `<path>.1`, called segments. Records are
+appended to the active segment. A flush writes all of the records that were appended
+since the last flush with one sequential write followed by one `fdatasync()`, so
+concurrent callers of `wait_durable()` share the cost. Every flush starts at a
+`DEVICE_BLOCK_SIZE` boundary, so that a flush that gets torn by a crash can't damage
+records that were already durable.
+
+The log never forgets records by itself. The user calls `start_new_segment()` to move
+on to the other segment, makes everything that was logged in the old segment durable by
+other means, and then calls `discard_old_segment()`. After a crash, the records that are
+still in the log are returned by `take_recovered_records()`. They may include records
+whose effects already made it to disk some other way, so the user has to be able to
+recognize those when it replays the records. */
+
+class write_ahead_log_t : public home_thread_mixin_t {
+public:
+    /* Log sequence numbers count the records appended since the log was opened. */
+    typedef uint64_t lsn_t;
+
+    /* Opens the log, creating the segment files if they don't exist yet, and reads the
+    records that are left over from before. Blocks. */
+    write_ahead_log_t(io_backender_t *io_backender, const std::string &path);
+    ~write_ahead_log_t();
+
+    /* Deletes the segment files of the log at `path`. */
+    static void remove(const std::string &path);
+
+    /* Returns the records that were in the log when it was opened, oldest first. */
+    std::vector<std::vector<char> > take_recovered_records();
+
+    /* Empties both segments. This must be called once the recovered records have been
+    made durable by other means, and before the first call to `append()`. */
+    void reset();
+
+    /* Appends a record and returns its log sequence number. Doesn't block; the record
+    gets flushed in the background. */
+    lsn_t append(std::vector<char> &&record);
+
+    /* Blocks until the record `lsn` and all records before it are on disk. */
+    void wait_durable(lsn_t lsn, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
+
+    /* Makes all records durable and then reads the ones from `since` on back from
+    disk, oldest first. Only the flushes that contain such records are read. There must
+    not be any calls to `start_new_segment()` or `discard_old_segment()` while this is
+    running, but appends are fine; the records they append may or may not be
+    returned. */
+    std::vector<std::vector<char> > read_records(lsn_t since, signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
+
+    /* Waits until all records are on disk and then switches appends over to the other
+    segment, which must have been discarded. There must not be any calls to `append()`
+    while this is running. */
+    void start_new_segment(signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
+
+    /* Empties the segment that was active before the last `start_new_segment()`. */
+    void discard_old_segment();
+
+    /* The number of bytes in the active segment. */
+    int64_t active_segment_size() const;
+
+private:
+    struct segment_t {
+        scoped_ptr_t<file_t> file;
+        uint64_t sequence;
+        /* The end of the last flush. Always a multiple of `DEVICE_BLOCK_SIZE`. */
+        int64_t size;
+        /* The log sequence number of the first record of each flush since the segment
+        was initialized, and the offset at which the flush starts. */
+        std::vector<std::pair<lsn_t, int64_t> > flushes;
+    };
+
+    void open_segment(io_backender_t *io_backender,
+                      const std::string &path,
+                      segment_t *segment,
+                      std::vector<std::vector<char> > *records_out);
+    void init_segment(segment_t *segment, uint64_t sequence);
+
+    void flush(signal_t *interruptor);
+
+    segment_t segments[2];
+    int active;
+
+    std::vector<std::vector<char> > recovered_records;
+    bool needs_reset;
+
+    /* Records that were appended but haven't been handed to a flush yet. */
+    std::vector<std::vector<char> > pending_records;
+    lsn_t appended_lsn, durable_lsn;
+
+    pump_coro_t flusher;
+
+    DISABLE_COPYING(write_ahead_log_t);
+};
+
+#endif /* SERIALIZER_WRITE_AHEAD_LOG_HPP_ */
@@ -147,6 +147,15 @@ public:
             start_point, pre_item_producer, item_consumer, interruptor);
     }
 
+    void compute_backfill_digests(
+            const std::vector<key_range_t> &ranges,
+            std::vector<backfill_digest_t> *digests_out,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) {
+        home_thread_mixin_t::assert_thread();
+        store_view->compute_backfill_digests(ranges, digests_out, interruptor);
+    }
+
     continue_bool_t receive_backfill(
             const region_t &region,
             backfill_item_producer_t *item_producer,
@@ -162,6 +171,10 @@ public:
         store_view->wait_until_ok_to_receive_backfill(interruptor);
     }
 
+    double get_foreground_latency_ms() {
+        return store_view->get_foreground_latency_ms();
+    }
+
     void reset_data(
             const binary_blob_t &zero_version,
             const region_t &subregion,
@@ -4,6 +4,7 @@
 #include "protocol_api.hpp"
 #include "region/region_map.hpp"
 
+class backfill_digest_t;
 class backfill_item_t;
 class backfill_pre_item_t;
 
@@ -181,6 +182,16 @@ public:
             signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t) = 0;
 
+    /* `compute_backfill_digests()` appends the `backfill_digest_t` of the key-value
+    pairs in each of `ranges` to `*digests_out`. The ranges must be in lexicographical
+    order and must not overlap. The backfiller compares them with the digests of its own
+    backfill items, to find the items whose values the backfillee already has. */
+    virtual void compute_backfill_digests(
+            const std::vector<key_range_t> &ranges,
+            std::vector<backfill_digest_t> *digests_out,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) = 0;
+
     /* `receive_backfill()` applies backfill item(s) generated by `send_backfill()` to
     the B-tree. It receives the items from `next_item()`, which works just like
     `next_pre_item()` on `backfill_pre_item_producer_t` except that it returns the item
@@ -233,6 +244,10 @@ public:
     virtual void wait_until_ok_to_receive_backfill(signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t) = 0;
 
+    /* Returns the average latency of the reads and writes that the store has served
+    recently, in milliseconds. Backfills slow down if it gets too high. */
+    virtual double get_foreground_latency_ms() = 0;
+
     /* Deletes every key in the region, and sets the metainfo for that region to
     `zero_version`. */
     virtual void reset_data(
@@ -1,9 +1,12 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include <string>
+#include <vector>
 
 #include "unittest/gtest.hpp"
 
 #include "containers/archive/boost_types.hpp"
+#include "containers/archive/preserialized.hpp"
+#include "containers/archive/shared_buf_stream.hpp"
 #include "containers/archive/stl_types.hpp"
 
 namespace unittest {
@@ -34,6 +37,48 @@ TEST(WriteMessageTest, Variant) {
     ASSERT_EQ(15u, s.size());
 }
 
+TEST(WriteMessageTest, Preserialized) {
+    std::vector<std::string> v(1000, "Hello, world!");
+
+    write_message_t direct_wm;
+    serialize<cluster_version_t::CLUSTER>(&direct_wm, v);
+    std::string direct;
+    dump_to_string(&direct_wm, &direct);
+
+    // The copy shares the buffer, and both write the same bytes as `v` itself.
+    preserialized_t<std::vector<std::string> > p(v);
+    preserialized_t<std::vector<std::string> > copy = p;
+    ASSERT_EQ(p.data(), copy.data());
+    for (int i = 0; i < 2; ++i) {
+        write_message_t wm;
+        serialize<cluster_version_t::CLUSTER>(&wm, i == 0 ? p : copy);
+        std::string s;
+        dump_to_string(&wm, &s);
+        ASSERT_EQ(direct, s);
+    }
+}
+
+TEST(WriteMessageTest, SharedBufStream) {
+    std::vector<std::string> v(1000, "Hello, world!");
+
+    write_message_t wm;
+    serialize<cluster_version_t::CLUSTER>(&wm, v);
+    std::string direct;
+    dump_to_string(&wm, &direct);
+
+    // The chunks grow, and together hold exactly the serialized bytes.
+    shared_buf_stream_t stream(16);
+    ASSERT_EQ(0, send_write_message(&stream, &wm));
+    ASSERT_EQ(direct.size(), stream.size());
+    ASSERT_LT(1u, stream.chunks().size());
+    std::string s;
+    for (const auto &chunk : stream.chunks()) {
+        ASSERT_LE(chunk.size, chunk.buf->size());
+        s.append(chunk.buf->data(), chunk.size);
+    }
+    ASSERT_EQ(direct, s);
+}
+
 
 
 }  // namespace unittest
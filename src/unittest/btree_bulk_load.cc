@@ -0,0 +1,182 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "arch/io/disk.hpp"
+#include "btree/bulk_load.hpp"
+#include "btree/operations.hpp"
+#include "btree/reql_specific.hpp"
+#include "buffer_cache/alt.hpp"
+#include "buffer_cache/blob.hpp"
+#include "buffer_cache/cache_balancer.hpp"
+#include "buffer_cache/serialize_onto_blob.hpp"
+#include "rdb_protocol/btree.hpp"
+#include "rdb_protocol/lazy_json.hpp"
+#include "rdb_protocol/serialize_datum_onto_blob.hpp"
+#include "serializer/config.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* `map_bulk_load_source_t` passes the pairs from a `std::map` to `btree_bulk_load()`,
+storing each value as a number datum. */
+class map_bulk_load_source_t : public btree_bulk_load_source_t {
+public:
+    map_bulk_load_source_t(const std::map<store_key_t, double> *_pairs,
+                           max_block_size_t _block_size) :
+        pairs(_pairs), block_size(_block_size), it(pairs->begin()), first(true) { }
+
+    bool next_pair(store_key_t *key_out, repli_timestamp_t *recency_out) {
+        if (!first) {
+            ++it;
+        }
+        first = false;
+        if (it == pairs->end()) {
+            return false;
+        }
+        *key_out = it->first;
+        *recency_out = repli_timestamp_t::distant_past;
+        return true;
+    }
+
+    void write_value(buf_parent_t leaf, void *value_out) {
+        rdb_value_t *value = static_cast<rdb_value_t *>(value_out);
+        memset(value, 0, blob::btree_maxreflen);
+        blob_t blob(block_size, value->value_ref(), blob::btree_maxreflen);
+        ql::serialization_result_t res = datum_serialize_onto_blob(
+            leaf, &blob, ql::datum_t(it->second));
+        ASSERT_FALSE(bad(res));
+    }
+
+private:
+    const std::map<store_key_t, double> *pairs;
+    max_block_size_t block_size;
+    std::map<store_key_t, double>::const_iterator it;
+    bool first;
+};
+
+void bulk_load(cache_conn_t *cache_conn, double fill_factor,
+               const std::map<store_key_t, double> &pairs) {
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_writing(cache_conn, nullptr,
+        write_access_t::write, 1, write_durability_t::SOFT, &superblock, &txn);
+    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+    rdb_live_deletion_context_t deletion_context;
+    map_bulk_load_source_t source(&pairs, superblock->cache()->max_block_size());
+    size_t num_pairs = btree_bulk_load(superblock.get(), &sizer,
+        deletion_context.balancing_detacher(), fill_factor,
+        repli_timestamp_t::distant_past, &source);
+    ASSERT_EQ(pairs.size(), num_pairs);
+}
+
+bool range_is_empty(cache_conn_t *cache_conn, const key_range_t &range) {
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_reading(cache_conn, CACHE_SNAPSHOTTED_NO,
+        &superblock, &txn);
+    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+    return btree_range_is_empty(superblock.get(), &sizer, range);
+}
+
+void check_contents(cache_conn_t *cache_conn,
+                    const std::map<store_key_t, double> &expected) {
+    btree_stats_t stats(nullptr, "btree_bulk_load");
+    for (const auto &pair : expected) {
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn_for_reading(cache_conn, CACHE_SNAPSHOTTED_NO,
+            &superblock, &txn);
+        rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+        keyvalue_location_t kv_location;
+        find_keyvalue_location_for_read(&sizer, superblock.get(),
+            pair.first.btree_key(), &kv_location, &stats, nullptr);
+        ASSERT_TRUE(kv_location.value.has()) << key_to_debug_str(pair.first);
+        ql::datum_t datum = get_data(
+            static_cast<rdb_value_t *>(kv_location.value.get()),
+            buf_parent_t(&kv_location.buf));
+        ASSERT_EQ(pair.second, datum.as_num());
+    }
+}
+
+std::map<store_key_t, double> make_pairs(const std::string &prefix, int count) {
+    std::map<store_key_t, double> pairs;
+    for (int i = 0; i < count; ++i) {
+        pairs[store_key_t(strprintf("%s%06d", prefix.c_str(), i))] = i;
+    }
+    return pairs;
+}
+
+void run_bulk_load_test(double fill_factor) {
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    cache_t cache(&serializer, &balancer, &get_global_perfmon_collection());
+    cache_conn_t cache_conn(&cache);
+
+    {
+        txn_t txn(&cache_conn, write_durability_t::HARD, 1);
+        buf_lock_t sb_lock(&txn, SUPERBLOCK_ID, alt_create_t::create);
+        real_superblock_t superblock(std::move(sb_lock));
+        btree_slice_t::init_real_superblock(&superblock,
+                                            std::vector<char>(), binary_blob_t());
+    }
+
+    std::map<store_key_t, double> expected;
+    ASSERT_TRUE(range_is_empty(&cache_conn, key_range_t::universe()));
+
+    /* Load into an empty tree */
+    std::map<store_key_t, double> middle = make_pairs("m", 5000);
+    bulk_load(&cache_conn, fill_factor, middle);
+    expected.insert(middle.begin(), middle.end());
+    ASSERT_FALSE(range_is_empty(&cache_conn, key_range_t::universe()));
+
+    /* Load at the right-hand end of the tree */
+    std::map<store_key_t, double> right = make_pairs("z", 5000);
+    ASSERT_TRUE(range_is_empty(&cache_conn, key_range_t(key_range_t::open,
+        store_key_t("m999999"), key_range_t::none, store_key_t())));
+    bulk_load(&cache_conn, fill_factor, right);
+    expected.insert(right.begin(), right.end());
+
+    /* Load at the left-hand end of the tree, in front of existing entries */
+    std::map<store_key_t, double> left = make_pairs("a", 5000);
+    bulk_load(&cache_conn, fill_factor, left);
+    expected.insert(left.begin(), left.end());
+
+    /* Load into a gap in the middle of the tree */
+    std::map<store_key_t, double> gap = make_pairs("q", 5000);
+    key_range_t gap_range(key_range_t::closed, store_key_t("q"),
+                          key_range_t::open, store_key_t("r"));
+    ASSERT_TRUE(range_is_empty(&cache_conn, gap_range));
+    bulk_load(&cache_conn, fill_factor, gap);
+    expected.insert(gap.begin(), gap.end());
+    ASSERT_FALSE(range_is_empty(&cache_conn, gap_range));
+
+    /* Load in between two adjacent keys */
+    std::map<store_key_t, double> between = make_pairs("m002500x", 5000);
+    bulk_load(&cache_conn, fill_factor, between);
+    expected.insert(between.begin(), between.end());
+
+    check_contents(&cache_conn, expected);
+}
+
+TPTEST(BTreeBulkLoad, Full) {
+    run_bulk_load_test(1.0);
+}
+
+TPTEST(BTreeBulkLoad, PartlyFull) {
+    run_bulk_load_test(0.6);
+}
+
+}  // namespace unittest
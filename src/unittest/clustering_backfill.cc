@@ -1,9 +1,13 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <set>
+
 #include "clustering/immediate_consistency/backfiller.hpp"
 #include "clustering/immediate_consistency/backfillee.hpp"
+#include "clustering/immediate_consistency/standard_backfill_throttler.hpp"
 #include "clustering/table_manager/backfill_progress_tracker.hpp"
 #include "containers/uuid.hpp"
 #include "rpc/semilattice/view/field.hpp"
+#include "time.hpp"
 #include "unittest/branch_history_manager.hpp"
 #include "unittest/clustering_utils.hpp"
 #include "unittest/gtest.hpp"
@@ -12,7 +16,15 @@
 
 namespace unittest {
 
-TPTEST(ClusteringBackfill, BackfillTest) {
+/* Pads every value with `value_padding` bytes. If `backfillee_has_data` is true, the
+backfillee starts out with the final value of every key, but on a different branch and
+with different timestamps. Returns a lower bound on the number of bytes that the backfill
+had to transfer. If `omitted_value_items_out` is non-null, it receives the number of
+backfill items that the backfillee got without values. */
+size_t run_backfill_test(const backfill_rate_config_t &rate_config,
+                         size_t value_padding = 0,
+                         bool backfillee_has_data = false,
+                         size_t *omitted_value_items_out = nullptr) {
     order_source_t order_source;
     cond_t non_interruptor;
 
@@ -31,8 +43,18 @@ TPTEST(ClusteringBackfill, BackfillTest) {
         dummy_branch.origin = region_map_t<version_t>(region, version_t::zero());
         branch_history_manager.create_branch(dummy_branch_id, dummy_branch, &non_interruptor);
     }
+    branch_id_t backfillee_branch_id = dummy_branch_id;
+    if (backfillee_has_data) {
+        backfillee_branch_id = generate_uuid();
+        branch_birth_certificate_t backfillee_branch;
+        backfillee_branch.initial_timestamp = state_timestamp_t::zero();
+        backfillee_branch.origin = region_map_t<version_t>(region, version_t::zero());
+        branch_history_manager.create_branch(
+            backfillee_branch_id, backfillee_branch, &non_interruptor);
+    }
 
     state_timestamp_t timestamp = state_timestamp_t::zero();
+    state_timestamp_t backfillee_timestamp = state_timestamp_t::zero();
 
     // initialize the metainfo in a store
     store_view_t *stores[] = { &backfiller_store, &backfillee_store };
@@ -42,18 +64,24 @@ TPTEST(ClusteringBackfill, BackfillTest) {
         stores[i]->set_metainfo(
             region_map_t<binary_blob_t>(
                 region,
-                binary_blob_t(version_t(dummy_branch_id, timestamp))),
+                binary_blob_t(version_t(
+                    i == 0 ? dummy_branch_id : backfillee_branch_id, timestamp))),
             order_source.check_in(strprintf("set_metainfo(i=%zu)", i)),
             &token,
             write_durability_t::HARD,
             &non_interruptor);
     }
 
-    // Insert 10 values into both stores, then another 10 into only `backfiller_store` and not `backfillee_store`
+    /* Write 20 values into `backfiller_store`, the first 10 of them twice. If
+    `backfillee_has_data` is true, also write each value once into `backfillee_store`,
+    so it ends up with the same data but different timestamps. */
+    std::set<std::string> keys_written;
     for (int i = 0; i < 20; i++) {
         write_response_t response;
         const std::string key = std::string(1, 'a' + randint(26));
-        write_t w = mock_overwrite(key, strprintf("%d", i));
+        keys_written.insert(key);
+        write_t w = mock_overwrite(
+            key, strprintf("%d", i) + std::string(value_padding, 'x'));
 
         for (int j = 0; j < (i < 10 ? 2 : 1); j++) {
             timestamp = timestamp.next();
@@ -82,17 +110,48 @@ TPTEST(ClusteringBackfill, BackfillTest) {
                 &token,
                 &non_interruptor);
         }
+
+        if (backfillee_has_data) {
+            backfillee_timestamp = backfillee_timestamp.next();
+
+            write_token_t token;
+            backfillee_store.new_write_token(&token);
+
+#ifndef NDEBUG
+            metainfo_checker_t metainfo_checker(region,
+                [&](const region_t &, const binary_blob_t &bb) {
+                    rassert(bb == binary_blob_t(version_t(
+                        backfillee_branch_id, backfillee_timestamp.pred())));
+                });
+#endif
+
+            backfillee_store.write(
+                DEBUG_ONLY(metainfo_checker, )
+                region_map_t<binary_blob_t>(
+                    region,
+                    binary_blob_t(version_t(backfillee_branch_id, backfillee_timestamp))
+                ),
+                w,
+                &response, write_durability_t::SOFT,
+                backfillee_timestamp,
+                order_source.check_in("backfillee_store.write"),
+                &token,
+                &non_interruptor);
+        }
     }
 
     // Set up a cluster so mailboxes can be created
 
     simple_mailbox_cluster_t cluster;
+    standard_backfill_throttler_t backfill_throttler;
+    backfill_throttler.set_rate_config(rate_config);
 
     /* Expose the backfiller to the cluster */
 
     backfiller_t backfiller(
         cluster.get_mailbox_manager(),
         &branch_history_manager,
+        &backfill_throttler,
         &backfiller_store);
 
     /* Run a backfill */
@@ -109,6 +168,7 @@ TPTEST(ClusteringBackfill, BackfillTest) {
             &backfillee_store,
             backfiller.get_business_card(),
             backfill_config_t(),
+            &backfill_throttler,
             progress_tracker,
             &non_interruptor);
         class callback_t : public backfillee_t::callback_t {
@@ -151,6 +211,46 @@ TPTEST(ClusteringBackfill, BackfillTest) {
 
     //EXPECT_EQ(1, backfillee_metadata.size());
     //EXPECT_EQ(timestamp, backfillee_metadata[0].second.timestamp);
+
+    if (omitted_value_items_out != nullptr) {
+        *omitted_value_items_out = backfillee_store.omitted_value_items();
+    }
+
+    /* If the backfillee store started out empty, the latest value of every key had to
+    be transferred. Otherwise the values may all have been omitted. */
+    return backfillee_has_data ? 0 : keys_written.size() * value_padding;
+}
+
+TPTEST(ClusteringBackfill, BackfillTest) {
+    run_backfill_test(backfill_rate_config_t());
+}
+
+TPTEST(ClusteringBackfill, IdenticalData) {
+    /* The backfillee's data only differs in its timestamps, so the backfiller should
+    find matching digests and leave the values out. `run_backfill_test()` still checks
+    that the backfillee ends up with the backfiller's timestamps. */
+    size_t omitted_value_items;
+    run_backfill_test(backfill_rate_config_t(), 0, true, &omitted_value_items);
+    EXPECT_GT(omitted_value_items, 0u);
+}
+
+TPTEST(ClusteringBackfill, RateLimited) {
+    /* The limits are low enough that both directions have to wait, and the latency
+    target makes the feedback loop run too. */
+    backfill_rate_config_t rate_config;
+    rate_config.send_bytes_per_sec = 16 * KILOBYTE;
+    rate_config.receive_bytes_per_sec = 16 * KILOBYTE;
+    rate_config.latency_target_ms = 1;
+    microtime_t start = current_microtime();
+    size_t min_bytes = run_backfill_test(rate_config, 2 * KILOBYTE);
+    microtime_t elapsed_ms = (current_microtime() - start) / THOUSAND;
+
+    /* The token bucket can save up at most 250ms worth of tokens before the backfill
+    starts, and the latency feedback never raises the rate above the limit. */
+    int64_t min_elapsed_ms =
+        static_cast<int64_t>(min_bytes * THOUSAND / *rate_config.send_bytes_per_sec)
+        - 250;
+    EXPECT_GE(static_cast<int64_t>(elapsed_ms), min_elapsed_ms);
 }
 
 }   /* namespace unittest */
@@ -33,12 +33,14 @@ void run_with_primary(
 
     mock_store_t initial_store((binary_blob_t(version_t::zero())));
     in_memory_branch_history_manager_t branch_history_manager;
+    standard_backfill_throttler_t backfill_throttler;
     local_replicator_t local_replicator(
         cluster.get_mailbox_manager(),
         generate_uuid(),
         &primary_dispatcher,
         &initial_store,
         &branch_history_manager,
+        &backfill_throttler,
         &interruptor);
 
     fun(&cluster,
@@ -188,4 +190,107 @@ TPTEST(ClusteringBranch, Backfill) {
     run_with_primary(&run_backfill_test);
 }
 
+/* The `WriteBatching` test checks that writes which arrive while a batch for a ready
+dispatchee is still waiting to be sent join that batch, unless their durability is
+different, and that each write's callback gets the response for that write. */
+
+class batch_recording_dispatchee_t : public primary_dispatcher_t::dispatchee_t {
+public:
+    bool is_primary() const {
+        return true;
+    }
+    void do_read(const read_t &, state_timestamp_t, signal_t *, read_response_t *) {
+        unreachable();
+    }
+    void do_write_sync_batch(
+            const std::vector<replicated_write_t> &writes,
+            UNUSED signal_t *interruptor,
+            std::vector<write_response_t> *responses_out) {
+        batches.push_back(writes);
+        responses_out->clear();
+        for (const replicated_write_t &write : writes) {
+            /* Tag each response with the timestamp of its write. */
+            write_response_t response((dummy_write_response_t()));
+            response.n_shards = write.timestamp.count_changes(state_timestamp_t::zero());
+            responses_out->push_back(std::move(response));
+        }
+    }
+    void do_write_async(const write_t &, state_timestamp_t, order_token_t, signal_t *) {
+        unreachable();
+    }
+
+    std::vector<std::vector<replicated_write_t> > batches;
+};
+
+class tagged_write_callback_t :
+    public primary_dispatcher_t::write_callback_t, public cond_t
+{
+public:
+    explicit tagged_write_callback_t(size_t _expected_tag) :
+        expected_tag(_expected_tag), acks(0) { }
+    write_durability_t get_default_write_durability() {
+        return write_durability_t::HARD;
+    }
+    void on_ack(const server_id_t &, write_response_t &&response) {
+        EXPECT_EQ(expected_tag, response.n_shards);
+        ++acks;
+    }
+    void on_end() {
+        EXPECT_EQ(1, acks);
+        pulse();
+    }
+    size_t expected_tag;
+    int acks;
+};
+
+TPTEST(ClusteringBranch, WriteBatching) {
+    order_source_t order_source;
+    primary_dispatcher_t dispatcher(
+        &get_global_perfmon_collection(),
+        region_map_t<version_t>(region_t::universe(), version_t::zero()));
+
+    batch_recording_dispatchee_t dispatchee;
+    state_timestamp_t first_timestamp;
+    primary_dispatcher_t::dispatchee_registration_t registration(
+        &dispatcher, &dispatchee, generate_uuid(), 1.0, &first_timestamp);
+    registration.mark_ready();
+
+    /* `spawn_write()` doesn't block, so all of the writes arrive before the first
+    batch gets sent. */
+    const std::vector<write_durability_t> durabilities = {
+        write_durability_t::HARD, write_durability_t::HARD,
+        write_durability_t::SOFT, write_durability_t::SOFT, write_durability_t::SOFT,
+        write_durability_t::HARD };
+    std::vector<scoped_ptr_t<tagged_write_callback_t> > callbacks;
+    for (size_t i = 0; i < durabilities.size(); ++i) {
+        callbacks.push_back(make_scoped<tagged_write_callback_t>(
+            first_timestamp.count_changes(state_timestamp_t::zero()) + i + 1));
+        dispatcher.spawn_write(
+            write_t(dummy_write_t(),
+                    durabilities[i] == write_durability_t::HARD
+                        ? DURABILITY_REQUIREMENT_HARD
+                        : DURABILITY_REQUIREMENT_SOFT,
+                    profile_bool_t::DONT_PROFILE,
+                    ql::configured_limits_t()),
+            order_source.check_in("WriteBatching"),
+            callbacks.back().get());
+    }
+    for (const auto &callback : callbacks) {
+        callback->wait_lazily_unordered();
+    }
+
+    const std::vector<size_t> expected_batch_sizes = {2, 3, 1};
+    ASSERT_EQ(expected_batch_sizes.size(), dispatchee.batches.size());
+    size_t i = 0;
+    for (size_t b = 0; b < dispatchee.batches.size(); ++b) {
+        const std::vector<replicated_write_t> &batch = dispatchee.batches[b];
+        ASSERT_EQ(expected_batch_sizes[b], batch.size());
+        for (const replicated_write_t &write : batch) {
+            EXPECT_TRUE(durabilities[i] == write.durability);
+            EXPECT_TRUE(batch.front().durability == write.durability);
+            ++i;
+        }
+    }
+}
+
 }   /* namespace unittest */
@@ -52,7 +52,8 @@ inline merger_serializer_t *create_and_construct_serializer(temp_file_t *temp_fi
             &file_opener,
             &get_global_perfmon_collection());
     return new merger_serializer_t(std::move(inner_serializer),
-                                   MERGER_SERIALIZER_MAX_ACTIVE_WRITES);
+                                   MERGER_SERIALIZER_MAX_ACTIVE_WRITES,
+                                   &get_global_perfmon_collection());
 }
 
 class test_store_t {
@@ -57,7 +57,8 @@ std::string mock_lookup(store_view_t *store, std::string key) {
 
 mock_store_t::mock_store_t(binary_blob_t universe_metainfo)
     : store_view_t(region_t::universe()),
-      metainfo_(get_region(), universe_metainfo) { }
+      metainfo_(get_region(), universe_metainfo),
+      omitted_value_items_(0) { }
 mock_store_t::~mock_store_t() { }
 
 void mock_store_t::new_read_token(read_token_t *token_out) {
@@ -425,6 +426,25 @@ continue_bool_t mock_store_t::send_backfill(
     return continue_bool_t::CONTINUE;
 }
 
+void mock_store_t::compute_backfill_digests(
+        const std::vector<key_range_t> &ranges,
+        std::vector<backfill_digest_t> *digests_out,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    if (rng_.randint(2) == 0) {
+        nap(rng_.randint(10), interruptor);
+    }
+    for (const key_range_t &range : ranges) {
+        backfill_digest_t digest;
+        auto end = range.right.unbounded
+            ? table_.end() : table_.lower_bound(range.right.key());
+        for (auto it = table_.lower_bound(range.left); it != end; ++it) {
+            digest.add_pair(it->first, datum_to_vector(it->second.second));
+        }
+        digests_out->push_back(digest);
+    }
+}
+
 continue_bool_t mock_store_t::receive_backfill(
         const region_t &region,
         backfill_item_producer_t *item_producer,
@@ -453,6 +473,21 @@ continue_bool_t mock_store_t::receive_backfill(
             guarantee(key_range_t::right_bound_t(item.range.left) >= cursor);
             cursor = item.range.right;
 
+            /* If the backfiller omitted the values because we have the same ones,
+            take them from `table_` before we erase it */
+            if (item.values_omitted) {
+                for (auto &&pair : item.pairs) {
+                    if (static_cast<bool>(pair.value)) {
+                        auto it = table_.find(pair.key);
+                        guarantee(it != table_.end());
+                        pair.value = boost::make_optional(
+                            datum_to_vector(it->second.second));
+                    }
+                }
+                item.values_omitted = false;
+                ++omitted_value_items_;
+            }
+
             /* Delete any existing key-value pairs in the range */
             auto end = item.range.right.unbounded
                     ? table_.end() : table_.lower_bound(item.range.right.key());
@@ -486,6 +521,10 @@ void mock_store_t::wait_until_ok_to_receive_backfill(signal_t *interruptor)
     }
 }
 
+double mock_store_t::get_foreground_latency_ms() {
+    return 0;
+}
+
 void mock_store_t::reset_data(
         const binary_blob_t &zero_version,
         const region_t &subregion,
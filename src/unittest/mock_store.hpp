@@ -78,6 +78,11 @@ public:
             backfill_item_consumer_t *item_consumer,
             signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t);
+    void compute_backfill_digests(
+            const std::vector<key_range_t> &ranges,
+            std::vector<backfill_digest_t> *digests_out,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t);
     continue_bool_t receive_backfill(
             const region_t &region,
             backfill_item_producer_t *item_producer,
@@ -87,6 +92,8 @@ public:
     void wait_until_ok_to_receive_backfill(signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t);
 
+    double get_foreground_latency_ms();
+
     void reset_data(
             const binary_blob_t &zero_version,
             const region_t &subregion,
@@ -98,6 +105,10 @@ public:
     std::string values(std::string key);
     repli_timestamp_t timestamps(std::string key);
 
+    /* The number of backfill items we received without values, because we already had
+    the same values. */
+    size_t omitted_value_items() const { return omitted_value_items_; }
+
 private:
     fifo_enforcer_source_t token_source_;
     fifo_enforcer_sink_t token_sink_;
@@ -107,6 +118,7 @@ private:
     rng_t rng_;
     region_map_t<binary_blob_t> metainfo_;
     std::map<store_key_t, std::pair<repli_timestamp_t, ql::datum_t> > table_;
+    size_t omitted_value_items_;
 
     DISABLE_COPYING(mock_store_t);
 };
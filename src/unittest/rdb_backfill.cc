@@ -8,6 +8,7 @@
 #include "clustering/immediate_consistency/primary_dispatcher.hpp"
 #include "clustering/immediate_consistency/remote_replicator_client.hpp"
 #include "clustering/immediate_consistency/remote_replicator_server.hpp"
+#include "clustering/immediate_consistency/standard_backfill_throttler.hpp"
 #include "clustering/table_manager/backfill_progress_tracker.hpp"
 #include "extproc/extproc_pool.hpp"
 #include "extproc/extproc_spawner.hpp"
@@ -224,6 +225,7 @@ void run_backfill_test(const backfill_test_config_t &cfg) {
     cond_t non_interruptor;
 
     in_memory_branch_history_manager_t bhm;
+    standard_backfill_throttler_t replica_backfill_throttler;
     test_store_t store1(&io_backender, &order_source, &ctx);
     test_store_t store2(&io_backender, &order_source, &ctx);
     test_store_t store3(&io_backender, &order_source, &ctx);
@@ -237,7 +239,8 @@ void run_backfill_test(const backfill_test_config_t &cfg) {
             region_map_t<version_t>(region_t::universe(), version_t::zero()));
 
         local_replicator_t local_replicator(cluster.get_mailbox_manager(),
-            generate_uuid(), &dispatcher, &store1.store, &bhm, &non_interruptor);
+            generate_uuid(), &dispatcher, &store1.store, &bhm,
+            &replica_backfill_throttler, &non_interruptor);
 
         dispatcher_inserter_t inserter(
             &dispatcher, &order_source, cfg.value_padding_length, &first_inserter_state,
@@ -297,7 +300,8 @@ void run_backfill_test(const backfill_test_config_t &cfg) {
             get_store_version_map(&store2.store));
 
         local_replicator_t local_replicator(cluster.get_mailbox_manager(),
-            generate_uuid(), &dispatcher, &store2.store, &bhm, &non_interruptor);
+            generate_uuid(), &dispatcher, &store2.store, &bhm,
+            &replica_backfill_throttler, &non_interruptor);
 
         /* Find the subset of `first_inserter_state` that's actually present in `store2`
         */
@@ -351,7 +355,8 @@ void run_backfill_test(const backfill_test_config_t &cfg) {
             get_store_version_map(&store1.store));
 
         local_replicator_t local_replicator(cluster.get_mailbox_manager(),
-            generate_uuid(), &dispatcher, &store1.store, &bhm, &non_interruptor);
+            generate_uuid(), &dispatcher, &store1.store, &bhm,
+            &replica_backfill_throttler, &non_interruptor);
 
         /* Validate the state of `store1` to make sure
         that the backfill was completely correct */
@@ -394,7 +399,8 @@ void run_backfill_test(const backfill_test_config_t &cfg) {
             get_store_version_map(&store3.store));
 
         local_replicator_t local_replicator(cluster.get_mailbox_manager(),
-            generate_uuid(), &dispatcher, &store3.store, &bhm, &non_interruptor);
+            generate_uuid(), &dispatcher, &store3.store, &bhm,
+            &replica_backfill_throttler, &non_interruptor);
 
         /* Validate the state of `store3` to make sure that the backfill was completely
         correct */
@@ -512,6 +518,33 @@ TPTEST(RDBBackfill, FillPreItemQueue) {
     run_backfill_test(cfg);
 }
 
+TPTEST(RDBBackfill, ManyRangesSmallPrefetch) {
+    /* Read many sub-ranges at once with very little room to read ahead, so that the
+    sub-ranges stall waiting for the ones to their left to be sent. */
+    backfill_test_config_t cfg;
+    cfg.backfill.item_parallel_ranges = 16;
+    cfg.backfill.item_prefetch_mem_size = 1;
+    cfg.backfill.item_chunk_mem_size = 1;
+    cfg.num_initial_writes = 1000;
+    cfg.num_step_writes = 100;
+    run_backfill_test(cfg);
+}
+
+TPTEST(RDBBackfill, ReadAheadDuringWrites) {
+    /* Let the sub-ranges further right read far ahead while the backfillee's queue
+    holds up the sending, and keep writing all the while. So many chunks are older than
+    the chunks to their left by the time they're sent, and have to be read again. */
+    backfill_test_config_t cfg;
+    cfg.backfill.item_parallel_ranges = 8;
+    cfg.backfill.item_prefetch_mem_size = GIGABYTE;
+    cfg.backfill.item_chunk_mem_size = 1;
+    cfg.backfill.item_queue_mem_size = 1;
+    cfg.min_preempt_ms = cfg.max_preempt_ms = 60 * 60 * 1000;
+    cfg.num_initial_writes = 1000;
+    cfg.num_step_writes = 100;
+    run_backfill_test(cfg);
+}
+
 TPTEST(RDBBackfill, PreemptOften) {
     /* Force the backfill to be preempted after every single backfill item, just to
     stress the system */
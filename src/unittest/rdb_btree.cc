@@ -1,9 +1,11 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include <functional>
+#include <set>
 
 #include "arch/io/disk.hpp"
 #include "arch/runtime/coroutines.hpp"
 #include "arch/timing.hpp"
+#include "btree/concurrent_traversal.hpp"
 #include "btree/operations.hpp"
 #include "btree/reql_specific.hpp"
 #include "buffer_cache/cache_balancer.hpp"
@@ -14,6 +16,7 @@
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/erase_range.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/protocol.hpp"
@@ -29,52 +32,94 @@
 
 namespace unittest {
 
-void insert_rows(int start, int finish, store_t *store) {
+void insert_row(double id, const std::string &data, store_t *store) {
     ql::configured_limits_t limits;
+    cond_t dummy_interruptor;
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    write_token_t token;
+    store->new_write_token(&token);
+    store->acquire_superblock_for_write(
+        1, write_durability_t::SOFT,
+        &token, &txn, &superblock, &dummy_interruptor);
+    buf_lock_t sindex_block(superblock->expose_buf(),
+                            superblock->get_sindex_block_id(),
+                            access_t::write);
+
+    point_write_response_t response;
+
+    store_key_t pk(ql::datum_t(id).print_primary());
+    rdb_modification_report_t mod_report(pk);
+    rdb_live_deletion_context_t deletion_context;
+    rapidjson::Document doc;
+    doc.Parse(data.c_str());
+    rdb_set(pk,
+            ql::to_datum(doc, limits, reql_version_t::LATEST),
+            false, store->btree.get(), repli_timestamp_t::distant_past,
+            superblock.get(), &deletion_context, &response, &mod_report.info,
+            static_cast<profile::trace_t *>(NULL));
+
+    store_t::sindex_access_vector_t sindexes;
+    store->acquire_post_constructed_sindex_superblocks_for_write(
+             &sindex_block,
+             &sindexes);
+    rdb_update_sindexes(store,
+                        sindexes,
+                        &mod_report,
+                        txn.get(),
+                        &deletion_context,
+                        NULL,
+                        NULL,
+                        NULL);
+
+    new_mutex_in_line_t acq = store->get_in_line_for_sindex_queue(&sindex_block);
+    store->sindex_queue_push(mod_report, &acq);
+}
 
+void delete_row(double id, store_t *store) {
+    cond_t dummy_interruptor;
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    write_token_t token;
+    store->new_write_token(&token);
+    store->acquire_superblock_for_write(
+        1, write_durability_t::SOFT,
+        &token, &txn, &superblock, &dummy_interruptor);
+    buf_lock_t sindex_block(superblock->expose_buf(),
+                            superblock->get_sindex_block_id(),
+                            access_t::write);
+
+    point_delete_response_t response;
+
+    store_key_t pk(ql::datum_t(id).print_primary());
+    rdb_modification_report_t mod_report(pk);
+    rdb_live_deletion_context_t deletion_context;
+    // A timestamp after `distant_past`, so that the deletion leaves a tombstone.
+    rdb_delete(pk, store->btree.get(), repli_timestamp_t::distant_past.next(),
+               superblock.get(), &deletion_context, delete_mode_t::REGULAR_QUERY,
+               &response, &mod_report.info, static_cast<profile::trace_t *>(NULL));
+
+    store_t::sindex_access_vector_t sindexes;
+    store->acquire_post_constructed_sindex_superblocks_for_write(
+             &sindex_block,
+             &sindexes);
+    rdb_update_sindexes(store,
+                        sindexes,
+                        &mod_report,
+                        txn.get(),
+                        &deletion_context,
+                        NULL,
+                        NULL,
+                        NULL);
+
+    new_mutex_in_line_t acq = store->get_in_line_for_sindex_queue(&sindex_block);
+    store->sindex_queue_push(mod_report, &acq);
+}
+
+void insert_rows(int start, int finish, store_t *store) {
     guarantee(start <= finish);
     for (int i = start; i < finish; ++i) {
-        cond_t dummy_interruptor;
-        scoped_ptr_t<txn_t> txn;
-        scoped_ptr_t<real_superblock_t> superblock;
-        write_token_t token;
-        store->new_write_token(&token);
-        store->acquire_superblock_for_write(
-            1, write_durability_t::SOFT,
-            &token, &txn, &superblock, &dummy_interruptor);
-        buf_lock_t sindex_block(superblock->expose_buf(),
-                                superblock->get_sindex_block_id(),
-                                access_t::write);
-
-        std::string data = strprintf("{\"id\" : %d, \"sid\" : %d}", i, i * i);
-        point_write_response_t response;
-
-        store_key_t pk(ql::datum_t(static_cast<double>(i)).print_primary());
-        rdb_modification_report_t mod_report(pk);
-        rdb_live_deletion_context_t deletion_context;
-        rapidjson::Document doc;
-        doc.Parse(data.c_str());
-        rdb_set(pk,
-                ql::to_datum(doc, limits, reql_version_t::LATEST),
-                false, store->btree.get(), repli_timestamp_t::distant_past,
-                superblock.get(), &deletion_context, &response, &mod_report.info,
-                static_cast<profile::trace_t *>(NULL));
-
-        store_t::sindex_access_vector_t sindexes;
-        store->acquire_post_constructed_sindex_superblocks_for_write(
-                 &sindex_block,
-                 &sindexes);
-        rdb_update_sindexes(store,
-                            sindexes,
-                            &mod_report,
-                            txn.get(),
-                            &deletion_context,
-                            NULL,
-                            NULL,
-                            NULL);
-
-        new_mutex_in_line_t acq = store->get_in_line_for_sindex_queue(&sindex_block);
-        store->sindex_queue_push(mod_report, &acq);
+        insert_row(i, strprintf("{\"id\" : %d, \"sid\" : %d}", i, i * i), store);
     }
 }
 
@@ -437,4 +482,349 @@ TPTEST(RDBBtree, SindexInterruptionViaStoreDelete) {
     store.reset();
 }
 
+
+/* Runs `sum('sid')` over the whole primary index of `store`. Unordered reads are split
+into sub-ranges that are scanned in parallel, ordered reads are scanned serially. */
+rget_read_response_t sum_sid(store_t *store, sorting_t sorting) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store->acquire_superblock_for_read(
+            &token, &txn, &superblock,
+            &dummy_interruptor, false);
+
+    ql::env_t dummy_env(&dummy_interruptor,
+                        ql::return_empty_normal_batches_t::NO,
+                        reql_version_t::LATEST);
+    ql::sym_t one(1);
+    ql::protob_t<const Term> mapping = ql::r::var(one)["sid"].release_counted();
+    ql::map_wire_func_t func(mapping, make_vector(one), ql::backtrace_id_t::empty());
+    ql::terminal_variant_t terminal =
+        ql::sum_wire_func_t(ql::backtrace_id_t::empty(), func.compile_wire_func());
+
+    rget_read_response_t res;
+    rdb_rget_slice(
+        store->btree.get(),
+        key_range_t::universe(),
+        superblock.get(),
+        &dummy_env,
+        ql::batchspec_t::default_for(ql::batch_type_t::TERMINAL),
+        std::vector<ql::transform_variant_t>(),
+        boost::optional<ql::terminal_variant_t>(terminal),
+        sorting,
+        &res,
+        release_superblock_t::RELEASE);
+    return res;
+}
+
+TPTEST(RDBBtree, ParallelUnorderedAggregation) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            scoped_ptr_t<outdated_index_report_t>(),
+            generate_uuid());
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    {
+        /* The tree has to be big enough to be split, or the parallel code path
+        isn't taken at all. */
+        cond_t dummy_interruptor;
+        read_token_t token;
+        store.new_read_token(&token);
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        store.acquire_superblock_for_read(
+                &token, &txn, &superblock,
+                &dummy_interruptor, false);
+        ASSERT_LT(1u, split_range_for_parallel_traversal(
+            superblock.get(), key_range_t::universe(), 4, NULL).size());
+    }
+
+    double expected_sum = 0;
+    for (int i = 0; i < TOTAL_KEYS_TO_INSERT; ++i) {
+        expected_sum += i * i;
+    }
+
+    {
+        rget_read_response_t parallel = sum_sid(&store, sorting_t::UNORDERED);
+        rget_read_response_t serial = sum_sid(&store, sorting_t::ASCENDING);
+        ql::grouped_t<double> *parallel_sum =
+            boost::get<ql::grouped_t<double> >(&parallel.result);
+        ql::grouped_t<double> *serial_sum =
+            boost::get<ql::grouped_t<double> >(&serial.result);
+        ASSERT_TRUE(parallel_sum != NULL);
+        ASSERT_TRUE(serial_sum != NULL);
+        ASSERT_EQ(1, parallel_sum->size());
+        ASSERT_EQ(1, serial_sum->size());
+        EXPECT_EQ(expected_sum, parallel_sum->begin()->second);
+        EXPECT_EQ(serial_sum->begin()->second, parallel_sum->begin()->second);
+    }
+
+    /* A row in the middle of the table whose `sid` isn't a number makes the
+    sub-range that contains it fail. The whole read has to fail the same way as the
+    serial one does. */
+    insert_row(TOTAL_KEYS_TO_INSERT / 2 + 0.5,
+               strprintf("{\"id\" : %d.5, \"sid\" : \"oops\"}",
+                         TOTAL_KEYS_TO_INSERT / 2),
+               &store);
+
+    {
+        rget_read_response_t parallel = sum_sid(&store, sorting_t::UNORDERED);
+        rget_read_response_t serial = sum_sid(&store, sorting_t::ASCENDING);
+        ql::exc_t *parallel_exc = boost::get<ql::exc_t>(&parallel.result);
+        ql::exc_t *serial_exc = boost::get<ql::exc_t>(&serial.result);
+        ASSERT_TRUE(parallel_exc != NULL);
+        ASSERT_TRUE(serial_exc != NULL);
+        EXPECT_EQ(std::string(serial_exc->what()), std::string(parallel_exc->what()));
+    }
+}
+
+
+/* Runs `count()` over `range` of the primary index of `store`. Without `transforms`
+this takes the fast path that counts whole leaves; with a transform every row is
+handed to the accumulator. */
+uint64_t count_rows(store_t *store, const key_range_t &range,
+                    const std::vector<ql::transform_variant_t> &transforms) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store->acquire_superblock_for_read(
+            &token, &txn, &superblock,
+            &dummy_interruptor, false);
+
+    ql::env_t dummy_env(&dummy_interruptor,
+                        ql::return_empty_normal_batches_t::NO,
+                        reql_version_t::LATEST);
+    rget_read_response_t res;
+    rdb_rget_slice(
+        store->btree.get(),
+        range,
+        superblock.get(),
+        &dummy_env,
+        ql::batchspec_t::default_for(ql::batch_type_t::TERMINAL),
+        transforms,
+        boost::optional<ql::terminal_variant_t>(ql::count_wire_func_t()),
+        sorting_t::UNORDERED,
+        &res,
+        release_superblock_t::RELEASE);
+
+    ql::grouped_t<uint64_t> *counts = boost::get<ql::grouped_t<uint64_t> >(&res.result);
+    guarantee(counts != NULL);
+    // An empty range produces no group at all.
+    return counts->size() == 0 ? 0 : counts->begin()->second;
+}
+
+/* Like `count_rows()`, but runs `count()` over the rows whose `sid` is in
+`datum_range`, through the secondary index `sindex_name`. */
+uint64_t count_rows_via_sindex(
+        store_t *store,
+        const sindex_name_t &sindex_name,
+        const ql::datum_range_t &datum_range,
+        const std::vector<ql::transform_variant_t> &transforms) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> super_block;
+    store->acquire_superblock_for_read(
+            &token, &txn, &super_block,
+            &dummy_interruptor, true);
+
+    scoped_ptr_t<sindex_superblock_t> sindex_sb;
+    uuid_u sindex_uuid;
+    std::vector<char> opaque_definition;
+    bool sindex_exists = store->acquire_sindex_superblock_for_read(
+            sindex_name,
+            "",
+            super_block.get(),
+            &sindex_sb,
+            &opaque_definition,
+            &sindex_uuid);
+    guarantee(sindex_exists);
+
+    sindex_disk_info_t sindex_info;
+    try {
+        deserialize_sindex_info(opaque_definition, &sindex_info);
+    } catch (const archive_exc_t &e) {
+        crash("%s", e.what());
+    }
+
+    ql::env_t dummy_env(&dummy_interruptor,
+                        ql::return_empty_normal_batches_t::NO,
+                        reql_version_t::LATEST);
+    rget_read_response_t res;
+    rdb_rget_secondary_slice(
+        store->get_sindex_slice(sindex_uuid),
+        datum_range,
+        region_t(datum_range.to_sindex_keyrange(ql::skey_version_t::post_1_16)),
+        sindex_sb.get(),
+        &dummy_env,
+        ql::batchspec_t::default_for(ql::batch_type_t::TERMINAL),
+        transforms,
+        boost::optional<ql::terminal_variant_t>(ql::count_wire_func_t()),
+        key_range_t::universe(),
+        sorting_t::UNORDERED,
+        sindex_info,
+        &res,
+        release_superblock_t::RELEASE);
+
+    ql::grouped_t<uint64_t> *counts = boost::get<ql::grouped_t<uint64_t> >(&res.result);
+    guarantee(counts != NULL);
+    return counts->size() == 0 ? 0 : counts->begin()->second;
+}
+
+TPTEST(RDBBtree, CountKeys) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            scoped_ptr_t<outdated_index_report_t>(),
+            generate_uuid());
+
+    ql::sym_t one(1);
+    std::vector<ql::transform_variant_t> identity;
+    identity.push_back(ql::map_wire_func_t(
+        ql::r::var(one).release_counted(), make_vector(one),
+        ql::backtrace_id_t::empty()));
+
+    std::vector<key_range_t> ranges;
+    ranges.push_back(key_range_t::universe());
+    ranges.push_back(key_range_t(
+        key_range_t::closed,
+        store_key_t(ql::datum_t(100.0).print_primary()),
+        key_range_t::open,
+        store_key_t(ql::datum_t(700.0).print_primary())));
+
+    /* Bounds that fall exactly on stored values, so that the rows on the
+    boundaries have to be checked one by one. */
+    std::vector<ql::datum_range_t> sindex_ranges;
+    sindex_ranges.push_back(ql::datum_range_t::universe());
+    sindex_ranges.push_back(ql::datum_range_t(
+        ql::datum_t(100.0 * 100.0), key_range_t::closed,
+        ql::datum_t(500.0 * 500.0), key_range_t::open));
+    sindex_ranges.push_back(ql::datum_range_t(
+        ql::datum_t(100.0 * 100.0), key_range_t::open,
+        ql::datum_t(500.0 * 500.0), key_range_t::closed));
+    sindex_ranges.push_back(ql::datum_range_t(ql::datum_t(300.0 * 300.0)));
+
+    sindex_name_t sindex_name = create_sindex(&store);
+    for (int i = 0; ; ++i) {
+        try {
+            count_rows_via_sindex(&store, sindex_name, sindex_ranges[0],
+                                  std::vector<ql::transform_variant_t>());
+            break;
+        } catch (const sindex_not_ready_exc_t &) {
+            ASSERT_LT(i, MAX_RETRIES_FOR_SINDEX_POSTCONSTRUCT);
+        }
+        nap(100);
+    }
+
+    std::set<int> live;
+    auto check_counts = [&]() {
+        for (const key_range_t &range : ranges) {
+            uint64_t expected = 0;
+            for (int i : live) {
+                if (range.contains_key(
+                        store_key_t(ql::datum_t(static_cast<double>(i)).print_primary()))) {
+                    ++expected;
+                }
+            }
+            EXPECT_EQ(expected, count_rows(&store, range, identity));
+            EXPECT_EQ(expected, count_rows(&store, range,
+                                           std::vector<ql::transform_variant_t>()));
+        }
+        for (const ql::datum_range_t &datum_range : sindex_ranges) {
+            uint64_t expected = 0;
+            for (int i : live) {
+                if (datum_range.contains(ql::datum_t(static_cast<double>(i * i)))) {
+                    ++expected;
+                }
+            }
+            EXPECT_EQ(expected, count_rows_via_sindex(&store, sindex_name,
+                                                      datum_range, identity));
+            EXPECT_EQ(expected, count_rows_via_sindex(
+                &store, sindex_name, datum_range,
+                std::vector<ql::transform_variant_t>()));
+        }
+    };
+
+    check_counts();
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+    for (int i = 0; i < TOTAL_KEYS_TO_INSERT; ++i) {
+        live.insert(i);
+    }
+    check_counts();
+
+    /* Deleted rows leave tombstones behind in the leaves, which must not be
+    counted. Deleting a contiguous block empties some leaves entirely. */
+    for (int i = 0; i < TOTAL_KEYS_TO_INSERT; ++i) {
+        if (i % 3 == 0
+            || (i >= TOTAL_KEYS_TO_INSERT * 2 / 5 && i < TOTAL_KEYS_TO_INSERT * 3 / 5)) {
+            delete_row(i, &store);
+            live.erase(i);
+        }
+    }
+    check_counts();
+
+    for (int i = 0; i < TOTAL_KEYS_TO_INSERT; ++i) {
+        delete_row(i, &store);
+    }
+    live.clear();
+    check_counts();
+}
+
 } //namespace unittest
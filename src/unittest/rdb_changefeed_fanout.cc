@@ -0,0 +1,559 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <stdio.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "arch/timing.hpp"
+#include "buffer_cache/cache_balancer.hpp"
+#include "concurrency/pmap.hpp"
+#include "extproc/extproc_pool.hpp"
+#include "extproc/extproc_spawner.hpp"
+#include "perfmon/collect.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "rdb_protocol/protocol.hpp"
+#include "rdb_protocol/store.hpp"
+#include "serializer/config.hpp"
+#include "store_subview.hpp"
+#include "unittest/clustering_utils.hpp"
+#include "unittest/dummy_namespace_interface.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+/* These tests measure how the write path of a table scales with the number of
+changefeeds on it.  `N` writers insert rows as fast as they can while `M` feeds
+(split between range, point and limit feeds) are subscribed to the table's
+`server_t`, and we report the write throughput and how long changes took to reach
+the feeds.  Each feed gets its own mailbox, as if every feed were on a different
+server, which is the worst case for the fan-out in `server_t::send_all`. */
+
+namespace unittest {
+
+using ql::changefeed::msg_t;
+using ql::changefeed::stamped_msg_t;
+
+struct fanout_config_t {
+    size_t writers;
+    size_t writes_per_writer;
+    size_t range_feeds;
+    size_t point_feeds;
+    size_t limit_feeds;
+};
+
+store_key_t fanout_key(size_t id) {
+    return store_key_t(ql::datum_t(static_cast<double>(id)).print_primary());
+}
+
+/* Stands in for a `client_t`: it counts the changes the `server_t` sends it, the
+mailbox messages they arrive in, and how long ago the writes that made them started
+(the rows carry that time in `ts`). */
+class fanout_feed_t {
+public:
+    fanout_feed_t(mailbox_manager_t *manager, region_t _region)
+        : region(std::move(_region)),
+          changes(0),
+          limit_changes(0),
+          batches(0),
+          total_latency(0),
+          max_latency(0),
+          mailbox(manager,
+                  std::bind(&fanout_feed_t::on_msgs, this, ph::_1, ph::_2)) { }
+
+    ql::changefeed::client_t::addr_t get_addr() { return mailbox.get_address(); }
+
+    const region_t region;
+    size_t changes;
+    size_t limit_changes;
+    size_t batches;
+    ticks_t total_latency;
+    ticks_t max_latency;
+
+private:
+    void on_msgs(signal_t *, const std::vector<stamped_msg_t> &msgs) {
+        ticks_t now = get_ticks();
+        ++batches;
+        for (const auto &msg : msgs) {
+            ql::datum_t row;
+            if (auto change = boost::get<msg_t::change_t>(&msg.submsg.op)) {
+                ++changes;
+                row = change->new_val;
+            } else if (auto limit_change
+                       = boost::get<msg_t::limit_change_t>(&msg.submsg.op)) {
+                ++limit_changes;
+                if (limit_change->new_val) {
+                    row = limit_change->new_val->second.second;
+                }
+            }
+            if (row.has()) {
+                ticks_t start = static_cast<ticks_t>(row.get_field("ts").as_num());
+                ticks_t latency = now > start ? now - start : 0;
+                total_latency += latency;
+                max_latency = std::max(max_latency, latency);
+            }
+        }
+    }
+
+    mailbox_t<void(std::vector<stamped_msg_t>)> mailbox;
+
+    DISABLE_COPYING(fanout_feed_t);
+};
+
+void subscribe(namespace_interface_t *nsi, order_source_t *osource,
+               fanout_feed_t *feed) {
+    changefeed_subscribe_t subscribe(feed->get_addr(),
+                                     std::vector<ql::filter_wire_func_t>());
+    subscribe.region = feed->region;
+    read_t read(subscribe, profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE);
+    read_response_t response;
+    cond_t interruptor;
+    nsi->read(read, &response,
+              osource->check_in("unittest::subscribe(rdb_changefeed_fanout.cc)"),
+              &interruptor);
+}
+
+void subscribe_limit(namespace_interface_t *nsi, order_source_t *osource,
+                     fanout_feed_t *feed, size_t limit) {
+    ql::changefeed::keyspec_t::limit_t spec{
+        ql::changefeed::keyspec_t::range_t{
+            std::vector<ql::transform_variant_t>(),
+            boost::optional<std::string>(),
+            sorting_t::DESCENDING,
+            ql::datum_range_t::universe()},
+        limit};
+    read_t read(
+        changefeed_limit_subscribe_t(
+            feed->get_addr(),
+            generate_uuid(),
+            std::move(spec),
+            "fanout",
+            std::map<std::string, ql::wire_func_t>(),
+            region_t::universe()),
+        profile_bool_t::DONT_PROFILE,
+        read_mode_t::SINGLE);
+    read_response_t response;
+    cond_t interruptor;
+    nsi->read(read, &response,
+              osource->check_in("unittest::subscribe_limit(rdb_changefeed_fanout.cc)"),
+              &interruptor);
+}
+
+void write_row(namespace_interface_t *nsi, size_t id) {
+    ql::datum_object_builder_t builder;
+    builder.overwrite("id", ql::datum_t(static_cast<double>(id)));
+    builder.overwrite("ts", ql::datum_t(static_cast<double>(get_ticks())));
+    write_t write(
+        point_write_t(fanout_key(id), std::move(builder).to_datum()),
+        DURABILITY_REQUIREMENT_SOFT,
+        profile_bool_t::DONT_PROFILE,
+        ql::configured_limits_t());
+    write_response_t response;
+    cond_t interruptor;
+    nsi->write(write, &response, order_token_t::ignore, &interruptor);
+    point_write_response_t *point_response
+        = boost::get<point_write_response_t>(&response.response);
+    ASSERT_TRUE(point_response != NULL);
+}
+
+/* Calls `fn` with a table whose single store has a `changefeed::server_t`. Its stats
+show up as `changefeed_fanout`. */
+void with_changefeed_table(
+        const std::function<void(mailbox_manager_t *,
+                                 namespace_interface_t *,
+                                 order_source_t *)> &fn) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(&file_opener,
+                                  standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(),
+                                     &file_opener,
+                                     &get_global_perfmon_collection());
+
+    // Stores only get a `changefeed::server_t` if there's a mailbox manager.
+    simple_mailbox_cluster_t cluster;
+    extproc_pool_t extproc_pool(2);
+    rdb_context_t ctx(&extproc_pool, cluster.get_mailbox_manager(), NULL,
+                      boost::shared_ptr<
+                          semilattice_readwrite_view_t<auth_semilattice_metadata_t> >(),
+                      &get_global_perfmon_collection(), "");
+
+    perfmon_collection_t stats;
+    perfmon_membership_t stats_membership(
+        &get_global_perfmon_collection(), &stats, "changefeed_fanout");
+    store_t store(region_t::universe(), &serializer, &balancer, "store", true,
+                  &stats, &ctx, &io_backender, base_path_t("."),
+                  scoped_ptr_t<outdated_index_report_t>(), generate_uuid());
+
+    store_subview_t store_view(&store, region_t::universe());
+    store_view_t *store_ptr = &store_view;
+    order_source_t order_source;
+    dummy_namespace_interface_t nsi(std::vector<region_t>{region_t::universe()},
+                                    &store_ptr, &order_source, &ctx, true);
+
+    fn(cluster.get_mailbox_manager(), &nsi, &order_source);
+}
+
+ql::datum_t get_changefeed_stats() {
+    return perfmon_get_stats()
+        .get_field("changefeed_fanout")
+        .get_field("store")
+        .get_field("changefeeds");
+}
+
+/* What `run_fanout()` measured. */
+struct fanout_result_t {
+    size_t messages;
+    ticks_t write_time;
+    ticks_t receive_time;
+    ticks_t total_latency;
+    ticks_t max_latency;
+};
+
+/* Subscribes the feeds that `config` asks for, runs its writers, and waits until
+every feed has seen all of the changes in its region. */
+fanout_result_t run_fanout(const fanout_config_t &config,
+                           mailbox_manager_t *mailbox_manager,
+                           namespace_interface_t *nsi,
+                           order_source_t *order_source) {
+    const size_t total_writes = config.writers * config.writes_per_writer;
+
+    // Range feeds each watch a slice of the keys, point feeds a single key, and
+    // limit feeds the top 10 rows of the whole table.
+    std::vector<scoped_ptr_t<fanout_feed_t> > feeds;
+    for (size_t i = 0; i < config.range_feeds; ++i) {
+        size_t lo = i * total_writes / config.range_feeds;
+        size_t hi = (i + 1) * total_writes / config.range_feeds;
+        feeds.push_back(make_scoped<fanout_feed_t>(
+            mailbox_manager,
+            region_t(key_range_t(key_range_t::closed, fanout_key(lo),
+                                 key_range_t::open, fanout_key(hi)))));
+    }
+    for (size_t i = 0; i < config.point_feeds; ++i) {
+        feeds.push_back(make_scoped<fanout_feed_t>(
+            mailbox_manager,
+            rdb_protocol::monokey_region(fanout_key(i * 7 % total_writes))));
+    }
+    const size_t first_limit_feed = feeds.size();
+    for (size_t i = 0; i < config.limit_feeds; ++i) {
+        feeds.push_back(make_scoped<fanout_feed_t>(
+            mailbox_manager, region_t::universe()));
+    }
+    for (size_t i = 0; i < feeds.size(); ++i) {
+        subscribe(nsi, order_source, feeds[i].get());
+        if (i >= first_limit_feed) {
+            subscribe_limit(nsi, order_source, feeds[i].get(), 10);
+        }
+    }
+
+    std::vector<size_t> expected(feeds.size(), 0);
+    for (size_t id = 0; id < total_writes; ++id) {
+        store_key_t key = fanout_key(id);
+        for (size_t i = 0; i < feeds.size(); ++i) {
+            if (region_contains_key(feeds[i]->region, key)) {
+                ++expected[i];
+            }
+        }
+    }
+
+    fanout_result_t result;
+    ticks_t start = get_ticks();
+    pmap(config.writers, [&](int64_t writer) {
+        for (size_t j = 0; j < config.writes_per_writer; ++j) {
+            write_row(nsi, writer * config.writes_per_writer + j);
+        }
+    });
+    result.write_time = get_ticks() - start;
+
+    signal_timer_t timeout(60 * 1000);
+    for (size_t i = 0; i < feeds.size(); ++i) {
+        while (feeds[i]->changes < expected[i]) {
+            EXPECT_FALSE(timeout.is_pulsed())
+                << "feed " << i << " only got " << feeds[i]->changes
+                << " of " << expected[i] << " changes";
+            if (timeout.is_pulsed()) {
+                break;
+            }
+            nap(1);
+        }
+    }
+    result.receive_time = get_ticks() - start;
+
+    result.messages = 0;
+    result.total_latency = 0;
+    result.max_latency = 0;
+    for (const auto &feed : feeds) {
+        result.messages += feed->changes + feed->limit_changes;
+        result.total_latency += feed->total_latency;
+        result.max_latency = std::max(result.max_latency, feed->max_latency);
+    }
+    return result;
+}
+
+void run_fanout_benchmark(const fanout_config_t &config,
+                          mailbox_manager_t *mailbox_manager,
+                          namespace_interface_t *nsi,
+                          order_source_t *order_source) {
+    fanout_result_t result = run_fanout(config, mailbox_manager, nsi, order_source);
+    const size_t total_writes = config.writers * config.writes_per_writer;
+    printf("changefeed fan-out: %zu writers, %zu range / %zu point / %zu limit feeds: "
+           "%.0f writes/s, %.0f messages/s, latency %.3f ms mean / %.3f ms max\n",
+           config.writers, config.range_feeds, config.point_feeds, config.limit_feeds,
+           total_writes / ticks_to_secs(result.write_time),
+           result.messages / ticks_to_secs(result.receive_time),
+           result.messages == 0
+               ? 0.0 : ticks_to_secs(result.total_latency) * 1000 / result.messages,
+           ticks_to_secs(result.max_latency) * 1000);
+}
+
+void run_fanout_benchmarks() {
+    // Kept small enough to run with the other unit tests; raise these to measure
+    // bigger fan-outs.
+    for (size_t feeds : {0, 4, 40, 200}) {
+        fanout_config_t config;
+        config.writers = 8;
+        config.writes_per_writer = 125;
+        config.range_feeds = feeds;
+        config.point_feeds = feeds;
+        config.limit_feeds = feeds / 4;
+        with_changefeed_table(std::bind(&run_fanout_benchmark, config,
+                                        ph::_1, ph::_2, ph::_3));
+    }
+}
+
+// This is a benchmark rather than a test, so it only runs when asked for with
+// `--gtest_also_run_disabled_tests`.
+TEST(RDBChangefeeds, DISABLED_FanOutBenchmark) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(&run_fanout_benchmarks);
+}
+
+
+void wait_for_changes(fanout_feed_t *feed, size_t expected) {
+    signal_timer_t timeout(60 * 1000);
+    while (feed->changes < expected) {
+        ASSERT_FALSE(timeout.is_pulsed())
+            << "only got " << feed->changes << " of " << expected << " changes";
+        nap(1);
+    }
+}
+
+void run_batching_test(mailbox_manager_t *mailbox_manager,
+                       namespace_interface_t *nsi,
+                       order_source_t *order_source) {
+    fanout_feed_t feed(mailbox_manager, region_t::universe());
+    subscribe(nsi, order_source, &feed);
+
+    // A change on an idle feed is sent right away rather than being held back
+    // for the batch window, so it never shows up in the queue.
+    write_row(nsi, 0);
+    EXPECT_EQ(0, get_changefeed_stats().get_field("queue_depth").as_num());
+    wait_for_changes(&feed, 1);
+    EXPECT_EQ(1u, feed.batches);
+
+    // A burst of writes from many writers is batched into fewer messages.
+    const size_t writers = 8, writes_per_writer = 125;
+    pmap(writers, [&](int64_t writer) {
+        for (size_t j = 0; j < writes_per_writer; ++j) {
+            write_row(nsi, 1 + writer * writes_per_writer + j);
+        }
+    });
+    wait_for_changes(&feed, 1 + writers * writes_per_writer);
+    EXPECT_EQ(1 + writers * writes_per_writer, feed.changes);
+    EXPECT_LT(feed.batches, feed.changes);
+    EXPECT_EQ(0, get_changefeed_stats().get_field("queue_depth").as_num());
+}
+
+TEST(RDBChangefeeds, Batching) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(std::bind(&with_changefeed_table,
+                                 std::function<void(mailbox_manager_t *,
+                                                    namespace_interface_t *,
+                                                    order_source_t *)>(
+                                     &run_batching_test)));
+}
+
+void run_fanout_stats_test(mailbox_manager_t *mailbox_manager,
+                           namespace_interface_t *nsi,
+                           order_source_t *order_source) {
+    fanout_config_t config;
+    config.writers = 4;
+    config.writes_per_writer = 25;
+    config.range_feeds = 4;
+    config.point_feeds = 4;
+    config.limit_feeds = 1;
+    fanout_result_t result = run_fanout(config, mailbox_manager, nsi, order_source);
+
+    // Every change the feeds got was counted by the `server_t`, serializing them
+    // cost something, and nothing is left in the queue once they have arrived.
+    ql::datum_t changefeed_stats = get_changefeed_stats();
+    EXPECT_GE(changefeed_stats.get_field("total_messages_sent").as_num(),
+              result.messages);
+    EXPECT_GT(changefeed_stats.get_field("total_bytes_serialized").as_num(), 0);
+    EXPECT_EQ(0, changefeed_stats.get_field("queue_depth").as_num());
+}
+
+TEST(RDBChangefeeds, FanOutStats) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(std::bind(&with_changefeed_table,
+                                 std::function<void(mailbox_manager_t *,
+                                                    namespace_interface_t *,
+                                                    order_source_t *)>(
+                                     &run_fanout_stats_test)));
+}
+
+/* Keeps the rows of a limit feed up to date the way a `limit_sub_t` would. */
+class limit_feed_t {
+public:
+    explicit limit_feed_t(mailbox_manager_t *manager)
+        : stopped(false),
+          mailbox(manager,
+                  std::bind(&limit_feed_t::on_msgs, this, ph::_1, ph::_2)) { }
+
+    ql::changefeed::client_t::addr_t get_addr() { return mailbox.get_address(); }
+
+    // The ids of the rows the feed has, keyed by their `item_t` keys.
+    std::map<std::string, size_t> rows;
+    bool stopped;
+
+private:
+    static size_t row_id(const ql::changefeed::item_t &item) {
+        return static_cast<size_t>(item.second.second.get_field("id").as_num());
+    }
+
+    void on_msgs(signal_t *, const std::vector<stamped_msg_t> &msgs) {
+        for (const auto &msg : msgs) {
+            if (auto start = boost::get<msg_t::limit_start_t>(&msg.submsg.op)) {
+                for (const auto &item : start->start_data) {
+                    rows[item.first] = row_id(item);
+                }
+            } else if (auto change
+                       = boost::get<msg_t::limit_change_t>(&msg.submsg.op)) {
+                if (change->old_key) {
+                    EXPECT_EQ(1u, rows.erase(*change->old_key));
+                }
+                if (change->new_val) {
+                    rows[change->new_val->first] = row_id(*change->new_val);
+                }
+            } else if (boost::get<msg_t::limit_stop_t>(&msg.submsg.op) != nullptr) {
+                stopped = true;
+            }
+        }
+    }
+
+    mailbox_t<void(std::vector<stamped_msg_t>)> mailbox;
+
+    DISABLE_COPYING(limit_feed_t);
+};
+
+void delete_row(namespace_interface_t *nsi, size_t id) {
+    write_t write(
+        point_delete_t(fanout_key(id)),
+        DURABILITY_REQUIREMENT_SOFT,
+        profile_bool_t::DONT_PROFILE,
+        ql::configured_limits_t());
+    write_response_t response;
+    cond_t interruptor;
+    nsi->write(write, &response, order_token_t::ignore, &interruptor);
+}
+
+std::set<size_t> id_range(size_t first, size_t last) {
+    std::set<size_t> ids;
+    for (size_t id = first; id < last; ++id) {
+        ids.insert(id);
+    }
+    return ids;
+}
+
+void wait_for_limit_rows(limit_feed_t *feed, const std::set<size_t> &expected) {
+    signal_timer_t timeout(60 * 1000);
+    for (;;) {
+        std::set<size_t> ids;
+        for (const auto &pair : feed->rows) {
+            ids.insert(pair.second);
+        }
+        if (ids == expected) {
+            break;
+        }
+        ASSERT_FALSE(timeout.is_pulsed())
+            << "expected " << expected.size() << " rows from " << *expected.begin()
+            << " but got " << ids.size() << " rows";
+        nap(1);
+    }
+}
+
+void run_limit_buffer_test(mailbox_manager_t *mailbox_manager,
+                           namespace_interface_t *nsi,
+                           order_source_t *order_source) {
+    const size_t limit = 5, total_rows = 200;
+    const size_t buffer_size = ql::changefeed::limit_buffer_size(limit);
+    for (size_t id = 0; id < total_rows; ++id) {
+        write_row(nsi, id);
+    }
+
+    // The feed holds the rows with the highest ids.
+    limit_feed_t feed(mailbox_manager);
+    ql::changefeed::keyspec_t::limit_t spec{
+        ql::changefeed::keyspec_t::range_t{
+            std::vector<ql::transform_variant_t>(),
+            boost::optional<std::string>(),
+            sorting_t::DESCENDING,
+            ql::datum_range_t::universe()},
+        limit};
+    read_t read(
+        changefeed_limit_subscribe_t(
+            feed.get_addr(),
+            generate_uuid(),
+            std::move(spec),
+            "fanout",
+            std::map<std::string, ql::wire_func_t>(),
+            region_t::universe()),
+        profile_bool_t::DONT_PROFILE,
+        read_mode_t::SINGLE);
+    read_response_t response;
+    cond_t interruptor;
+    nsi->read(read, &response,
+              order_source->check_in("unittest::run_limit_buffer_test"),
+              &interruptor);
+    wait_for_limit_rows(&feed, id_range(total_rows - limit, total_rows));
+
+    // Deleting rows from the top of the feed replaces them from the buffer, and
+    // once the buffer runs out, from the rows we read to refill it.  We delete more
+    // than twice as many rows as the buffer holds so that it's refilled more than
+    // once.
+    const size_t deletes = 2 * (limit + buffer_size) + 7;
+    ASSERT_LT(deletes + limit, total_rows);
+    for (size_t i = 0; i < deletes; ++i) {
+        size_t top = total_rows - 1 - i;
+        delete_row(nsi, top);
+        wait_for_limit_rows(&feed, id_range(top - limit, top));
+    }
+
+    // A new row at the top pushes a row into the buffer, and it comes back when the
+    // new row is deleted again.
+    const size_t top = total_rows - deletes;
+    write_row(nsi, total_rows);
+    std::set<size_t> expected = id_range(top - limit + 1, top);
+    expected.insert(total_rows);
+    wait_for_limit_rows(&feed, expected);
+    delete_row(nsi, total_rows);
+    wait_for_limit_rows(&feed, id_range(top - limit, top));
+    EXPECT_FALSE(feed.stopped);
+}
+
+TEST(RDBChangefeeds, LimitBuffer) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(std::bind(&with_changefeed_table,
+                                 std::function<void(mailbox_manager_t *,
+                                                    namespace_interface_t *,
+                                                    order_source_t *)>(
+                                     &run_limit_buffer_test)));
+}
+
+}  // namespace unittest
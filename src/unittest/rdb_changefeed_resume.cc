@@ -0,0 +1,319 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "arch/timing.hpp"
+#include "buffer_cache/cache_balancer.hpp"
+#include "extproc/extproc_pool.hpp"
+#include "extproc/extproc_spawner.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "rdb_protocol/protocol.hpp"
+#include "rdb_protocol/store.hpp"
+#include "serializer/config.hpp"
+#include "serializer/write_ahead_log.hpp"
+#include "store_subview.hpp"
+#include "unittest/clustering_utils.hpp"
+#include "unittest/dummy_namespace_interface.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+/* These tests check that a `changefeed::server_t`'s change log survives a restart of
+its store, and that feeds are told how far they got even when they aren't sent any
+changes. */
+
+namespace unittest {
+
+using ql::changefeed::log_position_t;
+using ql::changefeed::log_read_t;
+using ql::changefeed::msg_t;
+using ql::changefeed::stamped_msg_t;
+
+store_key_t resume_key(size_t id) {
+    return store_key_t(ql::datum_t(static_cast<double>(id)).print_primary());
+}
+
+/* Stands in for a `client_t`: it remembers the position of the last change or
+`position_t` the `server_t` sent it. */
+class resume_feed_t {
+public:
+    explicit resume_feed_t(mailbox_manager_t *manager)
+        : changes(0),
+          positions(0),
+          last_seq(0),
+          mailbox(manager,
+                  std::bind(&resume_feed_t::on_msgs, this, ph::_1, ph::_2)) { }
+
+    ql::changefeed::client_t::addr_t get_addr() { return mailbox.get_address(); }
+
+    size_t changes;
+    size_t positions;
+    uint64_t last_seq;
+
+private:
+    void on_msgs(signal_t *, const std::vector<stamped_msg_t> &msgs) {
+        for (const auto &msg : msgs) {
+            if (boost::get<msg_t::change_t>(&msg.submsg.op) != nullptr) {
+                ++changes;
+            } else if (boost::get<msg_t::position_t>(&msg.submsg.op) != nullptr) {
+                ++positions;
+            } else {
+                continue;
+            }
+            EXPECT_LT(last_seq, msg.log_seq);
+            last_seq = msg.log_seq;
+        }
+    }
+
+    mailbox_t<void(std::vector<stamped_msg_t>)> mailbox;
+
+    DISABLE_COPYING(resume_feed_t);
+};
+
+/* Owns a table with a single store whose change log is at `change_log_path`. */
+class resume_table_t {
+public:
+    resume_table_t(const serializer_filepath_t &filepath,
+                   bool create,
+                   const std::string &change_log_path,
+                   io_backender_t *io_backender,
+                   rdb_context_t *ctx)
+        : balancer(GIGABYTE),
+          file_opener(filepath, io_backender) {
+        if (create) {
+            standard_serializer_t::create(&file_opener,
+                                          standard_serializer_t::static_config_t());
+        }
+        serializer.init(new standard_serializer_t(
+            standard_serializer_t::dynamic_config_t(),
+            &file_opener,
+            &get_global_perfmon_collection()));
+        store.init(new store_t(region_t::universe(), serializer.get(), &balancer,
+                               "store", create, &get_global_perfmon_collection(),
+                               ctx, io_backender, base_path_t("."),
+                               scoped_ptr_t<outdated_index_report_t>(),
+                               generate_uuid(),
+                               change_log_path));
+        store_view.init(new store_subview_t(store.get(), region_t::universe()));
+        store_ptr = store_view.get();
+        nsi.init(new dummy_namespace_interface_t(
+            std::vector<region_t>{region_t::universe()},
+            &store_ptr, &order_source, ctx, true));
+    }
+
+    void subscribe(resume_feed_t *feed, const region_t &region) {
+        changefeed_subscribe_t subscribe(feed->get_addr(),
+                                         std::vector<ql::filter_wire_func_t>());
+        subscribe.region = region;
+        read_response_t response;
+        cond_t interruptor;
+        nsi->read(read_t(subscribe, profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE),
+                  &response,
+                  order_source.check_in("unittest::resume_table_t::subscribe"),
+                  &interruptor);
+    }
+
+    /* Reads the change log like a feed that's created with `include_resume_tokens`
+    or `resume_from` does. */
+    std::pair<uuid_u, log_read_t> read_log(
+            resume_feed_t *feed,
+            const boost::optional<log_position_t> &resume_from) {
+        changefeed_stamp_t stamp(feed->get_addr());
+        stamp.read_log = true;
+        stamp.resume_from = resume_from;
+        read_response_t response;
+        cond_t interruptor;
+        nsi->read(read_t(stamp, profile_bool_t::DONT_PROFILE, read_mode_t::SINGLE),
+                  &response,
+                  order_source.check_in("unittest::resume_table_t::read_log"),
+                  &interruptor);
+        auto stamp_response =
+            boost::get<changefeed_stamp_response_t>(&response.response);
+        guarantee(stamp_response != nullptr);
+        guarantee(stamp_response->logs.size() == 1);
+        return *stamp_response->logs.begin();
+    }
+
+    void write_row(size_t id) {
+        ql::datum_object_builder_t builder;
+        builder.overwrite("id", ql::datum_t(static_cast<double>(id)));
+        write_t write(
+            point_write_t(resume_key(id), std::move(builder).to_datum()),
+            DURABILITY_REQUIREMENT_SOFT,
+            profile_bool_t::DONT_PROFILE,
+            ql::configured_limits_t());
+        write_response_t response;
+        cond_t interruptor;
+        nsi->write(write, &response, order_token_t::ignore, &interruptor);
+    }
+
+private:
+    dummy_cache_balancer_t balancer;
+    filepath_file_opener_t file_opener;
+    scoped_ptr_t<standard_serializer_t> serializer;
+
+public:
+    scoped_ptr_t<store_t> store;
+
+private:
+    scoped_ptr_t<store_subview_t> store_view;
+    store_view_t *store_ptr;
+    order_source_t order_source;
+    scoped_ptr_t<dummy_namespace_interface_t> nsi;
+};
+
+void wait_for_seq(resume_feed_t *feed, uint64_t seq) {
+    signal_timer_t timeout(60 * 1000);
+    while (feed->last_seq < seq) {
+        ASSERT_FALSE(timeout.is_pulsed())
+            << "only got to " << feed->last_seq << " of " << seq;
+        nap(1);
+    }
+}
+
+void run_change_log_restart_test() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+    const std::string change_log_path = temp_file.name().permanent_path() + ".changes";
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    simple_mailbox_cluster_t cluster;
+    extproc_pool_t extproc_pool(2);
+    rdb_context_t ctx(&extproc_pool, cluster.get_mailbox_manager(), NULL,
+                      boost::shared_ptr<
+                          semilattice_readwrite_view_t<auth_semilattice_metadata_t> >(),
+                      &get_global_perfmon_collection(), "");
+
+    uuid_u server_uuid;
+    log_position_t token;
+    {
+        resume_table_t table(temp_file.name(), true, change_log_path,
+                             &io_backender, &ctx);
+        resume_feed_t feed(cluster.get_mailbox_manager());
+        table.subscribe(&feed, region_t::universe());
+        std::pair<uuid_u, log_read_t> start = table.read_log(&feed, boost::none);
+        server_uuid = start.first;
+        EXPECT_FALSE(start.second.expired);
+        for (size_t id = 0; id < 10; ++id) {
+            table.write_row(id);
+        }
+        wait_for_seq(&feed, start.second.seq + 10);
+        EXPECT_EQ(10u, feed.changes);
+        // The token a feed would have handed out with its fifth change.
+        token[server_uuid] = start.second.seq + 5;
+    }
+
+    {
+        // The log was closed cleanly, so the new `server_t` takes over the old one's
+        // UUID and the token still works.
+        resume_table_t table(temp_file.name(), false, change_log_path,
+                             &io_backender, &ctx);
+        resume_feed_t feed(cluster.get_mailbox_manager());
+        table.subscribe(&feed, region_t::universe());
+        std::pair<uuid_u, log_read_t> resumed = table.read_log(&feed, token);
+        EXPECT_EQ(server_uuid, resumed.first);
+        ASSERT_FALSE(resumed.second.expired);
+        EXPECT_EQ(token[server_uuid] + 5, resumed.second.seq);
+        ASSERT_EQ(5u, resumed.second.changes.size());
+        for (size_t i = 0; i < 5; ++i) {
+            EXPECT_EQ(resume_key(5 + i), resumed.second.changes[i].pkey);
+        }
+
+        // New changes carry on from where the log left off.
+        table.write_row(10);
+        wait_for_seq(&feed, resumed.second.seq + 1);
+        token[server_uuid] = feed.last_seq;
+
+        // A backfill (or anything else that changes the data without telling the
+        // feeds) means the changes before it can't be resumed from anymore.
+        cond_t interruptor;
+        table.store->reset_data(binary_blob_t(version_t::zero()),
+                                region_t::universe(),
+                                write_durability_t::SOFT,
+                                &interruptor);
+        EXPECT_TRUE(table.read_log(&feed, token).second.expired);
+        token[server_uuid] = table.read_log(&feed, boost::none).second.seq;
+        EXPECT_FALSE(table.read_log(&feed, token).second.expired);
+    }
+
+    {
+        // Simulate a crash by copying the log before it's closed.  A log that wasn't
+        // closed cleanly is thrown away, because it may be missing changes.
+        const std::string crashed_path = change_log_path + ".crashed";
+        {
+            resume_table_t table(temp_file.name(), false, change_log_path,
+                                 &io_backender, &ctx);
+            resume_feed_t feed(cluster.get_mailbox_manager());
+            std::pair<uuid_u, log_read_t> resumed = table.read_log(&feed, token);
+            EXPECT_FALSE(resumed.second.expired);
+            for (int i = 0; i < 2; ++i) {
+                const std::string from = strprintf("%s.%d", change_log_path.c_str(), i);
+                const std::string to = strprintf("%s.%d", crashed_path.c_str(), i);
+                copy_file(from, to);
+            }
+        }
+        {
+            resume_table_t table(temp_file.name(), false, crashed_path,
+                                 &io_backender, &ctx);
+            resume_feed_t feed(cluster.get_mailbox_manager());
+            std::pair<uuid_u, log_read_t> resumed = table.read_log(&feed, token);
+            EXPECT_NE(server_uuid, resumed.first);
+            EXPECT_TRUE(resumed.second.expired);
+        }
+        write_ahead_log_t::remove(crashed_path);
+    }
+    write_ahead_log_t::remove(change_log_path);
+}
+
+TEST(RDBChangefeeds, ChangeLogSurvivesRestart) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(&run_change_log_restart_test);
+}
+
+void run_change_log_position_test() {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    simple_mailbox_cluster_t cluster;
+    extproc_pool_t extproc_pool(2);
+    rdb_context_t ctx(&extproc_pool, cluster.get_mailbox_manager(), NULL,
+                      boost::shared_ptr<
+                          semilattice_readwrite_view_t<auth_semilattice_metadata_t> >(),
+                      &get_global_perfmon_collection(), "");
+    const std::string change_log_path = temp_file.name().permanent_path() + ".changes";
+    {
+        resume_table_t table(temp_file.name(), true, change_log_path,
+                             &io_backender, &ctx);
+
+        // This feed only watches the row with id 0, so it isn't sent the other
+        // changes, but it's told how far it got once they stop.
+        resume_feed_t feed(cluster.get_mailbox_manager());
+        table.subscribe(&feed, rdb_protocol::monokey_region(resume_key(0)));
+        const uint64_t start = table.read_log(&feed, boost::none).second.seq;
+        for (size_t id = 1; id <= 100; ++id) {
+            table.write_row(id);
+        }
+        wait_for_seq(&feed, start + 100);
+        EXPECT_EQ(0u, feed.changes);
+        EXPECT_GE(feed.positions, 1u);
+        EXPECT_LT(feed.positions, 100u);
+
+        // A feed that never read the log isn't sent any positions.
+        resume_feed_t other_feed(cluster.get_mailbox_manager());
+        table.subscribe(&other_feed, rdb_protocol::monokey_region(resume_key(0)));
+        table.write_row(0);
+        table.write_row(1);
+        wait_for_seq(&feed, start + 102);
+        EXPECT_EQ(1u, feed.changes);
+        EXPECT_EQ(1u, other_feed.changes);
+        EXPECT_EQ(0u, other_feed.positions);
+    }
+    write_ahead_log_t::remove(change_log_path);
+}
+
+TEST(RDBChangefeeds, ChangeLogPositions) {
+    extproc_spawner_t extproc_spawner;
+    run_in_thread_pool(&run_change_log_position_test);
+}
+
+}  // namespace unittest
@@ -71,6 +71,20 @@ void mock_namespace_interface_t::read_visitor_t::operator()(const point_read_t &
     }
 }
 
+void mock_namespace_interface_t::read_visitor_t::operator()(
+        const multi_point_read_t &get) {
+    response->response = multi_point_read_response_t();
+    multi_point_read_response_t &res =
+        boost::get<multi_point_read_response_t>(response->response);
+
+    for (const auto &key : get.keys) {
+        auto it = parent->data.find(key);
+        if (it != parent->data.end()) {
+            res.data.insert(*it);
+        }
+    }
+}
+
 void mock_namespace_interface_t::read_visitor_t::operator()(const dummy_read_t &) {
     response->response = dummy_read_response_t();
 }
@@ -26,16 +26,16 @@ public:
         cluster_message_handler_t(cm, tag),
         sequence_number(0)
         { }
-    void send(int message, peer_id_t peer) {
+    void send(int message, peer_id_t peer, uint64_t ordering_key = 0) {
         auto_drainer_t::lock_t connection_keepalive;
         connectivity_cluster_t::connection_t *connection =
             get_connectivity_cluster()->get_connection(peer, &connection_keepalive);
         if (connection) {
-            send(message, connection, connection_keepalive);
+            send(message, connection, connection_keepalive, ordering_key);
         }
     }
     void send(int message, connectivity_cluster_t::connection_t *connection,
-            auto_drainer_t::lock_t connection_keepalive) {
+            auto_drainer_t::lock_t connection_keepalive, uint64_t ordering_key = 0) {
         class writer_t : public cluster_send_message_write_callback_t {
         public:
             explicit writer_t(int _data) : data(_data) { }
@@ -54,7 +54,7 @@ public:
             int32_t data;
         } writer(message);
         get_connectivity_cluster()->send_message(connection, connection_keepalive,
-            get_message_tag(), &writer);
+            get_message_tag(), &writer, ordering_key);
     }
     void expect(int message, peer_id_t peer) {
         expect_delivered(message);
@@ -247,6 +247,85 @@ TPTEST_MULTITHREAD(RPCConnectivityTest, Ordering, 3) {
     }
 }
 
+/* `FlushMessages` checks that small messages have been handed to the TCP stack by the
+time `flush_messages()` returns, so they still arrive if the connection is killed right
+afterwards. It also checks that flushing the loopback connection does nothing. */
+
+TPTEST_MULTITHREAD(RPCConnectivityTest, FlushMessages, 3) {
+    connectivity_cluster_t c1, c2;
+    recording_test_application_t a1(&c1, 'T'), a2(&c2, 'T');
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    {
+        auto_drainer_t::lock_t connection_keepalive;
+        connectivity_cluster_t::connection_t *connection =
+            c1.get_connection(c2.get_me(), &connection_keepalive);
+        ASSERT_TRUE(connection != NULL);
+        for (int i = 0; i < 10; i++) {
+            a1.send(i, connection, connection_keepalive);
+        }
+        c1.flush_messages(connection, connection_keepalive);
+        connection->kill_connection();
+    }
+
+    {
+        auto_drainer_t::lock_t connection_keepalive;
+        connectivity_cluster_t::connection_t *connection =
+            c1.get_connection(c1.get_me(), &connection_keepalive);
+        ASSERT_TRUE(connection != NULL);
+        a1.send(100, connection, connection_keepalive);
+        c1.flush_messages(connection, connection_keepalive);
+    }
+
+    let_stuff_happen();
+
+    for (int i = 0; i < 10; i++) {
+        a2.expect(i, c1.get_me());
+    }
+    a1.expect(100, c1.get_me());
+}
+
+/* `MultipleConnections` checks that messages still arrive, and that messages with the
+same ordering key still arrive in order, when each connection is made of several TCP
+connections. The second server asks for fewer connections, which the first must go
+along with. */
+
+TPTEST_MULTITHREAD(RPCConnectivityTest, MultipleConnections, 3) {
+    connectivity_cluster_t c1, c2;
+    recording_test_application_t a1(&c1, 'T'), a2(&c2, 'T');
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, 4);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, 3);
+
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    for (int i = 0; i < 60; i++) {
+        a1.send(i, c2.get_me(), i % 3);
+        a2.send(i, c1.get_me(), i % 3);
+    }
+
+    let_stuff_happen();
+
+    for (int i = 0; i < 60; i++) {
+        a1.expect(i, c2.get_me());
+        a2.expect(i, c1.get_me());
+    }
+    for (int i = 0; i + 3 < 60; i++) {
+        a1.expect_order(i, i + 3);
+        a2.expect_order(i, i + 3);
+    }
+}
+
 /* `GetConnections` confirms that the behavior of `cluster_t::get_connections()` is
 correct. */
 
@@ -466,6 +545,129 @@ TPTEST_MULTITHREAD(RPCConnectivityTest, BinaryData, 3) {
     EXPECT_TRUE(a2.got_spectrum);
 }
 
+/* `CompressedData` sends messages that are big enough to be compressed, mixed with
+small ones that aren't, and makes sure they all arrive intact and in order. */
+
+class string_test_application_t : public cluster_message_handler_t {
+public:
+    explicit string_test_application_t(connectivity_cluster_t *cm) :
+        cluster_message_handler_t(cm, 'C') { }
+    void send(const std::string &message, peer_id_t peer) {
+        class string_writer_t : public cluster_send_message_write_callback_t {
+        public:
+            explicit string_writer_t(const std::string &_data) : data(_data) { }
+            virtual ~string_writer_t() { }
+            void write(write_stream_t *stream) {
+                write_message_t wm;
+                serialize<cluster_version_t::CLUSTER>(&wm, data);
+                int res = send_write_message(stream, &wm);
+                if (res) { throw fake_archive_exc_t(); }
+            }
+#ifdef ENABLE_MESSAGE_PROFILER
+            const char *message_profiler_tag() const {
+                return "unittest";
+            }
+#endif
+            const std::string &data;
+        } writer(message);
+        auto_drainer_t::lock_t connection_keepalive;
+        connectivity_cluster_t::connection_t *connection =
+            get_connectivity_cluster()->get_connection(peer, &connection_keepalive);
+        ASSERT_TRUE(connection != NULL);
+        get_connectivity_cluster()->send_message(connection, connection_keepalive,
+                                                 get_message_tag(), &writer);
+    }
+    void on_message(connectivity_cluster_t::connection_t *,
+                    auto_drainer_t::lock_t,
+                    read_stream_t *stream) {
+        std::string message;
+        archive_result_t res
+            = deserialize<cluster_version_t::CLUSTER>(stream, &message);
+        if (bad(res)) { throw fake_archive_exc_t(); }
+        received.push_back(message);
+    }
+    std::vector<std::string> received;
+};
+
+TPTEST(RPCConnectivityTest, CompressedData) {
+    connectivity_cluster_t c1, c2;
+    string_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    std::vector<std::string> messages;
+    for (int i = 0; i < 100; ++i) {
+        std::string message;
+        // Alternate between repetitive messages, which compress well, and ones
+        // that mostly don't; every fifth message is too small to be compressed.
+        size_t size = i % 5 == 0 ? 10 : 1000 * i;
+        for (size_t j = 0; j < size; ++j) {
+            message.push_back(i % 2 == 0 ? 'a' + j % 7 : randint(256));
+        }
+        messages.push_back(message);
+        a1.send(message, c2.get_me());
+    }
+
+    let_stuff_happen();
+
+    ASSERT_EQ(messages.size(), a2.received.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        EXPECT_EQ(messages[i], a2.received[i]);
+    }
+}
+
+/* `CompressionDisabled` checks that a server that doesn't compress can still talk to
+one that does. */
+
+TPTEST(RPCConnectivityTest, CompressionDisabled) {
+    connectivity_cluster_t c1, c2;
+    string_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, 1, cluster_compression_t::ZLIB);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, 1, cluster_compression_t::NONE);
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    const std::string message(100000, 'a');
+    a1.send(message, c2.get_me());
+    a2.send(message, c1.get_me());
+
+    let_stuff_happen();
+
+    ASSERT_EQ(1u, a1.received.size());
+    ASSERT_EQ(1u, a2.received.size());
+    EXPECT_EQ(message, a1.received[0]);
+    EXPECT_EQ(message, a2.received[0]);
+}
+
+/* `CompressedSizeBound` checks that `cluster_compressed_size_bound()`, which the
+receiving side uses to reject corrupt message headers, holds for data that doesn't
+compress at all. */
+
+TEST(RPCConnectivityTest, CompressedSizeBound) {
+    cluster_compressor_t compressor;
+    for (size_t size = 1; size < 4 * MEGABYTE; size *= 3) {
+        std::string data;
+        for (size_t j = 0; j < size; ++j) {
+            data.push_back(randint(256));
+        }
+        const size_t split = size / 2;
+        std::vector<const_charslice> pieces{
+            const_charslice(data.data(), data.data() + split),
+            const_charslice(data.data() + split, data.data() + size)};
+        std::vector<char> compressed;
+        compressor.compress(pieces, &compressed);
+        EXPECT_LE(compressed.size(), cluster_compressed_size_bound(size));
+    }
+}
+
 /* `PeerIDSemantics` makes sure that `peer_id_t::is_nil()` works as expected. */
 TPTEST_MULTITHREAD(RPCConnectivityTest, PeerIDSemantics, 3) {
     peer_id_t nil_peer;
@@ -2,6 +2,7 @@
 #include "unittest/gtest.hpp"
 
 #include "arch/timing.hpp"
+#include "concurrency/pmap.hpp"
 #include "unittest/clustering_utils.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "rpc/mailbox/mailbox.hpp"
@@ -183,4 +184,50 @@ TPTEST_MULTITHREAD(RPCMailboxTest, TypedMailbox, 3) {
     }
 }
 
+/* `BatchedMessages` sends bursts of small messages to mailboxes on every thread of
+another server. Messages for the same thread are delivered in batches, but every
+mailbox must still see its messages in the order they were sent. */
+TPTEST_MULTITHREAD(RPCMailboxTest, BatchedMessages, 3) {
+    connectivity_cluster_t c1, c2;
+    mailbox_manager_t m1(&c1, 'M'), m2(&c2, 'M');
+    connectivity_cluster_t::run_t r1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+    connectivity_cluster_t::run_t r2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0);
+    r1.join(get_cluster_local_address(&c2));
+    let_stuff_happen();
+
+    const int num_mailboxes = 2 * get_num_threads();
+    std::vector<std::vector<int> > inboxes(num_mailboxes);
+    std::vector<scoped_ptr_t<mailbox_t<void(int)> > > mailboxes(num_mailboxes);
+    pmap(num_mailboxes, [&](int64_t i) {
+        on_thread_t thread_switcher(threadnum_t(i % get_num_threads()));
+        mailboxes[i].init(new mailbox_t<void(int)>(&m1,
+            [&inboxes, i](signal_t *, int message) {
+                inboxes[i].push_back(message);
+            }));
+    });
+
+    const int num_messages = 100;
+    for (int message = 0; message < num_messages; ++message) {
+        for (int i = 0; i < num_mailboxes; ++i) {
+            send(&m2, mailboxes[i]->get_address(), message);
+        }
+    }
+
+    let_stuff_happen();
+
+    pmap(num_mailboxes, [&](int64_t i) {
+        on_thread_t thread_switcher(threadnum_t(i % get_num_threads()));
+        mailboxes[i].reset();
+    });
+
+    for (int i = 0; i < num_mailboxes; ++i) {
+        ASSERT_EQ(static_cast<size_t>(num_messages), inboxes[i].size());
+        for (int message = 0; message < num_messages; ++message) {
+            EXPECT_EQ(message, inboxes[i][message]);
+        }
+    }
+}
+
 }   /* namespace unittest */
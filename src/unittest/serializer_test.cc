@@ -1,9 +1,19 @@
 #include <functional>
+#include <set>
+#include <string>
+#include <vector>
 
+#include "arch/runtime/coroutines.hpp"
 #include "arch/runtime/starter.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
 #include "concurrency/new_mutex.hpp"
+#include "perfmon/collect.hpp"
+#include "rdb_protocol/datum.hpp"
 #include "serializer/buf_ptr.hpp"
 #include "serializer/config.hpp"
+#include "serializer/merger.hpp"
+#include "time.hpp"
 #include "unittest/mock_file.hpp"
 #include "unittest/gtest.hpp"
 #include "unittest/unittest_utils.hpp"
@@ -90,5 +100,139 @@ TEST(SerializerTest, AddDeleteRepeatedlyWithIndex) {
     run_in_thread_pool(std::bind(run_AddDeleteRepeatedly, true), 4);
 }
 
+/* `index_write_counting_serializer_t` only supports `index_write()`. It records the
+index writes that it gets and takes `index_write_ms` for each of them, like a real
+serializer that has to sync the metablock. */
+class index_write_counting_serializer_t : public serializer_t {
+public:
+    explicit index_write_counting_serializer_t(int64_t _index_write_ms) :
+        index_write_ms(_index_write_ms) { }
+
+    using serializer_t::make_io_account;
+    file_account_t *make_io_account(int, int) {
+        return nullptr;
+    }
+    void register_read_ahead_cb(serializer_read_ahead_callback_t *) { unreachable(); }
+    void unregister_read_ahead_cb(serializer_read_ahead_callback_t *) { unreachable(); }
+    buf_ptr_t block_read(const counted_t<standard_block_token_t> &, file_account_t *) {
+        unreachable();
+    }
+    block_id_t max_block_id() { unreachable(); }
+    segmented_vector_t<repli_timestamp_t> get_all_recencies(block_id_t, block_id_t) {
+        unreachable();
+    }
+    bool get_delete_bit(block_id_t) { unreachable(); }
+    counted_t<standard_block_token_t> index_read(block_id_t) { unreachable(); }
+    std::vector<counted_t<standard_block_token_t> > block_writes(
+            const std::vector<buf_write_info_t> &, file_account_t *, iocallback_t *) {
+        unreachable();
+    }
+    max_block_size_t max_block_size() const { unreachable(); }
+    bool coop_lock_and_check() { return true; }
+    bool is_gc_active() const { return false; }
+
+    void index_write(new_mutex_in_line_t *mutex_acq,
+                     const std::vector<index_write_op_t> &write_ops) {
+        mutex_acq->acq_signal()->wait_lazily_unordered();
+        group_sizes.push_back(write_ops.size());
+        nap(index_write_ms);
+        for (const index_write_op_t &op : write_ops) {
+            written.insert(op.block_id);
+        }
+        mutex_acq->reset();
+    }
+
+    const int64_t index_write_ms;
+    /* The number of ops in each index write, and the blocks whose index writes have
+    completed */
+    std::vector<size_t> group_sizes;
+    std::set<block_id_t> written;
+};
+
+/* Calls `merger->index_write()` for `block_id`, and checks that it doesn't return
+before the inner serializer is done with it. */
+void merger_index_write(merger_serializer_t *merger,
+                        index_write_counting_serializer_t *inner,
+                        block_id_t block_id) {
+    std::vector<index_write_op_t> write_ops;
+    write_ops.push_back(
+        index_write_op_t(block_id, boost::none, repli_timestamp_t::distant_past));
+    new_mutex_in_line_t dummy_acq;
+    merger->index_write(&dummy_acq, write_ops);
+    EXPECT_EQ(1u, inner->written.count(block_id));
+}
+
+int64_t get_merger_stat(const std::string &collection, const std::string &stat) {
+    return perfmon_get_stats()
+        .get_field(datum_string_t(collection))
+        .get_field("merger")
+        .get_field(datum_string_t(stat))
+        .as_int();
+}
+
+TPTEST(SerializerTest, MergerGroupCommit) {
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(
+        &get_global_perfmon_collection(), &collection, "merger_group_commit_test");
+    index_write_counting_serializer_t *inner = new index_write_counting_serializer_t(10);
+    merger_serializer_t merger(
+        scoped_ptr_t<serializer_t>(inner), 1, &collection);
+
+    /* Writers that show up together share the inner index writes. */
+    const block_id_t num_writers = 32;
+    cond_t done;
+    block_id_t num_done = 0;
+    for (block_id_t i = 0; i < num_writers; ++i) {
+        coro_t::spawn_sometime([&, i]() {
+            merger_index_write(&merger, inner, i);
+            if (++num_done == num_writers) {
+                done.pulse();
+            }
+        });
+    }
+    done.wait();
+
+    size_t total_ops = 0;
+    for (size_t size : inner->group_sizes) {
+        total_ops += size;
+    }
+    EXPECT_EQ(num_writers, total_ops);
+    EXPECT_LT(inner->group_sizes.size(), 4u);
+
+    /* Each inner index write shows up in the histogram once, and some of them
+    combined several writers. */
+    int64_t groups_1 = get_merger_stat("merger_group_commit_test", "group_commits_1");
+    int64_t groups_total = groups_1
+        + get_merger_stat("merger_group_commit_test", "group_commits_2_3")
+        + get_merger_stat("merger_group_commit_test", "group_commits_4_7")
+        + get_merger_stat("merger_group_commit_test", "group_commits_8_15")
+        + get_merger_stat("merger_group_commit_test", "group_commits_16_plus");
+    EXPECT_EQ(static_cast<int64_t>(inner->group_sizes.size()), groups_total);
+    EXPECT_LT(groups_1, groups_total);
+}
+
+TPTEST(SerializerTest, MergerLoneWriterDoesntWait) {
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(
+        &get_global_perfmon_collection(), &collection, "merger_lone_writer_test");
+    index_write_counting_serializer_t *inner = new index_write_counting_serializer_t(0);
+    /* With a window this long, a single wait would be obvious. */
+    const int64_t window_ms = 1000;
+    merger_serializer_t merger(
+        scoped_ptr_t<serializer_t>(inner), 1, &collection, window_ms);
+
+    const block_id_t num_writes = 5;
+    microtime_t start = current_microtime();
+    for (block_id_t i = 0; i < num_writes; ++i) {
+        merger_index_write(&merger, inner, i);
+    }
+    EXPECT_LT(current_microtime() - start, static_cast<microtime_t>(window_ms * THOUSAND));
+
+    EXPECT_EQ(std::vector<size_t>(num_writes, 1), inner->group_sizes);
+    EXPECT_EQ(static_cast<int64_t>(num_writes),
+        get_merger_stat("merger_lone_writer_test", "group_commits_1"));
+    EXPECT_EQ(0, get_merger_stat("merger_lone_writer_test", "group_commits_2_3"));
+}
+
 
 }  // namespace unittest
@@ -0,0 +1,63 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <map>
+
+#include "arch/io/disk.hpp"
+#include "rdb_protocol/sindex_construction.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* Adds `num_keys` keys in a scrambled order, each of them twice, to a sorter that can
+only hold `entries_in_memory` entries in memory, and checks that they come out sorted
+and without duplicates. */
+void run_sindex_sorter_test(int num_keys, size_t entries_in_memory) {
+    recreate_temporary_directory(base_path_t("."));
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    std::map<store_key_t, std::vector<char> > expected;
+    {
+        sindex_sorter_t sorter(&io_backender, base_path_t("."), "sindex_sorter_test",
+                               &get_global_perfmon_collection(),
+                               entries_in_memory * (sizeof(sindex_entry_t) + 16));
+        for (int round = 0; round < 2; ++round) {
+            for (int i = 0; i < num_keys; ++i) {
+                // 7919 is a prime, so this goes through every key once.
+                int k = (i * 7919) % num_keys;
+                std::string value = strprintf("value%d", k);
+                sindex_entry_t entry(store_key_t(strprintf("key%06d", k)),
+                                     std::vector<char>(value.begin(), value.end()));
+                expected[entry.first] = entry.second;
+                sorter.add(std::move(entry));
+            }
+        }
+        ASSERT_EQ(2 * static_cast<uint64_t>(num_keys), sorter.num_entries());
+        sorter.finish();
+
+        auto it = expected.begin();
+        sindex_entry_t entry;
+        while (sorter.next(&entry)) {
+            ASSERT_TRUE(it != expected.end());
+            ASSERT_EQ(key_to_debug_str(it->first), key_to_debug_str(entry.first));
+            ASSERT_TRUE(it->second == entry.second);
+            ++it;
+        }
+        ASSERT_TRUE(it == expected.end());
+    }
+}
+
+TPTEST(SindexSorter, InMemory) {
+    run_sindex_sorter_test(1000, 10000);
+}
+
+TPTEST(SindexSorter, Spilled) {
+    run_sindex_sorter_test(1000, 300);
+}
+
+TPTEST(SindexSorter, Merged) {
+    // This writes enough runs for `sindex_sorter_t` to merge some of them before
+    // the final merge.
+    run_sindex_sorter_test(3000, 100);
+}
+
+}  // namespace unittest
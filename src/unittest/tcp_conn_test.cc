@@ -0,0 +1,95 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "arch/io/network.hpp"
+#include "arch/runtime/coroutines.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "containers/shared_buffer.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* `ZerocopySharedWrites` sends a mix of buffered writes and shared buffers, big and
+small, over a connection with zero-copy sends enabled. It checks that the bytes
+arrive intact and in order, that the shared buffers are released once the kernel is
+done with them, and that the completion notifications don't make the connection shut
+itself down. If the kernel doesn't support `MSG_ZEROCOPY`, this still tests the
+ordinary shared buffer path. */
+
+TPTEST(TcpConnTest, ZerocopySharedWrites) {
+    cond_t non_interruptor;
+    const ip_address_t loopback("127.0.0.1");
+
+    scoped_ptr_t<tcp_conn_t> server_conn;
+    cond_t accepted;
+    tcp_listener_t listener(
+        std::set<ip_address_t>{loopback}, 0,
+        [&](scoped_ptr_t<tcp_conn_descriptor_t> &nconn) {
+            nconn->make_overcomplicated(&server_conn);
+            accepted.pulse();
+        });
+    tcp_conn_t client_conn(loopback, listener.get_port(), &non_interruptor);
+    accepted.wait();
+    client_conn.enable_zerocopy();
+
+    std::string expected;
+    std::vector<counted_t<const shared_buf_t> > bufs;
+    for (size_t i = 0; i < 40; ++i) {
+        // Some data in the write buffer before each shared buffer...
+        const std::string header(i, 'a' + i % 26);
+        client_conn.write_buffered(header.data(), header.size(), &non_interruptor);
+        expected += header;
+
+        // ...and shared buffers that are too small to be sent without copying,
+        // small enough to be sent without `MSG_ZEROCOPY`, or big enough for it.
+        const size_t size = i % 3 == 0 ? 1 * KILOBYTE
+            : i % 3 == 1 ? 8 * KILOBYTE
+            : 256 * KILOBYTE;
+        counted_t<shared_buf_t> buf = shared_buf_t::create(size);
+        for (size_t j = 0; j < size; ++j) {
+            buf->data()[j] = randint(256);
+        }
+        const size_t offset = 16;
+        client_conn.write_shared_buffered(buf, offset, size - offset, &non_interruptor);
+        expected.append(buf->data(offset), size - offset);
+        bufs.push_back(buf);
+    }
+
+    std::string received(expected.size(), '\0');
+    cond_t read_done;
+    coro_t::spawn_sometime([&]() {
+        server_conn->read(&received[0], received.size(), &non_interruptor);
+        read_done.pulse();
+    });
+    client_conn.flush_buffer(&non_interruptor);
+    read_done.wait();
+    EXPECT_EQ(expected, received);
+
+    // The connection only lets go of a buffer sent with `MSG_ZEROCOPY` once the
+    // kernel says it's done with it.
+    signal_timer_t timeout(10 * 1000);
+    for (const auto &buf : bufs) {
+        while (counted_use_count(buf.get()) != 1) {
+            ASSERT_FALSE(timeout.is_pulsed());
+            nap(1);
+        }
+    }
+
+    // The completion notifications raise `POLLERR`, which must not have closed the
+    // connection.
+    nap(100);
+    ASSERT_TRUE(client_conn.is_write_open());
+    ASSERT_TRUE(client_conn.is_read_open());
+    const std::string last_message = "done";
+    client_conn.write(last_message.data(), last_message.size(), &non_interruptor);
+    std::string last_received(last_message.size(), '\0');
+    server_conn->read(&last_received[0], last_received.size(), &non_interruptor);
+    EXPECT_EQ(last_message, last_received);
+}
+
+}  // namespace unittest
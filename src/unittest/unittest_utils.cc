@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 
+#include <fstream>
 #include <functional>
 
 #include "arch/timing.hpp"
@@ -102,6 +103,14 @@ void let_stuff_happen() {
 #endif
 }
 
+void copy_file(const std::string &from, const std::string &to) {
+    std::ifstream in(from, std::ios::binary);
+    ASSERT_TRUE(in.good());
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    ASSERT_TRUE(out.good());
+}
+
 std::set<ip_address_t> get_unittest_addresses() {
     return get_local_ips(std::set<ip_address_t>(),
                          local_ip_filter_t::MATCH_FILTER_OR_LOOPBACK);
@@ -32,6 +32,9 @@ private:
 
 void let_stuff_happen();
 
+/* Copies the file at `from` to `to`, replacing `to` if it exists. */
+void copy_file(const std::string &from, const std::string &to);
+
 std::set<ip_address_t> get_unittest_addresses();
 
 void run_in_thread_pool(const std::function<void()> &fun, int num_workers = 1);
@@ -0,0 +1,280 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "arch/io/disk.hpp"
+#include "buffer_cache/cache_balancer.hpp"
+#include "clustering/immediate_consistency/history.hpp"
+#include "concurrency/cond_var.hpp"
+#include "extproc/extproc_pool.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/store.hpp"
+#include "serializer/log/log_serializer.hpp"
+#include "serializer/write_ahead_log.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/mock_store.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+std::vector<char> make_record(const std::string &contents) {
+    return std::vector<char>(contents.begin(), contents.end());
+}
+
+std::vector<std::string> reopen_and_take_records(
+        io_backender_t *io_backender, const std::string &path) {
+    write_ahead_log_t log(io_backender, path);
+    std::vector<std::string> res;
+    for (const auto &record : log.take_recovered_records()) {
+        res.push_back(std::string(record.begin(), record.end()));
+    }
+    return res;
+}
+
+TPTEST(WriteAheadLog, RecoverAndReset) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    temp_file_t temp_file;
+    const std::string path = temp_file.name().permanent_path();
+    cond_t non_interruptor;
+
+    {
+        write_ahead_log_t log(&io_backender, path);
+        EXPECT_TRUE(log.take_recovered_records().empty());
+        log.reset();
+        log.append(make_record("first"));
+        /* This one is larger than a block, so the next header has to be aligned. */
+        log.append(make_record(std::string(DEVICE_BLOCK_SIZE + 7, 'x')));
+        write_ahead_log_t::lsn_t lsn = log.append(make_record("third"));
+        log.wait_durable(lsn, &non_interruptor);
+    }
+
+    std::vector<std::string> expected;
+    expected.push_back("first");
+    expected.push_back(std::string(DEVICE_BLOCK_SIZE + 7, 'x'));
+    expected.push_back("third");
+    EXPECT_EQ(expected, reopen_and_take_records(&io_backender, path));
+
+    {
+        write_ahead_log_t log(&io_backender, path);
+        log.reset();
+    }
+    EXPECT_TRUE(reopen_and_take_records(&io_backender, path).empty());
+
+    write_ahead_log_t::remove(path);
+}
+
+TPTEST(WriteAheadLog, Segments) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    temp_file_t temp_file;
+    const std::string path = temp_file.name().permanent_path();
+    cond_t non_interruptor;
+
+    {
+        write_ahead_log_t log(&io_backender, path);
+        log.reset();
+        log.wait_durable(log.append(make_record("old")), &non_interruptor);
+        log.start_new_segment(&non_interruptor);
+        EXPECT_EQ(DEVICE_BLOCK_SIZE, log.active_segment_size());
+        log.wait_durable(log.append(make_record("new")), &non_interruptor);
+        EXPECT_EQ(2 * DEVICE_BLOCK_SIZE, log.active_segment_size());
+    }
+
+    /* Until the old segment is discarded, its records come first. */
+    std::vector<std::string> expected;
+    expected.push_back("old");
+    expected.push_back("new");
+    EXPECT_EQ(expected, reopen_and_take_records(&io_backender, path));
+
+    {
+        write_ahead_log_t log(&io_backender, path);
+        log.reset();
+        log.wait_durable(log.append(make_record("old")), &non_interruptor);
+        log.start_new_segment(&non_interruptor);
+        log.wait_durable(log.append(make_record("new")), &non_interruptor);
+        log.discard_old_segment();
+    }
+
+    expected.clear();
+    expected.push_back("new");
+    EXPECT_EQ(expected, reopen_and_take_records(&io_backender, path));
+
+    write_ahead_log_t::remove(path);
+}
+
+TPTEST(WriteAheadLog, ReadRecordsSince) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    temp_file_t temp_file;
+    const std::string path = temp_file.name().permanent_path();
+    cond_t non_interruptor;
+
+    {
+        write_ahead_log_t log(&io_backender, path);
+        log.reset();
+        /* Records 1 to 12, in flushes of three records each, with the first two flushes
+        in the old segment. One record in each flush spans a block. */
+        std::vector<std::string> all;
+        for (int i = 1; i <= 12; ++i) {
+            all.push_back(i % 3 == 2
+                          ? strprintf("%d", i) + std::string(DEVICE_BLOCK_SIZE, 'x')
+                          : strprintf("%d", i));
+            write_ahead_log_t::lsn_t lsn = log.append(make_record(all.back()));
+            EXPECT_EQ(static_cast<write_ahead_log_t::lsn_t>(i), lsn);
+            if (i % 3 == 0) {
+                log.wait_durable(lsn, &non_interruptor);
+            }
+            if (i == 6) {
+                log.start_new_segment(&non_interruptor);
+            }
+        }
+
+        auto read_since = [&](write_ahead_log_t::lsn_t since) {
+            std::vector<std::string> res;
+            for (const auto &record : log.read_records(since, &non_interruptor)) {
+                res.push_back(std::string(record.begin(), record.end()));
+            }
+            return res;
+        };
+        for (write_ahead_log_t::lsn_t since = 0; since <= 13; ++since) {
+            const size_t first = since == 0 ? 0 : std::min<size_t>(since - 1, 12);
+            std::vector<std::string> expected(all.begin() + first, all.end());
+            EXPECT_EQ(expected, read_since(since));
+        }
+
+        /* Once the old segment is gone, so are its records. */
+        log.discard_old_segment();
+        EXPECT_EQ(std::vector<std::string>(all.begin() + 6, all.end()), read_since(0));
+        EXPECT_EQ(std::vector<std::string>(all.begin() + 9, all.end()), read_since(10));
+    }
+
+    write_ahead_log_t::remove(path);
+}
+
+void copy_write_ahead_log(const std::string &from, const std::string &to) {
+    for (int i = 0; i < 2; ++i) {
+        copy_file(strprintf("%s.%d", from.c_str(), i), strprintf("%s.%d", to.c_str(), i));
+    }
+}
+
+/* `wal_test_store_t` opens a `store_t` on the database file `data_file`, the way the
+server does after a restart. */
+class wal_test_store_t {
+public:
+    wal_test_store_t(io_backender_t *io_backender,
+                     rdb_context_t *ctx,
+                     const temp_file_t &data_file,
+                     const namespace_id_t &table_id,
+                     bool create) :
+            file_opener(data_file.name(), io_backender) {
+        if (create) {
+            standard_serializer_t::create(&file_opener,
+                                          standard_serializer_t::static_config_t());
+        }
+        serializer.init(new standard_serializer_t(
+            standard_serializer_t::dynamic_config_t(),
+            &file_opener,
+            &get_global_perfmon_collection()));
+        balancer.init(new dummy_cache_balancer_t(GIGABYTE));
+        store.init(new store_t(region_t::universe(), serializer.get(), balancer.get(),
+            "wal_test_store", create, &get_global_perfmon_collection(), ctx,
+            io_backender, base_path_t("."), scoped_ptr_t<outdated_index_report_t>(),
+            table_id));
+        if (create) {
+            cond_t non_interruptor;
+            write_token_t token;
+            store->new_write_token(&token);
+            store->set_metainfo(
+                region_map_t<binary_blob_t>(
+                    region_t::universe(), binary_blob_t(version_t::zero())),
+                order_token_t::ignore, &token, write_durability_t::SOFT,
+                &non_interruptor);
+            file_opener.move_serializer_file_to_permanent_location();
+        }
+    }
+
+    void write(const std::string &key, const std::string &value,
+               const version_t &version) {
+        cond_t non_interruptor;
+#ifndef NDEBUG
+        metainfo_checker_t checker(store->get_region(),
+            [](const region_t &, const binary_blob_t &) { });
+#endif
+        write_token_t token;
+        store->new_write_token(&token);
+        write_response_t response;
+        store->write(
+            DEBUG_ONLY(checker, )
+            region_map_t<binary_blob_t>(store->get_region(), binary_blob_t(version)),
+            mock_overwrite(key, value), &response, write_durability_t::HARD,
+            version.timestamp, order_token_t::ignore, &token, &non_interruptor);
+    }
+
+    region_map_t<binary_blob_t> get_metainfo() {
+        cond_t non_interruptor;
+        read_token_t token;
+        store->new_read_token(&token);
+        return store->get_metainfo(order_token_t::ignore.with_read_mode(), &token,
+                                   store->get_region(), &non_interruptor);
+    }
+
+    filepath_file_opener_t file_opener;
+    scoped_ptr_t<standard_serializer_t> serializer;
+    scoped_ptr_t<cache_balancer_t> balancer;
+    scoped_ptr_t<store_t> store;
+};
+
+/* `StoreReplay` crashes a store by taking a copy of its write-ahead log while it's
+running. If the B-tree didn't get the writes in the copy, they must be replayed; if it
+did, they must be skipped, even though replaying them would succeed. */
+TPTEST(WriteAheadLog, StoreReplay) {
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    extproc_pool_t extproc_pool(2);
+    rdb_context_t ctx(&extproc_pool, nullptr);
+    cond_t non_interruptor;
+
+    temp_file_t data_file, data_file_before_writes, log_file, crashed_log_file;
+    const std::string log_path = log_file.name().permanent_path();
+    const std::string crashed_log_path = crashed_log_file.name().permanent_path();
+    const namespace_id_t table_id = generate_uuid();
+    const branch_id_t branch_id = generate_uuid();
+    const version_t first_version(branch_id, state_timestamp_t::zero().next());
+    const version_t second_version(branch_id, first_version.timestamp.next());
+
+    {
+        wal_test_store_t s(&io_backender, &ctx, data_file, table_id, true);
+    }
+    copy_file(data_file.name().permanent_path(),
+              data_file_before_writes.name().permanent_path());
+
+    {
+        wal_test_store_t s(&io_backender, &ctx, data_file, table_id, false);
+        s.store->open_write_ahead_log(log_path, &non_interruptor);
+        s.write("a", "first", first_version);
+        copy_write_ahead_log(log_path, crashed_log_path);
+        s.write("a", "second", second_version);
+        /* Shutting down checkpoints the log, so there's nothing left to replay. */
+    }
+    EXPECT_TRUE(reopen_and_take_records(&io_backender, log_path).empty());
+
+    /* The B-tree already has the first write, and the second one on top of it. */
+    copy_write_ahead_log(crashed_log_path, log_path);
+    {
+        wal_test_store_t s(&io_backender, &ctx, data_file, table_id, false);
+        s.store->open_write_ahead_log(log_path, &non_interruptor);
+        EXPECT_EQ("second", mock_lookup(s.store.get(), "a"));
+        EXPECT_TRUE(s.get_metainfo() == region_map_t<binary_blob_t>(
+            region_t::universe(), binary_blob_t(second_version)));
+    }
+
+    /* The B-tree is from before the first write. */
+    copy_write_ahead_log(crashed_log_path, log_path);
+    {
+        wal_test_store_t s(
+            &io_backender, &ctx, data_file_before_writes, table_id, false);
+        s.store->open_write_ahead_log(log_path, &non_interruptor);
+        EXPECT_EQ("first", mock_lookup(s.store.get(), "a"));
+        EXPECT_TRUE(s.get_metainfo() == region_map_t<binary_blob_t>(
+            region_t::universe(), binary_blob_t(first_version)));
+    }
+
+    write_ahead_log_t::remove(log_path);
+    write_ahead_log_t::remove(crashed_log_path);
+}
+
+}  // namespace unittest
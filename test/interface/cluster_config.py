@@ -25,7 +25,7 @@ with driver.Cluster(initial_servers=1, output_folder='.', wait_until_ready=True,
     
     print("Setting AuthKey (%.2fs)" % (time.time() - startTime))
     
-    assert list(r.db("rethinkdb").table("cluster_config").run(conn)) == [{"id": "auth", "auth_key": None}]
+    assert list(r.db("rethinkdb").table("cluster_config").order_by("id").run(conn)) == [{"id": "auth", "auth_key": None}, {"id": "backfill", "send_mb_per_sec": None, "receive_mb_per_sec": None, "latency_target_ms": None}]
     
     res = r.db("rethinkdb").table("cluster_config").get("auth").update({"auth_key": "hunter2"}).run(conn)
     assert res["errors"] == 0
@@ -45,22 +45,22 @@ with driver.Cluster(initial_servers=1, output_folder='.', wait_until_ready=True,
     
     conn = r.connect(server.host, server.driver_port, auth_key="hunter2")
     
-    rows = list(r.db("rethinkdb").table("cluster_config").run(conn))
-    assert rows == [{"id": "auth", "auth_key": {"hidden": True}}]
+    row = r.db("rethinkdb").table("cluster_config").get("auth").run(conn)
+    assert row == {"id": "auth", "auth_key": {"hidden": True}}
     
     print("Removing the AuthKey (%.2fs)" % (time.time() - startTime))
     
     res = r.db("rethinkdb").table("cluster_config").get("auth").update({"auth_key": None}).run(conn)
     assert res["errors"] == 0
     
-    assert list(r.db("rethinkdb").table("cluster_config").run(conn)) == [{"id": "auth", "auth_key": None}]
+    assert r.db("rethinkdb").table("cluster_config").get("auth").run(conn) == {"id": "auth", "auth_key": None}
     
     conn.close()
     
     print("Verifying connection without an AuthKey (%.2fs)" % (time.time() - startTime))
     
     conn = r.connect(server.host, server.driver_port)
-    assert list(r.db("rethinkdb").table("cluster_config").run(conn)) == [{"id": "auth", "auth_key": None}]
+    assert r.db("rethinkdb").table("cluster_config").get("auth").run(conn) == {"id": "auth", "auth_key": None}
 
     # This is mostly to make sure the server doesn't crash in this case
     res = r.db("rethinkdb").table("cluster_config").get("auth").update({"auth_key": {"hidden": True}}).run(conn)
@@ -79,6 +79,25 @@ with driver.Cluster(initial_servers=1, output_folder='.', wait_until_ready=True,
            .update({"auth_key": {"is_this_nonsense": "yes"}}).run(conn)
     assert res["errors"] == 1, res
 
+    print("Setting backfill limits (%.2fs)" % (time.time() - startTime))
+
+    res = r.db("rethinkdb").table("cluster_config").get("backfill") \
+           .update({"send_mb_per_sec": 64, "latency_target_ms": 20}).run(conn)
+    assert res["errors"] == 0, res
+    row = r.db("rethinkdb").table("cluster_config").get("backfill").run(conn)
+    assert row == {"id": "backfill", "send_mb_per_sec": 64, "receive_mb_per_sec": None, "latency_target_ms": 20}, row
+    res = r.db("rethinkdb").table("cluster_config").get("backfill") \
+           .update({"receive_mb_per_sec": 0}).run(conn)
+    assert res["errors"] == 1, res
+    res = r.db("rethinkdb").table("cluster_config").get("backfill") \
+           .update({"send_mb_per_sec": "fast"}).run(conn)
+    assert res["errors"] == 1, res
+    res = r.db("rethinkdb").table("cluster_config").get("backfill") \
+           .update({"send_mb_per_sec": None, "latency_target_ms": None}).run(conn)
+    assert res["errors"] == 0, res
+    row = r.db("rethinkdb").table("cluster_config").get("backfill").run(conn)
+    assert row == {"id": "backfill", "send_mb_per_sec": None, "receive_mb_per_sec": None, "latency_target_ms": None}, row
+
     print("Cleaning up (%.2fs)" % (time.time() - startTime))
 print("Done. (%.2fs)" % (time.time() - startTime))
 
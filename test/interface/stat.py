@@ -91,6 +91,8 @@ def check_table_stats(table_id, global_stats):
                                                  row_id[1] == table_id)
     check_sum_stat(['query_engine', 'read_docs_per_sec'], table_server_rows, table_row)
     check_sum_stat(['query_engine', 'written_docs_per_sec'], table_server_rows, table_row)
+    check_sum_stat(['query_engine', 'changefeed_messages_per_sec'], table_server_rows, table_row)
+    check_sum_stat(['query_engine', 'changefeed_queue_depth'], table_server_rows, table_row)
 
 # Verifies that the table_server stats add up to the server stats
 def check_server_stats(server_id, global_stats):